@@ -0,0 +1,325 @@
+// mcp23017_host_test.c
+// Host test of the batch engine (src/mcp23017_batch.c) against the emulated
+// device in mock/. Covers IOCON layout detection, BANK=0 and BANK=1 register
+// mapping, diff-only writes from the register image, block reads of the
+// interrupt registers, retries, and rollback after a failed batch; then a
+// seeded random run compares the device with a model after every batch.
+//
+// Build and run from components/mcp23017 (see README.md):
+//   cc -std=gnu11 -Wall -Imock/include -Iinclude -Isrc src/mcp23017_batch.c
+//      mock/i2c_master_mock.c host_test/mcp23017_host_test.c -o /tmp/mcp23017_host_test
+//   /tmp/mcp23017_host_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mcp23017_mock.h"
+#include "mcp23017_priv.h"
+
+#define RANDOM_DEVICES      2000
+#define RANDOM_BATCHES      10
+#define RANDOM_SEED         7
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Fresh emulated device, optionally switched to another IOCON behind the
+// driver's back, and a driver-side state that has loaded IOCON
+static i2c_master_dev_handle_t dev_new(uint8_t iocon, mcp23017_dev_t *d)
+{
+    i2c_master_dev_handle_t m = mcp_mock_create();
+    if (iocon) mcp_mock_poke(m, MCP_REG_IOCON, iocon);
+    *d = (mcp23017_dev_t){ .i2c = m };
+    CHECK(mcp_dev_load_iocon(d) == ESP_OK);
+    CHECK(d->iocon == iocon);
+    return m;
+}
+
+// Port B all inputs with pull-ups and change interrupts, pins 0-4 of port A
+// outputs starting at 0b00101: the io_MCP23017 board setup
+static const mcp23017_reg_change_t board_port_b[] = {
+    { MCP_REG_IODIRB,   0xFF, 0xFF },
+    { MCP_REG_GPPUB,    0xFF, 0xFF },
+    { MCP_REG_GPINTENB, 0xFF, 0xFF },
+    { MCP_REG_INTCONB,  0xFF, 0x00 },
+};
+static const mcp23017_reg_change_t board_port_a[] = {
+    { MCP_REG_OLATA,    0x1F, 0x05 },
+    { MCP_REG_IODIRA,   0x1F, 0x00 },
+    { MCP_REG_GPPUA,    0x1F, 0x00 },
+    { MCP_REG_GPINTENA, 0x1F, 0x00 },
+};
+
+static void check_board(i2c_master_dev_handle_t m)
+{
+    CHECK(mcp_mock_peek(m, MCP_REG_IODIRB) == 0xFF);
+    CHECK(mcp_mock_peek(m, MCP_REG_GPPUB) == 0xFF);
+    CHECK(mcp_mock_peek(m, MCP_REG_GPINTENB) == 0xFF);
+    CHECK(mcp_mock_peek(m, MCP_REG_INTCONB) == 0x00);
+    CHECK(mcp_mock_peek(m, MCP_REG_IODIRA) == 0xE0);
+    CHECK(mcp_mock_peek(m, MCP_REG_OLATA) == 0x05);
+    CHECK(mcp_mock_peek(m, MCP_REG_GPPUA) == 0x00);
+}
+
+static void apply_board(mcp23017_dev_t *d, uint32_t flags, const char *name)
+{
+    mcp23017_stats_t s0 = d->stats;
+    CHECK(mcp_dev_update(d, board_port_b, 4, flags) == ESP_OK);
+    CHECK(mcp_dev_update(d, board_port_a, 4, flags) == ESP_OK);
+    printf("  %-22s %2u transfers, %2u wire bytes\n", name,
+           (unsigned)(d->stats.transactions - s0.transactions), (unsigned)(d->stats.wire_bytes - s0.wire_bytes));
+}
+
+static void test_layouts(void)
+{
+    printf("layouts\n");
+    mcp23017_dev_t d;
+    i2c_master_dev_handle_t m;
+
+    m = dev_new(0, &d);
+    apply_board(&d, 0, "BANK=0 batch");
+    check_board(m);
+    mcp_mock_destroy(m);
+
+    m = dev_new(0, &d);
+    apply_board(&d, MCP_CFG_NO_BATCH, "BANK=0 per register");
+    check_board(m);
+    mcp_mock_destroy(m);
+
+    m = dev_new(MCP_IOCON_BANK, &d);
+    apply_board(&d, 0, "BANK=1 batch");
+    check_board(m);
+    mcp_mock_destroy(m);
+
+    // SEQOP=1: one register per transfer, or cleared around the batch
+    m = dev_new(MCP_IOCON_SEQOP, &d);
+    apply_board(&d, 0, "SEQOP fallback");
+    check_board(m);
+    mcp_mock_destroy(m);
+
+    m = dev_new(MCP_IOCON_SEQOP, &d);
+    apply_board(&d, MCP_CFG_FORCE_SEQOP, "SEQOP forced");
+    check_board(m);
+    CHECK(mcp_mock_peek(m, MCP_REG_IOCON) == MCP_IOCON_SEQOP);
+    mcp_mock_destroy(m);
+
+    m = dev_new(MCP_IOCON_BANK | MCP_IOCON_SEQOP, &d);
+    apply_board(&d, 0, "BANK=1 SEQOP");
+    check_board(m);
+    mcp_mock_destroy(m);
+
+    // In BANK=0, GPINTENB sits where BANK=1 keeps IOCON: bit 7 set there
+    // must not be taken for BANK=1
+    m = mcp_mock_create();
+    mcp_mock_poke(m, MCP_REG_GPINTENB, 0x80);
+    d = (mcp23017_dev_t){ .i2c = m };
+    CHECK(mcp_dev_load_iocon(&d) == ESP_OK && d.iocon == 0);
+    mcp_mock_destroy(m);
+}
+
+static void test_diff_writes(void)
+{
+    printf("diff-only writes\n");
+    for (int bank = 0; bank < 2; ++bank) {
+        mcp23017_dev_t d;
+        i2c_master_dev_handle_t m = dev_new(bank ? MCP_IOCON_BANK : 0, &d);
+
+        CHECK(mcp_dev_update(&d, board_port_a, 4, 0) == ESP_OK);
+        uint32_t t0 = d.stats.transactions;
+        uint32_t skips0 = d.stats.cache_skips;
+
+        // Same changes again: the image holds them, nothing goes out
+        CHECK(mcp_dev_update(&d, board_port_a, 4, 0) == ESP_OK);
+        CHECK(d.stats.transactions == t0);
+        CHECK(d.stats.cache_skips - skips0 == 4);
+
+        // A masked change to an imaged register: one write, no read, and
+        // only the masked bits move
+        mcp23017_reg_change_t olat = { MCP_REG_OLATA, 0x0F, 0x09 };
+        uint32_t r0 = d.stats.reads;
+        CHECK(mcp_dev_update(&d, &olat, 1, 0) == ESP_OK);
+        CHECK(d.stats.transactions - t0 == 1);
+        CHECK(d.stats.reads == r0);
+        CHECK(mcp_mock_peek(m, MCP_REG_OLATA) == 0x09);
+
+        // MCP_CFG_NO_CACHE reads the device instead of trusting the image
+        mcp_mock_poke(m, MCP_REG_GPPUA, 0x01);
+        mcp23017_reg_change_t pu = { MCP_REG_GPPUA, 0x1F, 0x00 };
+        CHECK(mcp_dev_update(&d, &pu, 1, 0) == ESP_OK);
+        CHECK(mcp_mock_peek(m, MCP_REG_GPPUA) == 0x01);   // image said 0: skipped
+        CHECK(mcp_dev_update(&d, &pu, 1, MCP_CFG_NO_CACHE) == ESP_OK);
+        CHECK(mcp_mock_peek(m, MCP_REG_GPPUA) == 0x00);
+
+        printf("  BANK=%d repeat batch 0 transfers, masked write 1 transfer\n", bank);
+        mcp_mock_destroy(m);
+    }
+}
+
+static void test_interrupt_block_read(void)
+{
+    printf("INTF..INTCAP block read\n");
+    for (int bank = 0; bank < 2; ++bank) {
+        mcp23017_dev_t d;
+        i2c_master_dev_handle_t m = dev_new(bank ? MCP_IOCON_BANK : 0, &d);
+        mcp23017_reg_change_t en[] = {
+            { MCP_REG_GPINTENB, 0xFF, 0xFF },
+            { MCP_REG_GPINTENA, 0xFF, 0xA0 },
+        };
+        CHECK(mcp_dev_update(&d, en, 2, 0) == ESP_OK);
+        mcp_mock_set_pins(m, 0x5F7F);
+
+        uint8_t b[4];
+        uint32_t t0 = d.stats.transactions;
+        CHECK(mcp_dev_read(&d, MCP_REG_INTFA, b, 4) == ESP_OK);
+        CHECK(d.stats.transactions - t0 == (uint32_t)(bank ? 2 : 1));
+        CHECK(b[0] == 0x80 && b[1] == 0xA0 && b[2] == 0x7F && b[3] == 0x5F);
+        // Reading INTCAP cleared the interrupt flags
+        CHECK(mcp_mock_peek(m, MCP_REG_INTFA) == 0 && mcp_mock_peek(m, MCP_REG_INTFB) == 0);
+        mcp_mock_destroy(m);
+    }
+}
+
+static void test_retry_and_rollback(void)
+{
+    printf("retry and rollback\n");
+    for (int bank = 0; bank < 2; ++bank) {
+        mcp23017_dev_t d;
+        i2c_master_dev_handle_t m = dev_new(bank ? MCP_IOCON_BANK : 0, &d);
+
+        // One failed transfer is retried and the batch completes
+        mcp_mock_fail(m, 2, 1);
+        CHECK(mcp_dev_update(&d, board_port_b, 4, 0) == ESP_OK);
+        CHECK(mcp_dev_update(&d, board_port_a, 4, 0) == ESP_OK);
+        check_board(m);
+        CHECK(d.stats.retries == 1 && d.stats.rollbacks == 0);
+        mcp_mock_destroy(m);
+
+        // A transfer that keeps failing part way through: the writes already
+        // made are undone and the caches are dropped
+        m = dev_new(bank ? MCP_IOCON_BANK : 0, &d);
+        mcp_mock_poke(m, MCP_REG_GPPUA, 0x40);
+        mcp_mock_poke(m, MCP_REG_OLATA, 0x80);
+        const mcp23017_reg_change_t chg[] = {
+            { MCP_REG_OLATA,  0x1F, 0x05 },
+            { MCP_REG_IODIRA, 0x1F, 0x00 },
+            { MCP_REG_GPPUA,  0x1F, 0x1F },
+        };
+        mcp_mock_fail(m, 3, 1 + MCP23017_BATCH_RETRIES);
+        CHECK(mcp_dev_update(&d, chg, 3, 0) != ESP_OK);
+        mcp_mock_fail(m, 0, 0);
+        CHECK(d.stats.rollbacks == 1 && d.stats.errors == 1);
+        CHECK(!d.iocon_valid && d.img_valid == 0);
+        CHECK(mcp_mock_peek(m, MCP_REG_OLATA) == 0x80);
+        CHECK(mcp_mock_peek(m, MCP_REG_IODIRA) == 0xFF);
+        CHECK(mcp_mock_peek(m, MCP_REG_GPPUA) == 0x40);
+
+        // The next batch starts from the device again
+        CHECK(mcp_dev_update(&d, chg, 3, 0) == ESP_OK);
+        CHECK(mcp_mock_peek(m, MCP_REG_OLATA) == 0x85);
+        CHECK(mcp_mock_peek(m, MCP_REG_IODIRA) == 0xE0);
+        CHECK(mcp_mock_peek(m, MCP_REG_GPPUA) == 0x5F);
+        printf("  BANK=%d rollback restored OLATA/IODIRA/GPPUA\n", bank);
+        mcp_mock_destroy(m);
+    }
+}
+
+// Registers a batch may change, excluding IOCON and the read-only ones
+static const uint8_t random_regs[] = {
+    MCP_REG_IODIRA, MCP_REG_IODIRB, MCP_REG_IPOLA, MCP_REG_IPOLB,
+    MCP_REG_GPINTENA, MCP_REG_GPINTENB, MCP_REG_DEFVALA, MCP_REG_DEFVALB,
+    MCP_REG_INTCONA, MCP_REG_INTCONB, MCP_REG_GPPUA, MCP_REG_GPPUB,
+    MCP_REG_GPIOA, MCP_REG_GPIOB, MCP_REG_OLATA, MCP_REG_OLATB,
+};
+#define RANDOM_REG_COUNT (sizeof(random_regs) / sizeof(random_regs[0]))
+
+static bool image_matches_device(const mcp23017_dev_t *d, i2c_master_dev_handle_t m)
+{
+    for (int r = 0; r < MCP_REG_COUNT; ++r) {
+        if ((d->img_valid >> r & 1) && d->img[r] != mcp_mock_peek(m, r)) return false;
+    }
+    return true;
+}
+
+// Every batch in a random layout, with random masks, interleaved block reads
+// and injected failures: a successful batch must leave exactly the model's
+// values, and the image must never disagree with the device
+static void test_random(void)
+{
+    printf("random batches\n");
+    srand(RANDOM_SEED);
+    uint32_t transfers = 0, batches = 0, failed = 0;
+    for (int it = 0; it < RANDOM_DEVICES; ++it) {
+        i2c_master_dev_handle_t m = mcp_mock_create();
+        uint8_t iocon = (rand() & 1 ? MCP_IOCON_BANK : 0) | (rand() % 4 == 0 ? MCP_IOCON_SEQOP : 0);
+        for (size_t i = 0; i < RANDOM_REG_COUNT; ++i) mcp_mock_poke(m, random_regs[i], (uint8_t)rand());
+        mcp_mock_poke(m, MCP_REG_IOCON, iocon);
+
+        uint8_t model[MCP_REG_COUNT];
+        for (int r = 0; r < MCP_REG_COUNT; ++r) model[r] = mcp_mock_peek(m, r);
+        mcp23017_dev_t d = { .i2c = m };
+        CHECK(mcp_dev_load_iocon(&d) == ESP_OK);
+
+        for (int b = 0; b < RANDOM_BATCHES; ++b) {
+            mcp23017_reg_change_t chg[6];
+            int n = 1 + rand() % 6;
+            for (int i = 0; i < n; ++i) {
+                chg[i].reg = random_regs[rand() % RANDOM_REG_COUNT];
+                chg[i].mask = rand() % 3 ? (uint8_t)rand() : 0xFF;
+                chg[i].value = (uint8_t)rand();
+                uint8_t r = chg[i].reg;
+                if ((r >> 1) == MCP_KIND_GPIO) r += 2;      // GPIO writes land in OLAT
+                model[r] = (model[r] & ~chg[i].mask) | (chg[i].value & chg[i].mask);
+            }
+            if (rand() % 5 == 0) {
+                uint8_t buf[4];
+                mcp_dev_read(&d, (uint8_t)(rand() % 8), buf, sizeof(buf));
+            }
+            if (rand() % 10 == 0) mcp_mock_fail(m, 1 + rand() % 4, 1 + MCP23017_BATCH_RETRIES);
+
+            uint32_t t0 = d.stats.transactions;
+            esp_err_t rc = mcp_dev_update(&d, chg, n, rand() % 4 == 0 ? MCP_CFG_FORCE_SEQOP : 0);
+            mcp_mock_fail(m, 0, 0);
+            if (!image_matches_device(&d, m)) {
+                printf("FAIL device %d batch %d: image disagrees with the device\n", it, b);
+                failures++;
+            }
+            if (rc != ESP_OK) {
+                // Rollback is best effort when the restore itself fails:
+                // continue from what the device holds
+                for (int r = 0; r < MCP_REG_COUNT; ++r) model[r] = mcp_mock_peek(m, r);
+                failed++;
+                continue;
+            }
+            transfers += d.stats.transactions - t0;
+            batches++;
+            for (int r = 0; r < MCP_REG_COUNT; ++r) {
+                int kind = r >> 1;
+                if (kind == MCP_KIND_GPIO) continue;    // input levels, not written state
+                if (mcp_mock_peek(m, r) != model[r]) {
+                    printf("FAIL device %d batch %d: reg 0x%02X is 0x%02X, expected 0x%02X\n",
+                           it, b, r, mcp_mock_peek(m, r), model[r]);
+                    failures++;
+                }
+            }
+        }
+        mcp_mock_destroy(m);
+    }
+    printf("  %u batches ok (%.2f transfers each), %u failed on purpose\n",
+           (unsigned)batches, batches ? (double)transfers / batches : 0.0, (unsigned)failed);
+}
+
+int main(void)
+{
+    test_layouts();
+    test_diff_writes();
+    test_interrupt_block_read();
+    test_retry_and_rollback();
+    test_random();
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+// MCP23017.h
+// ESP-IDF driver for the Microchip MCP23017 16-bit I2C I/O expander.
+//
+// - Discovery: mcp23017_auto_setup() finds an existing i2c_master bus, probes
+//   0x20..0x27 and attaches every device found to one handle. Devices are
+//   addressed by index (dev_idx) in discovery order.
+// - Registers are logical BANK=0 numbers (see mcp23017_regs.h); the driver
+//   caches IOCON per device and translates to BANK=1 addresses when needed.
+// - Multi-register updates go through the v3 batch engine: minimal windows,
+//   changed bytes only, retries and rollback
+//   (docs/MCP23017_v3_batching_and_bank_mode.md).
+// - Each device keeps an image of its plain read/write registers, so writes
+//   are diff-only: a change the image already holds costs no I2C at all.
+// - ISR plumbing only notifies a worker task; all I2C happens in task context.
+//
+// Every call that touches the bus takes the handle mutex and must not be made
+// from an ISR.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/i2c_master.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mcp23017_regs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP23017_MAX_DEVICES    8
+#define MCP23017_ADDR_BASE      0x20
+
+typedef struct mcp23017_s *mcp23017_handle_t;
+
+typedef struct {
+    mcp23017_handle_t handle;                   // NULL until auto_setup succeeds
+    uint8_t count;                              // devices attached to the handle
+    uint8_t addr[MCP23017_MAX_DEVICES];         // 7-bit address per dev_idx
+} mcp23017_attached_devices_t;
+
+typedef enum {
+    MCP_PORT_A = 0,
+    MCP_PORT_B = 1,
+} mcp23017_port_t;
+
+#define MCP_PORT_ALL 0xFF   // pin mask: every pin of the port
+
+typedef enum {
+    MCP_PIN_INPUT = 0,
+    MCP_PIN_OUTPUT,
+} mcp23017_pin_mode_t;
+
+typedef enum {
+    MCP_PULLUP_DISABLE = 0,
+    MCP_PULLUP_ENABLE,
+} mcp23017_pullup_t;
+
+typedef enum {
+    MCP_INT_NONE = 0,
+    MCP_INT_ANYEDGE,        // interrupt on change from the previous value
+    MCP_INT_LOW,            // interrupt while the pin is low (compared to DEFVAL=1)
+    MCP_INT_HIGH,           // interrupt while the pin is high (compared to DEFVAL=0)
+} mcp23017_int_mode_t;
+
+// INT pin driver, shared by both ports (IOCON.ODR / IOCON.INTPOL)
+typedef enum {
+    MCP_INT_OPENDRAIN = 0,
+    MCP_INT_ACTIVE_LOW,
+    MCP_INT_ACTIVE_HIGH,
+} mcp23017_int_polarity_t;
+
+typedef struct {
+    mcp23017_port_t port;
+    uint8_t mask;                       // pins affected by this call
+    mcp23017_pin_mode_t pin_mode;
+    mcp23017_pullup_t pullup;
+    mcp23017_int_mode_t int_mode;
+    mcp23017_int_polarity_t int_polarity;   // applied only when int_mode != MCP_INT_NONE
+    uint8_t initial_level;              // OLAT for output pins, written before IODIR
+    uint32_t flags;                     // MCP_CFG_*
+} mcp23017_pin_cfg_t;
+
+typedef enum {
+    MCP_ISR_SERVICE_NO = 0,     // caller already installed the GPIO ISR service
+    MCP_ISR_SERVICE_YES,        // install it (ESP_ERR_INVALID_STATE from an earlier install is ignored)
+} mcp23017_isr_service_t;
+
+typedef struct {
+    gpio_num_t int_gpio;                // MCU pin wired to INTA/INTB
+    gpio_pull_mode_t pull_mode;
+    gpio_int_type_t intr_type;
+    mcp23017_isr_service_t install_isr_service;
+} mcp23017_isr_cfg_t;
+
+// Find an i2c_master bus (bus == NULL: wait for I2C_NUM_0/1 to be created by
+// someone else), attach every MCP23017 on 0x20..0x27 and cache each IOCON.
+// With apply_defaults, every device is reset to the power-on register values
+// (IOCON=0, all pins inputs). Calling again with a populated `out` returns the
+// existing handle.
+esp_err_t mcp23017_auto_setup(mcp23017_attached_devices_t *out, bool apply_defaults, i2c_master_bus_handle_t bus);
+
+// Configure the pins in cfg->mask of one port in a single batch
+esp_err_t mcp23017_config_port(mcp23017_handle_t h, uint8_t dev_idx, const mcp23017_pin_cfg_t *cfg);
+
+// IOCON.MIRROR: INTA and INTB both signal either port
+esp_err_t mcp23017_set_int_mirror(mcp23017_handle_t h, uint8_t dev_idx, bool enable);
+
+// IOCON read from the cache (reloaded from the device if invalidated)
+esp_err_t mcp23017_get_iocon(mcp23017_handle_t h, uint8_t dev_idx, uint8_t *iocon);
+
+// Single logical registers. IOCON is accepted and keeps the cache in step.
+esp_err_t mcp23017_reg_read8(mcp23017_handle_t h, uint8_t dev_idx, uint8_t reg, uint8_t *val);
+esp_err_t mcp23017_reg_write8(mcp23017_handle_t h, uint8_t dev_idx, uint8_t reg, uint8_t val);
+
+// Logical registers [reg, reg + len): one transfer in BANK=0, one per port
+// in BANK=1
+esp_err_t mcp23017_reg_read_block(mcp23017_handle_t h, uint8_t dev_idx, uint8_t reg, uint8_t *buf, size_t len);
+
+// Apply masked changes to several registers as one batch (flags: MCP_CFG_*)
+esp_err_t mcp23017_update_regs(mcp23017_handle_t h, uint8_t dev_idx, const mcp23017_reg_change_t *chg, size_t n, uint32_t flags);
+
+// 8-bit port helpers: read GPIO, write OLAT
+esp_err_t mcp23017_port_read(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_port_t port, uint8_t *val);
+esp_err_t mcp23017_port_write(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_port_t port, uint8_t val);
+esp_err_t mcp23017_port_masked_write(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_port_t port, uint8_t mask, uint8_t value);
+
+// 16-bit wrappers, port A in the low byte
+esp_err_t mcp23017_read_gpio16(mcp23017_handle_t h, uint8_t dev_idx, uint16_t *val);
+esp_err_t mcp23017_write_gpio16(mcp23017_handle_t h, uint8_t dev_idx, uint16_t val);
+
+// Forget the register image and IOCON (e.g. after the device was reset
+// behind the driver's back); the next access reads from the device again
+esp_err_t mcp23017_cache_invalidate(mcp23017_handle_t h, uint8_t dev_idx);
+
+// Snapshot of the device's I2C counters; diff two snapshots to cost a call
+esp_err_t mcp23017_get_stats(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_stats_t *out);
+
+// Bit-reverse a byte (pin 0 <-> pin 7), for boards wired MSB-first
+void mcp23017_reverse8_inplace(uint8_t *b);
+
+// Configure cfg->int_gpio as an interrupt input whose ISR notifies
+// worker_task (vTaskNotifyGiveFromISR). Up to MCP23017_MAX_DEVICES lines.
+esp_err_t mcp23017_isr_register(const mcp23017_isr_cfg_t *cfg, TaskHandle_t worker_task);
+esp_err_t mcp23017_isr_unregister(gpio_num_t int_gpio);
+
+// Interrupts seen on an MCU GPIO since registration (diagnostics)
+uint32_t mcp23017_isr_get_hits(gpio_num_t int_gpio);
+
+#ifdef __cplusplus
+}
+#endif
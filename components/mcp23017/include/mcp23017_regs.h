@@ -0,0 +1,90 @@
+// mcp23017_regs.h
+// MCP23017 register map, configuration flags and transaction statistics.
+// Plain C with no RTOS or driver dependencies so the batching engine and its
+// i2c_master mock can be built on the host.
+//
+// Register numbers are *logical*: the IOCON.BANK=0 addresses, where each A/B
+// pair sits side by side (reg = kind * 2 + port). The engine translates them
+// to the device's current layout, so callers never depend on BANK.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_REG_IODIRA      0x00
+#define MCP_REG_IODIRB      0x01
+#define MCP_REG_IPOLA       0x02
+#define MCP_REG_IPOLB       0x03
+#define MCP_REG_GPINTENA    0x04
+#define MCP_REG_GPINTENB    0x05
+#define MCP_REG_DEFVALA     0x06
+#define MCP_REG_DEFVALB     0x07
+#define MCP_REG_INTCONA     0x08
+#define MCP_REG_INTCONB     0x09
+#define MCP_REG_IOCON       0x0A    // one register, mirrored at 0x0B in BANK=0
+#define MCP_REG_GPPUA       0x0C
+#define MCP_REG_GPPUB       0x0D
+#define MCP_REG_INTFA       0x0E    // read-only
+#define MCP_REG_INTFB       0x0F
+#define MCP_REG_INTCAPA     0x10    // read-only; reading clears the interrupt
+#define MCP_REG_INTCAPB     0x11
+#define MCP_REG_GPIOA       0x12    // reading clears the interrupt; writes go to OLAT
+#define MCP_REG_GPIOB       0x13
+#define MCP_REG_OLATA       0x14
+#define MCP_REG_OLATB       0x15
+#define MCP_REG_COUNT       0x16
+
+// Register kind (logical reg >> 1); also the BANK=1 offset within a port
+#define MCP_KIND_IOCON      (MCP_REG_IOCON >> 1)
+#define MCP_KIND_INTF       (MCP_REG_INTFA >> 1)
+#define MCP_KIND_INTCAP     (MCP_REG_INTCAPA >> 1)
+#define MCP_KIND_GPIO       (MCP_REG_GPIOA >> 1)
+
+#define MCP_IOCON_BANK      0x80
+#define MCP_IOCON_MIRROR    0x40
+#define MCP_IOCON_SEQOP     0x20    // 1 = address pointer does not increment
+#define MCP_IOCON_DISSLW    0x10
+#define MCP_IOCON_HAEN      0x08
+#define MCP_IOCON_ODR       0x04
+#define MCP_IOCON_INTPOL    0x02
+
+// Flags for mcp23017_pin_cfg_t.flags / mcp23017_update_regs()
+#define MCP_CFG_BATCH_WRITE 0x01    // default: windowed batch RMW when the layout allows it
+#define MCP_CFG_NO_BATCH    0x02    // one register per transaction
+#define MCP_CFG_FORCE_SEQOP 0x04    // if IOCON.SEQOP=1, clear it for the batch and restore it after
+#define MCP_CFG_NO_CACHE    0x08    // read the device instead of trusting the cached register image
+
+#define MCP23017_BATCH_RETRIES  2   // extra attempts per transaction before giving up
+#define MCP23017_SCL_HZ         400000
+
+// Estimated bus time for a number of bytes on the wire (9 clocks per byte)
+#define MCP23017_WIRE_US(bytes) ((uint32_t)(((uint64_t)(bytes) * 9 * 1000000) / MCP23017_SCL_HZ))
+
+// One masked register update: reg = (reg & ~mask) | (value & mask)
+typedef struct {
+    uint8_t reg;        // logical register (MCP_REG_*)
+    uint8_t mask;
+    uint8_t value;
+} mcp23017_reg_change_t;
+
+// Per-device I2C counters (monotonic; diff two snapshots to cost an operation)
+typedef struct {
+    uint32_t transactions;  // I2C transfers issued, retries included
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t wire_bytes;    // address + register + data bytes on the bus
+    uint32_t retries;
+    uint32_t errors;        // transfers that failed after all retries
+    uint32_t rollbacks;     // batches that had to restore earlier writes
+    uint32_t cache_skips;   // register changes dropped because the cache already held the value
+} mcp23017_stats_t;
+
+#ifdef __cplusplus
+}
+#endif
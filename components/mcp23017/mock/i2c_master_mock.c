@@ -0,0 +1,169 @@
+// i2c_master_mock.c
+// Register-level MCP23017 emulation behind the i2c_master transfer calls.
+// See mcp23017_mock.h for what is modelled.
+
+#include <stdlib.h>
+#include <string.h>
+#include "mcp23017_mock.h"
+#include "mcp23017_regs.h"
+
+#define MOCK_REG_NONE 0xFF
+
+struct mcp_mock_dev {
+    uint8_t reg[MCP_REG_COUNT];     // logical register file; IOCON kept at MCP_REG_IOCON
+    uint16_t pins;                  // external levels, port A in the low byte
+    uint32_t fail_at;               // 0 = no failure pending
+    uint32_t fail_count;
+    mcp_mock_counters_t cnt;
+};
+
+i2c_master_dev_handle_t mcp_mock_create(void)
+{
+    struct mcp_mock_dev *d = calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    d->reg[MCP_REG_IODIRA] = 0xFF;
+    d->reg[MCP_REG_IODIRB] = 0xFF;
+    d->pins = 0xFFFF;
+    return d;
+}
+
+void mcp_mock_destroy(i2c_master_dev_handle_t dev)
+{
+    free(dev);
+}
+
+static uint8_t iocon(const struct mcp_mock_dev *d)
+{
+    return d->reg[MCP_REG_IOCON];
+}
+
+// Logical register at a device address in the current layout
+static uint8_t phys_to_reg(const struct mcp_mock_dev *d, uint8_t phys)
+{
+    if (iocon(d) & MCP_IOCON_BANK) {
+        uint8_t kind = phys & 0x0F;
+        if (phys >= 0x20 || kind > (MCP_REG_OLATA >> 1)) return MOCK_REG_NONE;
+        if (kind == MCP_KIND_IOCON) return MCP_REG_IOCON;
+        return (uint8_t)((kind << 1) | (phys >> 4));
+    }
+    if (phys >= MCP_REG_COUNT) return MOCK_REG_NONE;
+    return phys == MCP_REG_IOCON + 1 ? MCP_REG_IOCON : phys;
+}
+
+static uint8_t pointer_next(const struct mcp_mock_dev *d, uint8_t phys)
+{
+    if (iocon(d) & MCP_IOCON_SEQOP) return phys;
+    if (iocon(d) & MCP_IOCON_BANK) return (uint8_t)((phys + 1) & 0x1F);
+    return (uint8_t)((phys + 1) % MCP_REG_COUNT);
+}
+
+static uint8_t gpio_value(const struct mcp_mock_dev *d, int port)
+{
+    uint8_t dir = d->reg[MCP_REG_IODIRA + port];
+    uint8_t in = (uint8_t)(((d->pins >> (8 * port)) & 0xFF) ^ d->reg[MCP_REG_IPOLA + port]);
+    return (uint8_t)((in & dir) | (d->reg[MCP_REG_OLATA + port] & ~dir));
+}
+
+static uint8_t reg_read(struct mcp_mock_dev *d, uint8_t reg)
+{
+    if (reg == MOCK_REG_NONE) return 0;
+    uint8_t kind = reg >> 1;
+    int port = reg & 1;
+    if (kind == MCP_KIND_GPIO) {
+        d->reg[MCP_REG_INTFA + port] = 0;
+        return gpio_value(d, port);
+    }
+    if (kind == MCP_KIND_INTCAP) d->reg[MCP_REG_INTFA + port] = 0;
+    return d->reg[reg];
+}
+
+static void reg_write(struct mcp_mock_dev *d, uint8_t reg, uint8_t val)
+{
+    if (reg == MOCK_REG_NONE) return;
+    uint8_t kind = reg >> 1;
+    if (kind == MCP_KIND_INTF || kind == MCP_KIND_INTCAP) return;
+    if (kind == MCP_KIND_GPIO) reg = (uint8_t)(MCP_REG_OLATA + (reg & 1));
+    d->reg[reg] = val;
+}
+
+static bool xfer_fails(struct mcp_mock_dev *d)
+{
+    d->cnt.transactions++;
+    if (!d->fail_at) return false;
+    if (--d->fail_at) return false;
+    if (--d->fail_count) d->fail_at = 1;
+    return true;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t d, const uint8_t *buf, size_t len, int timeout_ms)
+{
+    (void)timeout_ms;
+    if (!d || !buf || len == 0) return ESP_ERR_INVALID_ARG;
+    d->cnt.wire_bytes += (uint32_t)(1 + len);
+    if (xfer_fails(d)) return ESP_ERR_TIMEOUT;
+
+    uint8_t ptr = buf[0];
+    for (size_t i = 1; i < len; ++i) {
+        reg_write(d, phys_to_reg(d, ptr), buf[i]);
+        ptr = pointer_next(d, ptr);     // after the write: an IOCON write takes effect at once
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t d, const uint8_t *wbuf, size_t wlen,
+                                      uint8_t *rbuf, size_t rlen, int timeout_ms)
+{
+    (void)timeout_ms;
+    if (!d || !wbuf || wlen != 1 || !rbuf || rlen == 0) return ESP_ERR_INVALID_ARG;
+    d->cnt.wire_bytes += (uint32_t)(3 + rlen);
+    if (xfer_fails(d)) return ESP_ERR_TIMEOUT;
+
+    uint8_t ptr = wbuf[0];
+    for (size_t i = 0; i < rlen; ++i) {
+        rbuf[i] = reg_read(d, phys_to_reg(d, ptr));
+        ptr = pointer_next(d, ptr);
+    }
+    return ESP_OK;
+}
+
+uint8_t mcp_mock_peek(i2c_master_dev_handle_t d, uint8_t reg)
+{
+    if (reg >= MCP_REG_COUNT) return 0;
+    if ((reg >> 1) == MCP_KIND_GPIO) return gpio_value(d, reg & 1);
+    return d->reg[(reg >> 1) == MCP_KIND_IOCON ? MCP_REG_IOCON : reg];
+}
+
+void mcp_mock_poke(i2c_master_dev_handle_t d, uint8_t reg, uint8_t val)
+{
+    if (reg >= MCP_REG_COUNT) return;
+    d->reg[(reg >> 1) == MCP_KIND_IOCON ? MCP_REG_IOCON : reg] = val;
+}
+
+void mcp_mock_set_pins(i2c_master_dev_handle_t d, uint16_t pins)
+{
+    for (int port = 0; port < 2; ++port) {
+        uint8_t before = gpio_value(d, port);
+        d->pins = (uint16_t)((d->pins & ~(0xFF << (8 * port))) | (pins & (0xFF << (8 * port))));
+        uint8_t after = gpio_value(d, port);
+
+        uint8_t en = d->reg[MCP_REG_GPINTENA + port] & d->reg[MCP_REG_IODIRA + port];
+        uint8_t intcon = d->reg[MCP_REG_INTCONA + port];
+        uint8_t fire = (uint8_t)((((before ^ after) & ~intcon) | ((after ^ d->reg[MCP_REG_DEFVALA + port]) & intcon)) & en);
+        // INTCAP holds the first capture until INTF is cleared
+        if (fire && !d->reg[MCP_REG_INTFA + port]) {
+            d->reg[MCP_REG_INTFA + port] = fire;
+            d->reg[MCP_REG_INTCAPA + port] = after;
+        }
+    }
+}
+
+void mcp_mock_fail(i2c_master_dev_handle_t d, uint32_t at, uint32_t count)
+{
+    d->fail_at = count ? at : 0;
+    d->fail_count = count;
+}
+
+mcp_mock_counters_t mcp_mock_counters(i2c_master_dev_handle_t d)
+{
+    return d->cnt;
+}
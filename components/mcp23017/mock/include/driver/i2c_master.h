@@ -0,0 +1,15 @@
+// driver/i2c_master.h (host mock)
+// Just enough of the ESP-IDF i2c_master API for mcp23017_batch.c; every
+// device handle is an emulated MCP23017 (see mcp23017_mock.h).
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct mcp_mock_dev *i2c_master_dev_handle_t;
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *write_buffer, size_t write_size, int xfer_timeout_ms);
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *write_buffer, size_t write_size,
+                                      uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms);
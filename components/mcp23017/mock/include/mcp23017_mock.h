@@ -0,0 +1,37 @@
+// mcp23017_mock.h
+// Host-side MCP23017 emulation behind the i2c_master mock, for exercising
+// mcp23017_batch.c without hardware. Models both IOCON.BANK layouts, the
+// SEQOP address pointer, GPIO writes landing in OLAT, interrupt capture and
+// INTF clearing on GPIO/INTCAP reads.
+//
+// Host build (no ESP-IDF needed), from components/mcp23017:
+//   cc -Imock/include -Iinclude -Isrc src/mcp23017_batch.c mock/i2c_master_mock.c your_test.c
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/i2c_master.h"
+
+typedef struct {
+    uint32_t transactions;  // transfers attempted, failed ones included
+    uint32_t wire_bytes;    // address + register + data bytes
+} mcp_mock_counters_t;
+
+// New emulated device in its power-on state (BANK=0, all inputs)
+i2c_master_dev_handle_t mcp_mock_create(void);
+void mcp_mock_destroy(i2c_master_dev_handle_t dev);
+
+// Direct register access by logical (BANK=0) number, bypassing the bus
+uint8_t mcp_mock_peek(i2c_master_dev_handle_t dev, uint8_t reg);
+void mcp_mock_poke(i2c_master_dev_handle_t dev, uint8_t reg, uint8_t val);
+
+// Drive the external pin levels (port A in the low byte); latches INTF/INTCAP
+// for pins with GPINTEN set
+void mcp_mock_set_pins(i2c_master_dev_handle_t dev, uint16_t pins);
+
+// Fail `count` transfers starting with the `at`-th transfer from now (1 = the
+// next one). A failed write changes nothing.
+void mcp_mock_fail(i2c_master_dev_handle_t dev, uint32_t at, uint32_t count);
+
+mcp_mock_counters_t mcp_mock_counters(i2c_master_dev_handle_t dev);
@@ -0,0 +1,384 @@
+// MCP23017.c
+// Discovery, locking, port helpers and ISR plumbing around the batch engine
+// in mcp23017_batch.c. One handle per process: every device found on the bus
+// hangs off it and shares its mutex, which also serializes the bus between
+// callers of this component.
+
+#include <string.h>
+#include "MCP23017.h"
+#include "mcp23017_priv.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+
+static const char *TAG = "MCP23017";
+
+#define MCP_PROBE_TIMEOUT_MS    20
+#define MCP_BUS_WAIT_RETRIES    50
+#define MCP_BUS_WAIT_MS         200
+
+struct mcp23017_s {
+    i2c_master_bus_handle_t bus;
+    mcp23017_dev_t dev[MCP23017_MAX_DEVICES];
+    uint8_t count;
+    SemaphoreHandle_t lock;
+};
+
+static struct mcp23017_s s_mcp;
+static bool s_mcp_ready = false;
+
+typedef struct {
+    bool used;
+    gpio_num_t gpio;
+    TaskHandle_t task;
+    volatile uint32_t hits;
+} mcp_isr_slot_t;
+
+static mcp_isr_slot_t s_isr_slots[MCP23017_MAX_DEVICES];
+
+static mcp23017_dev_t *dev_lock(mcp23017_handle_t h, uint8_t dev_idx)
+{
+    if (!h || dev_idx >= h->count) return NULL;
+    xSemaphoreTake(h->lock, portMAX_DELAY);
+    return &h->dev[dev_idx];
+}
+
+static void dev_unlock(mcp23017_handle_t h)
+{
+    xSemaphoreGive(h->lock);
+}
+
+static esp_err_t dev_iocon(mcp23017_dev_t *d)
+{
+    return d->iocon_valid ? ESP_OK : mcp_dev_load_iocon(d);
+}
+
+// Power-on register values. IOCON first, so the rest goes to BANK=0
+// addresses; the whole-byte changes need no reads.
+static esp_err_t dev_apply_defaults(mcp23017_dev_t *d)
+{
+    esp_err_t rc = dev_iocon(d);
+    if (rc == ESP_OK && d->iocon != 0) rc = mcp_dev_write_iocon(d, 0);
+    if (rc != ESP_OK) return rc;
+
+    mcp23017_reg_change_t chg[MCP_REG_COUNT];
+    size_t n = 0;
+    for (uint8_t reg = 0; reg < MCP_REG_COUNT; ++reg) {
+        uint8_t kind = reg >> 1;
+        if (kind == MCP_KIND_IOCON || kind == MCP_KIND_INTF || kind == MCP_KIND_INTCAP || kind == MCP_KIND_GPIO) continue;
+        uint8_t value = (kind == (MCP_REG_IODIRA >> 1)) ? 0xFF : 0x00;
+        chg[n++] = (mcp23017_reg_change_t){ .reg = reg, .mask = 0xFF, .value = value };
+    }
+    return mcp_dev_update(d, chg, n, 0);
+}
+
+esp_err_t mcp23017_auto_setup(mcp23017_attached_devices_t *out, bool apply_defaults, i2c_master_bus_handle_t bus)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    if (out->handle) return ESP_OK;
+    if (s_mcp_ready) {
+        out->handle = &s_mcp;
+        out->count = s_mcp.count;
+        for (uint8_t i = 0; i < s_mcp.count; ++i) out->addr[i] = s_mcp.dev[i].addr;
+        return ESP_OK;
+    }
+
+    if (!bus) {
+        for (int attempt = 0; attempt < MCP_BUS_WAIT_RETRIES; ++attempt) {
+            if (i2c_master_get_bus_handle(I2C_NUM_0, &bus) == ESP_OK) break;
+            if (i2c_master_get_bus_handle(I2C_NUM_1, &bus) == ESP_OK) break;
+            bus = NULL;
+            ESP_LOGI(TAG, "waiting for I2C bus (attempt %d/%d)", attempt + 1, MCP_BUS_WAIT_RETRIES);
+            vTaskDelay(pdMS_TO_TICKS(MCP_BUS_WAIT_MS));
+        }
+        if (!bus) {
+            ESP_LOGW(TAG, "No existing I2C master bus found");
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+
+    struct mcp23017_s *h = &s_mcp;
+    memset(h, 0, sizeof(*h));
+    h->bus = bus;
+    h->lock = xSemaphoreCreateMutex();
+    if (!h->lock) return ESP_ERR_NO_MEM;
+
+    for (uint8_t addr = MCP23017_ADDR_BASE; addr < MCP23017_ADDR_BASE + MCP23017_MAX_DEVICES; ++addr) {
+        if (i2c_master_probe(bus, addr, MCP_PROBE_TIMEOUT_MS) != ESP_OK) continue;
+
+        mcp23017_dev_t *d = &h->dev[h->count];
+        i2c_device_config_t dev_cfg = {
+            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+            .device_address = addr,
+            .scl_speed_hz = MCP23017_SCL_HZ,
+        };
+        esp_err_t rc = i2c_master_bus_add_device(bus, &dev_cfg, &d->i2c);
+        if (rc != ESP_OK) {
+            ESP_LOGW(TAG, "0x%02X: add device failed (0x%X)", addr, rc);
+            continue;
+        }
+        d->addr = addr;
+
+        rc = apply_defaults ? dev_apply_defaults(d) : mcp_dev_load_iocon(d);
+        if (rc != ESP_OK) {
+            // Left attached; the IOCON cache reloads on first use
+            ESP_LOGW(TAG, "0x%02X: %s failed (0x%X)", addr, apply_defaults ? "defaults" : "IOCON read", rc);
+        }
+        ESP_LOGI(TAG, "device %u at 0x%02X (IOCON=0x%02X, %s)", h->count, addr, d->iocon,
+                 (d->iocon & MCP_IOCON_BANK) ? "BANK=1" : "BANK=0");
+        out->addr[h->count] = addr;
+        h->count++;
+    }
+
+    if (h->count == 0) {
+        vSemaphoreDelete(h->lock);
+        h->lock = NULL;
+        ESP_LOGW(TAG, "no MCP23017 found on 0x%02X..0x%02X", MCP23017_ADDR_BASE, MCP23017_ADDR_BASE + MCP23017_MAX_DEVICES - 1);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_mcp_ready = true;
+    out->handle = h;
+    out->count = h->count;
+    return ESP_OK;
+}
+
+esp_err_t mcp23017_config_port(mcp23017_handle_t h, uint8_t dev_idx, const mcp23017_pin_cfg_t *cfg)
+{
+    if (!cfg || cfg->port > MCP_PORT_B) return ESP_ERR_INVALID_ARG;
+
+    const uint8_t p = (uint8_t)cfg->port;
+    const uint8_t m = cfg->mask;
+    const bool output = cfg->pin_mode == MCP_PIN_OUTPUT;
+    const bool irq = !output && cfg->int_mode != MCP_INT_NONE;
+
+    mcp23017_reg_change_t chg[6];
+    size_t n = 0;
+    if (output) chg[n++] = (mcp23017_reg_change_t){ MCP_REG_OLATA + p, m, cfg->initial_level };
+    chg[n++] = (mcp23017_reg_change_t){ MCP_REG_IODIRA + p, m, output ? 0x00 : 0xFF };
+    chg[n++] = (mcp23017_reg_change_t){ MCP_REG_GPPUA + p, m, cfg->pullup == MCP_PULLUP_ENABLE ? 0xFF : 0x00 };
+    chg[n++] = (mcp23017_reg_change_t){ MCP_REG_GPINTENA + p, m, irq ? 0xFF : 0x00 };
+    if (irq) {
+        bool level = cfg->int_mode != MCP_INT_ANYEDGE;
+        chg[n++] = (mcp23017_reg_change_t){ MCP_REG_INTCONA + p, m, level ? 0xFF : 0x00 };
+        if (level) chg[n++] = (mcp23017_reg_change_t){ MCP_REG_DEFVALA + p, m, cfg->int_mode == MCP_INT_LOW ? 0xFF : 0x00 };
+    }
+
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    esp_err_t rc = mcp_dev_update(d, chg, n, cfg->flags);
+    if (rc == ESP_OK && irq) rc = dev_iocon(d);
+    if (rc == ESP_OK && irq) {
+        // ODR overrides INTPOL on the device; only touch IOCON when it differs
+        uint8_t want = d->iocon & (uint8_t)~(MCP_IOCON_ODR | MCP_IOCON_INTPOL);
+        if (cfg->int_polarity == MCP_INT_OPENDRAIN) want |= MCP_IOCON_ODR;
+        else if (cfg->int_polarity == MCP_INT_ACTIVE_HIGH) want |= MCP_IOCON_INTPOL;
+        if (want != d->iocon) rc = mcp_dev_write_iocon(d, want);
+    }
+    dev_unlock(h);
+    return rc;
+}
+
+esp_err_t mcp23017_set_int_mirror(mcp23017_handle_t h, uint8_t dev_idx, bool enable)
+{
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    esp_err_t rc = dev_iocon(d);
+    if (rc == ESP_OK) {
+        uint8_t want = enable ? (d->iocon | MCP_IOCON_MIRROR) : (d->iocon & (uint8_t)~MCP_IOCON_MIRROR);
+        if (want != d->iocon) rc = mcp_dev_write_iocon(d, want);
+    }
+    dev_unlock(h);
+    return rc;
+}
+
+esp_err_t mcp23017_get_iocon(mcp23017_handle_t h, uint8_t dev_idx, uint8_t *iocon)
+{
+    if (!iocon) return ESP_ERR_INVALID_ARG;
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    esp_err_t rc = dev_iocon(d);
+    *iocon = d->iocon;
+    dev_unlock(h);
+    return rc;
+}
+
+esp_err_t mcp23017_reg_read8(mcp23017_handle_t h, uint8_t dev_idx, uint8_t reg, uint8_t *val)
+{
+    return mcp23017_reg_read_block(h, dev_idx, reg, val, 1);
+}
+
+esp_err_t mcp23017_reg_write8(mcp23017_handle_t h, uint8_t dev_idx, uint8_t reg, uint8_t val)
+{
+    if (reg >= MCP_REG_COUNT) return ESP_ERR_INVALID_ARG;
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    esp_err_t rc;
+    if ((reg >> 1) == MCP_KIND_IOCON) {
+        rc = dev_iocon(d);
+        if (rc == ESP_OK) rc = mcp_dev_write_iocon(d, val);
+    } else {
+        mcp23017_reg_change_t chg = { reg, 0xFF, val };
+        rc = mcp_dev_update(d, &chg, 1, 0);
+    }
+    dev_unlock(h);
+    return rc;
+}
+
+esp_err_t mcp23017_reg_read_block(mcp23017_handle_t h, uint8_t dev_idx, uint8_t reg, uint8_t *buf, size_t len)
+{
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    esp_err_t rc = mcp_dev_read(d, reg, buf, len);
+    dev_unlock(h);
+    return rc;
+}
+
+esp_err_t mcp23017_update_regs(mcp23017_handle_t h, uint8_t dev_idx, const mcp23017_reg_change_t *chg, size_t n, uint32_t flags)
+{
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    esp_err_t rc = mcp_dev_update(d, chg, n, flags);
+    dev_unlock(h);
+    return rc;
+}
+
+esp_err_t mcp23017_port_read(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_port_t port, uint8_t *val)
+{
+    if (port > MCP_PORT_B) return ESP_ERR_INVALID_ARG;
+    return mcp23017_reg_read_block(h, dev_idx, MCP_REG_GPIOA + port, val, 1);
+}
+
+esp_err_t mcp23017_port_write(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_port_t port, uint8_t val)
+{
+    return mcp23017_port_masked_write(h, dev_idx, port, 0xFF, val);
+}
+
+esp_err_t mcp23017_port_masked_write(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_port_t port, uint8_t mask, uint8_t value)
+{
+    if (port > MCP_PORT_B) return ESP_ERR_INVALID_ARG;
+    mcp23017_reg_change_t chg = { MCP_REG_OLATA + port, mask, value };
+    return mcp23017_update_regs(h, dev_idx, &chg, 1, 0);
+}
+
+esp_err_t mcp23017_read_gpio16(mcp23017_handle_t h, uint8_t dev_idx, uint16_t *val)
+{
+    if (!val) return ESP_ERR_INVALID_ARG;
+    uint8_t buf[2];
+    esp_err_t rc = mcp23017_reg_read_block(h, dev_idx, MCP_REG_GPIOA, buf, sizeof(buf));
+    if (rc == ESP_OK) *val = (uint16_t)(buf[0] | (buf[1] << 8));
+    return rc;
+}
+
+esp_err_t mcp23017_write_gpio16(mcp23017_handle_t h, uint8_t dev_idx, uint16_t val)
+{
+    mcp23017_reg_change_t chg[2] = {
+        { MCP_REG_OLATA, 0xFF, (uint8_t)val },
+        { MCP_REG_OLATB, 0xFF, (uint8_t)(val >> 8) },
+    };
+    return mcp23017_update_regs(h, dev_idx, chg, 2, 0);
+}
+
+esp_err_t mcp23017_cache_invalidate(mcp23017_handle_t h, uint8_t dev_idx)
+{
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    d->img_valid = 0;
+    d->iocon_valid = false;
+    dev_unlock(h);
+    return ESP_OK;
+}
+
+esp_err_t mcp23017_get_stats(mcp23017_handle_t h, uint8_t dev_idx, mcp23017_stats_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    mcp23017_dev_t *d = dev_lock(h, dev_idx);
+    if (!d) return ESP_ERR_INVALID_ARG;
+    *out = d->stats;
+    dev_unlock(h);
+    return ESP_OK;
+}
+
+void mcp23017_reverse8_inplace(uint8_t *b)
+{
+    if (!b) return;
+    uint8_t v = *b;
+    v = (uint8_t)(((v & 0xF0) >> 4) | ((v & 0x0F) << 4));
+    v = (uint8_t)(((v & 0xCC) >> 2) | ((v & 0x33) << 2));
+    v = (uint8_t)(((v & 0xAA) >> 1) | ((v & 0x55) << 1));
+    *b = v;
+}
+
+static void IRAM_ATTR mcp_isr_handler(void *arg)
+{
+    mcp_isr_slot_t *slot = (mcp_isr_slot_t *)arg;
+    slot->hits++;
+    BaseType_t woken = pdFALSE;
+    if (slot->task) vTaskNotifyGiveFromISR(slot->task, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+static mcp_isr_slot_t *isr_slot_find(gpio_num_t gpio)
+{
+    for (int i = 0; i < MCP23017_MAX_DEVICES; ++i) {
+        if (s_isr_slots[i].used && s_isr_slots[i].gpio == gpio) return &s_isr_slots[i];
+    }
+    return NULL;
+}
+
+esp_err_t mcp23017_isr_register(const mcp23017_isr_cfg_t *cfg, TaskHandle_t worker_task)
+{
+    if (!cfg || !worker_task || cfg->int_gpio < 0) return ESP_ERR_INVALID_ARG;
+
+    mcp_isr_slot_t *slot = isr_slot_find(cfg->int_gpio);
+    if (slot) {
+        slot->task = worker_task;   // already wired; just retarget
+        return ESP_OK;
+    }
+    for (int i = 0; i < MCP23017_MAX_DEVICES && !slot; ++i) {
+        if (!s_isr_slots[i].used) slot = &s_isr_slots[i];
+    }
+    if (!slot) return ESP_ERR_NO_MEM;
+
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << cfg->int_gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = (cfg->pull_mode == GPIO_PULLUP_ONLY || cfg->pull_mode == GPIO_PULLUP_PULLDOWN),
+        .pull_down_en = (cfg->pull_mode == GPIO_PULLDOWN_ONLY || cfg->pull_mode == GPIO_PULLUP_PULLDOWN),
+        .intr_type = cfg->intr_type,
+    };
+    esp_err_t rc = gpio_config(&io);
+    if (rc != ESP_OK) return rc;
+
+    if (cfg->install_isr_service == MCP_ISR_SERVICE_YES) {
+        rc = gpio_install_isr_service(0);
+        if (rc != ESP_OK && rc != ESP_ERR_INVALID_STATE) return rc;
+    }
+
+    slot->gpio = cfg->int_gpio;
+    slot->task = worker_task;
+    slot->hits = 0;
+    slot->used = true;
+    rc = gpio_isr_handler_add(cfg->int_gpio, mcp_isr_handler, slot);
+    if (rc != ESP_OK) {
+        slot->used = false;
+        return rc;
+    }
+    ESP_LOGI(TAG, "INT on GPIO %d registered", cfg->int_gpio);
+    return ESP_OK;
+}
+
+esp_err_t mcp23017_isr_unregister(gpio_num_t int_gpio)
+{
+    mcp_isr_slot_t *slot = isr_slot_find(int_gpio);
+    if (!slot) return ESP_ERR_NOT_FOUND;
+    esp_err_t rc = gpio_isr_handler_remove(int_gpio);
+    slot->used = false;
+    slot->task = NULL;
+    return rc;
+}
+
+uint32_t mcp23017_isr_get_hits(gpio_num_t int_gpio)
+{
+    mcp_isr_slot_t *slot = isr_slot_find(int_gpio);
+    return slot ? slot->hits : 0;
+}
@@ -0,0 +1,400 @@
+// mcp23017_batch.c
+// Windowed batch read-modify-write (v3 batching, see
+// docs/MCP23017_v3_batching_and_bank_mode.md).
+//
+// A batch is a set of masked changes to logical registers. They are mapped to
+// device addresses for the cached IOCON layout and grouped into windows:
+// contiguous address ranges that never cross a register with side effects
+// (IOCON, INTF, INTCAP, GPIO) or, in BANK=1, the gap between the two ports.
+// A window is read once when it needs it (a partial mask) or when the image
+// lets several whole-byte changes go out as one write; only changed bytes
+// are written back, and runs a few bytes apart are merged because a transfer
+// costs far more in driver setup than rewriting a known byte.
+//
+// Every plain read/write register seen on the bus is kept in a per-device
+// image. A change to an imaged register needs no read, and one that leaves
+// it unchanged never reaches the bus, so repeated writes are diff-only.
+//
+// Every transfer is retried MCP23017_BATCH_RETRIES times. If a write still
+// fails, the runs already written in this batch are restored from the window
+// images read at the start, and both the register image and the IOCON cache
+// are dropped so the next call starts from the device again.
+
+#include <string.h>
+#include "mcp23017_priv.h"
+
+#define MCP_I2C_TIMEOUT_MS  50
+#define MCP_READ_GAP_MAX    4       // unchanged registers read to keep two changes in one window
+#define MCP_WRITE_GAP_MAX   4       // unchanged (read-back) registers rewritten to join two runs
+#define MCP_READ_TO_MERGE   3       // whole-byte changes in a window that justify reading it
+#define MCP_PHYS_SPAN       0x20    // BANK=1 uses 0x00-0x0A (port A) and 0x10-0x1A (port B)
+#define MCP_KIND_LAST       (MCP_REG_OLATA >> 1)
+#define MCP_REG_NONE        0xFF
+
+static esp_err_t xfer_read(mcp23017_dev_t *d, uint8_t phys, uint8_t *buf, size_t len)
+{
+    esp_err_t rc = ESP_FAIL;
+    for (int attempt = 0; attempt <= MCP23017_BATCH_RETRIES; ++attempt) {
+        if (attempt) d->stats.retries++;
+        d->stats.transactions++;
+        d->stats.reads++;
+        d->stats.wire_bytes += 3 + len;     // addr+W, register, addr+R, data
+        rc = i2c_master_transmit_receive(d->i2c, &phys, 1, buf, len, MCP_I2C_TIMEOUT_MS);
+        if (rc == ESP_OK) return ESP_OK;
+    }
+    d->stats.errors++;
+    return rc;
+}
+
+static esp_err_t xfer_write(mcp23017_dev_t *d, uint8_t phys, const uint8_t *data, size_t len)
+{
+    uint8_t buf[1 + MCP_PHYS_SPAN];
+    if (len > MCP_PHYS_SPAN) return ESP_ERR_INVALID_SIZE;
+    buf[0] = phys;
+    memcpy(&buf[1], data, len);
+
+    esp_err_t rc = ESP_FAIL;
+    for (int attempt = 0; attempt <= MCP23017_BATCH_RETRIES; ++attempt) {
+        if (attempt) d->stats.retries++;
+        d->stats.transactions++;
+        d->stats.writes++;
+        d->stats.wire_bytes += 2 + len;     // addr+W, register, data
+        rc = i2c_master_transmit(d->i2c, buf, len + 1, MCP_I2C_TIMEOUT_MS);
+        if (rc == ESP_OK) return ESP_OK;
+    }
+    d->stats.errors++;
+    return rc;
+}
+
+uint8_t mcp_dev_phys(const mcp23017_dev_t *d, uint8_t reg)
+{
+    if (d->iocon & MCP_IOCON_BANK) return (uint8_t)(((reg & 1) << 4) | (reg >> 1));
+    return reg;
+}
+
+// Logical register at a device address, MCP_REG_NONE if unimplemented
+static uint8_t phys_to_reg(const mcp23017_dev_t *d, int phys)
+{
+    if (d->iocon & MCP_IOCON_BANK) {
+        int kind = phys & 0x0F;
+        if (phys >= MCP_PHYS_SPAN || kind > MCP_KIND_LAST) return MCP_REG_NONE;
+        return (uint8_t)((kind << 1) | (phys >> 4));
+    }
+    return phys < MCP_REG_COUNT ? (uint8_t)phys : MCP_REG_NONE;
+}
+
+// Registers a window must not span: IOCON (changes the layout), INTF/INTCAP
+// (read-only) and GPIO (reading clears a pending interrupt)
+static bool reg_is_barrier(uint8_t reg)
+{
+    if (reg == MCP_REG_NONE) return true;
+    uint8_t kind = reg >> 1;
+    return kind == MCP_KIND_IOCON || kind == MCP_KIND_INTF || kind == MCP_KIND_INTCAP || kind == MCP_KIND_GPIO;
+}
+
+// IOCON lives at 0x0A/0x0B in BANK=0 and at 0x05/0x15 in BANK=1, and BANK is
+// only readable once IOCON has been found. Probe from cheapest to rarest:
+// - 0x05 is GPINTENB in BANK=0; a clear bit 7 there rules out BANK=1.
+// - 0x0A/0x0B are both IOCON in BANK=0, while 0x0B reads 0 in BANK=1, so any
+//   difference or a non-zero value settles it.
+// - Both 0 is BANK=0 with IOCON=0 or BANK=1 with OLATA=0. BANK=1 needs the
+//   second IOCON copy at 0x15 to match and 0x0C/0x0D (GPPU in BANK=0,
+//   unimplemented in BANK=1) to read 0.
+static void img_put(mcp23017_dev_t *d, uint8_t reg, uint8_t val)
+{
+    if (reg_is_barrier(reg)) return;
+    d->img[reg] = val;
+    d->img_valid |= 1u << reg;
+}
+
+esp_err_t mcp_dev_load_iocon(mcp23017_dev_t *d)
+{
+    uint8_t r05 = 0, r0a = 0, r0b = 0, r15 = 0, gppu[2] = {0};
+    esp_err_t rc = xfer_read(d, 0x05, &r05, 1);
+    if (rc == ESP_OK) rc = xfer_read(d, 0x0A, &r0a, 1);
+    if (rc != ESP_OK) return rc;
+
+    uint8_t iocon = r0a;
+    if (r05 & MCP_IOCON_BANK) {
+        rc = xfer_read(d, 0x0B, &r0b, 1);
+        if (rc != ESP_OK) return rc;
+        if (r0a != r0b) {
+            iocon = r05;
+        } else if (r0a == 0) {
+            rc = xfer_read(d, 0x15, &r15, 1);
+            if (rc == ESP_OK && r15 == r05) rc = xfer_read(d, 0x0C, gppu, sizeof(gppu));
+            if (rc != ESP_OK) return rc;
+            if (r15 == r05 && !gppu[0] && !gppu[1]) iocon = r05;
+        }
+    }
+    d->iocon = iocon;
+    d->iocon_valid = true;
+    return ESP_OK;
+}
+
+esp_err_t mcp_dev_write_iocon(mcp23017_dev_t *d, uint8_t iocon)
+{
+    uint8_t phys = (d->iocon & MCP_IOCON_BANK) ? 0x05 : MCP_REG_IOCON;
+    esp_err_t rc = xfer_write(d, phys, &iocon, 1);
+    if (rc != ESP_OK) {
+        d->iocon_valid = false;
+        return rc;
+    }
+    d->iocon = iocon;
+    d->iocon_valid = true;
+    return ESP_OK;
+}
+
+esp_err_t mcp_dev_read(mcp23017_dev_t *d, uint8_t reg, uint8_t *buf, size_t len)
+{
+    if (!buf || len == 0 || (size_t)reg + len > MCP_REG_COUNT) return ESP_ERR_INVALID_ARG;
+    if (!d->iocon_valid) {
+        esp_err_t rc = mcp_dev_load_iocon(d);
+        if (rc != ESP_OK) return rc;
+    }
+
+    if (d->iocon & MCP_IOCON_SEQOP) {
+        for (size_t i = 0; i < len; ++i) {
+            esp_err_t rc = xfer_read(d, mcp_dev_phys(d, (uint8_t)(reg + i)), &buf[i], 1);
+            if (rc != ESP_OK) return rc;
+            img_put(d, (uint8_t)(reg + i), buf[i]);
+        }
+        return ESP_OK;
+    }
+
+    // Position in buf of each requested device address; contiguous runs of
+    // addresses are one transfer each
+    uint8_t where[MCP_PHYS_SPAN];
+    memset(where, MCP_REG_NONE, sizeof(where));
+    for (size_t i = 0; i < len; ++i) {
+        where[mcp_dev_phys(d, (uint8_t)(reg + i))] = (uint8_t)i;
+    }
+    int p = 0;
+    while (p < MCP_PHYS_SPAN) {
+        if (where[p] == MCP_REG_NONE) {
+            p++;
+            continue;
+        }
+        int q = p;
+        while (q + 1 < MCP_PHYS_SPAN && where[q + 1] != MCP_REG_NONE) q++;
+        uint8_t tmp[MCP_PHYS_SPAN];
+        esp_err_t rc = xfer_read(d, (uint8_t)p, tmp, (size_t)(q - p + 1));
+        if (rc != ESP_OK) return rc;
+        for (int k = p; k <= q; ++k) {
+            buf[where[k]] = tmp[k - p];
+            img_put(d, (uint8_t)(reg + where[k]), tmp[k - p]);
+        }
+        p = q + 1;
+    }
+    return ESP_OK;
+}
+
+// One register per transfer (SEQOP set, or MCP_CFG_NO_BATCH). Whole-byte
+// changes skip the read.
+static esp_err_t update_each(mcp23017_dev_t *d, const uint8_t *mask, const uint8_t *val)
+{
+    for (uint8_t reg = 0; reg < MCP_REG_COUNT; ++reg) {
+        if (!mask[reg]) continue;
+        uint8_t phys = mcp_dev_phys(d, reg);
+        uint8_t v = val[reg];
+        if (mask[reg] != 0xFF) {
+            uint8_t cur;
+            esp_err_t rc = xfer_read(d, phys, &cur, 1);
+            if (rc != ESP_OK) return rc;
+            img_put(d, reg, cur);
+            v = (uint8_t)((cur & ~mask[reg]) | (val[reg] & mask[reg]));
+            if (v == cur) continue;
+        }
+        esp_err_t rc = xfer_write(d, phys, &v, 1);
+        if (rc != ESP_OK) return rc;
+        img_put(d, reg, v);
+    }
+    return ESP_OK;
+}
+
+typedef struct {
+    uint8_t start;
+    uint8_t len;
+} mcp_run_t;
+
+static esp_err_t update_windows(mcp23017_dev_t *d, const uint8_t *mask, const uint8_t *val, bool use_img)
+{
+    uint8_t pm[MCP_PHYS_SPAN] = {0};    // change mask / value by device address
+    uint8_t pv[MCP_PHYS_SPAN] = {0};
+    uint8_t img[MCP_PHYS_SPAN];         // register contents before the batch
+    bool known[MCP_PHYS_SPAN] = {false};
+    uint8_t out[MCP_PHYS_SPAN];
+    bool changed[MCP_PHYS_SPAN];
+    mcp_run_t done[MCP_PHYS_SPAN];
+    size_t n_done = 0;
+    esp_err_t rc = ESP_OK;
+
+    for (uint8_t reg = 0; reg < MCP_REG_COUNT; ++reg) {
+        if (!mask[reg]) continue;
+        uint8_t p = mcp_dev_phys(d, reg);
+        pm[p] = mask[reg];
+        pv[p] = val[reg];
+    }
+
+    // Windows are applied from the highest address down, so OLAT is written
+    // before IODIR and a pin switched to output drives the requested level
+    // from the start
+    int p = MCP_PHYS_SPAN - 1;
+    while (p >= 0) {
+        if (!pm[p]) {
+            p--;
+            continue;
+        }
+        int hi = p;
+        int lo = p;
+        for (int q = lo - 1; q >= 0; --q) {
+            if (reg_is_barrier(phys_to_reg(d, q))) break;
+            if (pm[q]) {
+                lo = q;
+                continue;
+            }
+            if (lo - q > MCP_READ_GAP_MAX) break;
+        }
+
+        // Imaged bytes count as read: they fill gaps so runs can merge
+        bool need_read = false;
+        bool gaps_known = true;
+        int n_chg = 0;
+        for (int k = lo; k <= hi; ++k) {
+            uint8_t reg = phys_to_reg(d, k);
+            if (use_img && (d->img_valid & (1u << reg))) {
+                img[k] = d->img[reg];
+                known[k] = true;
+            }
+            if (!pm[k]) {
+                if (!known[k]) gaps_known = false;
+                continue;
+            }
+            n_chg++;
+            if (pm[k] != 0xFF && !known[k]) need_read = true;
+        }
+        if (n_chg >= MCP_READ_TO_MERGE && !gaps_known) need_read = true;
+        if (need_read) {
+            rc = xfer_read(d, (uint8_t)lo, &img[lo], (size_t)(hi - lo + 1));
+            if (rc != ESP_OK) goto fail;
+            for (int k = lo; k <= hi; ++k) {
+                known[k] = true;
+                img_put(d, phys_to_reg(d, k), img[k]);
+            }
+        }
+
+        for (int k = lo; k <= hi; ++k) {
+            if (pm[k]) {
+                out[k] = known[k] ? (uint8_t)((img[k] & ~pm[k]) | (pv[k] & pm[k])) : pv[k];
+                changed[k] = !known[k] || out[k] != img[k];
+            } else {
+                out[k] = img[k];    // only read when known[k]
+                changed[k] = false;
+            }
+        }
+
+        int k = lo;
+        while (k <= hi) {
+            if (!changed[k]) {
+                k++;
+                continue;
+            }
+            int s = k;
+            int e = k;
+            for (int j = e + 1; j <= hi; ++j) {
+                if (changed[j]) {
+                    e = j;
+                    continue;
+                }
+                if (!known[j] || j - e > MCP_WRITE_GAP_MAX) break;
+            }
+            done[n_done++] = (mcp_run_t){ .start = (uint8_t)s, .len = (uint8_t)(e - s + 1) };
+            rc = xfer_write(d, (uint8_t)s, &out[s], (size_t)(e - s + 1));
+            if (rc != ESP_OK) goto fail;
+            for (int j = s; j <= e; ++j) img_put(d, phys_to_reg(d, j), out[j]);
+            k = e + 1;
+        }
+        p = lo - 1;
+    }
+    return ESP_OK;
+
+fail:
+    // Best effort: put back what this batch already wrote (the failed run
+    // included, it may have landed partially). Runs written without a prior
+    // read have no image and stay as written.
+    d->stats.rollbacks++;
+    for (size_t r = 0; r < n_done; ++r) {
+        bool restorable = true;
+        for (int k = done[r].start; k < done[r].start + done[r].len; ++k) {
+            if (!known[k]) restorable = false;
+        }
+        if (restorable) (void)xfer_write(d, done[r].start, &img[done[r].start], done[r].len);
+    }
+    d->iocon_valid = false;
+    return rc;
+}
+
+esp_err_t mcp_dev_update(mcp23017_dev_t *d, const mcp23017_reg_change_t *chg, size_t n, uint32_t flags)
+{
+    if (!chg && n) return ESP_ERR_INVALID_ARG;
+
+    uint8_t mask[MCP_REG_COUNT] = {0};
+    uint8_t val[MCP_REG_COUNT] = {0};
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t reg = chg[i].reg;
+        if (reg >= MCP_REG_COUNT) return ESP_ERR_INVALID_ARG;
+        uint8_t kind = reg >> 1;
+        if (kind == MCP_KIND_GPIO) {
+            reg = (uint8_t)(MCP_REG_OLATA + (reg & 1));     // GPIO writes land in OLAT anyway
+        } else if (kind == MCP_KIND_IOCON || kind == MCP_KIND_INTF || kind == MCP_KIND_INTCAP) {
+            return ESP_ERR_INVALID_ARG;     // IOCON has its own path; INTF/INTCAP are read-only
+        }
+        val[reg] = (uint8_t)((val[reg] & ~chg[i].mask) | (chg[i].value & chg[i].mask));
+        mask[reg] |= chg[i].mask;
+    }
+
+    // Resolve imaged registers: unchanged ones drop out, the rest become
+    // whole-byte writes that need no read
+    bool any = false;
+    for (uint8_t reg = 0; reg < MCP_REG_COUNT; ++reg) {
+        if (!mask[reg]) continue;
+        if (!(flags & MCP_CFG_NO_CACHE) && (d->img_valid & (1u << reg))) {
+            uint8_t v = (uint8_t)((d->img[reg] & ~mask[reg]) | (val[reg] & mask[reg]));
+            if (v == d->img[reg]) {
+                mask[reg] = 0;
+                d->stats.cache_skips++;
+                continue;
+            }
+            mask[reg] = 0xFF;
+            val[reg] = v;
+        }
+        any = true;
+    }
+    if (!any) return ESP_OK;
+
+    if (!d->iocon_valid) {
+        esp_err_t rc = mcp_dev_load_iocon(d);
+        if (rc != ESP_OK) return rc;
+    }
+
+    bool batch = !(flags & MCP_CFG_NO_BATCH);
+    bool forced = false;
+    uint8_t saved = d->iocon;
+    if (batch && (d->iocon & MCP_IOCON_SEQOP)) {
+        if (flags & MCP_CFG_FORCE_SEQOP) {
+            esp_err_t rc = mcp_dev_write_iocon(d, (uint8_t)(saved & ~MCP_IOCON_SEQOP));
+            if (rc != ESP_OK) return rc;
+            forced = true;
+        } else {
+            batch = false;
+        }
+    }
+
+    esp_err_t rc = batch ? update_windows(d, mask, val, !(flags & MCP_CFG_NO_CACHE)) : update_each(d, mask, val);
+    if (rc != ESP_OK) d->img_valid = 0;
+    if (forced) {
+        esp_err_t rc_restore = mcp_dev_write_iocon(d, saved);
+        if (rc == ESP_OK) rc = rc_restore;
+    }
+    return rc;
+}
@@ -0,0 +1,39 @@
+// mcp23017_priv.h
+// Batched register engine shared by MCP23017.c and the host mock build.
+// Nothing here locks: callers serialize access to a device (MCP23017.c holds
+// the handle mutex around every call).
+
+#pragma once
+
+#include "esp_err.h"
+#include "driver/i2c_master.h"
+#include "mcp23017_regs.h"
+
+typedef struct {
+    i2c_master_dev_handle_t i2c;
+    uint8_t addr;
+    uint8_t iocon;          // cached IOCON; selects the register layout
+    bool iocon_valid;       // false until read, and again after a failed batch
+    uint8_t img[MCP_REG_COUNT];     // last known value per logical register
+    uint32_t img_valid;     // bit per logical register; never set for INTF/INTCAP/GPIO/IOCON
+    mcp23017_stats_t stats;
+} mcp23017_dev_t;
+
+// Read IOCON and work out which layout the device is in (BANK is not known
+// up front, so this probes the IOCON location of both layouts)
+esp_err_t mcp_dev_load_iocon(mcp23017_dev_t *d);
+
+// Write IOCON at its current location and update the cache
+esp_err_t mcp_dev_write_iocon(mcp23017_dev_t *d, uint8_t iocon);
+
+// Device address of a logical register in the cached layout
+uint8_t mcp_dev_phys(const mcp23017_dev_t *d, uint8_t reg);
+
+// Read logical registers [reg, reg + len) with the fewest transfers the
+// layout allows (one in BANK=0, one per port in BANK=1)
+esp_err_t mcp_dev_read(mcp23017_dev_t *d, uint8_t reg, uint8_t *buf, size_t len);
+
+// Apply masked changes as windowed read-modify-write (see mcp23017_batch.c).
+// Registers held in the image are resolved without a read and dropped when
+// unchanged, unless flags has MCP_CFG_NO_CACHE.
+esp_err_t mcp_dev_update(mcp23017_dev_t *d, const mcp23017_reg_change_t *chg, size_t n, uint32_t flags);
@@ -24,6 +24,9 @@ static void dispatcher_module_ptr_task(void *arg) {
         /* compute period and timeout if periodic stepping is enabled */
         if (module->step_ms > 0) {
             period = pdMS_TO_TICKS(module->step_ms);
+            /* step_ms below one tick would give a zero period and never
+             * advance next_step; run such modules once per tick instead */
+            if (period == 0) period = 1;
             if (module->next_step == 0) {
                 module->next_step = xTaskGetTickCount() + period;
             }
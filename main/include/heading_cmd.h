@@ -0,0 +1,68 @@
+#ifndef HEADING_CMD_H
+#define HEADING_CMD_H
+
+#include <stdint.h>
+
+/*
+ * Messages accepted on TARGET_HEADING_CMD (consumed by the heading controller,
+ * see docs/io_heading_control.md; not implemented yet, so nothing registers
+ * the target and these are dropped). data[0] is always the message kind.
+ * Angles follow the controller convention: radians x1000, CCW positive,
+ * relative to the robot's forward axis.
+ */
+typedef enum {
+    HEADING_CMD_KIND_STEER = 1,     // heading_cmd_steer_t (obstacle avoidance)
+    HEADING_CMD_KIND_ODOM  = 2,     // heading_cmd_odom_t (scan-match odometry)
+    HEADING_CMD_KIND_LINE  = 3,     // heading_cmd_line_t (line following)
+} heading_cmd_kind_t;
+
+#define HEADING_CMD_FLAG_BLOCKED  0x01  // no free direction; stop
+#define HEADING_CMD_FLAG_STALE    0x02  // sensor data too old to trust
+
+typedef struct __attribute__((packed)) {
+    uint8_t  kind;              // HEADING_CMD_KIND_STEER
+    uint8_t  flags;             // HEADING_CMD_FLAG_*
+    int16_t  heading_mrad;      // desired heading relative to forward
+    uint16_t speed_scale_q8;    // forward speed scale, 256 = full
+    uint32_t seq;
+} heading_cmd_steer_t;
+
+/* Pose increment since the previous odometry message, expressed in the
+ * previous robot frame (x forward, y left). */
+#define HEADING_CMD_ODOM_FLAG_KEYFRAME  0x01  // reference keyframe was replaced
+#define HEADING_CMD_ODOM_FLAG_LOST      0x02  // match failed; increment is zero
+
+typedef struct __attribute__((packed)) {
+    uint8_t  kind;              // HEADING_CMD_KIND_ODOM
+    uint8_t  flags;             // HEADING_CMD_ODOM_FLAG_*
+    int16_t  dx_mm;
+    int16_t  dy_mm;
+    int16_t  dtheta_mrad;
+    uint16_t inliers;           // matched points
+    uint16_t rms_mm;            // point-to-line residual
+    uint32_t frame_seq;         // LIDAR frame the estimate belongs to
+} heading_cmd_odom_t;
+
+/* Lateral line position under the sensor bar. Errors are Q15 fractions of
+ * the bar half-width (±32767 = line under an outermost sensor), positive
+ * when the line is left of centre, so a positive error asks for a CCW turn. */
+#define HEADING_CMD_LINE_FLAG_LOST          0x01  // no sensor sees the line; error holds the side it left on
+#define HEADING_CMD_LINE_FLAG_INTERSECTION  0x02  // (nearly) all sensors on the line; error held
+#define HEADING_CMD_LINE_FLAG_FORK          0x04  // more than one line segment under the bar
+#define HEADING_CMD_LINE_FLAG_STALE         0x08  // lost for longer than the hold time
+#define HEADING_CMD_LINE_FLAG_NO_CURVATURE  0x10  // forward speed unknown or too low; curvature is 0
+
+typedef struct __attribute__((packed)) {
+    uint8_t  kind;              // HEADING_CMD_KIND_LINE
+    uint8_t  flags;             // HEADING_CMD_LINE_FLAG_*
+    int16_t  error_q15;         // smoothed lateral error
+    int16_t  raw_q15;           // this sample's centroid
+    uint8_t  confidence;        // 0..255
+    uint8_t  pattern;           // sensor byte, channel 0 in the MSB
+    uint32_t seq;
+    int16_t  rate_mm_s;         // lateral drift of the line, from transition timing
+    int16_t  curvature_mpm;     // line curvature relative to the robot's path, 1/km (CCW positive)
+    uint32_t t_us;              // sample time of the last transition (esp_timer, low 32 bits)
+} heading_cmd_line_t;
+
+#endif // HEADING_CMD_H
@@ -1,9 +1,39 @@
 #pragma once
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// SOURCE_MCP23017 messages start with a kind byte
+#define IO_MCP_MSG_ENCODER      1
+#define IO_MCP_MSG_PORT_EVENT   2
+
+// Rotary encoder state, sent to TARGET_LOG on the streaming pool: at most
+// one message per ISR worker pass, when the count, invalid-transition count
+// or switch changed during it, and once more when the knob stops (velocity 0)
+typedef struct __attribute__((packed)) {
+    uint8_t kind;           // IO_MCP_MSG_ENCODER
+    int32_t count;          // accumulated quadrature steps (4 per detent cycle), clockwise positive
+    int16_t delta;          // steps since the previous message (saturating)
+    int16_t velocity;       // steps/s, signed
+    uint16_t invalid;       // transitions where both lines changed between samples (wraps)
+    uint8_t pressed;        // push switch, 1 = pressed
+} io_mcp_encoder_msg_t;
+
+// Interrupt on an expander port without a dedicated handler. Expanders are
+// numbered by address (0x20 + expander).
+typedef struct __attribute__((packed)) {
+    uint8_t kind;           // IO_MCP_MSG_PORT_EVENT
+    uint8_t expander;
+    uint8_t port;           // 0 = A, 1 = B
+    uint8_t intf;           // pins that raised the interrupt
+    uint8_t intcap;         // port at the first edge
+    uint8_t level;          // port when read
+    int64_t t_us;           // esp_timer time of the read
+} io_mcp_port_event_t;
+
 // Start the MCP23017 plugin task (non-blocking)
 void io_MCP23017_init(void);
 
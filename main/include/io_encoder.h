@@ -0,0 +1,78 @@
+#ifndef IO_ENCODER_H
+#define IO_ENCODER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "dispatcher.h"
+
+/*
+ * Wheel encoders (docs/io_encoder.md). Each AB Hall encoder feeds a PCNT
+ * unit with two channels, so every edge of A and B is counted (4 x PPR per
+ * motor revolution) and glitches shorter than the filter are dropped. The
+ * driver accumulates past the 16-bit hardware limits; differences are taken
+ * modulo 2^32 so the running count may wrap.
+ *
+ * A gptimer alarm latches both counts at the same instant every
+ * CONFIG_ENCODER_SAMPLE_MS. At speed, velocity is counts per window. Below
+ * IO_ENCODER_PERIOD_COUNTS per window the A-edge interrupt is enabled and
+ * velocity comes from the time between the last two A edges instead, which
+ * keeps resolution down to a crawl; the edge interrupt is off again once the
+ * wheel is fast.
+ *
+ * About every 100 ms (every window if the window is longer) the module
+ * publishes the robot's forward speed and yaw rate to the LIDAR de-skew (LIDAR_DESKEW_CTRL_ODOM) and the forward speed to the
+ * line position estimator (LINE_POSITION_CMD_SPEED).
+ *
+ * The latest sample of each wheel is also kept in a lock-free mailbox
+ * (io_encoder_latest) for control loops that must not wait on a queue.
+ *
+ * For bench tests with no motor attached, a synthetic quadrature generator
+ * drives the encoder pins themselves (input+output mode, so PCNT sees the
+ * generated levels): IO_ENCODER_CMD_SYNTH on TARGET_ENCODER, or
+ * CONFIG_ENCODER_SYNTH_RPM at boot. While it runs, every sample is also sent
+ * to TARGET_LOG.
+ */
+#define IO_ENCODER_LEFT             0
+#define IO_ENCODER_RIGHT            1
+#define IO_ENCODER_COUNT            2
+
+#define IO_ENCODER_PERIOD_COUNTS    16      // below this per window: period measurement
+
+#define IO_ENCODER_FLAG_PERIOD      0x01    // velocity from A-edge period
+#define IO_ENCODER_FLAG_STOPPED     0x02    // no edge for IO_ENCODER_STOP_MS
+#define IO_ENCODER_FLAG_SYNTH       0x04    // synthetic generator running on this wheel
+
+#define IO_ENCODER_STOP_MS          500
+
+/* One wheel, one sample window (SOURCE_ENCODER). The first four fields are
+   the encoder_msg of the design doc. Positive is forward for both wheels. */
+typedef struct __attribute__((packed)) {
+    uint8_t  id;                // IO_ENCODER_LEFT / IO_ENCODER_RIGHT
+    int32_t  counts;            // signed counts in the window
+    int32_t  motor_rpm_x100;
+    int32_t  wheel_rpm_x100;
+    int32_t  total;             // running count (wraps)
+    uint8_t  flags;             // IO_ENCODER_FLAG_*
+    int64_t  t_us;              // esp_timer time the counts were latched
+} io_encoder_msg_t;
+
+/* Commands accepted on TARGET_ENCODER (msg->data[0]) */
+typedef enum {
+    IO_ENCODER_CMD_SYNTH = 1,   // io_encoder_synth_t follows
+} io_encoder_cmd_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  cmd;               // IO_ENCODER_CMD_SYNTH
+    uint8_t  id;                // wheel; 0xFF = both
+    int16_t  motor_rpm;         // signed, 0 stops the generator for this wheel
+} io_encoder_synth_t;
+
+void io_encoder_init(void);
+
+/* Copy the newest sample of a wheel. Never blocks: a reader racing the
+   sample task retries the copy. seq (optional) increments once per sample,
+   so a caller can tell a new sample from one it has seen; 0 means none yet.
+   Returns false for a bad id or before the first sample. */
+bool io_encoder_latest(uint8_t id, io_encoder_msg_t *out, uint32_t *seq);
+
+#endif // IO_ENCODER_H
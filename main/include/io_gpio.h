@@ -16,7 +16,6 @@ void setup_button(void);
 void setup_line_sensor(void);
 void io_gpio_event_task(void *arg);
 void button_gpio_isr(void *arg);
-void line_sensor_gpio_isr(void *arg);
 bool io_gpio_get_state(gpio_num_t gpio_num);
 void setup_test_led(void);
 
@@ -32,6 +31,14 @@ typedef struct {
     dispatch_source_t source_id;
     dispatch_target_t target_id[TARGET_MAX];
     uint8_t state;
+    int64_t t_us;       // esp_timer time the state was first seen
 } gpio_isr_msg_t;
 
+/* Payload of SOURCE_LINE_SENSOR messages from the sampler. The state byte
+   comes first, so readers that only look at data[0] are unaffected. */
+typedef struct __attribute__((packed)) {
+    uint8_t state;
+    int64_t t_us;       // first sample showing this state
+} io_gpio_line_event_t;
+
 bool io_gpio_get_state(gpio_num_t gpio_num);
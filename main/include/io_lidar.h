@@ -1,8 +1,23 @@
 #ifndef IO_LIDAR_H
 #define IO_LIDAR_H
 
+#include <stdint.h>
 #include "dispatcher.h"
 
+// RX chunks sent to TARGET_LIDAR_COORD carry the esp_timer time at which
+// their last byte was received, packed into msg->context as the low 32 bits
+// (wraps every ~71 min; unpacked relative to the receiver's clock).
+static inline void *io_lidar_stamp_pack(int64_t t_us) {
+    uint32_t lo = (uint32_t)t_us;
+    return (void *)(uintptr_t)(lo ? lo : 1);   // NULL means "not stamped"
+}
+
+static inline int64_t io_lidar_stamp_unpack(const void *ctx, int64_t now_us) {
+    if (!ctx) return now_us;
+    uint32_t age = (uint32_t)now_us - (uint32_t)(uintptr_t)ctx;
+    return now_us - age;
+}
+
 // Initialize UART hardware + register dispatcher handler
 void io_lidar_init(void);
 
@@ -0,0 +1,55 @@
+#ifndef IO_MOTOR_CONTROL_H
+#define IO_MOTOR_CONTROL_H
+
+#include <stdint.h>
+#include "dispatcher.h"
+
+/*
+ * Closed-loop wheel speed control (docs/io_motor_control.md). A task pinned
+ * to MOTOR_CONTROL_CORE runs every 1 / CONFIG_MOTOR_CONTROL_LOOP_HZ with
+ * xTaskDelayUntil:
+ *
+ *   - the commanded wheel speed is shaped into a jerk- and acceleration-
+ *     limited reference (S-curve),
+ *   - a fixed-point PI(D) with feed-forward turns reference minus measured
+ *     speed into a signed duty; the integrator stops while the output is
+ *     saturated in the direction of the error (anti-windup),
+ *   - |duty| goes to the LEDC PWM pin of each motor, the sign to its IN1/IN2
+ *     bits on the MCP23017 (io_MCP23017, TARGET_MOTOR_DRIVER).
+ *
+ * Speed is measured from the encoders' lock-free mailbox (io_encoder_latest),
+ * never from a queue, so the loop cannot block on feedback. The PID advances
+ * when a new encoder sample arrives; the reference, watchdog and direction
+ * sequencing advance every tick.
+ *
+ * Direction changes are interlocked: the motor's duty is forced to 0 for
+ * MOTOR_CONTROL_DIR_SWITCH_MS, then the direction bits of both motors and the
+ * enable bit go out in one masked message, so they land in one OLAT write.
+ *
+ * Without a command for CONFIG_MOTOR_CMD_TIMEOUT_MS both motors stop at once
+ * (duty 0, coast).
+ */
+#define MOTOR_CONTROL_LEFT          0
+#define MOTOR_CONTROL_RIGHT         1
+#define MOTOR_CONTROL_COUNT         2
+
+#define MOTOR_CONTROL_CORE          1
+#define MOTOR_CONTROL_DIR_SWITCH_MS 30
+
+/* Commands accepted on TARGET_MOTOR_CONTROL (msg->data[0]) */
+typedef enum {
+    MOTOR_CONTROL_CMD_SPEED = 1,    // motor_control_speed_t follows
+    MOTOR_CONTROL_CMD_STOP  = 2,    // immediate stop, no ramp
+} motor_control_cmd_t;
+
+/* Wheel surface speeds, positive forward. Resend faster than the command
+   timeout to keep moving. */
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;            // MOTOR_CONTROL_CMD_SPEED
+    int16_t left_mm_s;
+    int16_t right_mm_s;
+} motor_control_speed_t;
+
+void io_motor_control_init(void);
+
+#endif // IO_MOTOR_CONTROL_H
@@ -0,0 +1,41 @@
+#ifndef MOD_LINE_POSITION_H
+#define MOD_LINE_POSITION_H
+
+#include <stdint.h>
+#include "dispatcher.h"
+
+/*
+ * Line position estimator. Every line sensor state (SOURCE_LINE_SENSOR) is
+ * turned into a lateral error through a 256-entry table built at init
+ * (centroid, confidence and shape flags per pattern), smoothed with a
+ * confidence-weighted EMA and published to TARGET_HEADING_CMD as a
+ * heading_cmd_line_t. The sampler only reports changes, so the last
+ * estimate is repeated every LINE_POSITION_HEARTBEAT_MS when the line is
+ * steady under the bar.
+ *
+ * Channel 0 (pins[0] in io_gpio, the MSB of the sensor byte) is taken as
+ * the leftmost sensor.
+ *
+ * Each transition carries the sampler timestamp, so the time between
+ * centroid steps gives the lateral drift rate of the line. Its change over
+ * time divided by v^2 is the line's curvature relative to the robot's own
+ * path: the steering feed-forward term. That needs the forward speed, sent
+ * by odometry as LINE_POSITION_CMD_SPEED.
+ */
+#define LINE_POSITION_CHANNELS       8
+#define LINE_POSITION_PITCH_MM       10     // centre-to-centre sensor spacing
+#define LINE_POSITION_HEARTBEAT_MS   20
+
+/* Commands accepted on TARGET_LINE_POSITION from other sources (msg->data[0]) */
+typedef enum {
+    LINE_POSITION_CMD_SPEED = 1,    // line_position_speed_t follows
+} line_position_cmd_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;            // LINE_POSITION_CMD_SPEED
+    int16_t v_mm_s;         // forward speed
+} line_position_speed_t;
+
+void mod_line_position_init(void);
+
+#endif // MOD_LINE_POSITION_H
@@ -0,0 +1,54 @@
+#ifndef MOD_OCCUPANCY_GRID_H
+#define MOD_OCCUPANCY_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dispatcher.h"
+
+/*
+ * Rolling local occupancy grid built from LIDAR scan frames.
+ * 256 x 256 int8 log-odds cells at 20 mm (5.12 m square), robot-centred.
+ * The window scrolls with the robot pose; cells that leave the window are
+ * cleared as the opposite edge enters.
+ */
+#define OCC_GRID_DIM      256
+#define OCC_GRID_CELL_MM  20
+
+/* Commands accepted on TARGET_OCCUPANCY_GRID (msg->data[0]) */
+typedef enum {
+    OCC_GRID_CMD_POSE_DELTA = 1,   // occ_grid_pose_delta_t follows
+    OCC_GRID_CMD_CLEAR      = 2,   // reset all cells to unknown
+} occ_grid_cmd_t;
+
+/* Odometry increment in the robot frame (x forward, y left, theta CCW) */
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;            // OCC_GRID_CMD_POSE_DELTA
+    int16_t dx_mm;
+    int16_t dy_mm;
+    int16_t dtheta_mrad;
+} occ_grid_pose_delta_t;
+
+/* Cell classes used by the RLE export */
+#define OCC_GRID_CLASS_UNKNOWN  0
+#define OCC_GRID_CLASS_FREE     1
+#define OCC_GRID_CLASS_OCCUPIED 2
+
+/*
+ * GET /api/grid[?ds=1|2|4|8] returns this header followed by (count, class)
+ * byte pairs, row-major from the +y (left of start heading) edge, columns
+ * from -x to +x. count is 1..255.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t  magic[2];      // 'O','G'
+    uint8_t  version;       // 1
+    uint8_t  downsample;    // cells per exported pixel edge
+    uint16_t width;
+    uint16_t height;
+    uint16_t cell_mm;       // exported pixel size
+    uint32_t frame_seq;     // last integrated scan frame
+    int16_t  heading_mrad;  // robot heading in grid frame
+} occ_grid_export_hdr_t;
+
+void mod_occupancy_grid_init(void);
+
+#endif // MOD_OCCUPANCY_GRID_H
@@ -0,0 +1,57 @@
+#ifndef MOD_SCAN_FEATURES_H
+#define MOD_SCAN_FEATURES_H
+
+#include <stdint.h>
+#include "dispatcher.h"
+
+/*
+ * Line and corner extraction from assembled LIDAR frames. Bins are already
+ * angle-ordered, so points are segmented at range breaks and split-and-merge
+ * runs directly on that order. Results go to TARGET_SSE_LIDAR_FEATURES on
+ * the streaming pool as packed binary chunks (header, lines, corners), as
+ * many per frame as the streaming payload size needs. Lines come first,
+ * then corners; a client rebuilds the frame's lists from first_line /
+ * first_corner and knows it has them all once n_chunks chunks with the same
+ * frame_seq arrived.
+ *
+ * Coordinates are robot frame: x forward, y left, mm.
+ */
+#define SCAN_FEATURES_MAX_LINES    32
+#define SCAN_FEATURES_MAX_CORNERS  16
+
+#define SCAN_FEATURES_FLAG_TRUNCATED 0x01   // a line or corner was dropped: MAX_LINES/MAX_CORNERS was full
+
+typedef struct __attribute__((packed)) {
+    uint32_t frame_seq;
+    uint8_t  n_lines;           // lines in this chunk
+    uint8_t  n_corners;         // corners in this chunk
+    uint8_t  flags;             // SCAN_FEATURES_FLAG_*, same in every chunk
+    uint8_t  chunk;             // 0 .. n_chunks - 1
+    uint8_t  n_chunks;
+    uint8_t  first_line;        // frame index of this chunk's first line
+    uint8_t  first_corner;      // frame index of this chunk's first corner
+    uint8_t  lines_total;       // lines in the frame
+    uint8_t  corners_total;     // corners in the frame
+    uint16_t extract_us;
+} scan_features_hdr_t;
+
+/* Line in Hessian form (alpha = normal angle, rho = origin distance) with
+ * endpoints for drawing. Covariance is of (rho, alpha). */
+typedef struct __attribute__((packed)) {
+    int16_t  x0_mm, y0_mm;
+    int16_t  x1_mm, y1_mm;
+    uint16_t var_rho;           // mm^2, saturating
+    uint16_t var_alpha;         // mrad^2, saturating
+    int16_t  cov_rho_alpha;     // mm*mrad, saturating
+    uint8_t  n_points;
+} scan_feature_line_t;
+
+typedef struct __attribute__((packed)) {
+    int16_t  x_mm, y_mm;
+    uint16_t angle_mrad;        // angle between the two lines
+    uint8_t  line_a, line_b;    // indices into the line list
+} scan_feature_corner_t;
+
+void mod_scan_features_init(void);
+
+#endif // MOD_SCAN_FEATURES_H
@@ -0,0 +1,73 @@
+#ifndef MOD_SCAN_LOG_H
+#define MOD_SCAN_LOG_H
+
+#include <stdint.h>
+#include "dispatcher.h"
+
+/*
+ * On-device scan recorder. Assembled frames are encoded (lidar_scan_codec,
+ * lossless) into a PSRAM staging ring by the module task; a low-priority
+ * writer task drains whole blocks to /data/lidar/scan_NNNN.bin, so every
+ * fwrite is one block at a block-aligned file offset and the scan path never
+ * waits on flash. Frames are dropped (and counted) if the ring is full.
+ *
+ * File layout (little endian):
+ *   scan_log_file_hdr_t
+ *   records: scan_log_rec_hdr_t + rec.len bytes of codec data
+ *   index:   scan_log_index_t x footer.index_count  (every Nth record)
+ *   scan_log_footer_t                               (last 16 bytes)
+ * A file cut short by power loss has no footer; readers then walk the
+ * records from the header. tools/lidar_log_reader.py reads both.
+ *
+ * Control: send SCAN_LOG_CMD_* in data[0] to TARGET_SCAN_LOG.
+ */
+#define SCAN_LOG_DIR            "/data/lidar"
+#define SCAN_LOG_MAGIC          0x4E43534Cu     // "LSCN"
+#define SCAN_LOG_REC_MAGIC      0x5346u         // "FS"
+#define SCAN_LOG_FOOTER_MAGIC   0x5844494Cu     // "LIDX"
+#define SCAN_LOG_VERSION        1
+
+#define SCAN_LOG_BLOCK_SIZE     (16 * 1024)     // fwrite unit, multiple of the FAT sector
+#define SCAN_LOG_BLOCK_COUNT    6               // staging ring: 96 KB
+#define SCAN_LOG_INDEX_EVERY    10              // index entry per N records
+#define SCAN_LOG_INDEX_MAX      4096
+
+#define SCAN_LOG_CMD_STOP       0
+#define SCAN_LOG_CMD_START      1               // close any open file, start a new one
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // SCAN_LOG_MAGIC
+    uint16_t version;
+    uint16_t hdr_size;          // sizeof(scan_log_file_hdr_t)
+    uint16_t bins;              // LIDAR_SCAN_BINS (bin -> angle = bin * 360 / bins)
+    uint8_t  q_shift;           // distance quantum, 0 = mm
+    uint8_t  reserved;
+    uint32_t start_ms;          // ms since boot at file open
+    uint8_t  pad[16];
+} scan_log_file_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;             // SCAN_LOG_REC_MAGIC
+    uint16_t len;               // codec bytes following this header
+    uint32_t seq;               // lidar_scan_frame_t.seq
+    uint32_t t_ms;              // frame end, ms since boot
+    uint16_t rpm_x10;           // lidar_motor_rpm_x10() when recorded
+    uint16_t count;             // encoded points
+} scan_log_rec_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t t_ms;
+    uint32_t offset;            // file offset of the record header
+} scan_log_index_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // SCAN_LOG_FOOTER_MAGIC
+    uint32_t index_count;
+    uint32_t index_offset;
+    uint32_t record_count;
+} scan_log_footer_t;
+
+void mod_scan_log_init(void);
+
+#endif // MOD_SCAN_LOG_H
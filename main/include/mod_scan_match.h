@@ -0,0 +1,17 @@
+#ifndef MOD_SCAN_MATCH_H
+#define MOD_SCAN_MATCH_H
+
+#include "dispatcher.h"
+
+/*
+ * Scan-to-keyframe ICP odometry. Each assembled LIDAR frame is registered
+ * against the current keyframe (polar correlative rotation search, then
+ * point-to-line Gauss-Newton). The frame-to-frame increment is published to
+ * TARGET_HEADING_CMD (heading_cmd_odom_t) and to TARGET_OCCUPANCY_GRID as a
+ * pose delta.
+ */
+#define SCAN_MATCH_MIN_PERIOD_MS  100   // cap at 10 Hz regardless of LIDAR rate
+
+void mod_scan_match_init(void);
+
+#endif // MOD_SCAN_MATCH_H
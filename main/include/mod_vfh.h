@@ -0,0 +1,35 @@
+#ifndef MOD_VFH_H
+#define MOD_VFH_H
+
+#include <stdint.h>
+#include "dispatcher.h"
+
+/*
+ * VFH+ obstacle avoidance. The polar histogram is updated per LIDAR point
+ * (via lidar_scan point sink) and per ultrasonic reading; bins not seen
+ * again within two rotations are dropped, so obstacles that left the view
+ * do not linger. A steering direction is chosen every VFH_STEP_MS and
+ * published to TARGET_HEADING_CMD.
+ *
+ * TARGET_HEADING_CMD is the input of the heading controller designed in
+ * docs/io_heading_control.md, which is not implemented yet; until it is,
+ * nothing registers the target and the commands are dropped by the
+ * dispatcher. Wheel speeds are commanded on TARGET_MOTOR_CONTROL
+ * (io_motor_control.h).
+ */
+#define VFH_SECTORS   72      // 5° per sector, clockwise from forward (LIDAR order)
+#define VFH_STEP_MS   50
+
+/* Commands accepted on TARGET_VFH (msg->data[0]) */
+typedef enum {
+    VFH_CMD_SET_GOAL = 1,   // vfh_goal_t follows
+} vfh_cmd_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;            // VFH_CMD_SET_GOAL
+    int16_t goal_mrad;      // goal direction relative to forward, CCW positive
+} vfh_goal_t;
+
+void mod_vfh_init(void);
+
+#endif // MOD_VFH_H
@@ -7,6 +7,8 @@
 #include "io_ultrasonic.h"
 #include "io_gpio.h"
 #include "io_MCP23017.h"
+#include "io_encoder.h"
+#include "io_motor_control.h"
 #include "io_lidar.h"
 #include "lidar_coordinator.h"
 #include "io_rgb.h"
@@ -16,6 +18,12 @@
 #include "io_log.h"
 #include "io_wifi_ap.h"
 #include "mod_line_sensor_window.h"
+#include "mod_line_position.h"
+#include "mod_occupancy_grid.h"
+#include "mod_vfh.h"
+#include "mod_scan_match.h"
+#include "mod_scan_features.h"
+#include "mod_scan_log.h"
 #include "mcp23017_test.h"
 #include "io_i2c_oled.h"
 #include "driver/gpio.h"
@@ -49,11 +57,19 @@ void app_main(void)
     io_gpio_init();
     io_ultrasonic_init();
     mod_line_sensor_window_init();
+    mod_line_position_init();
     io_lidar_init();
     lidar_coordinator_init();
+    mod_occupancy_grid_init();
+    mod_vfh_init();
+    mod_scan_match_init();
+    mod_scan_features_init();
+    mod_scan_log_init();
     io_wifi_ap_init();
     io_battery_init();
     io_MCP23017_init();
+    io_encoder_init();
+    io_motor_control_init();
     mcp23017_test_start();
 
     /* Initialize I2C OLED example (reuses existing I2C bus if present) */
@@ -0,0 +1,187 @@
+// lidar_caps.c
+// Capability discovery sequence (see lidar_caps.h)
+
+#include <string.h>
+#include "lidar_caps.h"
+#include "lidar_message_builder.h"
+#include "lidar_protocol_cmd.h"
+#include "esp_log.h"
+
+static const char *TAG = "lidar_caps";
+
+typedef enum {
+    CAPS_IDLE = 0,
+    CAPS_HEALTH,
+    CAPS_MODE_COUNT,
+    CAPS_TYPICAL,
+    CAPS_SAMPLETIME,        // per-mode steps, repeated for each mode id
+    CAPS_MAX_DIST,
+    CAPS_ANS_TYPE,
+    CAPS_NAME,
+} caps_step_t;
+
+static lidar_caps_t caps;
+static caps_step_t caps_step = CAPS_IDLE;
+static uint16_t caps_mode = 0;          // mode id of the pending per-mode query
+
+static uint16_t caps_modes_known(void)
+{
+    return caps.mode_count < LIDAR_CAPS_MAX_MODES ? caps.mode_count : LIDAR_CAPS_MAX_MODES;
+}
+
+static size_t caps_build(uint8_t *out_buf, size_t buf_size)
+{
+    switch (caps_step) {
+    case CAPS_HEALTH:     return lidar_build_by_idx(out_buf, buf_size, LIDAR_CMD_IDX_GET_HEALTH);
+    case CAPS_MODE_COUNT: return lidar_build_by_idx(out_buf, buf_size, LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_COUNT);
+    case CAPS_TYPICAL:    return lidar_build_by_idx(out_buf, buf_size, LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_TYPICAL);
+    case CAPS_SAMPLETIME: return lidar_build_conf_mode(out_buf, buf_size, LIDAR_CONF_SCAN_MODE_SAMPLETIME, caps_mode);
+    case CAPS_MAX_DIST:   return lidar_build_conf_mode(out_buf, buf_size, LIDAR_CONF_SCAN_MODE_MAX_DIST, caps_mode);
+    case CAPS_ANS_TYPE:   return lidar_build_conf_mode(out_buf, buf_size, LIDAR_CONF_SCAN_MODE_ANS_TYPE, caps_mode);
+    case CAPS_NAME:       return lidar_build_conf_mode(out_buf, buf_size, LIDAR_CONF_SCAN_MODE_NAME, caps_mode);
+    default:              return 0;
+    }
+}
+
+static void caps_log_summary(void)
+{
+    if (caps.health_valid) {
+        ESP_LOGI(TAG, "Health status %u, error 0x%04X", (unsigned)caps.health_status, (unsigned)caps.health_error);
+    }
+    if (!caps.conf_supported) {
+        ESP_LOGI(TAG, "GET_LIDAR_CONF not supported; using standard scan");
+        return;
+    }
+    for (uint16_t m = 0; m < caps_modes_known(); ++m) {
+        const lidar_scan_mode_caps_t *mc = &caps.modes[m];
+        ESP_LOGI(TAG, "Mode %u %-12s ans 0x%02X, %u.%02u us/sample, %u m%s", (unsigned)m, mc->name,
+                 (unsigned)mc->ans_type, (unsigned)(mc->us_per_sample_q8 >> 8),
+                 (unsigned)(((mc->us_per_sample_q8 & 0xFF) * 100) >> 8), (unsigned)(mc->max_dist_q8 >> 8),
+                 m == caps.typical_mode ? " (typical)" : "");
+    }
+    int best = lidar_caps_best_mode();
+    ESP_LOGI(TAG, "%u scan modes, selected %d", (unsigned)caps.mode_count, best);
+}
+
+// Move to the step after the current one and build its query (0 = finished)
+static size_t caps_advance(uint8_t *out_buf, size_t buf_size)
+{
+    switch (caps_step) {
+    case CAPS_HEALTH:
+        caps_step = CAPS_MODE_COUNT;
+        break;
+    case CAPS_MODE_COUNT:
+        caps_step = caps.conf_supported ? CAPS_TYPICAL : CAPS_IDLE;
+        break;
+    case CAPS_TYPICAL:
+        caps_mode = 0;
+        caps_step = caps_modes_known() > 0 ? CAPS_SAMPLETIME : CAPS_IDLE;
+        break;
+    case CAPS_SAMPLETIME:
+    case CAPS_MAX_DIST:
+    case CAPS_ANS_TYPE:
+        caps_step = (caps_step_t)(caps_step + 1);
+        break;
+    case CAPS_NAME:
+        caps_mode++;
+        caps_step = caps_mode < caps_modes_known() ? CAPS_SAMPLETIME : CAPS_IDLE;
+        break;
+    default:
+        caps_step = CAPS_IDLE;
+        break;
+    }
+    if (caps_step == CAPS_IDLE) {
+        caps_log_summary();
+        return 0;
+    }
+    return caps_build(out_buf, buf_size);
+}
+
+size_t lidar_caps_begin(uint8_t *out_buf, size_t buf_size)
+{
+    memset(&caps, 0, sizeof(caps));
+    caps_mode = 0;
+    caps_step = CAPS_HEALTH;
+    return caps_build(out_buf, buf_size);
+}
+
+size_t lidar_caps_on_response(uint8_t response_type, const void *parsed, uint8_t *out_buf, size_t buf_size)
+{
+    if (caps_step == CAPS_IDLE || !parsed) return 0;
+
+    if (caps_step == CAPS_HEALTH) {
+        if (response_type != LIDAR_RSP_TYPE_GET_HEALTH) return 0;
+        const lidar_health_response_t *h = (const lidar_health_response_t *)parsed;
+        caps.health_valid = true;
+        caps.health_status = h->status;
+        caps.health_error = h->error_code;
+        return caps_advance(out_buf, buf_size);
+    }
+
+    if (response_type != LIDAR_RSP_TYPE_GET_LIDAR_CONF) return 0;
+    const lidar_conf_response_t *c = (const lidar_conf_response_t *)parsed;
+    lidar_scan_mode_caps_t *mc = &caps.modes[caps_mode < LIDAR_CAPS_MAX_MODES ? caps_mode : 0];
+    switch (caps_step) {
+    case CAPS_MODE_COUNT:
+        if (c->type != LIDAR_CONF_SCAN_MODE_COUNT) return 0;
+        caps.conf_supported = true;
+        caps.mode_count = (uint16_t)c->value;
+        break;
+    case CAPS_TYPICAL:
+        if (c->type != LIDAR_CONF_SCAN_MODE_TYPICAL) return 0;
+        caps.typical_mode = (uint16_t)c->value;
+        break;
+    case CAPS_SAMPLETIME:
+        if (c->type != LIDAR_CONF_SCAN_MODE_SAMPLETIME) return 0;
+        mc->us_per_sample_q8 = c->value;
+        break;
+    case CAPS_MAX_DIST:
+        if (c->type != LIDAR_CONF_SCAN_MODE_MAX_DIST) return 0;
+        mc->max_dist_q8 = c->value;
+        break;
+    case CAPS_ANS_TYPE:
+        if (c->type != LIDAR_CONF_SCAN_MODE_ANS_TYPE) return 0;
+        mc->ans_type = (uint8_t)c->value;
+        break;
+    case CAPS_NAME:
+        if (c->type != LIDAR_CONF_SCAN_MODE_NAME) return 0;
+        memcpy(mc->name, c->name, sizeof(mc->name));
+        break;
+    default:
+        return 0;
+    }
+    return caps_advance(out_buf, buf_size);
+}
+
+size_t lidar_caps_on_timeout(uint8_t *out_buf, size_t buf_size)
+{
+    if (caps_step == CAPS_IDLE) return 0;
+    ESP_LOGW(TAG, "No answer to discovery step %d (mode %u); skipping", (int)caps_step, (unsigned)caps_mode);
+    return caps_advance(out_buf, buf_size);
+}
+
+bool lidar_caps_active(void)
+{
+    return caps_step != CAPS_IDLE;
+}
+
+const lidar_caps_t *lidar_caps_get(void)
+{
+    return &caps;
+}
+
+int lidar_caps_best_mode(void)
+{
+    int best = -1;
+    for (uint16_t m = 0; m < caps_modes_known(); ++m) {
+        const lidar_scan_mode_caps_t *mc = &caps.modes[m];
+        if (!LIDAR_CAPS_ANS_DECODABLE(mc->ans_type) || mc->us_per_sample_q8 == 0) continue;
+        if (best < 0 || mc->us_per_sample_q8 < caps.modes[best].us_per_sample_q8) best = m;
+    }
+    return best;
+}
+
+size_t lidar_caps_build_scan(uint8_t *out_buf, size_t buf_size)
+{
+    return lidar_build_by_idx(out_buf, buf_size, LIDAR_CMD_IDX_SCAN);
+}
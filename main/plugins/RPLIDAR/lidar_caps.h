@@ -0,0 +1,61 @@
+// lidar_caps.h
+// Boot-time capability discovery: health, then GET_LIDAR_CONF for the scan
+// mode count, typical mode and each mode's sample time, max distance, answer
+// type and name. Queries are issued one at a time by the coordinator; each
+// parsed answer (or timeout) yields the next command to send.
+
+#ifndef LIDAR_CAPS_H
+#define LIDAR_CAPS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lidar_protocol_rsp.h"
+#include "lidar_response_parser.h"
+
+#define LIDAR_CAPS_MAX_MODES   8
+#define LIDAR_CAPS_TIMEOUT_MS  300      // per query; older firmware ignores GET_LIDAR_CONF
+
+// Answer types the scan assembler can decode: standard scan only. Express
+// modes are discovered and logged but never started; there is no capsule
+// decoder.
+#define LIDAR_CAPS_ANS_DECODABLE(ans) ((ans) == LIDAR_RSP_TYPE_SCAN_STANDARD)
+
+typedef struct {
+    uint32_t us_per_sample_q8;  // 0 = unknown
+    uint32_t max_dist_q8;       // metres, Q8
+    uint8_t  ans_type;          // LIDAR_RSP_TYPE_SCAN_*
+    char     name[LIDAR_CONF_NAME_MAX];
+} lidar_scan_mode_caps_t;
+
+typedef struct {
+    bool     health_valid;
+    uint8_t  health_status;     // LIDAR_HEALTH_STATUS_*
+    uint16_t health_error;
+    bool     conf_supported;    // sensor answered GET_LIDAR_CONF
+    uint16_t mode_count;        // modes reported (may exceed LIDAR_CAPS_MAX_MODES)
+    uint16_t typical_mode;
+    lidar_scan_mode_caps_t modes[LIDAR_CAPS_MAX_MODES];
+} lidar_caps_t;
+
+// Reset and build the first query. Returns the command length.
+size_t lidar_caps_begin(uint8_t *out_buf, size_t buf_size);
+
+// Record a parsed response and build the next query. Returns 0 when discovery
+// is finished (or was not running); lidar_caps_active() tells which.
+size_t lidar_caps_on_response(uint8_t response_type, const void *parsed, uint8_t *out_buf, size_t buf_size);
+
+// The pending query went unanswered: skip ahead. Same return as above.
+size_t lidar_caps_on_timeout(uint8_t *out_buf, size_t buf_size);
+
+bool lidar_caps_active(void);
+const lidar_caps_t *lidar_caps_get(void);
+
+// Fastest decodable (standard) mode, whose sample time the assembler uses,
+// or -1 if none is known
+int lidar_caps_best_mode(void);
+
+// Build the command that starts scanning: always a standard SCAN
+size_t lidar_caps_build_scan(uint8_t *out_buf, size_t buf_size);
+
+#endif // LIDAR_CAPS_H
@@ -0,0 +1,192 @@
+// lidar_cartesian.c
+// Polar -> Cartesian conversion for scan frames (see lidar_cartesian.h)
+
+#include "lidar_cartesian.h"
+#include "esp_dsp.h"
+
+// round(cos(2*pi*i/1440) * 16384), i = 0..1800
+// Aligned so that both the cos slice and the -sin slice (offset 720 bytes)
+// meet the 16-byte requirement of the PIE multiply.
+const int16_t lidar_trig_cos_q14[LIDAR_TRIG_TABLE_LEN] __attribute__((aligned(16))) = {
+     16384,  16384,  16383,  16383,  16382,  16380,  16378,  16376,  16374,  16371,  16368,  16365,
+     16362,  16358,  16353,  16349,  16344,  16339,  16333,  16328,  16322,  16315,  16309,  16302,
+     16294,  16287,  16279,  16270,  16262,  16253,  16244,  16234,  16225,  16214,  16204,  16193,
+     16182,  16171,  16159,  16147,  16135,  16123,  16110,  16096,  16083,  16069,  16055,  16041,
+     16026,  16011,  15996,  15980,  15964,  15948,  15931,  15914,  15897,  15880,  15862,  15844,
+     15826,  15807,  15788,  15769,  15749,  15729,  15709,  15689,  15668,  15647,  15626,  15604,
+     15582,  15560,  15537,  15515,  15491,  15468,  15444,  15420,  15396,  15371,  15346,  15321,
+     15296,  15270,  15244,  15218,  15191,  15164,  15137,  15109,  15082,  15053,  15025,  14996,
+     14968,  14938,  14909,  14879,  14849,  14819,  14788,  14757,  14726,  14694,  14663,  14631,
+     14598,  14566,  14533,  14500,  14466,  14433,  14399,  14364,  14330,  14295,  14260,  14225,
+     14189,  14153,  14117,  14081,  14044,  14007,  13970,  13932,  13894,  13856,  13818,  13780,
+     13741,  13702,  13662,  13623,  13583,  13543,  13502,  13462,  13421,  13380,  13338,  13297,
+     13255,  13213,  13170,  13128,  13085,  13042,  12998,  12955,  12911,  12867,  12822,  12778,
+     12733,  12688,  12642,  12597,  12551,  12505,  12458,  12412,  12365,  12318,  12271,  12223,
+     12176,  12128,  12080,  12031,  11982,  11934,  11885,  11835,  11786,  11736,  11686,  11636,
+     11585,  11535,  11484,  11433,  11381,  11330,  11278,  11226,  11174,  11121,  11069,  11016,
+     10963,  10910,  10856,  10803,  10749,  10695,  10641,  10586,  10531,  10477,  10422,  10366,
+     10311,  10255,  10199,  10143,  10087,  10031,   9974,   9917,   9860,   9803,   9746,   9688,
+      9630,   9572,   9514,   9456,   9397,   9339,   9280,   9221,   9162,   9102,   9043,   8983,
+      8923,   8863,   8803,   8743,   8682,   8621,   8561,   8500,   8438,   8377,   8316,   8254,
+      8192,   8130,   8068,   8006,   7943,   7881,   7818,   7755,   7692,   7629,   7565,   7502,
+      7438,   7374,   7311,   7246,   7182,   7118,   7053,   6989,   6924,   6859,   6794,   6729,
+      6664,   6599,   6533,   6467,   6402,   6336,   6270,   6204,   6138,   6071,   6005,   5938,
+      5872,   5805,   5738,   5671,   5604,   5536,   5469,   5402,   5334,   5266,   5199,   5131,
+      5063,   4995,   4927,   4859,   4790,   4722,   4653,   4585,   4516,   4447,   4378,   4310,
+      4240,   4171,   4102,   4033,   3964,   3894,   3825,   3755,   3686,   3616,   3546,   3476,
+      3406,   3336,   3266,   3196,   3126,   3056,   2986,   2915,   2845,   2775,   2704,   2634,
+      2563,   2492,   2422,   2351,   2280,   2209,   2139,   2068,   1997,   1926,   1855,   1784,
+      1713,   1641,   1570,   1499,   1428,   1357,   1285,   1214,   1143,   1072,   1000,    929,
+       857,    786,    715,    643,    572,    500,    429,    357,    286,    214,    143,     71,
+         0,    -71,   -143,   -214,   -286,   -357,   -429,   -500,   -572,   -643,   -715,   -786,
+      -857,   -929,  -1000,  -1072,  -1143,  -1214,  -1285,  -1357,  -1428,  -1499,  -1570,  -1641,
+     -1713,  -1784,  -1855,  -1926,  -1997,  -2068,  -2139,  -2209,  -2280,  -2351,  -2422,  -2492,
+     -2563,  -2634,  -2704,  -2775,  -2845,  -2915,  -2986,  -3056,  -3126,  -3196,  -3266,  -3336,
+     -3406,  -3476,  -3546,  -3616,  -3686,  -3755,  -3825,  -3894,  -3964,  -4033,  -4102,  -4171,
+     -4240,  -4310,  -4378,  -4447,  -4516,  -4585,  -4653,  -4722,  -4790,  -4859,  -4927,  -4995,
+     -5063,  -5131,  -5199,  -5266,  -5334,  -5402,  -5469,  -5536,  -5604,  -5671,  -5738,  -5805,
+     -5872,  -5938,  -6005,  -6071,  -6138,  -6204,  -6270,  -6336,  -6402,  -6467,  -6533,  -6599,
+     -6664,  -6729,  -6794,  -6859,  -6924,  -6989,  -7053,  -7118,  -7182,  -7246,  -7311,  -7374,
+     -7438,  -7502,  -7565,  -7629,  -7692,  -7755,  -7818,  -7881,  -7943,  -8006,  -8068,  -8130,
+     -8192,  -8254,  -8316,  -8377,  -8438,  -8500,  -8561,  -8621,  -8682,  -8743,  -8803,  -8863,
+     -8923,  -8983,  -9043,  -9102,  -9162,  -9221,  -9280,  -9339,  -9397,  -9456,  -9514,  -9572,
+     -9630,  -9688,  -9746,  -9803,  -9860,  -9917,  -9974, -10031, -10087, -10143, -10199, -10255,
+    -10311, -10366, -10422, -10477, -10531, -10586, -10641, -10695, -10749, -10803, -10856, -10910,
+    -10963, -11016, -11069, -11121, -11174, -11226, -11278, -11330, -11381, -11433, -11484, -11535,
+    -11585, -11636, -11686, -11736, -11786, -11835, -11885, -11934, -11982, -12031, -12080, -12128,
+    -12176, -12223, -12271, -12318, -12365, -12412, -12458, -12505, -12551, -12597, -12642, -12688,
+    -12733, -12778, -12822, -12867, -12911, -12955, -12998, -13042, -13085, -13128, -13170, -13213,
+    -13255, -13297, -13338, -13380, -13421, -13462, -13502, -13543, -13583, -13623, -13662, -13702,
+    -13741, -13780, -13818, -13856, -13894, -13932, -13970, -14007, -14044, -14081, -14117, -14153,
+    -14189, -14225, -14260, -14295, -14330, -14364, -14399, -14433, -14466, -14500, -14533, -14566,
+    -14598, -14631, -14663, -14694, -14726, -14757, -14788, -14819, -14849, -14879, -14909, -14938,
+    -14968, -14996, -15025, -15053, -15082, -15109, -15137, -15164, -15191, -15218, -15244, -15270,
+    -15296, -15321, -15346, -15371, -15396, -15420, -15444, -15468, -15491, -15515, -15537, -15560,
+    -15582, -15604, -15626, -15647, -15668, -15689, -15709, -15729, -15749, -15769, -15788, -15807,
+    -15826, -15844, -15862, -15880, -15897, -15914, -15931, -15948, -15964, -15980, -15996, -16011,
+    -16026, -16041, -16055, -16069, -16083, -16096, -16110, -16123, -16135, -16147, -16159, -16171,
+    -16182, -16193, -16204, -16214, -16225, -16234, -16244, -16253, -16262, -16270, -16279, -16287,
+    -16294, -16302, -16309, -16315, -16322, -16328, -16333, -16339, -16344, -16349, -16353, -16358,
+    -16362, -16365, -16368, -16371, -16374, -16376, -16378, -16380, -16382, -16383, -16383, -16384,
+    -16384, -16384, -16383, -16383, -16382, -16380, -16378, -16376, -16374, -16371, -16368, -16365,
+    -16362, -16358, -16353, -16349, -16344, -16339, -16333, -16328, -16322, -16315, -16309, -16302,
+    -16294, -16287, -16279, -16270, -16262, -16253, -16244, -16234, -16225, -16214, -16204, -16193,
+    -16182, -16171, -16159, -16147, -16135, -16123, -16110, -16096, -16083, -16069, -16055, -16041,
+    -16026, -16011, -15996, -15980, -15964, -15948, -15931, -15914, -15897, -15880, -15862, -15844,
+    -15826, -15807, -15788, -15769, -15749, -15729, -15709, -15689, -15668, -15647, -15626, -15604,
+    -15582, -15560, -15537, -15515, -15491, -15468, -15444, -15420, -15396, -15371, -15346, -15321,
+    -15296, -15270, -15244, -15218, -15191, -15164, -15137, -15109, -15082, -15053, -15025, -14996,
+    -14968, -14938, -14909, -14879, -14849, -14819, -14788, -14757, -14726, -14694, -14663, -14631,
+    -14598, -14566, -14533, -14500, -14466, -14433, -14399, -14364, -14330, -14295, -14260, -14225,
+    -14189, -14153, -14117, -14081, -14044, -14007, -13970, -13932, -13894, -13856, -13818, -13780,
+    -13741, -13702, -13662, -13623, -13583, -13543, -13502, -13462, -13421, -13380, -13338, -13297,
+    -13255, -13213, -13170, -13128, -13085, -13042, -12998, -12955, -12911, -12867, -12822, -12778,
+    -12733, -12688, -12642, -12597, -12551, -12505, -12458, -12412, -12365, -12318, -12271, -12223,
+    -12176, -12128, -12080, -12031, -11982, -11934, -11885, -11835, -11786, -11736, -11686, -11636,
+    -11585, -11535, -11484, -11433, -11381, -11330, -11278, -11226, -11174, -11121, -11069, -11016,
+    -10963, -10910, -10856, -10803, -10749, -10695, -10641, -10586, -10531, -10477, -10422, -10366,
+    -10311, -10255, -10199, -10143, -10087, -10031,  -9974,  -9917,  -9860,  -9803,  -9746,  -9688,
+     -9630,  -9572,  -9514,  -9456,  -9397,  -9339,  -9280,  -9221,  -9162,  -9102,  -9043,  -8983,
+     -8923,  -8863,  -8803,  -8743,  -8682,  -8621,  -8561,  -8500,  -8438,  -8377,  -8316,  -8254,
+     -8192,  -8130,  -8068,  -8006,  -7943,  -7881,  -7818,  -7755,  -7692,  -7629,  -7565,  -7502,
+     -7438,  -7374,  -7311,  -7246,  -7182,  -7118,  -7053,  -6989,  -6924,  -6859,  -6794,  -6729,
+     -6664,  -6599,  -6533,  -6467,  -6402,  -6336,  -6270,  -6204,  -6138,  -6071,  -6005,  -5938,
+     -5872,  -5805,  -5738,  -5671,  -5604,  -5536,  -5469,  -5402,  -5334,  -5266,  -5199,  -5131,
+     -5063,  -4995,  -4927,  -4859,  -4790,  -4722,  -4653,  -4585,  -4516,  -4447,  -4378,  -4310,
+     -4240,  -4171,  -4102,  -4033,  -3964,  -3894,  -3825,  -3755,  -3686,  -3616,  -3546,  -3476,
+     -3406,  -3336,  -3266,  -3196,  -3126,  -3056,  -2986,  -2915,  -2845,  -2775,  -2704,  -2634,
+     -2563,  -2492,  -2422,  -2351,  -2280,  -2209,  -2139,  -2068,  -1997,  -1926,  -1855,  -1784,
+     -1713,  -1641,  -1570,  -1499,  -1428,  -1357,  -1285,  -1214,  -1143,  -1072,  -1000,   -929,
+      -857,   -786,   -715,   -643,   -572,   -500,   -429,   -357,   -286,   -214,   -143,    -71,
+         0,     71,    143,    214,    286,    357,    429,    500,    572,    643,    715,    786,
+       857,    929,   1000,   1072,   1143,   1214,   1285,   1357,   1428,   1499,   1570,   1641,
+      1713,   1784,   1855,   1926,   1997,   2068,   2139,   2209,   2280,   2351,   2422,   2492,
+      2563,   2634,   2704,   2775,   2845,   2915,   2986,   3056,   3126,   3196,   3266,   3336,
+      3406,   3476,   3546,   3616,   3686,   3755,   3825,   3894,   3964,   4033,   4102,   4171,
+      4240,   4310,   4378,   4447,   4516,   4585,   4653,   4722,   4790,   4859,   4927,   4995,
+      5063,   5131,   5199,   5266,   5334,   5402,   5469,   5536,   5604,   5671,   5738,   5805,
+      5872,   5938,   6005,   6071,   6138,   6204,   6270,   6336,   6402,   6467,   6533,   6599,
+      6664,   6729,   6794,   6859,   6924,   6989,   7053,   7118,   7182,   7246,   7311,   7374,
+      7438,   7502,   7565,   7629,   7692,   7755,   7818,   7881,   7943,   8006,   8068,   8130,
+      8192,   8254,   8316,   8377,   8438,   8500,   8561,   8621,   8682,   8743,   8803,   8863,
+      8923,   8983,   9043,   9102,   9162,   9221,   9280,   9339,   9397,   9456,   9514,   9572,
+      9630,   9688,   9746,   9803,   9860,   9917,   9974,  10031,  10087,  10143,  10199,  10255,
+     10311,  10366,  10422,  10477,  10531,  10586,  10641,  10695,  10749,  10803,  10856,  10910,
+     10963,  11016,  11069,  11121,  11174,  11226,  11278,  11330,  11381,  11433,  11484,  11535,
+     11585,  11636,  11686,  11736,  11786,  11835,  11885,  11934,  11982,  12031,  12080,  12128,
+     12176,  12223,  12271,  12318,  12365,  12412,  12458,  12505,  12551,  12597,  12642,  12688,
+     12733,  12778,  12822,  12867,  12911,  12955,  12998,  13042,  13085,  13128,  13170,  13213,
+     13255,  13297,  13338,  13380,  13421,  13462,  13502,  13543,  13583,  13623,  13662,  13702,
+     13741,  13780,  13818,  13856,  13894,  13932,  13970,  14007,  14044,  14081,  14117,  14153,
+     14189,  14225,  14260,  14295,  14330,  14364,  14399,  14433,  14466,  14500,  14533,  14566,
+     14598,  14631,  14663,  14694,  14726,  14757,  14788,  14819,  14849,  14879,  14909,  14938,
+     14968,  14996,  15025,  15053,  15082,  15109,  15137,  15164,  15191,  15218,  15244,  15270,
+     15296,  15321,  15346,  15371,  15396,  15420,  15444,  15468,  15491,  15515,  15537,  15560,
+     15582,  15604,  15626,  15647,  15668,  15689,  15709,  15729,  15749,  15769,  15788,  15807,
+     15826,  15844,  15862,  15880,  15897,  15914,  15931,  15948,  15964,  15980,  15996,  16011,
+     16026,  16041,  16055,  16069,  16083,  16096,  16110,  16123,  16135,  16147,  16159,  16171,
+     16182,  16193,  16204,  16214,  16225,  16234,  16244,  16253,  16262,  16270,  16279,  16287,
+     16294,  16302,  16309,  16315,  16322,  16328,  16333,  16339,  16344,  16349,  16353,  16358,
+     16362,  16365,  16368,  16371,  16374,  16376,  16378,  16380,  16382,  16383,  16383,  16384,
+     16384,  16384,  16383,  16383,  16382,  16380,  16378,  16376,  16374,  16371,  16368,  16365,
+     16362,  16358,  16353,  16349,  16344,  16339,  16333,  16328,  16322,  16315,  16309,  16302,
+     16294,  16287,  16279,  16270,  16262,  16253,  16244,  16234,  16225,  16214,  16204,  16193,
+     16182,  16171,  16159,  16147,  16135,  16123,  16110,  16096,  16083,  16069,  16055,  16041,
+     16026,  16011,  15996,  15980,  15964,  15948,  15931,  15914,  15897,  15880,  15862,  15844,
+     15826,  15807,  15788,  15769,  15749,  15729,  15709,  15689,  15668,  15647,  15626,  15604,
+     15582,  15560,  15537,  15515,  15491,  15468,  15444,  15420,  15396,  15371,  15346,  15321,
+     15296,  15270,  15244,  15218,  15191,  15164,  15137,  15109,  15082,  15053,  15025,  14996,
+     14968,  14938,  14909,  14879,  14849,  14819,  14788,  14757,  14726,  14694,  14663,  14631,
+     14598,  14566,  14533,  14500,  14466,  14433,  14399,  14364,  14330,  14295,  14260,  14225,
+     14189,  14153,  14117,  14081,  14044,  14007,  13970,  13932,  13894,  13856,  13818,  13780,
+     13741,  13702,  13662,  13623,  13583,  13543,  13502,  13462,  13421,  13380,  13338,  13297,
+     13255,  13213,  13170,  13128,  13085,  13042,  12998,  12955,  12911,  12867,  12822,  12778,
+     12733,  12688,  12642,  12597,  12551,  12505,  12458,  12412,  12365,  12318,  12271,  12223,
+     12176,  12128,  12080,  12031,  11982,  11934,  11885,  11835,  11786,  11736,  11686,  11636,
+     11585,  11535,  11484,  11433,  11381,  11330,  11278,  11226,  11174,  11121,  11069,  11016,
+     10963,  10910,  10856,  10803,  10749,  10695,  10641,  10586,  10531,  10477,  10422,  10366,
+     10311,  10255,  10199,  10143,  10087,  10031,   9974,   9917,   9860,   9803,   9746,   9688,
+      9630,   9572,   9514,   9456,   9397,   9339,   9280,   9221,   9162,   9102,   9043,   8983,
+      8923,   8863,   8803,   8743,   8682,   8621,   8561,   8500,   8438,   8377,   8316,   8254,
+      8192,   8130,   8068,   8006,   7943,   7881,   7818,   7755,   7692,   7629,   7565,   7502,
+      7438,   7374,   7311,   7246,   7182,   7118,   7053,   6989,   6924,   6859,   6794,   6729,
+      6664,   6599,   6533,   6467,   6402,   6336,   6270,   6204,   6138,   6071,   6005,   5938,
+      5872,   5805,   5738,   5671,   5604,   5536,   5469,   5402,   5334,   5266,   5199,   5131,
+      5063,   4995,   4927,   4859,   4790,   4722,   4653,   4585,   4516,   4447,   4378,   4310,
+      4240,   4171,   4102,   4033,   3964,   3894,   3825,   3755,   3686,   3616,   3546,   3476,
+      3406,   3336,   3266,   3196,   3126,   3056,   2986,   2915,   2845,   2775,   2704,   2634,
+      2563,   2492,   2422,   2351,   2280,   2209,   2139,   2068,   1997,   1926,   1855,   1784,
+      1713,   1641,   1570,   1499,   1428,   1357,   1285,   1214,   1143,   1072,   1000,    929,
+       857,    786,    715,    643,    572,    500,    429,    357,    286,    214,    143,     71,
+         0,
+};
+
+_Static_assert((LIDAR_TRIG_QUARTER * sizeof(int16_t)) % 16 == 0, "-sin slice must stay 16-byte aligned");
+_Static_assert(LIDAR_SCAN_BINS % 8 == 0, "PIE multiply processes 8 lanes per step");
+
+static inline int32_t trig_interp(uint32_t idx, uint32_t frac) {
+    int32_t a = lidar_trig_cos_q14[idx];
+    int32_t b = lidar_trig_cos_q14[idx + 1];
+    return a + (((b - a) * (int32_t)frac) >> 4);
+}
+
+int16_t lidar_trig_cos_q6(uint32_t angle_q6)
+{
+    angle_q6 %= LIDAR_SCAN_ANGLE_Q6;
+    return (int16_t)trig_interp(angle_q6 / LIDAR_SCAN_BIN_Q6, angle_q6 % LIDAR_SCAN_BIN_Q6);
+}
+
+int16_t lidar_trig_sin_q6(uint32_t angle_q6)
+{
+    angle_q6 %= LIDAR_SCAN_ANGLE_Q6;
+    return (int16_t)-trig_interp(angle_q6 / LIDAR_SCAN_BIN_Q6 + LIDAR_TRIG_QUARTER,
+                                 angle_q6 % LIDAR_SCAN_BIN_Q6);
+}
+
+void lidar_cartesian_convert(const uint16_t *dist_mm, int16_t *x_mm, int16_t *y_mm)
+{
+    // Scan node distances are 14-bit (dist_q2 >> 2), so they fit int16 as-is
+    const int16_t *d = (const int16_t *)dist_mm;
+    dsps_mul_s16(d, lidar_trig_cos_q14, x_mm, LIDAR_SCAN_BINS, 1, 1, 1, LIDAR_TRIG_Q);
+    dsps_mul_s16(d, lidar_trig_cos_q14 + LIDAR_TRIG_QUARTER, y_mm, LIDAR_SCAN_BINS, 1, 1, 1, LIDAR_TRIG_Q);
+}
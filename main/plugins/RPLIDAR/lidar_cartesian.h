@@ -0,0 +1,51 @@
+// lidar_cartesian.h
+// Shared polar -> Cartesian stage for assembled scan frames. The assembler
+// converts each frame once (lidar_scan_frame_t x_mm/y_mm) so consumers never
+// redo the trig themselves.
+//
+// Robot frame: x forward, y left, mm. LIDAR bin angles run clockwise, so
+// x = d * cos(alpha) and y = -d * sin(alpha).
+
+#ifndef LIDAR_CARTESIAN_H
+#define LIDAR_CARTESIAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lidar_scan.h"
+
+#define LIDAR_TRIG_Q           14
+#define LIDAR_TRIG_ONE         (1 << LIDAR_TRIG_Q)
+
+// cos() of bin angles in Q14, stored in flash. The table runs a quarter turn
+// (plus one interpolation guard entry) past 360° so that
+// lidar_trig_cos_q14[b + LIDAR_TRIG_QUARTER] == -sin(b): the x and y
+// direction vectors are both contiguous slices of one table.
+#define LIDAR_TRIG_QUARTER     (LIDAR_SCAN_BINS / 4)
+#define LIDAR_TRIG_TABLE_LEN   (LIDAR_SCAN_BINS + LIDAR_TRIG_QUARTER + 1)
+
+extern const int16_t lidar_trig_cos_q14[LIDAR_TRIG_TABLE_LEN];
+
+static inline int32_t lidar_trig_wrap_bin(int32_t bin) {
+    bin %= LIDAR_SCAN_BINS;
+    return bin < 0 ? bin + LIDAR_SCAN_BINS : bin;
+}
+
+// cos/sin of an angle given in 0.25° bins (any sign, wraps)
+static inline int16_t lidar_trig_cos_bin(int32_t bin) {
+    return lidar_trig_cos_q14[lidar_trig_wrap_bin(bin)];
+}
+
+static inline int16_t lidar_trig_sin_bin(int32_t bin) {
+    return (int16_t)-lidar_trig_cos_q14[lidar_trig_wrap_bin(bin) + LIDAR_TRIG_QUARTER];
+}
+
+// cos/sin of an arbitrary angle_q6 (1/64°), linearly interpolated between bins
+int16_t lidar_trig_cos_q6(uint32_t angle_q6);
+int16_t lidar_trig_sin_q6(uint32_t angle_q6);
+
+// Convert one frame worth of per-bin ranges to robot-frame x/y (mm).
+// dist_mm[b] == 0 yields (0, 0). Uses the esp-dsp s16 multiply, which takes
+// the PIE path on the S3 when all three buffers are 16-byte aligned.
+void lidar_cartesian_convert(const uint16_t *dist_mm, int16_t *x_mm, int16_t *y_mm);
+
+#endif // LIDAR_CARTESIAN_H
@@ -9,9 +9,17 @@
 #include "lidar_protocol_cmd.h"
 #include "lidar_protocol_rsp.h"
 #include "lidar_response_parser.h"
+#include "lidar_scan.h"
+#include "lidar_scan_filter.h"
+#include "lidar_deskew.h"
+#include "lidar_motor.h"
+#include "lidar_session.h"
+#include "rest_context.h"
+#include "io_lidar.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 
-#define LIDAR_TASK_STACK_SIZE 4096
+#define LIDAR_TASK_STACK_SIZE 8192
 #define LIDAR_TASK_PRIORITY   8
 #define LIDAR_CMD_QUEUE_LEN   10
 
@@ -29,7 +37,8 @@ static inline void lidar_send(const dispatcher_pool_send_params_t *params)
 // Initialization function
 void lidar_coordinator_init(void)
 {
-	lidar_response_parser_init();
+	lidar_scan_init();
+	lidar_motor_init();
 
 	// Register pointer queue
 	lidar_ptr_queue = xQueueCreate(LIDAR_CMD_QUEUE_LEN, sizeof(pool_msg_t *));
@@ -44,10 +53,20 @@ void lidar_coordinator_init(void)
 // LIDAR task — processes incoming commands
 static void lidar_task(void *arg)
 {
+	// Give the sensor time to spin up after power-on, then hand over to the
+	// session controller (probe, discovery, scan start, watchdog).
+	vTaskDelay(pdMS_TO_TICKS(1000));
+	lidar_session_begin();
+
 	while (1) {
-		// Wait for incoming command (pointer queue)
+		// Wait for incoming command (pointer queue); the session decides how
+		// long we may block before its next timer or watchdog check.
 		pool_msg_t *pmsg = NULL;
-		if (xQueueReceive(lidar_ptr_queue, &pmsg, portMAX_DELAY) == pdTRUE) {
+		uint32_t wait_ms = lidar_session_poll();
+		TickType_t wait = (wait_ms == LIDAR_SESSION_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms);
+		if (wait == 0) wait = 1;
+		if (xQueueReceive(lidar_ptr_queue, &pmsg, wait) != pdTRUE) continue;
+		{
 			const dispatcher_msg_ptr_t *in = dispatcher_pool_get_msg_const(pmsg);
 			if (!in) {
 				dispatcher_pool_msg_unref(pmsg);
@@ -72,8 +91,13 @@ static void lidar_task(void *arg)
 					case SOURCE_LIDAR_IO: {
 						// Handle responses from LIDAR IO (if needed)
 						   out_msg.targets[0] = TARGET_LOG;
+						   if (lidar_session_streaming()) {
+							lidar_scan_feed(in->data, in->message_len, io_lidar_stamp_unpack(in->context, esp_timer_get_time()));
+							break;
+						   }
 						   {
 							size_t in_len = in->message_len;
+							int64_t t_rx_us = io_lidar_stamp_unpack(in->context, esp_timer_get_time());
 						uint8_t local_in_buf[256] = {0};
 							size_t copy_len = (in_len < sizeof(local_in_buf)) ? in_len : sizeof(local_in_buf);
 							if (copy_len > 0 && in->data) memcpy(local_in_buf, in->data, copy_len);
@@ -95,15 +119,22 @@ static void lidar_task(void *arg)
 						if (resp_desc.payload_len > available) resp_desc.payload_len = available;
 						resp_desc.payload = &local_in_buf[7];
 
-						bool handled = false;
-						const lidar_response_parser_entry_t *entry = NULL;
-						if (resp_desc.response_type < lidar_response_parser_table_size) {
-							entry = lidar_response_parser_table[resp_desc.response_type];
+						if (local_in_buf[5] & LIDAR_RSP_SENDMODE_MULTI_RESPONSE) {
+							// Multi-response: descriptor is sent once, nodes follow indefinitely
+							if (lidar_session_on_stream(resp_desc.response_type)) {
+								if (copy_len > 7) lidar_scan_feed(&local_in_buf[7], copy_len - 7, t_rx_us);
+								ESP_LOGI("lidar_coord", "Scan stream 0x%02X started", (unsigned)resp_desc.response_type);
+								break;
+							}
 						}
-						if (entry && entry->parser && entry->formatter) {
-							uint8_t parsed_buf[32] = {0}; // Adjust size as needed for largest static response
+
+						bool handled = false;
+						const lidar_response_parser_entry_t *entry = lidar_response_parser_find(resp_desc.response_type);
+						if (entry && entry->formatter) {
+							uint8_t parsed_buf[LIDAR_RESP_PARSED_MAX] __attribute__((aligned(4))) = {0};
 							bool ok = entry->parser(resp_desc.payload, resp_desc.payload_len, parsed_buf, entry->struct_info);
 							if (ok) {
+								lidar_session_on_response(resp_desc.response_type, parsed_buf);
 								char usb_buf[128];
 								entry->formatter(parsed_buf, usb_buf, sizeof(usb_buf), entry->struct_info);
 								out_msg.message_len = (uint16_t)strnlen(usb_buf, sizeof(usb_buf));
@@ -126,13 +157,61 @@ static void lidar_task(void *arg)
 						break;
 					}
 				default: {
-					// Treat any other source as a control request and forward GET_INFO to the LIDAR
-					out_msg.targets[0] = TARGET_LIDAR_IO;
-					out_msg.message_len = lidar_build_by_idx(out_msg.data, sizeof(out_msg.data), LIDAR_CMD_IDX_GET_INFO);
-					base.targets = out_msg.targets;
-					base.data = out_msg.data;
-					base.data_len = out_msg.message_len;
-					lidar_send(&base);
+					// Treat any other source as a control request. data[0] is either a
+					// LIDAR_SESSION_CTRL_* request, LIDAR_FILTER_CTRL_JSON,
+					// LIDAR_DESKEW_CTRL_ODOM or a raw lidar_cmd_idx_t. A REST request
+					// (context set) reads the filter config or, with
+					// LIDAR_FILTER_CTRL_JSON, changes it and answers with the result.
+					if (in->source == SOURCE_REST && in->context) {
+						// POST answers with the configuration it applied, so
+						// the caller persists only what was accepted
+						rest_json_request_t *req = (rest_json_request_t *)in->context;
+						size_t len = 0;
+						if (in->message_len > 0 && in->data[0] == LIDAR_FILTER_CTRL_JSON) {
+							if (lidar_scan_filter_apply_json((const char *)in->data + 1, in->message_len - 1u)) {
+								len = lidar_scan_filter_cfg_to_json(req->json_buf, req->buf_size);
+							}
+						} else {
+							len = lidar_scan_filter_to_json(req->json_buf, req->buf_size);
+						}
+						if (req->json_len) *req->json_len = len;
+						xSemaphoreGive(req->sem);
+						break;
+					}
+					if (!in->data || in->message_len == 0) break;
+					if (in->data[0] == LIDAR_DESKEW_CTRL_ODOM) {
+						if (in->message_len >= sizeof(lidar_deskew_odom_t)) {
+							lidar_deskew_odom_t odom;
+							memcpy(&odom, in->data, sizeof(odom));
+							lidar_deskew_on_odom(&odom);
+						}
+						break;
+					}
+					if (in->data[0] == LIDAR_FILTER_CTRL_JSON) {
+						lidar_scan_filter_apply_json((const char *)in->data + 1, in->message_len - 1u);
+						break;
+					}
+					if (in->data[0] >= LIDAR_SESSION_CTRL_START) {
+						lidar_session_request(in->data[0]);
+						break;
+					}
+					if (in->data[0] >= lidar_cmd_table_count) {
+						ESP_LOGW("lidar_coord", "Unknown control request 0x%02X from source %d",
+								 (unsigned)in->data[0], (int)in->source);
+						break;
+					}
+					lidar_cmd_idx_t idx = (lidar_cmd_idx_t)in->data[0];
+					if (idx == LIDAR_CMD_IDX_MOTOR_SPEED_CTRL) {
+						// data[1..2] = RPM (LE); the motor regulator owns the actuator
+						uint16_t rpm = 0;
+						if (in->message_len >= 3) rpm = (uint16_t)(in->data[1] | (in->data[2] << 8));
+						lidar_motor_set_target_rpm(rpm);
+						break;
+					}
+					// Raw commands go through the session so STOP/RESET and the
+					// expected response stay consistent with its state
+					out_msg.message_len = lidar_build_by_idx(out_msg.data, sizeof(out_msg.data), idx);
+					lidar_session_send_cmd(out_msg.data, out_msg.message_len);
 						break;
 				}
 			}
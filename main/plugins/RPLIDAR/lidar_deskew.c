@@ -0,0 +1,194 @@
+// lidar_deskew.c
+// Odometry pose history + per-frame motion de-skew (see lidar_deskew.h)
+
+#include <math.h>
+#include "lidar_deskew.h"
+#include "lidar_cartesian.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "lidar_deskew";
+
+#define DESKEW_STATS_FRAMES 100
+
+typedef struct {
+    int64_t t_us;
+    float x_mm;
+    float y_mm;
+    float th_rad;       // CCW
+} deskew_pose_t;
+
+typedef struct {
+    int16_t c_q14;
+    int16_t s_q14;
+    int16_t tx_mm;
+    int16_t ty_mm;
+} deskew_step_t;
+
+// Pose history: written by the coordinator (odometry), read by the frame
+// processing task while it builds a frame's steps
+static SemaphoreHandle_t pose_mutex = NULL;
+static deskew_pose_t poses[LIDAR_DESKEW_HISTORY];
+static uint8_t pose_head = 0;           // newest entry
+static uint8_t pose_count = 0;
+static float cur_v_mm_s = 0.0f;
+static float cur_w_rad_s = 0.0f;
+static int64_t last_sample_us = 0;
+
+static deskew_step_t steps[LIDAR_DESKEW_STEPS];
+
+static uint64_t stats_sum_us = 0;
+static uint32_t stats_max_us = 0;
+static uint32_t stats_count = 0;
+static uint32_t stats_skipped = 0;
+
+// Advance p by the current velocities over dt (midpoint heading)
+static void deskew_advance(deskew_pose_t *p, int64_t t_us)
+{
+    float dt = (float)(t_us - p->t_us) * 1e-6f;
+    float th_mid = p->th_rad + 0.5f * cur_w_rad_s * dt;
+    p->x_mm += cur_v_mm_s * dt * cosf(th_mid);
+    p->y_mm += cur_v_mm_s * dt * sinf(th_mid);
+    p->th_rad += cur_w_rad_s * dt;
+    p->t_us = t_us;
+}
+
+bool lidar_deskew_init(void)
+{
+    if (!pose_mutex) pose_mutex = xSemaphoreCreateMutex();
+    return pose_mutex != NULL;
+}
+
+void lidar_deskew_on_odom(const lidar_deskew_odom_t *odom)
+{
+    if (!pose_mutex) return;
+    int64_t t = odom->t_us ? odom->t_us : esp_timer_get_time();
+    xSemaphoreTake(pose_mutex, portMAX_DELAY);
+    if (pose_count == 0) {
+        poses[0] = (deskew_pose_t){ .t_us = t };
+        pose_head = 0;
+        pose_count = 1;
+    } else {
+        deskew_pose_t p = poses[pose_head];
+        if (t < p.t_us) t = p.t_us;     // late sample: apply from the newest pose on
+        deskew_advance(&p, t);
+        pose_head = (uint8_t)((pose_head + 1) % LIDAR_DESKEW_HISTORY);
+        poses[pose_head] = p;
+        if (pose_count < LIDAR_DESKEW_HISTORY) pose_count++;
+    }
+    if (odom->flags & LIDAR_DESKEW_ODOM_HAS_V) cur_v_mm_s = (float)odom->v_mm_s;
+    if (odom->flags & LIDAR_DESKEW_ODOM_HAS_W) cur_w_rad_s = (float)odom->w_mrad_s * 1e-3f;
+    last_sample_us = t;
+    xSemaphoreGive(pose_mutex);
+}
+
+// Pose at time t: interpolated inside the history, extrapolated with the
+// current velocities past the newest entry, clamped before the oldest
+static deskew_pose_t deskew_pose_at(int64_t t_us)
+{
+    deskew_pose_t p = poses[pose_head];
+    if (t_us >= p.t_us) {
+        deskew_advance(&p, t_us);
+        return p;
+    }
+    uint8_t i = pose_head;
+    for (uint8_t n = 1; n < pose_count; ++n) {
+        uint8_t prev = (uint8_t)((i + LIDAR_DESKEW_HISTORY - 1) % LIDAR_DESKEW_HISTORY);
+        const deskew_pose_t *a = &poses[prev];
+        const deskew_pose_t *b = &poses[i];
+        if (t_us >= a->t_us) {
+            float f = (b->t_us > a->t_us) ? (float)(t_us - a->t_us) / (float)(b->t_us - a->t_us) : 0.0f;
+            return (deskew_pose_t){
+                .t_us = t_us,
+                .x_mm = a->x_mm + f * (b->x_mm - a->x_mm),
+                .y_mm = a->y_mm + f * (b->y_mm - a->y_mm),
+                .th_rad = a->th_rad + f * (b->th_rad - a->th_rad),
+            };
+        }
+        i = prev;
+    }
+    return poses[i];
+}
+
+static inline int16_t sat16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+// Fill steps[] with each step's pose relative to the end pose. Returns false
+// if the robot did not move over the frame.
+static bool deskew_build_steps(int64_t t_start, int64_t t_end)
+{
+    deskew_pose_t e = deskew_pose_at(t_end);
+    float ce = cosf(e.th_rad);
+    float se = sinf(e.th_rad);
+    int64_t span = t_end - t_start;
+    bool moved = false;
+    for (int s = 0; s < LIDAR_DESKEW_STEPS; ++s) {
+        int64_t ts = t_start + span * (2 * s + 1) / (2 * LIDAR_DESKEW_STEPS);
+        deskew_pose_t p = deskew_pose_at(ts);
+        float dth = p.th_rad - e.th_rad;
+        float dx = p.x_mm - e.x_mm;
+        float dy = p.y_mm - e.y_mm;
+        deskew_step_t *st = &steps[s];
+        st->c_q14 = (int16_t)lrintf(cosf(dth) * LIDAR_TRIG_ONE);
+        st->s_q14 = (int16_t)lrintf(sinf(dth) * LIDAR_TRIG_ONE);
+        st->tx_mm = sat16((int32_t)lrintf(ce * dx + se * dy));
+        st->ty_mm = sat16((int32_t)lrintf(-se * dx + ce * dy));
+        moved |= st->s_q14 != 0 || st->tx_mm != 0 || st->ty_mm != 0;
+    }
+    return moved;
+}
+
+void lidar_deskew_apply(lidar_scan_frame_t *f)
+{
+    if (!pose_mutex) return;
+    int64_t span = f->t_end_us - f->t_start_us;
+    xSemaphoreTake(pose_mutex, portMAX_DELAY);
+    if (pose_count == 0 || span <= 0 ||
+        f->t_end_us - last_sample_us > (int64_t)LIDAR_DESKEW_MAX_AGE_MS * 1000) {
+        xSemaphoreGive(pose_mutex);
+        stats_skipped++;
+        return;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    bool moved = deskew_build_steps(f->t_start_us, f->t_end_us);
+    xSemaphoreGive(pose_mutex);
+    if (moved) {
+        // step = t_rel * STEPS / span, as a Q24 multiply instead of a divide
+        // per point. Q16 truncated the factor by up to 1% at a 150 ms span,
+        // which put points near a step boundary in the wrong step. t_rel is
+        // below span_rel, so the product stays under STEPS << 24.
+        uint32_t span_rel = (uint32_t)(span >> LIDAR_SCAN_T_REL_SHIFT) + 1;
+        uint32_t step_q24 = ((uint32_t)LIDAR_DESKEW_STEPS << 24) / span_rel;
+        for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+            if (f->dist_mm[i] == 0) continue;
+            uint32_t s = ((uint32_t)f->t_rel[i] * step_q24) >> 24;
+            if (s >= LIDAR_DESKEW_STEPS) s = LIDAR_DESKEW_STEPS - 1;
+            const deskew_step_t *st = &steps[s];
+            int32_t x = f->x_mm[i];
+            int32_t y = f->y_mm[i];
+            int32_t xr = (st->c_q14 * x - st->s_q14 * y + (1 << (LIDAR_TRIG_Q - 1))) >> LIDAR_TRIG_Q;
+            int32_t yr = (st->s_q14 * x + st->c_q14 * y + (1 << (LIDAR_TRIG_Q - 1))) >> LIDAR_TRIG_Q;
+            f->x_mm[i] = sat16(xr + st->tx_mm);
+            f->y_mm[i] = sat16(yr + st->ty_mm);
+        }
+    }
+    f->flags |= LIDAR_SCAN_FLAG_DESKEWED;
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    stats_sum_us += dt;
+    if (dt > stats_max_us) stats_max_us = dt;
+    if (++stats_count >= DESKEW_STATS_FRAMES) {
+        ESP_LOGI(TAG, "De-skew: avg %u us, max %u us over %u frames (%u skipped without odometry)",
+                 (unsigned)(stats_sum_us / stats_count), (unsigned)stats_max_us, (unsigned)stats_count,
+                 (unsigned)stats_skipped);
+        stats_sum_us = 0;
+        stats_max_us = 0;
+        stats_count = 0;
+        stats_skipped = 0;
+    }
+}
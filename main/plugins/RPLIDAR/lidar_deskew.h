@@ -0,0 +1,53 @@
+// lidar_deskew.h
+// Motion de-skew of assembled frames. A revolution takes ~150 ms, so while
+// the robot moves each point is seen from a different pose. Odometry samples
+// (forward speed and/or yaw rate) are integrated into a short pose history;
+// when a frame closes, every point's x_mm/y_mm is moved into the pose at the
+// frame's last point (t_end_us).
+//
+// The frame time span is cut into LIDAR_DESKEW_STEPS steps; each step's pose
+// relative to the end pose (rotation in Q14 plus translation) is computed
+// once, and points use the transform of the step their sample time falls in.
+// dist_mm stays the raw polar range; only the Cartesian view is corrected.
+//
+// Odometry arrives as LIDAR_DESKEW_CTRL_ODOM messages on TARGET_LIDAR_COORD
+// and is recorded by the coordinator task; frames are corrected in the frame
+// processing task. The pose history is shared under a mutex.
+
+#ifndef LIDAR_DESKEW_H
+#define LIDAR_DESKEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lidar_scan.h"
+
+// Control request on TARGET_LIDAR_COORD: lidar_deskew_odom_t
+#define LIDAR_DESKEW_CTRL_ODOM      0x91
+
+#define LIDAR_DESKEW_HISTORY        64      // integrated poses kept
+#define LIDAR_DESKEW_STEPS          32      // transform steps per frame
+#define LIDAR_DESKEW_MAX_AGE_MS     250     // skip frames whose odometry is older than this
+
+#define LIDAR_DESKEW_ODOM_HAS_V     0x01    // v_mm_s is valid (motor/wheel odometry)
+#define LIDAR_DESKEW_ODOM_HAS_W     0x02    // w_mrad_s is valid (heading/gyro)
+
+// Velocity sample in the robot frame (x forward, CCW positive). Modules that
+// know only one of the two set only that flag; the other keeps its last value.
+typedef struct __attribute__((packed)) {
+    uint8_t  cmd;           // LIDAR_DESKEW_CTRL_ODOM
+    uint8_t  flags;         // LIDAR_DESKEW_ODOM_HAS_*
+    int16_t  v_mm_s;        // forward speed
+    int16_t  w_mrad_s;      // yaw rate
+    int64_t  t_us;          // esp_timer time of the sample, 0 = when received
+} lidar_deskew_odom_t;
+
+// Create the pose history lock (lidar_scan_init calls this). False if out of memory.
+bool lidar_deskew_init(void);
+
+// Record a velocity sample
+void lidar_deskew_on_odom(const lidar_deskew_odom_t *odom);
+
+// Correct f->x_mm/y_mm in place. Sets LIDAR_SCAN_FLAG_DESKEWED when applied.
+void lidar_deskew_apply(lidar_scan_frame_t *f);
+
+#endif // LIDAR_DESKEW_H
@@ -0,0 +1,140 @@
+// lidar_frame_pool.c
+// Refcounted scan frame pool (see lidar_frame_pool.h)
+
+#include "lidar_frame_pool.h"
+#include "lidar_scan.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char *TAG = "lidar_frame_pool";
+
+// Per slot: generation in the upper 16 bits, reference count in the lower
+// 16. Both change together with one compare-and-swap, so a release can never
+// hit a slot that was recycled in between.
+#define SLOT_GEN(s)         ((s) >> 16)
+#define SLOT_REFS(s)        ((s) & 0xFFFFu)
+#define SLOT_STATE(g, r)    (((uint32_t)(g) << 16) | (r))
+
+#define HANDLE_SLOT(h)      ((h) & 0xFFu)
+#define HANDLE_GEN(h)       (((h) >> 8) & 0xFFFFu)
+
+static lidar_scan_frame_t *pool_frames = NULL;
+static uint32_t pool_state[LIDAR_FRAME_POOL_COUNT];
+static uint8_t pool_cursor = 0;             // next slot to try; spreads reuse over the pool
+
+static uint32_t stat_allocs = 0;
+static uint32_t stat_alloc_fails = 0;
+static uint32_t stat_stale = 0;
+
+bool lidar_frame_pool_init(void)
+{
+    if (pool_frames) return true;
+    pool_frames = (lidar_scan_frame_t *)heap_caps_aligned_calloc(16, LIDAR_FRAME_POOL_COUNT, sizeof(lidar_scan_frame_t),
+                                                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!pool_frames) {
+        ESP_LOGW(TAG, "PSRAM frame pool alloc failed; trying internal heap");
+        pool_frames = (lidar_scan_frame_t *)heap_caps_aligned_calloc(16, LIDAR_FRAME_POOL_COUNT, sizeof(lidar_scan_frame_t),
+                                                                     MALLOC_CAP_8BIT);
+    }
+    if (!pool_frames) {
+        ESP_LOGE(TAG, "Frame pool allocation failed (%u bytes)",
+                 (unsigned)(LIDAR_FRAME_POOL_COUNT * sizeof(lidar_scan_frame_t)));
+        return false;
+    }
+    for (int i = 0; i < LIDAR_FRAME_POOL_COUNT; ++i) {
+        pool_state[i] = SLOT_STATE(0, 0);
+    }
+    ESP_LOGI(TAG, "Frame pool ready: %u frames x %u bytes", (unsigned)LIDAR_FRAME_POOL_COUNT,
+             (unsigned)sizeof(lidar_scan_frame_t));
+    return true;
+}
+
+lidar_scan_frame_t *lidar_frame_pool_alloc(lidar_frame_handle_t *handle)
+{
+    if (!pool_frames) return NULL;
+    for (int n = 0; n < LIDAR_FRAME_POOL_COUNT; ++n) {
+        uint8_t i = (uint8_t)((pool_cursor + n) % LIDAR_FRAME_POOL_COUNT);
+        uint32_t s = __atomic_load_n(&pool_state[i], __ATOMIC_ACQUIRE);
+        if (SLOT_REFS(s) != 0) continue;
+        uint32_t gen = (SLOT_GEN(s) + 1) & 0xFFFFu;
+        if (gen == 0) gen = 1;              // generation 0 never appears in a handle
+        if (!__atomic_compare_exchange_n(&pool_state[i], &s, SLOT_STATE(gen, 1), false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        pool_cursor = (uint8_t)((i + 1) % LIDAR_FRAME_POOL_COUNT);
+        stat_allocs++;
+        if (handle) *handle = (gen << 8) | i;
+        return &pool_frames[i];
+    }
+    stat_alloc_fails++;
+    return NULL;
+}
+
+// Slot index if the handle's generation is current and referenced, else -1
+static int pool_slot_live(lidar_frame_handle_t handle, uint32_t *state)
+{
+    uint32_t i = HANDLE_SLOT(handle);
+    if (!pool_frames || i >= LIDAR_FRAME_POOL_COUNT) return -1;
+    uint32_t s = __atomic_load_n(&pool_state[i], __ATOMIC_ACQUIRE);
+    if (SLOT_GEN(s) != HANDLE_GEN(handle) || SLOT_REFS(s) == 0) return -1;
+    if (state) *state = s;
+    return (int)i;
+}
+
+static void pool_stale(const char *op, lidar_frame_handle_t handle)
+{
+    if ((++stat_stale & 0x3F) == 1) {
+        ESP_LOGW(TAG, "Stale handle 0x%06X on %s (%u so far)", (unsigned)handle, op, (unsigned)stat_stale);
+    }
+}
+
+lidar_scan_frame_t *lidar_frame_pool_get(lidar_frame_handle_t handle)
+{
+    int i = pool_slot_live(handle, NULL);
+    if (i < 0) {
+        pool_stale("get", handle);
+        return NULL;
+    }
+    return &pool_frames[i];
+}
+
+bool lidar_frame_pool_retain(lidar_frame_handle_t handle, uint16_t n)
+{
+    if (n == 0) return true;
+    uint32_t s;
+    int i;
+    do {
+        i = pool_slot_live(handle, &s);
+        if (i < 0) {
+            pool_stale("retain", handle);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&pool_state[i], &s, s + n, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return true;
+}
+
+void lidar_frame_pool_release(lidar_frame_handle_t handle)
+{
+    uint32_t s;
+    int i;
+    do {
+        i = pool_slot_live(handle, &s);
+        if (i < 0) {
+            pool_stale("release", handle);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&pool_state[i], &s, s - 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+void lidar_frame_pool_get_stats(lidar_frame_pool_stats_t *out)
+{
+    if (!out) return;
+    out->allocs = stat_allocs;
+    out->alloc_fails = stat_alloc_fails;
+    out->stale = stat_stale;
+    out->in_use = 0;
+    for (int i = 0; i < LIDAR_FRAME_POOL_COUNT; ++i) {
+        if (SLOT_REFS(__atomic_load_n(&pool_state[i], __ATOMIC_ACQUIRE)) != 0) out->in_use++;
+    }
+}
@@ -0,0 +1,49 @@
+// lidar_frame_pool.h
+// Refcounted pool of assembled scan frames (PSRAM). The assembler takes a
+// free frame, fills it and publishes only a handle; each subscriber that the
+// message reached owns one reference and releases it when done. The frame
+// goes back to the pool when the last reference is dropped.
+//
+// A handle is (generation << 8) | slot. The generation is bumped every time
+// a slot is handed out, so a handle kept after its frame was recycled no
+// longer resolves (lidar_frame_pool_get returns NULL) instead of silently
+// reading a newer frame.
+
+#ifndef LIDAR_FRAME_POOL_H
+#define LIDAR_FRAME_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint32_t lidar_frame_handle_t;
+
+#define LIDAR_FRAME_HANDLE_NONE     0u
+#define LIDAR_FRAME_POOL_COUNT      6       // one being filled + frames held by readers
+
+typedef struct lidar_scan_frame_s lidar_scan_frame_t;
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t alloc_fails;       // no free frame: readers held every slot
+    uint32_t stale;             // get/retain/release with an outdated handle
+    uint8_t  in_use;            // slots currently referenced
+} lidar_frame_pool_stats_t;
+
+// Allocate the frames. Returns false if memory is short.
+bool lidar_frame_pool_init(void);
+
+// Take a free frame with one reference held by the caller. NULL if none.
+lidar_scan_frame_t *lidar_frame_pool_alloc(lidar_frame_handle_t *handle);
+
+// Frame for a handle the caller holds a reference on, or NULL if stale
+lidar_scan_frame_t *lidar_frame_pool_get(lidar_frame_handle_t handle);
+
+// Add n references (e.g. one per reader before publishing)
+bool lidar_frame_pool_retain(lidar_frame_handle_t handle, uint16_t n);
+
+// Drop one reference; the frame is free again after the last one
+void lidar_frame_pool_release(lidar_frame_handle_t handle);
+
+void lidar_frame_pool_get_stats(lidar_frame_pool_stats_t *out);
+
+#endif // LIDAR_FRAME_POOL_H
@@ -6,6 +6,7 @@
 #include <string.h>
 #include "lidar_protocol_cmd.h"
 #include "lidar_message_builder.h"
+#include "lidar_protocol_rsp.h"
 
 // Unified helper for all commands (simple and payload-based)
 size_t lidar_build_cmd(uint8_t *out_buf, size_t buf_size, uint8_t cmd_code, const uint8_t *payload, size_t payload_len)
@@ -62,28 +63,55 @@ static size_t lidar_get_lidar_conf_builder(uint8_t *out_buf, size_t buf_size, co
     return lidar_build_cmd(out_buf, buf_size, entry->code, payload, 4);
 }
 
+// MOTOR_SPEED_CTRL with a runtime RPM (uint16 little-endian payload, 0 stops the motor)
+size_t lidar_build_motor_speed(uint8_t *out_buf, size_t buf_size, uint16_t rpm)
+{
+    uint8_t payload[2] = { (uint8_t)(rpm & 0xFF), (uint8_t)(rpm >> 8) };
+    return lidar_build_cmd(out_buf, buf_size, LIDAR_CMD_MOTOR_SPEED_CTRL, payload, sizeof(payload));
+}
+
+// GET_LIDAR_CONF for a per-mode query (SAMPLETIME, MAX_DIST, ANS_TYPE, NAME):
+// payload is the 32-bit type followed by the 16-bit scan mode id
+size_t lidar_build_conf_mode(uint8_t *out_buf, size_t buf_size, uint32_t conf_type, uint16_t mode)
+{
+    uint8_t payload[6] = {
+        (uint8_t)conf_type, (uint8_t)(conf_type >> 8), (uint8_t)(conf_type >> 16), (uint8_t)(conf_type >> 24),
+        (uint8_t)mode, (uint8_t)(mode >> 8)
+    };
+    return lidar_build_cmd(out_buf, buf_size, LIDAR_CMD_GET_LIDAR_CONF, payload, sizeof(payload));
+}
+
 // Registry: order must match lidar_cmd_t enum
 const lidar_cmd_entry_t lidar_cmd_table[] = {
-    { LIDAR_CMD_IDX_STOP, "STOP", LIDAR_CMD_STOP, NULL, 0, lidar_generic_builder },
-    { LIDAR_CMD_IDX_RESET, "RESET", LIDAR_CMD_RESET, NULL, 0, lidar_generic_builder },
-    { LIDAR_CMD_IDX_SCAN, "SCAN", LIDAR_CMD_SCAN, NULL, 0, lidar_generic_builder },
-    { LIDAR_CMD_IDX_EXPRESS_SCAN_LEGACY, "EXPRESS_SCAN_LEGACY", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_LEGACY}, 1, lidar_express_scan_builder },
-    { LIDAR_CMD_IDX_EXPRESS_SCAN_BOOST, "EXPRESS_SCAN_BOOST", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_BOOST}, 1, lidar_express_scan_builder },
-    { LIDAR_CMD_IDX_EXPRESS_SCAN_SENSITIVITY, "EXPRESS_SCAN_SENSITIVITY", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_SENSITIVITY}, 1, lidar_express_scan_builder },
-    { LIDAR_CMD_IDX_EXPRESS_SCAN_STABILITY, "EXPRESS_SCAN_STABILITY", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_STABILITY}, 1, lidar_express_scan_builder },
-    { LIDAR_CMD_IDX_FORCE_SCAN, "FORCE_SCAN", LIDAR_CMD_FORCE_SCAN, NULL, 0, lidar_generic_builder },
-    { LIDAR_CMD_IDX_GET_INFO, "GET_INFO", LIDAR_CMD_GET_INFO, NULL, 0, lidar_generic_builder },
-    { LIDAR_CMD_IDX_GET_HEALTH, "GET_HEALTH", LIDAR_CMD_GET_HEALTH, NULL, 0, lidar_generic_builder },
-    { LIDAR_CMD_IDX_GET_SAMPLERATE, "GET_SAMPLERATE", LIDAR_CMD_GET_SAMPLERATE, NULL, 0, lidar_generic_builder },
-    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_COUNT, "GET_LIDAR_CONF_SCAN_MODE_COUNT", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_COUNT, 0}, 2, lidar_get_lidar_conf_builder },
-    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_SAMPLETIME, "GET_LIDAR_CONF_SCAN_MODE_SAMPLETIME", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_SAMPLETIME, 0}, 2, lidar_get_lidar_conf_builder },
-    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_MAX_DIST, "GET_LIDAR_CONF_SCAN_MODE_MAX_DIST", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_MAX_DIST, 0}, 2, lidar_get_lidar_conf_builder },
-    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_ANS_TYPE, "GET_LIDAR_CONF_SCAN_MODE_ANS_TYPE", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_ANS_TYPE, 0}, 2, lidar_get_lidar_conf_builder },
-    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_NAME, "GET_LIDAR_CONF_SCAN_MODE_NAME", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_NAME, 0}, 2, lidar_get_lidar_conf_builder },
-    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_TYPICAL, "GET_LIDAR_CONF_SCAN_MODE_TYPICAL", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_TYPICAL, 0}, 2, lidar_get_lidar_conf_builder },
+    { LIDAR_CMD_IDX_STOP, "STOP", LIDAR_CMD_STOP, NULL, 0, lidar_generic_builder, 0 },
+    { LIDAR_CMD_IDX_RESET, "RESET", LIDAR_CMD_RESET, NULL, 0, lidar_generic_builder, 0 },
+    { LIDAR_CMD_IDX_SCAN, "SCAN", LIDAR_CMD_SCAN, NULL, 0, lidar_generic_builder, LIDAR_RSP_TYPE_SCAN_STANDARD },
+    { LIDAR_CMD_IDX_EXPRESS_SCAN_LEGACY, "EXPRESS_SCAN_LEGACY", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_LEGACY}, 1, lidar_express_scan_builder, LIDAR_RSP_TYPE_SCAN_EXPRESS_LEGACY },
+    { LIDAR_CMD_IDX_EXPRESS_SCAN_BOOST, "EXPRESS_SCAN_BOOST", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_BOOST}, 1, lidar_express_scan_builder, LIDAR_RSP_TYPE_SCAN_EXPRESS_EXTEND },
+    { LIDAR_CMD_IDX_EXPRESS_SCAN_SENSITIVITY, "EXPRESS_SCAN_SENSITIVITY", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_SENSITIVITY}, 1, lidar_express_scan_builder, LIDAR_RSP_TYPE_SCAN_EXPRESS_EXTEND },
+    { LIDAR_CMD_IDX_EXPRESS_SCAN_STABILITY, "EXPRESS_SCAN_STABILITY", LIDAR_CMD_EXPRESS_SCAN, (const uint8_t[]){LIDAR_EXPRESS_SCAN_MODE_STABILITY}, 1, lidar_express_scan_builder, LIDAR_RSP_TYPE_SCAN_EXPRESS_EXTEND },
+    { LIDAR_CMD_IDX_FORCE_SCAN, "FORCE_SCAN", LIDAR_CMD_FORCE_SCAN, NULL, 0, lidar_generic_builder, LIDAR_RSP_TYPE_SCAN_STANDARD },
+    { LIDAR_CMD_IDX_GET_INFO, "GET_INFO", LIDAR_CMD_GET_INFO, NULL, 0, lidar_generic_builder, LIDAR_RSP_TYPE_GET_INFO },
+    { LIDAR_CMD_IDX_GET_HEALTH, "GET_HEALTH", LIDAR_CMD_GET_HEALTH, NULL, 0, lidar_generic_builder, LIDAR_RSP_TYPE_GET_HEALTH },
+    { LIDAR_CMD_IDX_GET_SAMPLERATE, "GET_SAMPLERATE", LIDAR_CMD_GET_SAMPLERATE, NULL, 0, lidar_generic_builder, LIDAR_RSP_TYPE_GET_SAMPLERATE },
+    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_COUNT, "GET_LIDAR_CONF_SCAN_MODE_COUNT", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_COUNT, 0}, 2, lidar_get_lidar_conf_builder, LIDAR_RSP_TYPE_GET_LIDAR_CONF },
+    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_SAMPLETIME, "GET_LIDAR_CONF_SCAN_MODE_SAMPLETIME", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_SAMPLETIME, 0}, 2, lidar_get_lidar_conf_builder, LIDAR_RSP_TYPE_GET_LIDAR_CONF },
+    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_MAX_DIST, "GET_LIDAR_CONF_SCAN_MODE_MAX_DIST", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_MAX_DIST, 0}, 2, lidar_get_lidar_conf_builder, LIDAR_RSP_TYPE_GET_LIDAR_CONF },
+    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_ANS_TYPE, "GET_LIDAR_CONF_SCAN_MODE_ANS_TYPE", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_ANS_TYPE, 0}, 2, lidar_get_lidar_conf_builder, LIDAR_RSP_TYPE_GET_LIDAR_CONF },
+    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_NAME, "GET_LIDAR_CONF_SCAN_MODE_NAME", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_NAME, 0}, 2, lidar_get_lidar_conf_builder, LIDAR_RSP_TYPE_GET_LIDAR_CONF },
+    { LIDAR_CMD_IDX_GET_LIDAR_CONF_SCAN_MODE_TYPICAL, "GET_LIDAR_CONF_SCAN_MODE_TYPICAL", LIDAR_CMD_GET_LIDAR_CONF, (const uint8_t[]){LIDAR_CONF_SCAN_MODE_TYPICAL, 0}, 2, lidar_get_lidar_conf_builder, LIDAR_RSP_TYPE_GET_LIDAR_CONF },
+    { LIDAR_CMD_IDX_MOTOR_SPEED_CTRL, "MOTOR_SPEED_CTRL", LIDAR_CMD_MOTOR_SPEED_CTRL, (const uint8_t[]){0, 0}, 2, lidar_generic_builder, 0 },
 };
 
 const size_t lidar_cmd_table_count = sizeof(lidar_cmd_table) / sizeof(lidar_cmd_table[0]);
 
+const lidar_cmd_entry_t *lidar_cmd_find_by_code(uint8_t code)
+{
+    for (size_t i = 0; i < lidar_cmd_table_count; ++i) {
+        if (lidar_cmd_table[i].code == code) return &lidar_cmd_table[i];
+    }
+    return NULL;
+}
+
 // Usage example:
 // size_t len = lidar_cmd_table[cmd_enum].builder(out_buf, buf_size, &lidar_cmd_table[cmd_enum]);
@@ -11,6 +11,12 @@ typedef size_t (*lidar_builder_fn)(uint8_t *out_buf, size_t buf_size, const void
 // Protocol-accurate builder for all commands (simple and payload-based)
 size_t lidar_build_cmd(uint8_t *out_buf, size_t buf_size, uint8_t cmd_code, const uint8_t *payload, size_t payload_len);
 
+// MOTOR_SPEED_CTRL with a runtime RPM (the table entry carries 0 = stop)
+size_t lidar_build_motor_speed(uint8_t *out_buf, size_t buf_size, uint16_t rpm);
+
+// GET_LIDAR_CONF query that takes a scan mode id (SAMPLETIME, MAX_DIST, ANS_TYPE, NAME)
+size_t lidar_build_conf_mode(uint8_t *out_buf, size_t buf_size, uint32_t conf_type, uint16_t mode);
+
 // Command registry entry
 typedef struct {
 	lidar_cmd_idx_t cmd;           // Enum index for direct lookup
@@ -19,6 +25,7 @@ typedef struct {
 	const uint8_t *payload;        // Static payload, or NULL
 	size_t payload_len;            // Payload length
 	lidar_builder_fn builder;      // Builder function pointer
+	uint8_t rsp_type;              // Expected response type (LIDAR_RSP_TYPE_*), 0 = no response
 } lidar_cmd_entry_t;
 
 
@@ -26,6 +33,9 @@ typedef struct {
 extern const lidar_cmd_entry_t lidar_cmd_table[];
 extern const size_t lidar_cmd_table_count;
 
+// Look up the registry entry for a protocol command code (first match), or NULL
+const lidar_cmd_entry_t *lidar_cmd_find_by_code(uint8_t code);
+
 // Helper: build a message by enum index (DRY, safe)
 static inline size_t lidar_build_by_idx(uint8_t *out_buf, size_t buf_size, lidar_cmd_idx_t idx) {
 	return lidar_cmd_table[idx].builder(out_buf, buf_size, &lidar_cmd_table[idx]);
@@ -0,0 +1,263 @@
+// lidar_motor.c
+// Rotation speed estimate + PI regulation (see lidar_motor.h)
+
+#include "lidar_motor.h"
+#include "lidar_scan.h"
+#include "lidar_session.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#if CONFIG_LIDAR_MOTOR_CTRL_LEDC
+#include "driver/ledc.h"
+#endif
+
+static const char *TAG = "lidar_motor";
+
+// Plausible rotation period window (1200..60 RPM); anything else is a missed
+// or spurious rotation start and is not fed to the loop.
+#define MOTOR_PERIOD_MIN_US    50000
+#define MOTOR_PERIOD_MAX_US    1000000
+// Reject single periods further than this fraction (Q8) from the estimate
+#define MOTOR_OUTLIER_Q8       128
+// Period EMA: est += (sample - est) >> MOTOR_EMA_SHIFT
+#define MOTOR_EMA_SHIFT        2
+
+#define MOTOR_STATS_ROTATIONS  50
+
+#if CONFIG_LIDAR_MOTOR_CTRL_LEDC
+#define MOTOR_LEDC_MODE        LEDC_LOW_SPEED_MODE
+#define MOTOR_LEDC_TIMER       LEDC_TIMER_0
+#define MOTOR_LEDC_CHANNEL     LEDC_CHANNEL_0
+#define MOTOR_LEDC_FREQ_HZ     25000            // above audible; MOTOCTL filters it
+#define MOTOR_DUTY_BITS        10
+#define MOTOR_DUTY_MAX         ((1 << MOTOR_DUTY_BITS) - 1)
+#define MOTOR_DUTY_START       600              // open-loop spin-up, ~60%
+// Gains on the RPM x10 error, Q8. Roughly 10 error units per duty count.
+#define MOTOR_KP_Q8            8
+#define MOTOR_KI_Q8            3
+#elif CONFIG_LIDAR_MOTOR_CTRL_CMD
+// The sensor runs its own speed loop; only an integral trim on the setpoint
+// is needed to remove its steady-state offset. Trim is in RPM Q8.
+#define MOTOR_KI_Q8            5
+#define MOTOR_TRIM_MAX_PCT     25
+#define MOTOR_CMD_DEADBAND_RPM 2                // skip resends smaller than this
+#define MOTOR_CMD_MIN_ROTATIONS 10              // at most one resend per this many rotations
+#endif
+
+static uint16_t target_rpm = CONFIG_LIDAR_MOTOR_TARGET_RPM;
+
+// Estimator state (coordinator task only, except the published rpm/stamp)
+static int32_t last_bin = -1;
+static int64_t last_rot_us = 0;
+static uint32_t period_est_us = 0;            // 0 = no estimate yet
+static volatile uint16_t rpm_x10 = 0;
+static volatile uint32_t rpm_stamp_ms = 0;    // 32-bit so readers never see a torn value
+
+#if !CONFIG_LIDAR_MOTOR_CTRL_NONE
+// Regulator state
+static int32_t integ_q8 = 0;
+static int32_t output = 0;                    // duty counts (LEDC) or commanded RPM (CMD)
+#else
+static const int32_t output = 0;
+#endif
+
+#if !CONFIG_LIDAR_MOTOR_CTRL_LEDC
+static uint32_t cmd_rotations = 0;            // accepted rotations since the last speed command
+static uint32_t stat_cmd_failed = 0;
+#endif
+
+static uint32_t stat_rotations = 0;
+static uint32_t stat_rejected = 0;
+static int32_t stat_err_abs_sum = 0;
+
+#if !CONFIG_LIDAR_MOTOR_CTRL_LEDC
+// Through the session so the command never lands in a pending exchange
+static bool motor_send_speed_cmd(uint16_t rpm)
+{
+    cmd_rotations = 0;
+    if (lidar_session_send_motor_speed(rpm)) return true;
+    stat_cmd_failed++;
+    ESP_LOGW(TAG, "MOTOR_SPEED_CTRL %u RPM not sent (session busy or pool full)", (unsigned)rpm);
+    return false;
+}
+#endif
+
+#if !CONFIG_LIDAR_MOTOR_CTRL_NONE
+static void motor_apply(int32_t out)
+{
+#if CONFIG_LIDAR_MOTOR_CTRL_LEDC
+    output = out;
+    ledc_set_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL, (uint32_t)out);
+    ledc_update_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL);
+#else
+    // Only a command that went out changes output, so a failed one is retried
+    if (motor_send_speed_cmd((uint16_t)out)) output = out;
+#endif
+}
+#endif
+
+// One PI step per accepted rotation; err is target - measured in RPM x10
+static void motor_regulate(int32_t err)
+{
+    if (target_rpm == 0) return;
+#if CONFIG_LIDAR_MOTOR_CTRL_LEDC
+    integ_q8 += MOTOR_KI_Q8 * err;
+    if (integ_q8 < 0) integ_q8 = 0;
+    if (integ_q8 > (MOTOR_DUTY_MAX << 8)) integ_q8 = MOTOR_DUTY_MAX << 8;
+    int32_t duty = (integ_q8 + MOTOR_KP_Q8 * err) >> 8;
+    if (duty < 0) duty = 0;
+    if (duty > MOTOR_DUTY_MAX) duty = MOTOR_DUTY_MAX;
+    if (duty != output) motor_apply(duty);
+#elif CONFIG_LIDAR_MOTOR_CTRL_CMD
+    int32_t trim_max = ((int32_t)target_rpm * MOTOR_TRIM_MAX_PCT / 100) << 8;
+    integ_q8 += MOTOR_KI_Q8 * err / 10;
+    if (integ_q8 > trim_max) integ_q8 = trim_max;
+    if (integ_q8 < -trim_max) integ_q8 = -trim_max;
+    int32_t rpm = (int32_t)target_rpm + (integ_q8 >> 8);
+    int32_t diff = rpm - output;
+    if (++cmd_rotations < MOTOR_CMD_MIN_ROTATIONS) return;
+    if (diff >= MOTOR_CMD_DEADBAND_RPM || diff <= -MOTOR_CMD_DEADBAND_RPM) motor_apply(rpm);
+#else
+    (void)err;
+#endif
+}
+
+static void motor_on_rotation(int64_t t_us)
+{
+    int64_t prev = last_rot_us;
+    last_rot_us = t_us;
+    if (prev == 0) return;
+
+    uint32_t period = (uint32_t)(t_us - prev);
+    if (period < MOTOR_PERIOD_MIN_US || period > MOTOR_PERIOD_MAX_US) {
+        stat_rejected++;
+        return;
+    }
+    if (period_est_us == 0) {
+        period_est_us = period;
+    } else {
+        uint32_t dev = period > period_est_us ? period - period_est_us : period_est_us - period;
+        if (dev > ((period_est_us * MOTOR_OUTLIER_Q8) >> 8)) {
+            stat_rejected++;
+            return;
+        }
+        period_est_us = (uint32_t)((int32_t)period_est_us + (((int32_t)period - (int32_t)period_est_us) >> MOTOR_EMA_SHIFT));
+    }
+
+    uint16_t rpm = (uint16_t)(600000000u / period_est_us);
+    rpm_x10 = rpm;
+    rpm_stamp_ms = (uint32_t)(t_us / 1000);
+
+    int32_t err = (int32_t)target_rpm * 10 - (int32_t)rpm;
+    motor_regulate(err);
+
+    stat_err_abs_sum += err < 0 ? -err : err;
+    if (++stat_rotations >= MOTOR_STATS_ROTATIONS) {
+#if !CONFIG_LIDAR_MOTOR_CTRL_LEDC
+        ESP_LOGI(TAG, "%u.%u RPM (target %u), mean |err| %u.%u RPM, output %d, %u rejected, %u commands failed",
+                 (unsigned)(rpm / 10), (unsigned)(rpm % 10), (unsigned)target_rpm,
+                 (unsigned)(stat_err_abs_sum / stat_rotations / 10), (unsigned)(stat_err_abs_sum / stat_rotations % 10),
+                 (int)output, (unsigned)stat_rejected, (unsigned)stat_cmd_failed);
+        stat_cmd_failed = 0;
+#else
+        ESP_LOGI(TAG, "%u.%u RPM (target %u), mean |err| %u.%u RPM, output %d, %u rejected",
+                 (unsigned)(rpm / 10), (unsigned)(rpm % 10), (unsigned)target_rpm,
+                 (unsigned)(stat_err_abs_sum / stat_rotations / 10), (unsigned)(stat_err_abs_sum / stat_rotations % 10),
+                 (int)output, (unsigned)stat_rejected);
+#endif
+        stat_rotations = 0;
+        stat_rejected = 0;
+        stat_err_abs_sum = 0;
+    }
+}
+
+// Point sink: a bin index falling back by more than half a turn is a rotation start
+static void motor_point_sink(uint16_t bin, uint16_t dist_mm, uint8_t quality, int64_t t_us)
+{
+    (void)dist_mm;
+    (void)quality;
+    if (last_bin >= 0 && (int32_t)bin + LIDAR_SCAN_BINS / 2 < last_bin) {
+        motor_on_rotation(t_us);
+    }
+    last_bin = bin;
+}
+
+void lidar_motor_init(void)
+{
+#if CONFIG_LIDAR_MOTOR_CTRL_LEDC
+    ledc_timer_config_t timer_cfg = {
+        .speed_mode = MOTOR_LEDC_MODE,
+        .duty_resolution = MOTOR_DUTY_BITS,
+        .timer_num = MOTOR_LEDC_TIMER,
+        .freq_hz = MOTOR_LEDC_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK,
+    };
+    ledc_channel_config_t ch_cfg = {
+        .gpio_num = CONFIG_LIDAR_MOTOR_PWM_GPIO,
+        .speed_mode = MOTOR_LEDC_MODE,
+        .channel = MOTOR_LEDC_CHANNEL,
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = MOTOR_LEDC_TIMER,
+        .duty = 0,
+        .hpoint = 0,
+    };
+    if (ledc_timer_config(&timer_cfg) != ESP_OK || ledc_channel_config(&ch_cfg) != ESP_OK) {
+        ESP_LOGE(TAG, "LEDC setup failed on GPIO %d", CONFIG_LIDAR_MOTOR_PWM_GPIO);
+        return;
+    }
+    // Spin up open loop now so the sensor is at speed when the scan starts
+    integ_q8 = target_rpm ? (MOTOR_DUTY_START << 8) : 0;
+    motor_apply(integ_q8 >> 8);
+#endif
+    if (!lidar_scan_add_point_sink(motor_point_sink)) {
+        ESP_LOGE(TAG, "Could not register rotation sink; RPM estimate disabled");
+        return;
+    }
+    ESP_LOGI(TAG, "Target %u RPM", (unsigned)target_rpm);
+}
+
+void lidar_motor_start(void)
+{
+    lidar_motor_stop();
+#if CONFIG_LIDAR_MOTOR_CTRL_CMD
+    integ_q8 = 0;
+    output = 0;                         // force the first regulated resend if this one fails
+    motor_apply(target_rpm);
+#endif
+}
+
+void lidar_motor_stop(void)
+{
+    last_bin = -1;
+    last_rot_us = 0;
+    period_est_us = 0;
+    rpm_x10 = 0;
+}
+
+void lidar_motor_set_target_rpm(uint16_t rpm)
+{
+    target_rpm = rpm;
+#if CONFIG_LIDAR_MOTOR_CTRL_LEDC
+    if (rpm == 0) {
+        integ_q8 = 0;
+        motor_apply(0);
+    } else if (output == 0) {
+        integ_q8 = MOTOR_DUTY_START << 8;
+        motor_apply(MOTOR_DUTY_START);
+    }
+#elif CONFIG_LIDAR_MOTOR_CTRL_CMD
+    integ_q8 = 0;
+    motor_apply(rpm);
+#else
+    motor_send_speed_cmd(rpm);          // not regulated: pass the request through
+#endif
+    ESP_LOGI(TAG, "Target set to %u RPM", (unsigned)rpm);
+}
+
+uint16_t lidar_motor_rpm_x10(void)
+{
+    uint32_t stamp = rpm_stamp_ms;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (stamp == 0 || now_ms - stamp > LIDAR_MOTOR_STALE_US / 1000) return 0;
+    return rpm_x10;
+}
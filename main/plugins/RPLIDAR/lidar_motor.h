@@ -0,0 +1,34 @@
+// lidar_motor.h
+// LIDAR rotation speed: RPM estimate from rotation-start timestamps and a PI
+// loop that holds CONFIG_LIDAR_MOTOR_TARGET_RPM, acting either through
+// MOTOR_SPEED_CTRL or a LEDC PWM on MOTOCTL (see Kconfig "LIDAR").
+// MOTOR_SPEED_CTRL is S-series only (A1/A2 ignore it) and goes out through
+// lidar_session, at most once per MOTOR_CMD_MIN_ROTATIONS rotations.
+//
+// All functions except lidar_motor_rpm_x10() run in the LIDAR coordinator task.
+
+#ifndef LIDAR_MOTOR_H
+#define LIDAR_MOTOR_H
+
+#include <stdint.h>
+
+// Estimates older than this read as stopped
+#define LIDAR_MOTOR_STALE_US       1000000
+
+// Set up PWM (if used) and hook the estimator into the scan assembler
+void lidar_motor_init(void);
+
+// A scan stream started: re-arm the estimator and apply the current setpoint
+void lidar_motor_start(void);
+
+// Scan stopped: forget timing so the loop does not wind up on stale data
+void lidar_motor_stop(void);
+
+// Change the regulated speed. 0 stops the motor and disables regulation.
+// With regulation off (estimate only) the request goes straight to the sensor.
+void lidar_motor_set_target_rpm(uint16_t rpm);
+
+// Latest smoothed estimate in RPM x10, 0 if not rotating (safe from any task)
+uint16_t lidar_motor_rpm_x10(void);
+
+#endif // LIDAR_MOTOR_H
@@ -0,0 +1,274 @@
+// lidar_obstacle.c
+// Per-frame obstacle query index (see lidar_obstacle.h)
+
+#include <math.h>
+#include <string.h>
+#include "lidar_obstacle.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "lidar_obstacle";
+
+#define OBST_CELLS          (LIDAR_OBSTACLE_GRID_DIM * LIDAR_OBSTACLE_GRID_DIM)
+#define OBST_HALF_MM        (LIDAR_OBSTACLE_GRID_DIM * LIDAR_OBSTACLE_CELL_MM / 2)
+#define OBST_MRAD_PER_TURN  6283.1853f
+#define OBST_STATS_FRAMES   100
+
+// Tree entries pack (dist << 16) | bin, so one unsigned min yields the
+// closest return and its bin; empty bins hold LIDAR_OBSTACLE_NONE.
+typedef struct {
+    uint32_t tree[2 * LIDAR_SCAN_BINS];             // leaves at [LIDAR_SCAN_BINS + bin]
+    uint16_t cell_start[OBST_CELLS + 1];            // points of cell c: [cell_start[c], cell_start[c + 1])
+    int16_t  px[LIDAR_SCAN_BINS];
+    int16_t  py[LIDAR_SCAN_BINS];
+    uint32_t seq;
+    int64_t  t_end_us;
+    bool     valid;
+} obst_index_t;
+
+static obst_index_t *obst_buf[2] = { NULL, NULL };
+static obst_index_t *obst_front = NULL;             // read by queries (under obst_mutex)
+static obst_index_t *obst_back = NULL;              // written by the builder
+static SemaphoreHandle_t obst_mutex = NULL;
+static uint16_t obst_cell_of[LIDAR_SCAN_BINS];      // build scratch
+
+static uint64_t stats_sum_us = 0;
+static uint32_t stats_max_us = 0;
+static uint32_t stats_count = 0;
+
+bool lidar_obstacle_init(void)
+{
+    if (obst_mutex) return true;
+    for (int i = 0; i < 2; ++i) {
+        obst_buf[i] = heap_caps_calloc(1, sizeof(obst_index_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!obst_buf[i]) {
+            ESP_LOGW(TAG, "PSRAM index alloc failed; using internal RAM");
+            obst_buf[i] = heap_caps_calloc(1, sizeof(obst_index_t), MALLOC_CAP_8BIT);
+        }
+        if (!obst_buf[i]) {
+            ESP_LOGE(TAG, "Index allocation failed (%u bytes)", (unsigned)sizeof(obst_index_t));
+            return false;
+        }
+    }
+    obst_mutex = xSemaphoreCreateMutex();
+    if (!obst_mutex) return false;
+    obst_front = obst_buf[0];
+    obst_back = obst_buf[1];
+    return true;
+}
+
+static void obst_build_tree(obst_index_t *ix, const lidar_scan_frame_t *f)
+{
+    uint32_t *t = ix->tree;
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        uint32_t d = f->dist_mm[i] ? f->dist_mm[i] : LIDAR_OBSTACLE_NONE;
+        t[LIDAR_SCAN_BINS + i] = (d << 16) | (uint32_t)i;
+    }
+    for (int i = LIDAR_SCAN_BINS - 1; i > 0; --i) {
+        uint32_t a = t[2 * i];
+        uint32_t b = t[2 * i + 1];
+        t[i] = a < b ? a : b;
+    }
+}
+
+// Counting sort of the Cartesian points by cell
+static void obst_build_grid(obst_index_t *ix, const lidar_scan_frame_t *f)
+{
+    uint16_t *start = ix->cell_start;
+    memset(start, 0, sizeof(ix->cell_start));
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        uint16_t c = OBST_CELLS;
+        if (f->dist_mm[i]) {
+            int32_t cx = (f->x_mm[i] + OBST_HALF_MM) / LIDAR_OBSTACLE_CELL_MM;
+            int32_t cy = (f->y_mm[i] + OBST_HALF_MM) / LIDAR_OBSTACLE_CELL_MM;
+            if (f->x_mm[i] + OBST_HALF_MM >= 0 && f->y_mm[i] + OBST_HALF_MM >= 0 &&
+                cx < LIDAR_OBSTACLE_GRID_DIM && cy < LIDAR_OBSTACLE_GRID_DIM) {
+                c = (uint16_t)(cy * LIDAR_OBSTACLE_GRID_DIM + cx);
+                start[c + 1]++;
+            }
+        }
+        obst_cell_of[i] = c;
+    }
+    for (int c = 0; c < OBST_CELLS; ++c) {
+        start[c + 1] += start[c];
+    }
+    // Place points using start[] as write cursors, then shift it back
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        uint16_t c = obst_cell_of[i];
+        if (c == OBST_CELLS) continue;
+        uint16_t pos = start[c]++;
+        ix->px[pos] = f->x_mm[i];
+        ix->py[pos] = f->y_mm[i];
+    }
+    for (int c = OBST_CELLS; c > 0; --c) {
+        start[c] = start[c - 1];
+    }
+    start[0] = 0;
+}
+
+void lidar_obstacle_build(const lidar_scan_frame_t *f)
+{
+    if (!obst_mutex || !f) return;
+    int64_t t0 = esp_timer_get_time();
+
+    obst_index_t *ix = obst_back;
+    obst_build_tree(ix, f);
+    obst_build_grid(ix, f);
+    ix->seq = f->seq;
+    ix->t_end_us = f->t_end_us;
+    ix->valid = true;
+
+    xSemaphoreTake(obst_mutex, portMAX_DELAY);
+    obst_back = obst_front;
+    obst_front = ix;
+    xSemaphoreGive(obst_mutex);
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    stats_sum_us += dt;
+    if (dt > stats_max_us) stats_max_us = dt;
+    if (++stats_count >= OBST_STATS_FRAMES) {
+        ESP_LOGI(TAG, "Index build: avg %u us, max %u us over %u frames",
+                 (unsigned)(stats_sum_us / stats_count), (unsigned)stats_max_us, (unsigned)stats_count);
+        stats_sum_us = 0;
+        stats_max_us = 0;
+        stats_count = 0;
+    }
+}
+
+// Bins run clockwise from forward; mrad run CCW
+static int32_t obst_mrad_to_bin(int16_t mrad)
+{
+    int32_t bin = (int32_t)lrintf(-(float)mrad * LIDAR_SCAN_BINS / OBST_MRAD_PER_TURN);
+    bin %= LIDAR_SCAN_BINS;
+    return bin < 0 ? bin + LIDAR_SCAN_BINS : bin;
+}
+
+static int16_t obst_bin_to_mrad(uint32_t bin)
+{
+    float a = -(float)bin * OBST_MRAD_PER_TURN / LIDAR_SCAN_BINS;
+    if (a <= -OBST_MRAD_PER_TURN / 2) a += OBST_MRAD_PER_TURN;
+    return (int16_t)lrintf(a);
+}
+
+// Min over bins [lo, hi] (inclusive, lo <= hi)
+static uint32_t obst_tree_min(const uint32_t *t, int32_t lo, int32_t hi)
+{
+    uint32_t res = UINT32_MAX;
+    for (lo += LIDAR_SCAN_BINS, hi += LIDAR_SCAN_BINS + 1; lo < hi; lo >>= 1, hi >>= 1) {
+        if (lo & 1) {
+            if (t[lo] < res) res = t[lo];
+            lo++;
+        }
+        if (hi & 1) {
+            --hi;
+            if (t[hi] < res) res = t[hi];
+        }
+    }
+    return res;
+}
+
+bool lidar_obstacle_sector_min(int16_t from_mrad, int16_t to_mrad, lidar_obstacle_hit_t *hit)
+{
+    if (!obst_mutex || !hit) return false;
+    // CCW from -> to is clockwise (increasing bins) from bin(to) to bin(from)
+    int32_t lo = obst_mrad_to_bin(to_mrad);
+    int32_t hi = obst_mrad_to_bin(from_mrad);
+
+    xSemaphoreTake(obst_mutex, portMAX_DELAY);
+    const obst_index_t *ix = obst_front;
+    bool valid = ix->valid;
+    uint32_t m = UINT32_MAX;
+    if (valid) {
+        if (lo <= hi) {
+            m = obst_tree_min(ix->tree, lo, hi);
+        } else {
+            uint32_t a = obst_tree_min(ix->tree, lo, LIDAR_SCAN_BINS - 1);
+            uint32_t b = obst_tree_min(ix->tree, 0, hi);
+            m = a < b ? a : b;
+        }
+    }
+    xSemaphoreGive(obst_mutex);
+    if (!valid) return false;
+
+    hit->dist_mm = (uint16_t)(m >> 16);
+    hit->angle_mrad = hit->dist_mm == LIDAR_OBSTACLE_NONE ? 0 : obst_bin_to_mrad(m & 0xFFFFu);
+    return true;
+}
+
+bool lidar_obstacle_corridor_clear(int16_t heading_mrad, uint16_t width_mm, uint16_t length_mm,
+                                   bool *clear, uint16_t *block_mm)
+{
+    if (!obst_mutex || !clear) return false;
+
+    float c = cosf(heading_mrad * 1e-3f);
+    float s = sinf(heading_mrad * 1e-3f);
+    float hw = width_mm * 0.5f;
+    float len = length_mm;
+    // Cell-centre test margin: half the cell diagonal
+    const float margin = LIDAR_OBSTACLE_CELL_MM * 0.7072f;
+
+    // Bounding box of the corridor corners, in cells
+    float xs[4] = { -s * hw, s * hw, len * c - s * hw, len * c + s * hw };
+    float ys[4] = { c * hw, -c * hw, len * s + c * hw, len * s - c * hw };
+    float x0 = xs[0], x1 = xs[0], y0 = ys[0], y1 = ys[0];
+    for (int i = 1; i < 4; ++i) {
+        x0 = fminf(x0, xs[i]);
+        x1 = fmaxf(x1, xs[i]);
+        y0 = fminf(y0, ys[i]);
+        y1 = fmaxf(y1, ys[i]);
+    }
+    int32_t cx0 = (int32_t)floorf((x0 + OBST_HALF_MM) / LIDAR_OBSTACLE_CELL_MM);
+    int32_t cx1 = (int32_t)floorf((x1 + OBST_HALF_MM) / LIDAR_OBSTACLE_CELL_MM);
+    int32_t cy0 = (int32_t)floorf((y0 + OBST_HALF_MM) / LIDAR_OBSTACLE_CELL_MM);
+    int32_t cy1 = (int32_t)floorf((y1 + OBST_HALF_MM) / LIDAR_OBSTACLE_CELL_MM);
+    if (cx0 < 0) cx0 = 0;
+    if (cy0 < 0) cy0 = 0;
+    if (cx1 >= LIDAR_OBSTACLE_GRID_DIM) cx1 = LIDAR_OBSTACLE_GRID_DIM - 1;
+    if (cy1 >= LIDAR_OBSTACLE_GRID_DIM) cy1 = LIDAR_OBSTACLE_GRID_DIM - 1;
+
+    xSemaphoreTake(obst_mutex, portMAX_DELAY);
+    const obst_index_t *ix = obst_front;
+    bool valid = ix->valid;
+    float best = len + 1.0f;
+    for (int32_t cy = cy0; valid && cy <= cy1; ++cy) {
+        float ccy = (cy + 0.5f) * LIDAR_OBSTACLE_CELL_MM - OBST_HALF_MM;
+        for (int32_t cx = cx0; cx <= cx1; ++cx) {
+            uint16_t cell = (uint16_t)(cy * LIDAR_OBSTACLE_GRID_DIM + cx);
+            uint16_t p = ix->cell_start[cell];
+            uint16_t end = ix->cell_start[cell + 1];
+            if (p == end) continue;
+            float ccx = (cx + 0.5f) * LIDAR_OBSTACLE_CELL_MM - OBST_HALF_MM;
+            float cu = ccx * c + ccy * s;
+            float cv = -ccx * s + ccy * c;
+            if (cu < -margin || cu > len + margin || fabsf(cv) > hw + margin) continue;
+            for (; p < end; ++p) {
+                float u = ix->px[p] * c + ix->py[p] * s;
+                float v = -ix->px[p] * s + ix->py[p] * c;
+                if (u > 0.0f && u <= len && fabsf(v) <= hw && u < best) best = u;
+            }
+        }
+    }
+    xSemaphoreGive(obst_mutex);
+    if (!valid) return false;
+
+    *clear = best > len;
+    if (block_mm) *block_mm = *clear ? LIDAR_OBSTACLE_NONE : (uint16_t)lrintf(best);
+    return true;
+}
+
+bool lidar_obstacle_frame_info(uint32_t *seq, uint32_t *age_ms)
+{
+    if (!obst_mutex) return false;
+    xSemaphoreTake(obst_mutex, portMAX_DELAY);
+    bool valid = obst_front->valid;
+    uint32_t s = obst_front->seq;
+    int64_t t = obst_front->t_end_us;
+    xSemaphoreGive(obst_mutex);
+    if (!valid) return false;
+    if (seq) *seq = s;
+    if (age_ms) *age_ms = (uint32_t)((esp_timer_get_time() - t) / 1000);
+    return true;
+}
@@ -0,0 +1,55 @@
+// lidar_obstacle.h
+// Nearest-obstacle queries over the latest LIDAR frame, for controllers that
+// poll at high rate (motor, avoidance) and must not rescan 1440 bins each time.
+//
+// Built once per frame by the assembler, after filtering and de-skew:
+//   - a min segment tree over the angular bins (range in mm) for sector
+//     minimum queries in O(log n)
+//   - a coarse Cartesian bucket grid (points sorted by cell) for corridor
+//     queries that only visit cells overlapping the corridor
+// The index is double buffered: queries take a mutex only for their own
+// duration and the builder only to swap buffers, so readers in any task see
+// one consistent frame.
+//
+// Angles follow the heading controller convention (heading_cmd.h): mrad, CCW
+// positive, 0 = robot forward. Distances are from the sensor origin.
+
+#ifndef LIDAR_OBSTACLE_H
+#define LIDAR_OBSTACLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lidar_scan.h"
+
+#define LIDAR_OBSTACLE_CELL_MM      100
+#define LIDAR_OBSTACLE_GRID_DIM     64      // cells per side, sensor-centred (±3.2 m)
+#define LIDAR_OBSTACLE_NONE         0xFFFF  // no return in the queried region
+
+typedef struct {
+    uint16_t dist_mm;       // LIDAR_OBSTACLE_NONE if the sector is empty
+    int16_t  angle_mrad;    // direction of the closest return
+} lidar_obstacle_hit_t;
+
+// Allocate the index buffers (called by lidar_scan_init)
+bool lidar_obstacle_init(void);
+
+// Rebuild from a closed frame (assembler only)
+void lidar_obstacle_build(const lidar_scan_frame_t *f);
+
+// Closest return with angle in the CCW sector from_mrad -> to_mrad (may wrap
+// through 180°). Returns false if no frame has been indexed yet.
+bool lidar_obstacle_sector_min(int16_t from_mrad, int16_t to_mrad, lidar_obstacle_hit_t *hit);
+
+// Is the rectangle that starts at the sensor and runs along heading_mrad,
+// width_mm wide (centred) and length_mm long, free of returns? *block_mm
+// (optional) gets the distance along the corridor to the first return in it,
+// or LIDAR_OBSTACLE_NONE. Only the bucket grid is searched, so length is
+// effectively capped at its half-size. Returns false if no frame has been
+// indexed yet (treat as blocked).
+bool lidar_obstacle_corridor_clear(int16_t heading_mrad, uint16_t width_mm, uint16_t length_mm,
+                                   bool *clear, uint16_t *block_mm);
+
+// Sequence number and age of the indexed frame. Returns false if none yet.
+bool lidar_obstacle_frame_info(uint32_t *seq, uint32_t *age_ms);
+
+#endif // LIDAR_OBSTACLE_H
@@ -1,5 +1,6 @@
 #include "lidar_response_parser.h"
 #include "lidar_protocol_rsp.h"
+#include "lidar_protocol_cmd.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -7,6 +8,11 @@
 #define LIDAR_PARSE_FIXED(payload, len, out_struct_ptr) \
     ((len) >= sizeof(*(out_struct_ptr)) ? (memcpy((out_struct_ptr), (payload), sizeof(*(out_struct_ptr))), true) : false)
 
+_Static_assert(sizeof(lidar_info_response_t) <= LIDAR_RESP_PARSED_MAX, "parsed scratch too small");
+_Static_assert(sizeof(lidar_health_response_t) <= LIDAR_RESP_PARSED_MAX, "parsed scratch too small");
+_Static_assert(sizeof(lidar_samplerate_response_t) <= LIDAR_RESP_PARSED_MAX, "parsed scratch too small");
+_Static_assert(sizeof(lidar_conf_response_t) <= LIDAR_RESP_PARSED_MAX, "parsed scratch too small");
+
 // --- GET_INFO parser (now uses macro) ---
 bool lidar_parse_info(const uint8_t *payload, size_t len, void *out_struct, const void *unused) {
     return LIDAR_PARSE_FIXED(payload, len, (lidar_info_response_t *)out_struct);
@@ -22,22 +28,100 @@ void lidar_format_info(const void *out_struct, char *buf, size_t buf_len, const
         info->serial[0], info->serial[1], info->serial[2]);
 }
 
-// --- Parser registry (sparse, NULL for unused codes) ---
+// --- GET_HEALTH ---
+bool lidar_parse_health(const uint8_t *payload, size_t len, void *out_struct, const void *unused) {
+    return LIDAR_PARSE_FIXED(payload, len, (lidar_health_response_t *)out_struct);
+}
 
-const lidar_response_parser_entry_t *lidar_response_parser_table[LIDAR_RESP_TYPE_MAX] = {0};
+void lidar_format_health(const void *out_struct, char *buf, size_t buf_len, const void *struct_info) {
+    if (!out_struct || !buf || buf_len < 1) return;
+    const lidar_health_response_t *h = (const lidar_health_response_t *)out_struct;
+    static const char *const status_names[] = { "Good", "Warning", "Error" };
+    const char *status = h->status < 3 ? status_names[h->status] : "Unknown";
+    snprintf(buf, buf_len, "Health: %s (error code 0x%04X)", status, (unsigned)h->error_code);
+}
 
+// --- GET_SAMPLERATE ---
+bool lidar_parse_samplerate(const uint8_t *payload, size_t len, void *out_struct, const void *unused) {
+    return LIDAR_PARSE_FIXED(payload, len, (lidar_samplerate_response_t *)out_struct);
+}
 
-// GET_INFO entry
-static const lidar_response_parser_entry_t get_info_entry = {
-    LIDAR_RSP_TYPE_GET_INFO, "GET_INFO", lidar_parse_info, NULL, lidar_format_info
-};
+void lidar_format_samplerate(const void *out_struct, char *buf, size_t buf_len, const void *struct_info) {
+    if (!out_struct || !buf || buf_len < 1) return;
+    const lidar_samplerate_response_t *r = (const lidar_samplerate_response_t *)out_struct;
+    snprintf(buf, buf_len, "Sample time: standard %u us, express %u us",
+        (unsigned)r->t_standard_us, (unsigned)r->t_express_us);
+}
+
+// --- GET_LIDAR_CONF (variable layout: 32-bit type, then type-specific data) ---
+bool lidar_parse_conf(const uint8_t *payload, size_t len, void *out_struct, const void *unused) {
+    if (!payload || len < 4 || !out_struct) return false;
+    lidar_conf_response_t *c = (lidar_conf_response_t *)out_struct;
+    memset(c, 0, sizeof(*c));
+    c->type = (uint32_t)payload[0] | ((uint32_t)payload[1] << 8) |
+              ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    const uint8_t *data = payload + 4;
+    size_t data_len = len - 4;
+    c->data_len = (uint8_t)(data_len > 0xFF ? 0xFF : data_len);
 
+    if (c->type == LIDAR_CONF_SCAN_MODE_NAME) {
+        size_t n = data_len < (LIDAR_CONF_NAME_MAX - 1) ? data_len : (LIDAR_CONF_NAME_MAX - 1);
+        memcpy(c->name, data, n);
+        c->name[n] = '\0';
+        return true;
+    }
+    // Numeric answers are little-endian, 1 to 4 bytes depending on type
+    for (size_t i = 0; i < data_len && i < 4; ++i) {
+        c->value |= (uint32_t)data[i] << (8 * i);
+    }
+    return data_len > 0;
+}
 
-// Registry setup (call once at startup)
-void lidar_response_parser_init(void) {
-    memset((void*)lidar_response_parser_table, 0, sizeof(lidar_response_parser_table));
-    lidar_response_parser_table[LIDAR_RSP_TYPE_GET_INFO] = &get_info_entry;
-    // Add more as needed, using LIDAR_RSP_TYPE_* defines
+void lidar_format_conf(const void *out_struct, char *buf, size_t buf_len, const void *struct_info) {
+    if (!out_struct || !buf || buf_len < 1) return;
+    const lidar_conf_response_t *c = (const lidar_conf_response_t *)out_struct;
+    switch (c->type) {
+    case LIDAR_CONF_SCAN_MODE_COUNT:
+        snprintf(buf, buf_len, "Scan modes: %u", (unsigned)c->value);
+        break;
+    case LIDAR_CONF_SCAN_MODE_TYPICAL:
+        snprintf(buf, buf_len, "Typical scan mode: %u", (unsigned)c->value);
+        break;
+    case LIDAR_CONF_SCAN_MODE_SAMPLETIME:
+        snprintf(buf, buf_len, "Mode sample time: %u.%02u us",
+            (unsigned)(c->value >> 8), (unsigned)(((c->value & 0xFF) * 100) >> 8));
+        break;
+    case LIDAR_CONF_SCAN_MODE_MAX_DIST:
+        snprintf(buf, buf_len, "Mode max distance: %u.%02u m",
+            (unsigned)(c->value >> 8), (unsigned)(((c->value & 0xFF) * 100) >> 8));
+        break;
+    case LIDAR_CONF_SCAN_MODE_ANS_TYPE:
+        snprintf(buf, buf_len, "Mode answer type: 0x%02X", (unsigned)c->value);
+        break;
+    case LIDAR_CONF_SCAN_MODE_NAME:
+        snprintf(buf, buf_len, "Mode name: %s", c->name);
+        break;
+    default:
+        snprintf(buf, buf_len, "Conf 0x%08X: %u (%u bytes)",
+            (unsigned)c->type, (unsigned)c->value, (unsigned)c->data_len);
+        break;
+    }
 }
 
+// --- Parser registry (sparse, indexed by response type; unused codes are zero) ---
+const lidar_response_parser_entry_t lidar_response_parser_table[LIDAR_RESP_TYPE_MAX] = {
+    [LIDAR_RSP_TYPE_GET_INFO] = {
+        LIDAR_RSP_TYPE_GET_INFO, "GET_INFO", lidar_parse_info, NULL, lidar_format_info
+    },
+    [LIDAR_RSP_TYPE_GET_HEALTH] = {
+        LIDAR_RSP_TYPE_GET_HEALTH, "GET_HEALTH", lidar_parse_health, NULL, lidar_format_health
+    },
+    [LIDAR_RSP_TYPE_GET_SAMPLERATE] = {
+        LIDAR_RSP_TYPE_GET_SAMPLERATE, "GET_SAMPLERATE", lidar_parse_samplerate, NULL, lidar_format_samplerate
+    },
+    [LIDAR_RSP_TYPE_GET_LIDAR_CONF] = {
+        LIDAR_RSP_TYPE_GET_LIDAR_CONF, "GET_LIDAR_CONF", lidar_parse_conf, NULL, lidar_format_conf
+    },
+};
+
 const size_t lidar_response_parser_table_size = LIDAR_RESP_TYPE_MAX;
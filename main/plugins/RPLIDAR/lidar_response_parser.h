@@ -16,6 +16,31 @@ typedef struct {
     uint8_t serial[16];
 } lidar_info_response_t;
 
+// GET_HEALTH response (PDF Sec 5.2.6)
+typedef struct __attribute__((packed)) {
+    uint8_t status;         // LIDAR_HEALTH_STATUS_*
+    uint16_t error_code;
+} lidar_health_response_t;
+
+// GET_SAMPLERATE response (PDF Sec 5.2.9), microseconds per sample
+typedef struct __attribute__((packed)) {
+    uint16_t t_standard_us;
+    uint16_t t_express_us;
+} lidar_samplerate_response_t;
+
+// GET_LIDAR_CONF response (PDF Sec 5.2.10): echoed type + type-dependent data.
+// Numeric answers land in value (SAMPLETIME/MAX_DIST are Q8), NAME in name.
+#define LIDAR_CONF_NAME_MAX 24
+typedef struct {
+    uint32_t type;          // LIDAR_CONF_* echoed by the sensor
+    uint32_t value;
+    uint8_t data_len;       // bytes after the type field
+    char name[LIDAR_CONF_NAME_MAX];
+} lidar_conf_response_t;
+
+// Largest parsed struct: size of the scratch buffer callers pass to parsers
+#define LIDAR_RESP_PARSED_MAX 48
+
 
 // Unified parser function signature
 // Accepts struct metadata for generic parsing
@@ -42,21 +67,30 @@ typedef struct {
 
 
 
-// Parser registry (extern)
-extern const lidar_response_parser_entry_t *lidar_response_parser_table[LIDAR_RESP_TYPE_MAX];
+// Parser registry, indexed by response type. Const and fully built at compile
+// time (lives in flash); unused codes have parser == NULL.
+extern const lidar_response_parser_entry_t lidar_response_parser_table[LIDAR_RESP_TYPE_MAX];
 extern const size_t lidar_response_parser_table_size;
 
-// Initialization function
-void lidar_response_parser_init(void);
-
-
+// Registry lookup: returns NULL when no parser handles the response type
+static inline const lidar_response_parser_entry_t *lidar_response_parser_find(uint8_t response_type) {
+    if (response_type >= LIDAR_RESP_TYPE_MAX) return NULL;
+    const lidar_response_parser_entry_t *e = &lidar_response_parser_table[response_type];
+    return e->parser ? e : NULL;
+}
 
 // For fixed-layout responses, struct_info is unused (pass NULL). Parsing is handled by the LIDAR_PARSE_FIXED macro in the .c file.
 
 // GET_INFO parser (can use generic or custom)
 bool lidar_parse_info(const uint8_t *payload, size_t len, void *out_struct, const void *struct_info);
+bool lidar_parse_health(const uint8_t *payload, size_t len, void *out_struct, const void *struct_info);
+bool lidar_parse_samplerate(const uint8_t *payload, size_t len, void *out_struct, const void *struct_info);
+bool lidar_parse_conf(const uint8_t *payload, size_t len, void *out_struct, const void *struct_info);
 
-// Example formatter
+// Formatters (human-readable one-liners for the log/USB path)
 void lidar_format_info(const void *out_struct, char *buf, size_t buf_len, const void *struct_info);
+void lidar_format_health(const void *out_struct, char *buf, size_t buf_len, const void *struct_info);
+void lidar_format_samplerate(const void *out_struct, char *buf, size_t buf_len, const void *struct_info);
+void lidar_format_conf(const void *out_struct, char *buf, size_t buf_len, const void *struct_info);
 
 #endif // LIDAR_RESPONSE_PARSER_H
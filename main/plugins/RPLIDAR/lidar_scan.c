@@ -0,0 +1,336 @@
+// lidar_scan.c
+// Standard scan stream decoder + 360° frame assembler (see lidar_scan.h)
+
+#include <string.h>
+#include "lidar_scan.h"
+#include "lidar_cartesian.h"
+#include "lidar_scan_filter.h"
+#include "lidar_deskew.h"
+#include "lidar_obstacle.h"
+#include "lidar_protocol_rsp.h"
+#include "dispatcher_pool.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "lidar_scan";
+
+// Closed frames go to the processing task (filter, Cartesian, de-skew,
+// obstacle index, publish) so the coordinator keeps draining the UART.
+// Below the coordinator's priority: node decoding always wins.
+#define SCAN_PROC_TASK_STACK    6144
+#define SCAN_PROC_TASK_PRIORITY 7
+#define SCAN_PROC_QUEUE_LEN     2       // frames waiting; a full queue drops the newest
+
+static bool scan_ready = false;
+static lidar_scan_frame_t *scan_cur = NULL;      // frame being filled (NULL: pool exhausted)
+static lidar_frame_handle_t scan_cur_handle = LIDAR_FRAME_HANDLE_NONE;
+static uint32_t scan_seq = 0;
+static bool scan_synced = false;                 // true once the first rotation-start node was seen
+
+static uint8_t node_buf[LIDAR_SCAN_NODE_SIZE];
+static size_t node_len = 0;
+
+static dispatch_target_t scan_subscribers[LIDAR_SCAN_MAX_SUBSCRIBERS];
+static size_t scan_subscriber_count = 0;
+
+static lidar_scan_point_sink_t scan_point_sinks[LIDAR_SCAN_MAX_POINT_SINKS];
+static size_t scan_point_sink_count = 0;
+
+static uint32_t scan_sample_us_q8 = LIDAR_SCAN_DEFAULT_SAMPLE_US_Q8;
+static int64_t scan_last_t_us = 0;               // timestamp given to the previous node
+
+static uint32_t scan_resync_bytes = 0;           // bytes dropped while hunting for node alignment
+static uint32_t scan_pool_drops = 0;             // revolutions skipped because no frame was free
+static volatile uint32_t scan_node_total = 0;    // well-formed nodes seen (incl. before sync)
+
+static QueueHandle_t scan_proc_queue = NULL;     // lidar_frame_handle_t, one reference each
+static volatile uint32_t scan_proc_drops = 0;    // closed frames dropped because processing was behind
+
+static void scan_proc_task(void *arg);
+
+#define SCAN_CART_STATS_FRAMES 100                  // log conversion timing every N frames
+static uint64_t cart_sum_us = 0;
+static uint32_t cart_max_us = 0;
+static uint32_t cart_count = 0;
+
+static void scan_frame_clear(lidar_scan_frame_t *f)
+{
+    f->t_start_us = 0;
+    f->t_end_us = 0;
+    f->sample_count = 0;
+    f->valid_count = 0;
+    f->flags = 0;
+    memset(f->dist_mm, 0, sizeof(f->dist_mm));
+    memset(f->quality, 0, sizeof(f->quality));
+    memset(f->t_rel, 0, sizeof(f->t_rel));
+}
+
+// Take a fresh frame from the pool for the next revolution. On failure the
+// assembler waits for the next rotation start so no frame is ever partial.
+static bool scan_frame_next(void)
+{
+    scan_cur = lidar_frame_pool_alloc(&scan_cur_handle);
+    if (!scan_cur) {
+        scan_cur_handle = LIDAR_FRAME_HANDLE_NONE;
+        scan_synced = false;
+        if ((++scan_pool_drops & 0x3F) == 1) {
+            ESP_LOGW(TAG, "No free frame (readers hold all %u); %u revolutions dropped",
+                     (unsigned)LIDAR_FRAME_POOL_COUNT, (unsigned)scan_pool_drops);
+        }
+        return false;
+    }
+    scan_frame_clear(scan_cur);
+    return true;
+}
+
+void lidar_scan_init(void)
+{
+    if (!scan_ready) {
+        if (!lidar_frame_pool_init()) return;
+        if (!lidar_deskew_init()) {
+            ESP_LOGE(TAG, "De-skew lock allocation failed");
+            return;
+        }
+        lidar_scan_filter_init();
+        lidar_obstacle_init();
+        scan_proc_queue = xQueueCreate(SCAN_PROC_QUEUE_LEN, sizeof(lidar_frame_handle_t));
+        if (!scan_proc_queue ||
+            xTaskCreate(scan_proc_task, "lidar_scan_proc", SCAN_PROC_TASK_STACK, NULL,
+                        SCAN_PROC_TASK_PRIORITY, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start frame processing task");
+            return;
+        }
+        scan_ready = true;
+    }
+    lidar_scan_reset();
+}
+
+void lidar_scan_reset(void)
+{
+    node_len = 0;
+    scan_synced = false;
+    scan_last_t_us = 0;
+    if (scan_cur) {
+        scan_frame_clear(scan_cur);
+    } else if (scan_ready) {
+        scan_frame_next();
+    }
+    lidar_scan_filter_reset();
+}
+
+void lidar_scan_set_sample_time(uint32_t us_per_sample_q8)
+{
+    scan_sample_us_q8 = us_per_sample_q8 ? us_per_sample_q8 : LIDAR_SCAN_DEFAULT_SAMPLE_US_Q8;
+    ESP_LOGI(TAG, "Sample time %u.%02u us", (unsigned)(scan_sample_us_q8 >> 8),
+             (unsigned)(((scan_sample_us_q8 & 0xFF) * 100) >> 8));
+}
+
+uint32_t lidar_scan_node_total(void)
+{
+    return scan_node_total;
+}
+
+bool lidar_scan_subscribe(dispatch_target_t target)
+{
+    if (target >= TARGET_MAX) return false;
+    for (size_t i = 0; i < scan_subscriber_count; ++i) {
+        if (scan_subscribers[i] == target) return true;
+    }
+    if (scan_subscriber_count >= LIDAR_SCAN_MAX_SUBSCRIBERS) {
+        ESP_LOGW(TAG, "Subscriber table full; dropping target %d", (int)target);
+        return false;
+    }
+    scan_subscribers[scan_subscriber_count++] = target;
+    return true;
+}
+
+bool lidar_scan_add_point_sink(lidar_scan_point_sink_t sink)
+{
+    if (!sink) return false;
+    if (scan_point_sink_count >= LIDAR_SCAN_MAX_POINT_SINKS) {
+        ESP_LOGW(TAG, "Point sink table full");
+        return false;
+    }
+    scan_point_sinks[scan_point_sink_count++] = sink;
+    return true;
+}
+
+// Announce the frame by handle. One frame reference is taken per subscriber
+// before the broadcast (so an early reader cannot free it under us) and the
+// references of targets whose queue was full are returned afterwards.
+static void scan_publish(lidar_scan_frame_t *f, lidar_frame_handle_t handle)
+{
+    uint16_t n = (uint16_t)scan_subscriber_count;
+    if (n == 0) return;
+
+    pool_msg_t *pmsg = dispatcher_pool_try_alloc(DISPATCHER_POOL_STREAMING);
+    dispatcher_msg_ptr_t *msg = pmsg ? dispatcher_pool_get_msg(pmsg) : NULL;
+    if (!msg || !msg->data) {
+        if (pmsg) dispatcher_pool_msg_unref(pmsg);
+        ESP_LOGW(TAG, "Pool send failed; dropping frame %u", (unsigned)f->seq);
+        return;
+    }
+
+    lidar_scan_msg_t hdr = {
+        .seq = f->seq,
+        .sample_count = f->sample_count,
+        .valid_count = f->valid_count,
+        .handle = handle,
+    };
+    msg->source = SOURCE_LIDAR_SCAN;
+    dispatcher_fill_targets(msg->targets);
+    for (size_t i = 0; i < scan_subscriber_count && i < TARGET_MAX; ++i) {
+        msg->targets[i] = scan_subscribers[i];
+    }
+    memcpy(msg->data, &hdr, sizeof(hdr));
+    msg->message_len = sizeof(hdr);
+    msg->context = NULL;
+
+    lidar_frame_pool_retain(handle, n);
+    int sent = dispatcher_broadcast_ptr(pmsg, msg->targets);
+    for (int i = sent; i < n; ++i) {
+        lidar_frame_pool_release(handle);
+    }
+}
+
+// Everything a closed frame goes through before subscribers see it
+static void scan_process_frame(lidar_scan_frame_t *f, lidar_frame_handle_t handle)
+{
+    lidar_scan_filter_apply(f);
+
+    // Cartesian view is computed once here rather than by every consumer
+    int64_t t0 = esp_timer_get_time();
+    lidar_cartesian_convert(f->dist_mm, f->x_mm, f->y_mm);
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    cart_sum_us += dt;
+    if (dt > cart_max_us) cart_max_us = dt;
+    if (++cart_count >= SCAN_CART_STATS_FRAMES) {
+        ESP_LOGI(TAG, "Cartesian conversion: avg %u us, max %u us over %u frames; "
+                 "%u frames dropped behind processing, stack %u B free",
+                 (unsigned)(cart_sum_us / cart_count), (unsigned)cart_max_us, (unsigned)cart_count,
+                 (unsigned)scan_proc_drops, (unsigned)uxTaskGetStackHighWaterMark(NULL));
+        cart_sum_us = 0;
+        cart_max_us = 0;
+        cart_count = 0;
+    }
+
+    // Move every point into the pose at the end of the revolution
+    lidar_deskew_apply(f);
+    lidar_obstacle_build(f);
+
+    scan_publish(f, handle);
+}
+
+static void scan_proc_task(void *arg)
+{
+    (void)arg;
+    lidar_frame_handle_t handle;
+    while (1) {
+        if (xQueueReceive(scan_proc_queue, &handle, portMAX_DELAY) != pdTRUE) continue;
+        lidar_scan_frame_t *f = lidar_frame_pool_get(handle);
+        if (f) scan_process_frame(f, handle);
+        // Readers now hold their own references; drop the assembler's
+        lidar_frame_pool_release(handle);
+    }
+}
+
+// Close the current frame, hand it to the processing task and start filling
+// a fresh one. The queue entry carries the assembler's reference.
+static void scan_finish_frame(void)
+{
+    scan_cur->seq = scan_seq++;
+    if (xQueueSend(scan_proc_queue, &scan_cur_handle, 0) != pdTRUE) {
+        lidar_frame_pool_release(scan_cur_handle);
+        if ((++scan_proc_drops & 0x3F) == 1) {
+            ESP_LOGW(TAG, "Frame processing behind; %u frames dropped", (unsigned)scan_proc_drops);
+        }
+    }
+    scan_frame_next();
+}
+
+// Returns false if the 5 bytes in node_buf do not form a valid standard node
+static bool scan_handle_node(const uint8_t *n, int64_t t_us)
+{
+    uint8_t start = n[0] & LIDAR_STD_DATA_ROT_START_BITS;
+    if (start != 0x01 && start != 0x02) return false;            // S and !S must differ
+    if ((n[1] & LIDAR_STD_DATA_CHECK_BIT) == 0) return false;    // C must be 1
+
+    uint16_t angle_q6 = (uint16_t)((n[1] >> 1) | ((uint16_t)n[2] << 7));
+    uint16_t dist_mm = (uint16_t)(((uint16_t)n[3] | ((uint16_t)n[4] << 8)) >> 2);
+    uint8_t quality = n[0] >> 2;
+
+    scan_node_total++;
+    if (angle_q6 >= LIDAR_SCAN_ANGLE_Q6) return true;            // valid framing, out-of-range angle: skip
+
+    if (start == 0x01) {
+        // One allocation attempt per rotation start, so each revolution lost
+        // to an exhausted pool is counted once: scan_finish_frame already
+        // tries for the next frame; otherwise retry after an earlier failure.
+        if (scan_synced && scan_cur->sample_count > 0) {
+            scan_finish_frame();
+        } else if (!scan_cur) {
+            scan_frame_next();
+        }
+        scan_synced = scan_cur != NULL;
+    }
+    if (!scan_synced) return true;
+
+    lidar_scan_frame_t *f = scan_cur;
+    if (f->sample_count == 0) f->t_start_us = t_us;
+    f->t_end_us = t_us;
+    f->sample_count++;
+
+    uint16_t bin = angle_q6 / LIDAR_SCAN_BIN_Q6;
+    for (size_t i = 0; i < scan_point_sink_count; ++i) {
+        scan_point_sinks[i](bin, dist_mm, quality, t_us);
+    }
+
+    if (dist_mm == 0) return true;
+
+    // Several nodes may land in one 0.25° bin; keep the nearest return
+    uint16_t prev = f->dist_mm[bin];
+    if (prev == 0) f->valid_count++;
+    if (prev == 0 || dist_mm < prev) {
+        int64_t rel = (t_us - f->t_start_us) >> LIDAR_SCAN_T_REL_SHIFT;
+        f->dist_mm[bin] = dist_mm;
+        f->quality[bin] = quality;
+        f->t_rel[bin] = rel > UINT16_MAX ? UINT16_MAX : (uint16_t)rel;
+    }
+    return true;
+}
+
+// The sensor samples at a fixed period but UART delivery is bursty, so the
+// node completed by the chunk's last byte is anchored at t_rx_us and earlier
+// nodes in the chunk are spaced back from it by the sample period. Times are
+// kept strictly increasing across chunks.
+void lidar_scan_feed(const uint8_t *data, size_t len, int64_t t_rx_us)
+{
+    if (!data || len == 0 || !scan_ready) return;
+
+    if (t_rx_us == 0) t_rx_us = esp_timer_get_time();
+    uint32_t nodes_left = (uint32_t)((node_len + len) / LIDAR_SCAN_NODE_SIZE);
+    for (size_t i = 0; i < len; ++i) {
+        node_buf[node_len++] = data[i];
+        if (node_len < LIDAR_SCAN_NODE_SIZE) continue;
+
+        if (nodes_left > 0) nodes_left--;
+        int64_t t_us = t_rx_us - (int64_t)(((uint64_t)nodes_left * scan_sample_us_q8) >> 8);
+        if (t_us <= scan_last_t_us) t_us = scan_last_t_us + 1;
+        if (scan_handle_node(node_buf, t_us)) {
+            scan_last_t_us = t_us;
+            node_len = 0;
+            continue;
+        }
+
+        // Misaligned: slide the window by one byte and keep hunting
+        memmove(node_buf, node_buf + 1, LIDAR_SCAN_NODE_SIZE - 1);
+        node_len = LIDAR_SCAN_NODE_SIZE - 1;
+        if ((++scan_resync_bytes & 0xFF) == 1) {
+            ESP_LOGW(TAG, "Resyncing scan stream (dropped %u bytes so far)", (unsigned)scan_resync_bytes);
+        }
+    }
+}
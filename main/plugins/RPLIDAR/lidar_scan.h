@@ -0,0 +1,132 @@
+// lidar_scan.h
+// Scan assembler: decodes standard scan nodes (PDF Sec 5.4.1) into ordered
+// 360° angular-bin frames and publishes each completed frame to subscribers.
+// Frames live in a refcounted pool (lidar_frame_pool.h); messages carry only
+// a handle, so one frame is shared by every subscriber without copies.
+
+#ifndef LIDAR_SCAN_H
+#define LIDAR_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "dispatcher.h"
+#include "lidar_frame_pool.h"
+
+// ---- Frame geometry ----
+// Bins are ordered by angle (clockwise from the sensor's forward direction,
+// matching the RPLIDAR angle convention). 1440 bins = 0.25° per bin, which
+// divides angle_q6 (1/64°) evenly: bin = angle_q6 / LIDAR_SCAN_BIN_Q6.
+#define LIDAR_SCAN_BINS        1440
+#define LIDAR_SCAN_ANGLE_Q6    (360 << 6)
+#define LIDAR_SCAN_BIN_Q6      (LIDAR_SCAN_ANGLE_Q6 / LIDAR_SCAN_BINS)
+
+#define LIDAR_SCAN_MAX_SUBSCRIBERS 8
+#define LIDAR_SCAN_MAX_POINT_SINKS 4
+
+// Standard scan node size on the wire (quality/flags, angle_q6 x2, dist_q2 x2)
+#define LIDAR_SCAN_NODE_SIZE   5
+
+// Sample period used until GET_LIDAR_CONF reports one (A1 standard mode, µs Q8)
+#define LIDAR_SCAN_DEFAULT_SAMPLE_US_Q8  130048
+
+// Per-bin time offsets from t_start_us are stored in units of 1 << this many
+// µs (8 µs steps, saturating at ~524 ms)
+#define LIDAR_SCAN_T_REL_SHIFT 3
+
+#define LIDAR_SCAN_FLAG_DESKEWED 0x01   // x_mm/y_mm corrected to the pose at t_end_us
+
+// One assembled 360° revolution. dist_mm == 0 means no return in that bin.
+// x_mm/y_mm hold the same bins in the robot frame (x forward, y left), filled
+// once when the frame is closed (see lidar_cartesian.h). Per-bin arrays are
+// 16-byte aligned for the S3 vector unit.
+//
+// Times are per-point sample times, not decode times: each RX chunk is
+// stamped at UART arrival and the nodes in it are spaced back from that
+// stamp by the scan mode's sample period (see lidar_scan_feed).
+typedef struct lidar_scan_frame_s {
+    uint32_t seq;            // monotonically increasing frame counter
+    int64_t  t_start_us;     // esp_timer time of the first node in the frame
+    int64_t  t_end_us;       // esp_timer time of the last node in the frame
+    uint16_t sample_count;   // nodes decoded into this frame (incl. zero-distance)
+    uint16_t valid_count;    // bins holding a non-zero distance
+    uint8_t  flags;          // LIDAR_SCAN_FLAG_*
+    uint16_t dist_mm[LIDAR_SCAN_BINS] __attribute__((aligned(16)));
+    int16_t  x_mm[LIDAR_SCAN_BINS] __attribute__((aligned(16)));
+    int16_t  y_mm[LIDAR_SCAN_BINS] __attribute__((aligned(16)));
+    uint16_t t_rel[LIDAR_SCAN_BINS] __attribute__((aligned(16)));  // sample time - t_start_us, see LIDAR_SCAN_T_REL_SHIFT
+    uint8_t  quality[LIDAR_SCAN_BINS];
+} lidar_scan_frame_t;
+
+// Payload of the dispatcher message announcing a completed frame. The frame
+// stays in the pool; each target the message reached holds one reference.
+typedef struct {
+    uint32_t seq;
+    uint16_t sample_count;
+    uint16_t valid_count;
+    lidar_frame_handle_t handle;
+} lidar_scan_msg_t;
+
+// Allocate the frame pool and reset decoder state
+void lidar_scan_init(void);
+
+// Drop any partial node/frame (call when a new scan is started or stopped)
+void lidar_scan_reset(void);
+
+// Feed raw UART bytes that belong to a standard scan stream. t_rx_us is the
+// esp_timer time the last byte arrived (0 = unknown, use now); nodes in the
+// chunk are timestamped back from it at the sample period.
+// Completed frames are queued to the frame processing task, which filters,
+// converts and de-skews them and publishes them to all subscribers.
+void lidar_scan_feed(const uint8_t *data, size_t len, int64_t t_rx_us);
+
+// Sample period of the running scan mode in µs Q8 (GET_LIDAR_CONF
+// SAMPLETIME); 0 restores LIDAR_SCAN_DEFAULT_SAMPLE_US_Q8
+void lidar_scan_set_sample_time(uint32_t us_per_sample_q8);
+
+// Running count of well-formed scan nodes decoded (for flow watchdogs)
+uint32_t lidar_scan_node_total(void);
+
+// Register a dispatcher target to receive completed frames (call during init)
+bool lidar_scan_subscribe(dispatch_target_t target);
+
+// Per-point hook for consumers that update incrementally instead of per frame.
+// Called for every decoded node (dist_mm == 0 means no return in that bin)
+// from the LIDAR coordinator task: keep it short and non-blocking.
+typedef void (*lidar_scan_point_sink_t)(uint16_t bin, uint16_t dist_mm, uint8_t quality, int64_t t_us);
+
+// Register a point sink (call during init)
+bool lidar_scan_add_point_sink(lidar_scan_point_sink_t sink);
+
+// Sample time of a bin's return (only meaningful where dist_mm != 0)
+static inline int64_t lidar_scan_bin_time_us(const lidar_scan_frame_t *f, uint16_t bin) {
+    return f->t_start_us + ((int64_t)f->t_rel[bin] << LIDAR_SCAN_T_REL_SHIFT);
+}
+
+// Consumers: every message from SOURCE_LIDAR_SCAN holds one frame reference
+// for the receiving target. Read the frame with lidar_scan_frame_from_msg()
+// and call lidar_scan_frame_done() exactly once per such message, including
+// when it is skipped. To keep a frame past the handler, retain its handle.
+static inline lidar_frame_handle_t lidar_scan_handle_from_msg(const dispatcher_msg_t *msg) {
+    if (!msg || msg->source != SOURCE_LIDAR_SCAN || msg->message_len < sizeof(lidar_scan_msg_t)) {
+        return LIDAR_FRAME_HANDLE_NONE;
+    }
+    lidar_scan_msg_t hdr;
+    memcpy(&hdr, msg->data, sizeof(hdr));
+    return hdr.handle;
+}
+
+// Frame announced by a scan message, or NULL (not a scan message / stale)
+static inline const lidar_scan_frame_t *lidar_scan_frame_from_msg(const dispatcher_msg_t *msg) {
+    lidar_frame_handle_t h = lidar_scan_handle_from_msg(msg);
+    return h == LIDAR_FRAME_HANDLE_NONE ? NULL : lidar_frame_pool_get(h);
+}
+
+// Drop the reference a scan message carried (no-op for other messages)
+static inline void lidar_scan_frame_done(const dispatcher_msg_t *msg) {
+    lidar_frame_handle_t h = lidar_scan_handle_from_msg(msg);
+    if (h != LIDAR_FRAME_HANDLE_NONE) lidar_frame_pool_release(h);
+}
+
+#endif // LIDAR_SCAN_H
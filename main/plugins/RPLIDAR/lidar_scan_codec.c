@@ -0,0 +1,35 @@
+// lidar_scan_codec.c
+#include "lidar_scan_codec.h"
+
+static inline uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+size_t lidar_scan_codec_encode(const uint16_t *dist_mm, uint8_t q_shift, uint8_t *out, uint16_t *count)
+{
+    const int32_t round = q_shift ? (1 << (q_shift - 1)) : 0;
+    uint8_t *p = out;
+    int prev_bin = -1;
+    int32_t prev_q = 0;
+    uint16_t n = 0;
+    for (int b = 0; b < LIDAR_SCAN_BINS; ++b) {
+        uint16_t d = dist_mm[b];
+        if (d == 0) continue;
+        int32_t q = ((int32_t)d + round) >> q_shift;
+        if (q == 0) q = 1;      // keep "no return" distinguishable
+        int32_t dd = q - prev_q;
+        p = put_varint(p, (uint32_t)(b - prev_bin));
+        p = put_varint(p, ((uint32_t)dd << 1) ^ (uint32_t)(dd >> 31));
+        prev_bin = b;
+        prev_q = q;
+        n++;
+    }
+    *count = n;
+    return (size_t)(p - out);
+}
@@ -0,0 +1,25 @@
+// lidar_scan_codec.h
+// Compact encoding of a frame's distance bins, shared by the web stream and
+// the on-device recorder. The angle is implied by the bin index: only valid
+// bins are stored, each as
+//   varint  bin_delta   (bin - previous valid bin; the first is relative to -1)
+//   varint  zigzag(q - previous q)   (the first is relative to 0)
+// where q = round(dist_mm / 2^q_shift), forced to >= 1. Consecutive bins on
+// a surface usually cost 2 bytes per point. Decoders: lidar_stream.js and
+// tools/lidar_log_reader.py.
+
+#ifndef LIDAR_SCAN_CODEC_H
+#define LIDAR_SCAN_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lidar_scan.h"
+
+// Worst case: 2-byte bin delta + 3-byte distance delta per bin
+#define LIDAR_SCAN_CODEC_MAX_BYTES (LIDAR_SCAN_BINS * 5)
+
+// Encode dist_mm[LIDAR_SCAN_BINS] into out (>= LIDAR_SCAN_CODEC_MAX_BYTES).
+// Returns bytes written; *count receives the number of points.
+size_t lidar_scan_codec_encode(const uint16_t *dist_mm, uint8_t q_shift, uint8_t *out, uint16_t *count);
+
+#endif // LIDAR_SCAN_CODEC_H
@@ -0,0 +1,345 @@
+// lidar_scan_filter.c
+#include "lidar_scan_filter.h"
+#include "io_fatfs.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "lidar_filter";
+
+// Speckle test looks for the nearest return within this many bins on each
+// side (2°: the A1 samples roughly every 1°, so adjacent bins are often empty)
+#define FILTER_NEIGHBOUR_BINS   8
+#define FILTER_STATS_FRAMES     100
+#define FILTER_JSON_MAX         512
+
+// Configuration is written by the coordinator (JSON requests) and taken by
+// the frame processing task at the start of each frame, under filter_lock.
+// The stages only read cfg, the processing task's copy.
+static portMUX_TYPE filter_lock = portMUX_INITIALIZER_UNLOCKED;
+static lidar_scan_filter_cfg_t cfg;
+static bool reset_pending = false;  // history reset requested (scan restart or k/mode change)
+static lidar_scan_filter_cfg_t pending_cfg = {
+    .min_quality = 1,
+    .outlier_mm = 100,
+    .outlier_rel_q8 = 13,
+    .temporal = LIDAR_FILTER_TEMPORAL_NONE,
+    .median_k = 3,
+    .ema_alpha_q8 = 128,
+    .ema_reset_mm = 200,
+};
+
+static uint16_t *gated = NULL;      // quality-gated input
+static uint16_t *prev_nb = NULL;    // nearest valid return to the left (0 = none)
+static uint16_t *hist = NULL;       // [LIDAR_FILTER_K_MAX][BINS] speckle-filtered frames
+static uint16_t *ema = NULL;        // EMA state per bin
+static uint8_t hist_head = 0;       // row holding the newest frame
+
+static uint64_t stats_sum_us = 0;
+static uint32_t stats_max_us = 0;
+static uint32_t stats_count = 0;
+static uint32_t stats_in = 0;
+static uint32_t stats_out = 0;
+static uint32_t last_avg_us = 0;
+
+static void *filter_alloc(size_t size, const char *what)
+{
+    void *p = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) {
+        ESP_LOGW(TAG, "PSRAM alloc failed for %s; using internal RAM", what);
+        p = calloc(1, size);
+    }
+    return p;
+}
+
+static inline uint16_t u16_min(uint16_t a, uint16_t b) { return a < b ? a : b; }
+static inline uint16_t u16_max(uint16_t a, uint16_t b) { return a > b ? a : b; }
+static inline uint16_t u16_absdiff(uint16_t a, uint16_t b) { return a > b ? (uint16_t)(a - b) : (uint16_t)(b - a); }
+
+static inline uint16_t med3(uint16_t a, uint16_t b, uint16_t c)
+{
+    return u16_max(u16_min(a, b), u16_min(u16_max(a, b), c));
+}
+
+static inline uint16_t med5(uint16_t a, uint16_t b, uint16_t c, uint16_t d, uint16_t e)
+{
+    uint16_t f = u16_max(u16_min(a, b), u16_min(c, d));
+    uint16_t g = u16_min(u16_max(a, b), u16_max(c, d));
+    return med3(e, f, g);
+}
+
+static void filter_clear_history(void)
+{
+    if (hist) memset(hist, 0, (size_t)LIDAR_FILTER_K_MAX * LIDAR_SCAN_BINS * sizeof(uint16_t));
+    if (ema) memset(ema, 0, LIDAR_SCAN_BINS * sizeof(uint16_t));
+    hist_head = 0;
+}
+
+void lidar_scan_filter_reset(void)
+{
+    portENTER_CRITICAL(&filter_lock);
+    reset_pending = true;
+    portEXIT_CRITICAL(&filter_lock);
+}
+
+// Stage 1: quality gate
+static void filter_gate(const uint16_t *dist, const uint8_t *quality, uint16_t *out)
+{
+    const uint8_t min_q = cfg.min_quality;
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        out[i] = quality[i] >= min_q ? dist[i] : 0;
+    }
+}
+
+// Stage 2: drop returns that agree with neither nearest neighbour. The
+// neighbour carries are running selects (value and age), seeded across the
+// 0/360° seam so bins near the seam see both sides.
+static void filter_speckle(const uint16_t *in, uint16_t *out)
+{
+    if (cfg.outlier_mm == 0) {
+        memcpy(out, in, LIDAR_SCAN_BINS * sizeof(uint16_t));
+        return;
+    }
+    const uint16_t base = cfg.outlier_mm;
+    const uint32_t rel = cfg.outlier_rel_q8;
+
+    uint16_t carry = 0;
+    uint32_t age = FILTER_NEIGHBOUR_BINS + 1;
+    for (int i = LIDAR_SCAN_BINS - FILTER_NEIGHBOUR_BINS; i < LIDAR_SCAN_BINS; ++i) {
+        uint16_t d = in[i];
+        age = d ? 1 : age + 1;
+        carry = d ? d : carry;
+    }
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        prev_nb[i] = age <= FILTER_NEIGHBOUR_BINS ? carry : 0;
+        uint16_t d = in[i];
+        age = d ? 1 : age + 1;
+        carry = d ? d : carry;
+    }
+
+    carry = 0;
+    age = FILTER_NEIGHBOUR_BINS + 1;
+    for (int i = FILTER_NEIGHBOUR_BINS - 1; i >= 0; --i) {
+        uint16_t d = in[i];
+        age = d ? 1 : age + 1;
+        carry = d ? d : carry;
+    }
+    for (int i = LIDAR_SCAN_BINS - 1; i >= 0; --i) {
+        uint16_t next = age <= FILTER_NEIGHBOUR_BINS ? carry : 0;
+        uint16_t d = in[i];
+        uint32_t thr = base + ((d * rel) >> 8);
+        uint32_t keep = (u16_absdiff(d, prev_nb[i]) <= thr) | (u16_absdiff(d, next) <= thr);
+        out[i] = keep ? d : 0;
+        age = d ? 1 : age + 1;
+        carry = d ? d : carry;
+    }
+}
+
+// Stage 3a: per-bin median of the last K frames. Empty bins are mapped to
+// 0xFFFF (d - 1 wraps) so they sort last; the result wraps back to 0 unless
+// more than K/2 frames saw a return, which fills single dropouts and drops
+// single-frame speckle.
+static void filter_median(uint16_t *out)
+{
+    const int k = cfg.median_k;
+    const uint16_t *r0 = hist + (size_t)hist_head * LIDAR_SCAN_BINS;
+    const uint16_t *r1 = hist + (size_t)((hist_head + k - 1) % k) * LIDAR_SCAN_BINS;
+    const uint16_t *r2 = hist + (size_t)((hist_head + k - 2) % k) * LIDAR_SCAN_BINS;
+    if (k == 3) {
+        for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+            out[i] = (uint16_t)(med3((uint16_t)(r0[i] - 1), (uint16_t)(r1[i] - 1), (uint16_t)(r2[i] - 1)) + 1);
+        }
+        return;
+    }
+    const uint16_t *r3 = hist + (size_t)((hist_head + k - 3) % k) * LIDAR_SCAN_BINS;
+    const uint16_t *r4 = hist + (size_t)((hist_head + k - 4) % k) * LIDAR_SCAN_BINS;
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        out[i] = (uint16_t)(med5((uint16_t)(r0[i] - 1), (uint16_t)(r1[i] - 1), (uint16_t)(r2[i] - 1),
+                                 (uint16_t)(r3[i] - 1), (uint16_t)(r4[i] - 1)) + 1);
+    }
+}
+
+// Stage 3b: EMA per bin. A miss outputs nothing but keeps the state; a jump
+// beyond ema_reset_mm (or no state yet) restarts from the new sample.
+static void filter_ema(const uint16_t *in, uint16_t *out)
+{
+    const int32_t alpha = cfg.ema_alpha_q8;
+    const uint16_t reset = cfg.ema_reset_mm;
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        uint16_t x = in[i];
+        uint16_t e = ema[i];
+        int32_t dx = (int32_t)x - (int32_t)e;
+        uint16_t blended = (uint16_t)(e + ((dx * alpha) >> 8));
+        uint16_t restart = (e == 0) | (u16_absdiff(x, e) > reset);
+        uint16_t next = restart ? x : blended;
+        ema[i] = x ? next : e;
+        out[i] = x ? next : 0;
+    }
+}
+
+void lidar_scan_filter_apply(lidar_scan_frame_t *f)
+{
+    if (!hist) return;
+    int64_t t0 = esp_timer_get_time();
+
+    portENTER_CRITICAL(&filter_lock);
+    cfg = pending_cfg;
+    bool reset = reset_pending;
+    reset_pending = false;
+    portEXIT_CRITICAL(&filter_lock);
+    if (reset) filter_clear_history();
+
+    const int k = (cfg.temporal == LIDAR_FILTER_TEMPORAL_MEDIAN) ? cfg.median_k : 1;
+    hist_head = (uint8_t)((hist_head + 1) % k);
+    uint16_t *row = hist + (size_t)hist_head * LIDAR_SCAN_BINS;
+
+    filter_gate(f->dist_mm, f->quality, gated);
+    filter_speckle(gated, row);
+    switch (cfg.temporal) {
+        case LIDAR_FILTER_TEMPORAL_MEDIAN: filter_median(f->dist_mm); break;
+        case LIDAR_FILTER_TEMPORAL_EMA:    filter_ema(row, f->dist_mm); break;
+        default: memcpy(f->dist_mm, row, LIDAR_SCAN_BINS * sizeof(uint16_t)); break;
+    }
+
+    uint16_t valid = 0;
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        valid += f->dist_mm[i] != 0;
+    }
+    stats_in += f->valid_count;
+    stats_out += valid;
+    f->valid_count = valid;
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    stats_sum_us += dt;
+    if (dt > stats_max_us) stats_max_us = dt;
+    if (++stats_count >= FILTER_STATS_FRAMES) {
+        last_avg_us = (uint32_t)(stats_sum_us / stats_count);
+        ESP_LOGI(TAG, "Filter: avg %u us, max %u us, valid %u -> %u per frame over %u frames",
+                 (unsigned)last_avg_us, (unsigned)stats_max_us, (unsigned)(stats_in / stats_count),
+                 (unsigned)(stats_out / stats_count), (unsigned)stats_count);
+        stats_sum_us = 0;
+        stats_max_us = 0;
+        stats_count = 0;
+        stats_in = 0;
+        stats_out = 0;
+    }
+}
+
+static int json_int(const cJSON *root, const char *key, int cur, int lo, int hi)
+{
+    const cJSON *it = cJSON_GetObjectItem(root, key);
+    if (!cJSON_IsNumber(it)) return cur;
+    int v = it->valueint;
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Fractions given as 0..1 in JSON, stored Q8
+static int json_q8(const cJSON *root, const char *key, int cur)
+{
+    const cJSON *it = cJSON_GetObjectItem(root, key);
+    if (!cJSON_IsNumber(it)) return cur;
+    int v = (int)(it->valuedouble * 256.0 + 0.5);
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static const char *temporal_name(uint8_t t)
+{
+    switch (t) {
+        case LIDAR_FILTER_TEMPORAL_MEDIAN: return "median";
+        case LIDAR_FILTER_TEMPORAL_EMA:    return "ema";
+        default:                           return "none";
+    }
+}
+
+bool lidar_scan_filter_apply_json(const char *json, size_t len)
+{
+    cJSON *root = cJSON_ParseWithLength(json, len);
+    if (!cJSON_IsObject(root)) {
+        ESP_LOGW(TAG, "Invalid filter JSON");
+        cJSON_Delete(root);
+        return false;
+    }
+    portENTER_CRITICAL(&filter_lock);
+    lidar_scan_filter_cfg_t old = pending_cfg;
+    portEXIT_CRITICAL(&filter_lock);
+    lidar_scan_filter_cfg_t c = old;
+    c.min_quality = (uint8_t)json_int(root, "min_quality", c.min_quality, 0, 63);
+    c.outlier_mm = (uint16_t)json_int(root, "outlier_mm", c.outlier_mm, 0, 2000);
+    c.outlier_rel_q8 = (uint8_t)json_q8(root, "outlier_rel", c.outlier_rel_q8);
+    c.median_k = (uint8_t)(json_int(root, "k", c.median_k, 3, LIDAR_FILTER_K_MAX) >= 5 ? 5 : 3);
+    c.ema_alpha_q8 = (uint8_t)json_q8(root, "ema_alpha", c.ema_alpha_q8);
+    c.ema_reset_mm = (uint16_t)json_int(root, "ema_reset_mm", c.ema_reset_mm, 0, 10000);
+    const cJSON *t = cJSON_GetObjectItem(root, "temporal");
+    if (cJSON_IsString(t)) {
+        if (strcmp(t->valuestring, "median") == 0)      c.temporal = LIDAR_FILTER_TEMPORAL_MEDIAN;
+        else if (strcmp(t->valuestring, "ema") == 0)    c.temporal = LIDAR_FILTER_TEMPORAL_EMA;
+        else                                            c.temporal = LIDAR_FILTER_TEMPORAL_NONE;
+    }
+    cJSON_Delete(root);
+
+    bool restart = c.temporal != old.temporal || c.median_k != old.median_k;
+    portENTER_CRITICAL(&filter_lock);
+    pending_cfg = c;
+    if (restart) reset_pending = true;
+    portEXIT_CRITICAL(&filter_lock);
+    ESP_LOGI(TAG, "Config: min_quality %u, outlier %u mm + %u/256, temporal %s (k %u, alpha %u/256, reset %u mm)",
+             (unsigned)c.min_quality, (unsigned)c.outlier_mm, (unsigned)c.outlier_rel_q8,
+             temporal_name(c.temporal), (unsigned)c.median_k, (unsigned)c.ema_alpha_q8,
+             (unsigned)c.ema_reset_mm);
+    return true;
+}
+
+static size_t filter_json(char *buf, size_t size, bool timing)
+{
+    portENTER_CRITICAL(&filter_lock);
+    lidar_scan_filter_cfg_t c = pending_cfg;
+    portEXIT_CRITICAL(&filter_lock);
+    int n = snprintf(buf, size,
+                     "{\"min_quality\":%u,\"outlier_mm\":%u,\"outlier_rel\":%.3f,\"temporal\":\"%s\","
+                     "\"k\":%u,\"ema_alpha\":%.3f,\"ema_reset_mm\":%u",
+                     (unsigned)c.min_quality, (unsigned)c.outlier_mm, c.outlier_rel_q8 / 256.0,
+                     temporal_name(c.temporal), (unsigned)c.median_k, c.ema_alpha_q8 / 256.0,
+                     (unsigned)c.ema_reset_mm);
+    if (n > 0 && (size_t)n < size) {
+        n += timing ? snprintf(buf + n, size - (size_t)n, ",\"avg_us\":%u}", (unsigned)last_avg_us)
+                    : snprintf(buf + n, size - (size_t)n, "}");
+    }
+    return (n > 0 && (size_t)n < size) ? (size_t)n : 0;
+}
+
+size_t lidar_scan_filter_to_json(char *buf, size_t size)
+{
+    return filter_json(buf, size, true);
+}
+
+size_t lidar_scan_filter_cfg_to_json(char *buf, size_t size)
+{
+    return filter_json(buf, size, false);
+}
+
+void lidar_scan_filter_init(void)
+{
+    gated = filter_alloc(LIDAR_SCAN_BINS * sizeof(uint16_t), "gate buffer");
+    prev_nb = filter_alloc(LIDAR_SCAN_BINS * sizeof(uint16_t), "neighbour buffer");
+    hist = filter_alloc((size_t)LIDAR_FILTER_K_MAX * LIDAR_SCAN_BINS * sizeof(uint16_t), "history");
+    ema = filter_alloc(LIDAR_SCAN_BINS * sizeof(uint16_t), "EMA state");
+    if (!gated || !prev_nb || !hist || !ema) {
+        ESP_LOGE(TAG, "Failed to allocate filter buffers; filter disabled");
+        free(gated);
+        free(prev_nb);
+        free(hist);
+        free(ema);
+        gated = prev_nb = hist = ema = NULL;
+        return;
+    }
+
+    if (!io_fatfs_file_exists(LIDAR_FILTER_JSON_PATH)) return;
+    char buf[FILTER_JSON_MAX];
+    int n = io_fatfs_read_file(LIDAR_FILTER_JSON_PATH, (uint8_t *)buf, sizeof(buf) - 1);
+    if (n > 0) lidar_scan_filter_apply_json(buf, (size_t)n);
+}
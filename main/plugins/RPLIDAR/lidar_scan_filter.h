@@ -0,0 +1,73 @@
+// lidar_scan_filter.h
+// Per-bin filter applied to each completed frame before the Cartesian stage
+// and publication, so every subscriber sees the same cleaned distances:
+//   1. quality gate      drop returns below min_quality
+//   2. speckle reject    drop a return that agrees with neither nearest
+//                        return (searched up to 2° each side)
+//   3. temporal (opt.)   K-frame median or EMA per bin over recent frames
+// Point sinks still see raw nodes.
+//
+// Every stage is a straight pass over the bin arrays with selects instead of
+// branches, so the loops stay branch-free and map onto SIMD lanes.
+//
+// Runs in the frame processing task (lidar_scan.c); configuration and reset
+// requests may come from any task and take effect at the next frame.
+// Configuration is JSON: loaded from LIDAR_FILTER_JSON_PATH at init and
+// changed at runtime with LIDAR_FILTER_CTRL_JSON messages (see
+// /api/lidar/filter).
+
+#ifndef LIDAR_SCAN_FILTER_H
+#define LIDAR_SCAN_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lidar_scan.h"
+
+#define LIDAR_FILTER_JSON_PATH  "/data/lidar_filter.json"
+
+// Control request on TARGET_LIDAR_COORD: data[0], then JSON text (not
+// necessarily NUL-terminated). Fields left out keep their current value.
+// Sent as a REST request (rest_json_request_t context), the answer is the
+// configuration after clamping (lidar_scan_filter_cfg_to_json), or an empty
+// reply if the JSON was rejected.
+#define LIDAR_FILTER_CTRL_JSON  0x90
+
+#define LIDAR_FILTER_K_MAX      5
+
+typedef enum {
+    LIDAR_FILTER_TEMPORAL_NONE = 0,
+    LIDAR_FILTER_TEMPORAL_MEDIAN,   // median of the last K frames; needs > K/2 hits
+    LIDAR_FILTER_TEMPORAL_EMA,      // exponential average, restarted on large jumps
+} lidar_filter_temporal_t;
+
+// JSON keys in brackets
+typedef struct {
+    uint8_t  min_quality;       // ["min_quality"] 0 = gate off
+    uint16_t outlier_mm;        // ["outlier_mm"] 0 = speckle reject off
+    uint8_t  outlier_rel_q8;    // ["outlier_rel"] extra tolerance per mm of range, Q8 (13 ~ 5%)
+    uint8_t  temporal;          // ["temporal"] "none" | "median" | "ema"
+    uint8_t  median_k;          // ["k"] 3 or 5
+    uint8_t  ema_alpha_q8;      // ["ema_alpha"] weight of the new sample, Q8
+    uint16_t ema_reset_mm;      // ["ema_reset_mm"] larger jumps restart the average
+} lidar_scan_filter_cfg_t;
+
+// Allocate history and load LIDAR_FILTER_JSON_PATH if present
+void lidar_scan_filter_init(void);
+
+// Forget temporal history (scan restarted)
+void lidar_scan_filter_reset(void);
+
+// Filter f->dist_mm in place and update f->valid_count
+void lidar_scan_filter_apply(lidar_scan_frame_t *f);
+
+// Apply a JSON object on top of the current configuration
+bool lidar_scan_filter_apply_json(const char *json, size_t len);
+
+// Current configuration and timing as JSON. Returns length (0 if it does not fit).
+size_t lidar_scan_filter_to_json(char *buf, size_t size);
+
+// Configuration only (what LIDAR_FILTER_JSON_PATH holds). Returns length (0 if it does not fit).
+size_t lidar_scan_filter_cfg_to_json(char *buf, size_t size);
+
+#endif // LIDAR_SCAN_FILTER_H
@@ -0,0 +1,398 @@
+// lidar_session.c
+// Session state machine (see lidar_session.h)
+
+#include <string.h>
+#include "lidar_session.h"
+#include "lidar_caps.h"
+#include "lidar_motor.h"
+#include "lidar_scan.h"
+#include "lidar_message_builder.h"
+#include "lidar_protocol_cmd.h"
+#include "lidar_protocol_rsp.h"
+#include "lidar_response_parser.h"
+#include "dispatcher.h"
+#include "dispatcher_pool.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "lidar_session";
+
+static const char *const state_names[] = {
+    "IDLE", "PROBE", "DISCOVER", "HEALTH", "STARTING", "SCANNING", "STOPPING", "RESETTING",
+};
+
+static lidar_session_state_t state = LIDAR_SESSION_IDLE;
+static int64_t deadline_ms = 0;             // 0 = no timer for this state
+static bool want_scan = false;              // scan requested (autostart or CTRL_START)
+static bool caps_known = false;             // discovery has completed once
+static bool stream_active = false;          // scan bytes go to the assembler
+
+static uint8_t pending_rsp = 0;             // response type the last command expects, 0 = none
+static uint8_t probe_tries = 0;
+static uint8_t fail_count = 0;              // consecutive recoveries without a stable scan
+static uint8_t reset_count = 0;             // consecutive resets (for back-off)
+
+// Watchdog: node counter and when it last moved
+static uint32_t wd_nodes = 0;
+static int64_t wd_progress_ms = 0;
+
+static int64_t scan_since_ms = 0;           // SCANNING entry time
+static int64_t fault_since_ms = 0;          // first fault of the current recovery, 0 = healthy
+static lidar_session_stats_t stats;
+
+static inline int64_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static void session_set_state(lidar_session_state_t next, uint32_t timeout_ms)
+{
+    if (state == LIDAR_SESSION_SCANNING && next != LIDAR_SESSION_SCANNING) {
+        stats.scan_uptime_ms += (uint32_t)(now_ms() - scan_since_ms);
+    }
+    if (next != state) {
+        ESP_LOGI(TAG, "%s -> %s", state_names[state], state_names[next]);
+    }
+    state = next;
+    stats.state = next;
+    deadline_ms = timeout_ms ? now_ms() + timeout_ms : 0;
+}
+
+static void session_stream_off(void)
+{
+    stream_active = false;
+    lidar_scan_reset();
+    lidar_motor_stop();
+}
+
+// Send a command; the expected response comes from the command table unless overridden
+static bool session_send(const uint8_t *cmd, size_t len, uint8_t expect_override)
+{
+    if (len < 2) return false;
+    const lidar_cmd_entry_t *entry = lidar_cmd_find_by_code(cmd[1]);
+    pending_rsp = expect_override ? expect_override : (entry ? entry->rsp_type : 0);
+    if (cmd[1] == LIDAR_CMD_STOP || cmd[1] == LIDAR_CMD_RESET) {
+        session_stream_off();
+    }
+
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_LIDAR_IO;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_CONTROL,
+        .source = SOURCE_LIDAR_COORD,
+        .targets = targets,
+        .data = cmd,
+        .data_len = len,
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Command 0x%02X dropped (pool full)", (unsigned)cmd[1]);
+        return false;
+    }
+    return true;
+}
+
+static void session_send_idx(lidar_cmd_idx_t idx)
+{
+    uint8_t buf[16];
+    session_send(buf, lidar_build_by_idx(buf, sizeof(buf), idx), 0);
+}
+
+static void session_probe(void)
+{
+    session_set_state(LIDAR_SESSION_PROBE, LIDAR_SESSION_PROBE_TIMEOUT_MS);
+    session_send_idx(LIDAR_CMD_IDX_GET_INFO);
+}
+
+static void session_reset(void)
+{
+    uint32_t wait = LIDAR_SESSION_RESET_WAIT_MS << (reset_count < 3 ? reset_count : 3);
+    if (wait > LIDAR_SESSION_RESET_WAIT_MAX_MS) wait = LIDAR_SESSION_RESET_WAIT_MAX_MS;
+    reset_count++;
+    stats.resets++;
+    session_set_state(LIDAR_SESSION_RESETTING, wait);
+    session_send_idx(LIDAR_CMD_IDX_RESET);
+}
+
+static void session_start_scan(void)
+{
+    uint8_t buf[16];
+    size_t len = lidar_caps_build_scan(buf, sizeof(buf));
+    session_set_state(LIDAR_SESSION_STARTING, LIDAR_SESSION_START_TIMEOUT_MS);
+    session_send(buf, len, LIDAR_RSP_TYPE_SCAN_STANDARD);
+}
+
+// Time left on the current state timer
+static uint32_t session_wait(void)
+{
+    if (deadline_ms == 0) return LIDAR_SESSION_WAIT_FOREVER;
+    int64_t left = deadline_ms - now_ms();
+    return left > 0 ? (uint32_t)left : 1;
+}
+
+// Discovery/health done: scan if wanted, otherwise park
+static void session_ready(void)
+{
+    if (want_scan) {
+        session_start_scan();
+    } else {
+        session_set_state(LIDAR_SESSION_IDLE, 0);
+    }
+}
+
+// Something went wrong while a scan was wanted: soft restart first, RESET if that keeps failing
+static void session_recover(const char *reason)
+{
+    int64_t t = now_ms();
+    if (fault_since_ms == 0) fault_since_ms = t;
+    stats.recoveries++;
+    fail_count++;
+    ESP_LOGW(TAG, "Recovery (%s) in %s, attempt %u", reason, state_names[state], (unsigned)fail_count);
+
+    if (fail_count > LIDAR_SESSION_SOFT_RETRIES) {
+        session_reset();
+        return;
+    }
+    session_set_state(LIDAR_SESSION_STOPPING, LIDAR_SESSION_STOP_SETTLE_MS);
+    session_send_idx(LIDAR_CMD_IDX_STOP);
+}
+
+static void session_discovery_next(size_t len, const uint8_t *cmd)
+{
+    if (len > 0) {
+        session_send(cmd, len, 0);
+        deadline_ms = now_ms() + LIDAR_CAPS_TIMEOUT_MS;
+        return;
+    }
+    if (lidar_caps_active()) return;            // answer did not match the pending query
+    caps_known = true;
+    const lidar_caps_t *caps = lidar_caps_get();
+    if (caps->health_valid && caps->health_status == LIDAR_HEALTH_STATUS_ERROR) {
+        ESP_LOGW(TAG, "Sensor reports protection stop (0x%04X)", (unsigned)caps->health_error);
+        session_reset();
+        return;
+    }
+    session_ready();
+}
+
+static void session_discover(void)
+{
+    uint8_t buf[16];
+    session_set_state(LIDAR_SESSION_DISCOVER, LIDAR_CAPS_TIMEOUT_MS);
+    size_t len = lidar_caps_begin(buf, sizeof(buf));
+    session_send(buf, len, 0);
+}
+
+void lidar_session_begin(void)
+{
+#if CONFIG_LIDAR_AUTOSTART_SCAN
+    want_scan = true;
+#endif
+    memset(&stats, 0, sizeof(stats));
+    probe_tries = 0;
+    session_probe();
+}
+
+uint32_t lidar_session_poll(void)
+{
+    int64_t t = now_ms();
+
+    if (state == LIDAR_SESSION_SCANNING) {
+        uint32_t nodes = lidar_scan_node_total();
+        if (nodes != wd_nodes) {
+            wd_nodes = nodes;
+            wd_progress_ms = t;
+        } else if (t - wd_progress_ms >= LIDAR_SESSION_STALL_MS) {
+            session_recover("sample flow stalled");
+            return session_wait();
+        }
+        if (fail_count && t - scan_since_ms >= LIDAR_SESSION_STABLE_MS) {
+            fail_count = 0;
+            reset_count = 0;
+        }
+        return LIDAR_SESSION_WATCHDOG_TICK_MS;
+    }
+
+    if (deadline_ms == 0 || t < deadline_ms) return session_wait();
+
+    // State timer expired
+    switch (state) {
+    case LIDAR_SESSION_PROBE:
+        if (++probe_tries >= LIDAR_SESSION_PROBE_RETRIES) {
+            ESP_LOGW(TAG, "No answer to GET_INFO after %u tries", (unsigned)probe_tries);
+            probe_tries = 0;
+            session_reset();
+        } else {
+            session_probe();
+        }
+        break;
+    case LIDAR_SESSION_DISCOVER: {
+        uint8_t buf[16];
+        session_discovery_next(lidar_caps_on_timeout(buf, sizeof(buf)), buf);
+        break;
+    }
+    case LIDAR_SESSION_HEALTH:
+        session_recover("health timeout");
+        break;
+    case LIDAR_SESSION_STARTING:
+        session_recover("no scan descriptor");
+        break;
+    case LIDAR_SESSION_STOPPING:
+        // Settled after STOP: check health before restarting
+        session_set_state(LIDAR_SESSION_HEALTH, LIDAR_SESSION_HEALTH_TIMEOUT_MS);
+        session_send_idx(LIDAR_CMD_IDX_GET_HEALTH);
+        break;
+    case LIDAR_SESSION_RESETTING:
+        probe_tries = 0;
+        session_probe();
+        break;
+    default:
+        deadline_ms = 0;
+        break;
+    }
+    return state == LIDAR_SESSION_SCANNING ? LIDAR_SESSION_WATCHDOG_TICK_MS : session_wait();
+}
+
+void lidar_session_on_response(uint8_t response_type, const void *parsed)
+{
+    if (pending_rsp && response_type != pending_rsp) {
+        ESP_LOGW(TAG, "Unexpected response 0x%02X (waiting for 0x%02X) in %s",
+                 (unsigned)response_type, (unsigned)pending_rsp, state_names[state]);
+        return;
+    }
+    pending_rsp = 0;
+
+    switch (state) {
+    case LIDAR_SESSION_PROBE:
+        if (response_type != LIDAR_RSP_TYPE_GET_INFO) break;
+        probe_tries = 0;
+        if (caps_known) {
+            // Re-probe after a reset: modes are already known, only health matters
+            session_set_state(LIDAR_SESSION_HEALTH, LIDAR_SESSION_HEALTH_TIMEOUT_MS);
+            session_send_idx(LIDAR_CMD_IDX_GET_HEALTH);
+        } else {
+            session_discover();
+        }
+        break;
+    case LIDAR_SESSION_DISCOVER: {
+        uint8_t buf[16];
+        session_discovery_next(lidar_caps_on_response(response_type, parsed, buf, sizeof(buf)), buf);
+        break;
+    }
+    case LIDAR_SESSION_HEALTH: {
+        if (response_type != LIDAR_RSP_TYPE_GET_HEALTH || !parsed) break;
+        const lidar_health_response_t *h = (const lidar_health_response_t *)parsed;
+        if (h->status == LIDAR_HEALTH_STATUS_ERROR) {
+            ESP_LOGW(TAG, "Sensor reports protection stop (0x%04X)", (unsigned)h->error_code);
+            session_reset();
+        } else {
+            session_ready();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bool lidar_session_on_stream(uint8_t response_type)
+{
+    bool decodable = LIDAR_CAPS_ANS_DECODABLE(response_type);
+    if (state == LIDAR_SESSION_STARTING && pending_rsp && response_type != pending_rsp) {
+        ESP_LOGW(TAG, "Scan descriptor 0x%02X, expected 0x%02X", (unsigned)response_type, (unsigned)pending_rsp);
+    }
+    pending_rsp = 0;
+    if (!decodable) {
+        ESP_LOGW(TAG, "Scan answer type 0x%02X has no decoder", (unsigned)response_type);
+        return false;
+    }
+
+    lidar_scan_reset();
+    int best = lidar_caps_best_mode();
+    lidar_scan_set_sample_time(best >= 0 ? lidar_caps_get()->modes[best].us_per_sample_q8 : 0);
+    stream_active = true;
+    want_scan = true;
+    wd_nodes = lidar_scan_node_total();
+    wd_progress_ms = now_ms();
+    scan_since_ms = wd_progress_ms;
+    session_set_state(LIDAR_SESSION_SCANNING, 0);
+    lidar_motor_start();                        // may send a speed command: state must be SCANNING
+    if (fault_since_ms) {
+        stats.last_recovery_ms = (uint32_t)(scan_since_ms - fault_since_ms);
+        ESP_LOGI(TAG, "Scan restored %u ms after fault (%u recoveries, %u resets)",
+                 (unsigned)stats.last_recovery_ms, (unsigned)stats.recoveries, (unsigned)stats.resets);
+        fault_since_ms = 0;
+    }
+    return true;
+}
+
+bool lidar_session_streaming(void)
+{
+    return stream_active;
+}
+
+void lidar_session_request(uint8_t ctrl)
+{
+    switch (ctrl) {
+    case LIDAR_SESSION_CTRL_START:
+        want_scan = true;
+        if (state == LIDAR_SESSION_IDLE) {
+            if (caps_known) {
+                session_start_scan();
+            } else {
+                probe_tries = 0;
+                session_probe();
+            }
+        }
+        break;
+    case LIDAR_SESSION_CTRL_STOP:
+        want_scan = false;
+        fault_since_ms = 0;
+        session_set_state(LIDAR_SESSION_IDLE, 0);
+        session_send_idx(LIDAR_CMD_IDX_STOP);
+        break;
+    case LIDAR_SESSION_CTRL_RESTART:
+        fault_since_ms = now_ms();
+        session_reset();
+        break;
+    default:
+        ESP_LOGW(TAG, "Unknown session request 0x%02X", (unsigned)ctrl);
+        break;
+    }
+}
+
+void lidar_session_send_cmd(const uint8_t *cmd, size_t len)
+{
+    if (len < 2) return;
+    if (cmd[1] == LIDAR_CMD_STOP) {
+        want_scan = false;
+        session_set_state(LIDAR_SESSION_IDLE, 0);
+    } else if (cmd[1] == LIDAR_CMD_RESET) {
+        session_set_state(LIDAR_SESSION_RESETTING, LIDAR_SESSION_RESET_WAIT_MS);
+    }
+    session_send(cmd, len, 0);
+}
+
+bool lidar_session_send_motor_speed(uint16_t rpm)
+{
+    // MOTOR_SPEED_CTRL has no response, so it is safe between scan nodes; in
+    // any other state a command/response exchange may be in flight.
+    if (state != LIDAR_SESSION_SCANNING && state != LIDAR_SESSION_IDLE) return false;
+    uint8_t buf[8];
+    size_t len = lidar_build_motor_speed(buf, sizeof(buf), rpm);
+    uint8_t keep = pending_rsp;
+    bool ok = session_send(buf, len, 0);
+    pending_rsp = keep;
+    return ok;
+}
+
+void lidar_session_get_stats(lidar_session_stats_t *out)
+{
+    if (!out) return;
+    *out = stats;
+    if (state == LIDAR_SESSION_SCANNING) {
+        out->scan_uptime_ms += (uint32_t)(now_ms() - scan_since_ms);
+    }
+}
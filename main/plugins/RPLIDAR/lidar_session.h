@@ -0,0 +1,88 @@
+// lidar_session.h
+// LIDAR session controller: probe -> capability discovery (health + scan
+// modes) -> start scan in the selected mode -> sample-flow watchdog, with
+// STOP/RESET recovery on stall, start timeout or protection stop.
+//
+// Runs entirely in the coordinator task: the coordinator forwards parsed
+// responses and stream descriptors and calls lidar_session_poll() with the
+// queue wait it returns.
+
+#ifndef LIDAR_SESSION_H
+#define LIDAR_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    LIDAR_SESSION_IDLE = 0,     // no scan wanted (or stopped on request)
+    LIDAR_SESSION_PROBE,        // GET_INFO sent, waiting for the device
+    LIDAR_SESSION_DISCOVER,     // capability discovery (lidar_caps)
+    LIDAR_SESSION_HEALTH,       // health re-check during recovery
+    LIDAR_SESSION_STARTING,     // scan command sent, waiting for the descriptor
+    LIDAR_SESSION_SCANNING,     // streaming; sample-flow watchdog armed
+    LIDAR_SESSION_STOPPING,     // STOP sent, settling before the next command
+    LIDAR_SESSION_RESETTING,    // RESET sent, waiting for the core to reboot
+} lidar_session_state_t;
+
+// Control requests on TARGET_LIDAR_COORD (data[0]). Values below
+// LIDAR_CMD_IDX_COUNT are sent to the sensor as raw lidar_cmd_idx_t commands.
+#define LIDAR_SESSION_CTRL_START    0x80    // bring a scan up (probing if needed)
+#define LIDAR_SESSION_CTRL_STOP     0x81    // stop scanning and stay idle
+#define LIDAR_SESSION_CTRL_RESTART  0x82    // full RESET and re-probe
+
+#define LIDAR_SESSION_WAIT_FOREVER  UINT32_MAX
+
+// Timing (ms)
+#define LIDAR_SESSION_PROBE_TIMEOUT_MS   500
+#define LIDAR_SESSION_PROBE_RETRIES      3
+#define LIDAR_SESSION_HEALTH_TIMEOUT_MS  500
+#define LIDAR_SESSION_START_TIMEOUT_MS   1000
+#define LIDAR_SESSION_STALL_MS           500     // no scan nodes for this long = stall
+#define LIDAR_SESSION_WATCHDOG_TICK_MS   100
+#define LIDAR_SESSION_STOP_SETTLE_MS     20      // protocol asks >= 1 ms after STOP
+#define LIDAR_SESSION_RESET_WAIT_MS      2000    // doubled per consecutive reset, capped
+#define LIDAR_SESSION_RESET_WAIT_MAX_MS  16000
+#define LIDAR_SESSION_SOFT_RETRIES       2       // STOP/restart attempts before RESET
+#define LIDAR_SESSION_STABLE_MS          10000   // scanning this long clears the failure count
+
+typedef struct {
+    lidar_session_state_t state;
+    uint32_t recoveries;        // stall/timeout/protection events handled
+    uint32_t resets;            // RESETs issued
+    uint32_t scan_uptime_ms;    // total time spent scanning
+    uint32_t last_recovery_ms;  // fault detected -> samples flowing again
+} lidar_session_stats_t;
+
+// Start the session (after the sensor's power-on delay). Scans automatically
+// when CONFIG_LIDAR_AUTOSTART_SCAN is set, otherwise stops after discovery.
+void lidar_session_begin(void);
+
+// Run timers. Returns how long the caller may block (ms) before calling again.
+uint32_t lidar_session_poll(void);
+
+// A single response was parsed (parsed points at the registry struct)
+void lidar_session_on_response(uint8_t response_type, const void *parsed);
+
+// A multi-response (scan) descriptor arrived. Returns true if the stream is
+// one the scan assembler decodes; the caller then feeds it scan bytes.
+bool lidar_session_on_stream(uint8_t response_type);
+
+// True while scan bytes should go to the assembler
+bool lidar_session_streaming(void);
+
+// LIDAR_SESSION_CTRL_* request
+void lidar_session_request(uint8_t ctrl);
+
+// Send a raw command built from the command table. STOP/RESET also move the
+// session (to IDLE / re-probe) so it does not fight manual control.
+void lidar_session_send_cmd(const uint8_t *cmd, size_t len);
+
+// Send MOTOR_SPEED_CTRL (S-series only). Serialized with the session: only
+// goes out while scanning or idle, never into a pending exchange. Returns
+// false if deferred or dropped; the caller retries later.
+bool lidar_session_send_motor_speed(uint16_t rpm);
+
+void lidar_session_get_stats(lidar_session_stats_t *out);
+
+#endif // LIDAR_SESSION_H
@@ -8,23 +8,61 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "MCP23017.h"
+#include "io_MCP23017.h"
 #include "driver/gpio.h"
 
 static const char *TAG = "io_MCP23017";
 
-// Shared handle for the discovered MCP23017 so ISR worker and msg handler can access it
+// Shared handle for the discovered MCP23017s so ISR worker and msg handler can access it
 static mcp23017_handle_t s_mcp_dev = NULL;
 static mcp23017_attached_devices_t s_mcp_devices = {0};
 
-// Select which MCU GPIO is used for the MCP23017 INT line (kept from previous design)
+// Expanders are numbered by address (0x20 + n, set by the A2..A0 straps) in
+// messages and tables, so the numbering does not depend on what else is
+// fitted. s_mcp_idx maps that number to the driver's dev_idx (-1: absent).
+#define MCP_EXPANDERS MCP23017_MAX_DEVICES
+static int8_t s_mcp_idx[MCP_EXPANDERS] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+
+// MCU GPIO wired to each expander's INT pin (MIRROR on, open-drain, active
+// low). Expanders may share a line (wired-OR). GPIO_NUM_NC: outputs only,
+// never serviced.
 #define MCP_INT_GPIOB GPIO_NUM_2
+static const gpio_num_t s_mcp_int_gpio[MCP_EXPANDERS] = {
+    [0] = MCP_INT_GPIOB,
+    [1 ... MCP_EXPANDERS - 1] = GPIO_NUM_NC,
+};
+
+// What an interrupting port feeds. Anything not listed publishes generic
+// io_mcp_port_event_t messages to MCP_PORT_EVENT_TARGET.
+typedef enum {
+    MCP_ROUTE_PORT_EVENT = 0,
+    MCP_ROUTE_ENCODER,          // rotary encoder decoder below
+    MCP_ROUTE_LINE_WINDOW,      // legacy 1-byte line sensor sample to TARGET_LINE_SENSOR_WINDOW
+} mcp_route_t;
+
+static const mcp_route_t s_mcp_routes[MCP_EXPANDERS][2] = {
+    [0] = { [MCP_PORT_A] = MCP_ROUTE_ENCODER, [MCP_PORT_B] = MCP_ROUTE_LINE_WINDOW },
+};
+
+#define MCP_PORT_EVENT_TARGET   TARGET_LOG
+#define MCP_SERVICE_PASSES      4   // re-checks of the INT lines per notification
 
 // ISR worker task handle
 static TaskHandle_t s_mcp_gpio_worker_task = NULL;
 
+// How often the ISR worker reports its I2C cost per interrupt
+#define MCP_STATS_PERIOD_MS 10000
+
+// Motor driver writes are coalesced: messages only fold into a pending port
+// image, and once per flush each pending port gets at most one OLAT write.
+// 10 ms is one tick at the default 100 Hz FreeRTOS tick.
+#define MOTOR_FLUSH_MS 10
+
 // Forward declarations
 static void io_motor_driver_process_msg(const dispatcher_msg_t *msg);
+static void io_motor_driver_flush(void);
 static void mcp_gpio_isr_worker(void *arg);
 void io_MCP23017_init(void);
 
@@ -36,223 +74,509 @@ static dispatcher_module_t io_motor_driver_mod = {
     .stack_size = 4096,
     .task_prio = 5,
     .process_msg = io_motor_driver_process_msg,
-    .step_frame = NULL,
-    .step_ms = 0,
+    .step_frame = io_motor_driver_flush,
+    .step_ms = MOTOR_FLUSH_MS,
     .queue = NULL,
     .next_step = 0,
     .last_queue_warn = 0
 };
 
-// ISR worker: waits for notifications from ISR and dumps INTF/INTCAP for diagnostics
+// Rebuild the expander number -> dev_idx map from the discovery result
+static void mcp_index_devices(void)
+{
+    for (int e = 0; e < MCP_EXPANDERS; ++e) s_mcp_idx[e] = -1;
+    for (uint8_t i = 0; i < s_mcp_devices.count; ++i) {
+        uint8_t e = s_mcp_devices.addr[i] - MCP23017_ADDR_BASE;
+        if (e < MCP_EXPANDERS) s_mcp_idx[e] = (int8_t)i;
+    }
+}
+
+// I2C counters summed over every expander
+static void mcp_total_stats(uint32_t *transactions, uint32_t *wire_bytes)
+{
+    *transactions = 0;
+    *wire_bytes = 0;
+    for (uint8_t i = 0; i < s_mcp_devices.count; ++i) {
+        mcp23017_stats_t st;
+        if (mcp23017_get_stats(s_mcp_dev, i, &st) != ESP_OK) continue;
+        *transactions += st.transactions;
+        *wire_bytes += st.wire_bytes;
+    }
+}
+
+// Log the I2C cost of a driver call from the stats snapshot taken before it
+static void mcp_log_cost(uint8_t dev_idx, const char *what, const mcp23017_stats_t *before)
+{
+    mcp23017_stats_t now;
+    if (mcp23017_get_stats(s_mcp_dev, dev_idx, &now) != ESP_OK) return;
+    uint32_t bytes = now.wire_bytes - before->wire_bytes;
+    ESP_LOGI(TAG, "%s: %u I2C transactions, %u bytes (~%u us on the wire)", what,
+             (unsigned)(now.transactions - before->transactions), (unsigned)bytes, (unsigned)MCP23017_WIRE_US(bytes));
+}
+
+// Rotary encoder on expander 0 Port A: quadrature A/B on bits 5/6, push switch on bit 7
+// (active low). All three interrupt on any edge.
+#define ENC_PIN_A           0x20
+#define ENC_PIN_B           0x40
+#define ENC_PIN_SW          0x80
+#define ENC_PINS            (ENC_PIN_A | ENC_PIN_B | ENC_PIN_SW)
+#define ENC_IDLE_US         200000  // no step for this long: velocity reported as 0
+#define ENC_VEL_EMA_SHIFT   2       // velocity EMA weight 1/4
+#define ENC_SW_DEBOUNCE_US  15000
+#define ENC_INVALID         2       // LUT marker: both lines changed, direction unknown
+
+// Step for (previous AB << 2) | current AB, with AB = (A << 1) | B. Clockwise
+// is 00 -> 10 -> 11 -> 01 -> 00 (A leads B).
+static const int8_t s_enc_lut[16] = {
+     0, -1, +1, ENC_INVALID,
+    +1,  0, ENC_INVALID, -1,
+    -1, ENC_INVALID,  0, +1,
+    ENC_INVALID, +1, -1,  0,
+};
+
+typedef struct {
+    uint8_t ab;             // last decoded AB state
+    int32_t count;
+    uint16_t invalid;
+    int32_t vel;            // steps/s, EMA
+    int64_t last_step_us;
+    bool pressed;
+    int64_t sw_change_us;
+} mcp_encoder_t;
+
+static uint8_t enc_ab(uint8_t port_a)
+{
+    return (uint8_t)(((port_a & ENC_PIN_A) ? 2 : 0) | ((port_a & ENC_PIN_B) ? 1 : 0));
+}
+
+// Feed one Port A sample; returns the signed step it produced
+static int enc_feed(mcp_encoder_t *enc, uint8_t port_a)
+{
+    uint8_t ab = enc_ab(port_a);
+    int8_t step = s_enc_lut[(enc->ab << 2) | ab];
+    enc->ab = ab;
+    if (step == ENC_INVALID) {
+        enc->invalid++;
+        return 0;
+    }
+    enc->count += step;
+    return step;
+}
+
+// Velocity from the net steps of one worker pass and the time since the
+// previous pass that moved. Timing is taken in the worker, so it carries the
+// task wake-up latency; the EMA smooths that out.
+static void enc_update_velocity(mcp_encoder_t *enc, int steps, int64_t now_us)
+{
+    int64_t dt = now_us - enc->last_step_us;
+    if (steps == 0) {
+        if (dt >= ENC_IDLE_US) enc->vel = 0;
+        return;
+    }
+    if (dt > 0 && dt < ENC_IDLE_US) {
+        int32_t inst = (int32_t)((int64_t)steps * 1000000 / dt);
+        if ((inst < 0) != (enc->vel < 0)) enc->vel = 0;     // reversal: restart the average
+        enc->vel += (inst - enc->vel) >> ENC_VEL_EMA_SHIFT;
+        if (enc->vel == 0) enc->vel = inst > 0 ? 1 : -1;
+    } else {
+        enc->vel = 0;   // first step after idle: no interval yet
+    }
+    enc->last_step_us = now_us;
+}
+
+static mcp_encoder_t s_enc;
+static bool s_enc_primed = false;
+static bool s_enc_dirty = false;            // changed since the last message
+static int32_t s_enc_published = 0;         // count carried by the last message
+
+// One message per worker tick at most, however many steps the tick decoded
+static void enc_publish(const mcp_encoder_t *enc)
+{
+    int32_t delta = enc->count - s_enc_published;
+    s_enc_published = enc->count;
+    s_enc_dirty = false;
+    io_mcp_encoder_msg_t out = {
+        .kind = IO_MCP_MSG_ENCODER,
+        .count = enc->count,
+        .delta = (int16_t)(delta > INT16_MAX ? INT16_MAX : (delta < -INT16_MAX ? -INT16_MAX : delta)),
+        .velocity = (int16_t)(enc->vel > INT16_MAX ? INT16_MAX : (enc->vel < -INT16_MAX ? -INT16_MAX : enc->vel)),
+        .invalid = enc->invalid,
+        .pressed = enc->pressed ? 1 : 0,
+    };
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_LOG;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_STREAMING,
+        .source = SOURCE_MCP23017,
+        .targets = targets,
+        .data = (const uint8_t *)&out,
+        .data_len = sizeof(out),
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; dropping encoder msg");
+    }
+}
+
+// INTCAP is the port at the first edge and GPIO the port now, so feeding
+// both to the decoder keeps up with a knob that moved again before the read
+static void enc_service(uint8_t intf, uint8_t intcap, uint8_t level, int64_t now_us)
+{
+    intf &= ENC_PINS;
+    if (!s_enc_primed) {
+        // First read gives the resting state, not a step
+        s_enc.ab = enc_ab(intf ? intcap : level);
+        s_enc.pressed = !(level & ENC_PIN_SW);
+        s_enc_primed = true;
+    }
+    if (!intf) return;
+
+    int32_t count_before = s_enc.count;
+    uint16_t invalid_before = s_enc.invalid;
+    int steps = enc_feed(&s_enc, intcap);
+    steps += enc_feed(&s_enc, level);
+    enc_update_velocity(&s_enc, steps, now_us);
+
+    bool pressed = !(level & ENC_PIN_SW);
+    bool sw_changed = false;
+    if (pressed != s_enc.pressed && now_us - s_enc.sw_change_us >= ENC_SW_DEBOUNCE_US) {
+        s_enc.pressed = pressed;
+        s_enc.sw_change_us = now_us;
+        sw_changed = true;
+    }
+    if (s_enc.count != count_before || s_enc.invalid != invalid_before || sw_changed) s_enc_dirty = true;
+}
+
+static void line_window_publish(uint8_t intcap)
+{
+    mcp23017_reverse8_inplace(&intcap);
+    // compose and send dispatcher message from INTCAP as SOURCE_LINE_SENSOR to TARGET_LINE_SENSOR_WINDOW
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_LINE_SENSOR_WINDOW;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_STREAMING,
+        .source = SOURCE_LINE_SENSOR,
+        .targets = targets,
+        .data = &intcap,
+        .data_len = sizeof(intcap),
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; dropping window msg");
+    }
+}
+
+static void port_event_publish(uint8_t expander, uint8_t port, uint8_t intf, uint8_t intcap, uint8_t level, int64_t t_us)
+{
+    io_mcp_port_event_t ev = {
+        .kind = IO_MCP_MSG_PORT_EVENT,
+        .expander = expander,
+        .port = port,
+        .intf = intf,
+        .intcap = intcap,
+        .level = level,
+        .t_us = t_us,
+    };
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = MCP_PORT_EVENT_TARGET;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_STREAMING,
+        .source = SOURCE_MCP23017,
+        .targets = targets,
+        .data = (const uint8_t *)&ev,
+        .data_len = sizeof(ev),
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; dropping port event");
+    }
+}
+
+// One block read of INTFA..GPIOB (reading GPIO also releases INT), then
+// each interrupting port goes to its route
+static void mcp_service_expander(uint8_t expander, uint8_t dev_idx)
+{
+    uint8_t buf[6] = {0};   // INTFA INTFB INTCAPA INTCAPB GPIOA GPIOB
+    esp_err_t rc = mcp23017_reg_read_block(s_mcp_dev, dev_idx, MCP_REG_INTFA, buf, sizeof(buf));
+    if (rc != ESP_OK) {
+        ESP_LOGW(TAG, "ISR worker: expander %u block read INTFA..GPIOB failed (0x%X)", expander, rc);
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    for (uint8_t port = MCP_PORT_A; port <= MCP_PORT_B; ++port) {
+        uint8_t intf = buf[port];
+        uint8_t intcap = buf[2 + port];
+        uint8_t level = buf[4 + port];
+        switch (s_mcp_routes[expander][port]) {
+        case MCP_ROUTE_ENCODER:
+            enc_service(intf, intcap, level, now_us);
+            break;
+        case MCP_ROUTE_LINE_WINDOW:
+            if (intf) line_window_publish(intcap);
+            break;
+        case MCP_ROUTE_PORT_EVENT:
+        default:
+            if (intf) port_event_publish(expander, port, intf, intcap, level, now_us);
+            break;
+        }
+    }
+}
+
+// ISR worker: one task services every expander. On each notification it
+// reads every expander whose INT line is asserted, then looks at the lines
+// again: on a shared line an expander that asserts while another is being
+// serviced produces no new falling edge, so it must be caught here.
 static void mcp_gpio_isr_worker(void *arg)
 {
     (void)arg;
 
-    uint8_t intcap_a_last = 0;
-    uint16_t encoder_pulse = 0xE0E0;
-    uint8_t gpio_a = 0;
-    TickType_t encoder_button_last_time = 0;
-    const TickType_t encoder_button_debounce_ticks = pdMS_TO_TICKS(15); // ms
-    uint16_t encoder_button_state = 0x8080; // low byte is current state of switch, high byte is previous state (initialized to released)
+    // I2C cost of servicing interrupts, reported every MCP_STATS_PERIOD_MS
+    uint32_t irq_count = 0;
+    uint32_t irq_transactions = 0;
+    uint32_t irq_wire_bytes = 0;
+    TickType_t stats_last = xTaskGetTickCount();
 
     for (;;) {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // While the knob is moving, wake up after the idle time to publish
+        // the velocity dropping to 0
+        TickType_t wait = s_enc.vel ? pdMS_TO_TICKS(ENC_IDLE_US / 1000) : portMAX_DELAY;
+        if (ulTaskNotifyTake(pdTRUE, wait) == 0) {
+            enc_update_velocity(&s_enc, 0, esp_timer_get_time());
+            if (s_enc.vel == 0) enc_publish(&s_enc);
+            continue;
+        }
 
         if (!s_mcp_dev) {
             ESP_LOGW(TAG, "ISR worker: MCP23017 device not ready");
             continue;
         }
 
-        uint8_t buf[4] = {0};
-        esp_err_t rc = mcp23017_reg_read_block(s_mcp_dev, 0, MCP_REG_INTFA, buf, sizeof(buf));
-        if (rc != ESP_OK) {
-            ESP_LOGW(TAG, "ISR worker: block read INTFA..INTCAPB failed (0x%X)", rc);
-            continue;
+        TickType_t stats_now = xTaskGetTickCount();
+        if (irq_count && stats_now - stats_last >= pdMS_TO_TICKS(MCP_STATS_PERIOD_MS)) {
+            ESP_LOGI(TAG, "ISR worker: %u interrupts, %.2f I2C transactions and %u wire bytes each; encoder %ld invalid %u",
+                     (unsigned)irq_count, (double)irq_transactions / irq_count, (unsigned)(irq_wire_bytes / irq_count),
+                     (long)s_enc.count, (unsigned)s_enc.invalid);
+            irq_count = irq_transactions = irq_wire_bytes = 0;
+            stats_last = stats_now;
         }
-        uint8_t intf_a = buf[0] & 0xE0; // only upper 3 bits of Port A are used for line sensors and encoder inputs
-        uint8_t intf_b = buf[1];
-        uint8_t intcap_a = buf[2] & 0xE0; // only upper 3 bits of Port A are used for line sensors and encoder inputs
-        uint8_t intcap_b = buf[3];
-
 
-
-        if (intf_a == 0 && intf_b == 0) {
-            ESP_LOGI(TAG, "ISR worker: spurious INT - no INTF flags set");
-            continue;
-        }
-        // Dedupe intcap_a
-        if (intcap_a == intcap_a_last) continue; // if intcap_a didn't change, skip processing to avoid duplicate logs and messages
-        
-        intcap_a_last = intcap_a;
-        encoder_pulse = (encoder_pulse << 8) | intcap_a; // shift in new pulse state for encoder inputs
-        
-        switch (intf_a){
-        case 0x20:{
-            switch (encoder_pulse) {
-            case 0x2040:
-                ESP_LOGI(TAG, "Encoder pulse clockwise detected");
-                ESP_LOGI(TAG, "Switch held low");
-                encoder_button_state = 0x0000;
-                break;
-            case 0xC0A0:
-                ESP_LOGI(TAG, "Encoder pulse clockwise detected");
-                ESP_LOGI(TAG, "Switch kept released");
-                encoder_button_state = 0x8080;
-                break;
-            case 0x0060:
-                ESP_LOGI(TAG, "Encoder pulse counterclockwise detected");
-                ESP_LOGI(TAG, "Switch held low");
-                encoder_button_state = 0x0000;
-                break;
-            case 0x80E0:
-                ESP_LOGI(TAG, "Encoder pulse counterclockwise detected");
-                ESP_LOGI(TAG, "Switch kept released");
-                encoder_button_state = 0x8080;
-                break;
-                }
-            break;
-            }
-        case 0x80:{
-            TickType_t now = xTaskGetTickCount();
-            if (now - encoder_button_last_time > encoder_button_debounce_ticks) {
-
-                encoder_button_last_time = now;
-                encoder_button_state = (encoder_button_state << 8) | (intcap_a & 0x80); // shift in new state of switch (bit 7 of Port A)
-                // ESP_LOGI(TAG, "MCP23017 Port A INTF=0x%02X INTCAP=0x%02X ENCODER_PULSE=0x%04X", intf_a, intcap_a, encoder_pulse);     
-                switch(encoder_button_state) {
-                case 0x0080:
-                    ESP_LOGI(TAG, "Switch released");
-                    break;
-                case 0x8000:
-                    ESP_LOGI(TAG, "Switch pressed");
-                    break;
-                    }
-                break;
-                }
+        uint32_t tx_before, bytes_before, tx_after, bytes_after;
+        mcp_total_stats(&tx_before, &bytes_before);
+
+        int serviced = 0;
+        for (int pass = 0; pass < MCP_SERVICE_PASSES; ++pass) {
+            bool asserted = false;
+            for (uint8_t e = 0; e < MCP_EXPANDERS; ++e) {
+                if (s_mcp_idx[e] < 0 || s_mcp_int_gpio[e] == GPIO_NUM_NC) continue;
+                if (gpio_get_level(s_mcp_int_gpio[e]) != 0) continue;
+                asserted = true;
+                mcp_service_expander(e, (uint8_t)s_mcp_idx[e]);
+                serviced++;
             }
+            if (!asserted) break;
         }
-        if (intf_b) {
-            mcp23017_reverse8_inplace(&intcap_b);
-            // compose and send dispatcher message from INTCAP as SOURCE_LINE_SENSOR to TARGET_LINE_SENSOR_WINDOW
-            dispatch_target_t targets[TARGET_MAX];
-            dispatcher_fill_targets(targets);
-            targets[0] = TARGET_LINE_SENSOR_WINDOW;
-                dispatcher_pool_send_params_t params = {
-                    .type = DISPATCHER_POOL_STREAMING,
-                    .source = SOURCE_LINE_SENSOR,
-                    .targets = targets,
-                    .data = &intcap_b,
-                    .data_len = sizeof(intcap_b),
-                    .context = NULL
-                };
-                if (!dispatcher_pool_send_ptr_params(&params)) {
-                    ESP_LOGW(TAG, "Pool send failed; dropping window msg");
-                }
-            ESP_LOGD(TAG, "MCP23017 Port B INTF=0x%02X INTCAP=0x%02X", intf_b, intcap_b);
+
+        if (s_enc_dirty) enc_publish(&s_enc);
+
+        mcp_total_stats(&tx_after, &bytes_after);
+        irq_count++;
+        irq_transactions += tx_after - tx_before;
+        irq_wire_bytes += bytes_after - bytes_before;
+
+        if (serviced == 0) {
+            ESP_LOGI(TAG, "ISR worker: spurious INT - no INT line asserted");
         }
     }
 }
 
-// Background task: perform auto-setup and port configuration so initialization
-// doesn't block system bring-up.
-static void io_mcp23017_task(void *arg)
+// Port configuration after auto-setup. Runs once from io_MCP23017_init,
+// before the ISR worker, the INT lines and the motor driver module exist, so
+// nothing reads or writes the expanders while their ports are being set up.
+static void mcp_configure_ports(void)
 {
-    (void)arg;
-
-    ESP_LOGI(TAG, "io_mcp23017_task: starting auto-setup");
+    // Expander 0: motor outputs, rotary encoder and line sensor inputs
+    if (s_mcp_idx[0] >= 0) {
+        uint8_t dev = (uint8_t)s_mcp_idx[0];
+        mcp23017_stats_t before;
+        (void)mcp23017_get_stats(s_mcp_dev, dev, &before);
+
+        // Configure Port B as inputs with pullups and interrupt on any edge
+        mcp23017_pin_cfg_t cfg = {
+            .port = MCP_PORT_B,
+            .mask = MCP_PORT_ALL,
+            .pin_mode = MCP_PIN_INPUT,
+            .pullup = MCP_PULLUP_ENABLE,
+            .int_mode = MCP_INT_ANYEDGE,
+            .int_polarity = MCP_INT_OPENDRAIN,
+            .initial_level = 0x00,
+            .flags = MCP_CFG_BATCH_WRITE,
+        };
+        (void)mcp23017_config_port(s_mcp_dev, dev, &cfg);
+        mcp_log_cost(dev, "config port B inputs", &before);
+
+        // Configure Port A as outputs for motor control pins
+        cfg.port = MCP_PORT_A;
+        cfg.mask = 0X1F; // only use lower 5 bits for motors
+        cfg.pin_mode = MCP_PIN_OUTPUT;
+        cfg.pullup = MCP_PULLUP_DISABLE;
+        cfg.int_mode = MCP_INT_NONE;
+        cfg.int_polarity = MCP_INT_OPENDRAIN;
+        cfg.initial_level = 0x00;
+        cfg.flags = MCP_CFG_BATCH_WRITE;
+        (void)mcp23017_get_stats(s_mcp_dev, dev, &before);
+        (void)mcp23017_config_port(s_mcp_dev, dev, &cfg);
+        mcp_log_cost(dev, "config port A motor outputs", &before);
+
+        // Configure Port A bits 5-7 as inputs with pullups for the rotary encoder
+        // (A, B, switch); both quadrature lines interrupt so every transition is seen
+        cfg.port = MCP_PORT_A;
+        cfg.mask = 0xE0; // bits 5, 6 and 7
+        cfg.pin_mode = MCP_PIN_INPUT;
+        cfg.pullup = MCP_PULLUP_ENABLE;
+        cfg.int_mode = MCP_INT_ANYEDGE;
+        cfg.int_polarity = MCP_INT_OPENDRAIN;
+        cfg.initial_level = 0x00;
+        cfg.flags = MCP_CFG_BATCH_WRITE;
+        (void)mcp23017_get_stats(s_mcp_dev, dev, &before);
+        (void)mcp23017_config_port(s_mcp_dev, dev, &cfg);
+        mcp_log_cost(dev, "config port A encoder inputs", &before);
+    }
 
-    esp_err_t rc = mcp23017_auto_setup(&s_mcp_devices, true, NULL);
-    if (rc != ESP_OK || s_mcp_devices.handle == NULL) {
-        ESP_LOGE(TAG, "io_mcp23017_task: Failed to auto-setup MCP23017: 0x%X", rc);
-        vTaskDelete(NULL);
-        return;
+    // Every expander with an INT line: mirrored, so one line covers both ports
+    for (uint8_t e = 0; e < MCP_EXPANDERS; ++e) {
+        if (s_mcp_idx[e] < 0 || s_mcp_int_gpio[e] == GPIO_NUM_NC) continue;
+        (void)mcp23017_set_int_mirror(s_mcp_dev, (uint8_t)s_mcp_idx[e], true);
     }
-    s_mcp_dev = s_mcp_devices.handle;
 
-    // Configure Port B as inputs with pullups and interrupt on any edge
-    mcp23017_pin_cfg_t cfg = {
-        .port = MCP_PORT_B,
-        .mask = MCP_PORT_ALL,
-        .pin_mode = MCP_PIN_INPUT,
-        .pullup = MCP_PULLUP_ENABLE,
-        .int_mode = MCP_INT_ANYEDGE,
-        .int_polarity = MCP_INT_OPENDRAIN,
-        .initial_level = 0x00,
-        .flags = MCP_CFG_BATCH_WRITE,
-    };
-    (void)mcp23017_config_port(s_mcp_dev, 0, &cfg);
-
-    // Configure Port A as outputs for motor control pins
-    cfg.port = MCP_PORT_A;
-    cfg.mask = 0X1F; // only use lower 5 bits for motors
-    cfg.pin_mode = MCP_PIN_OUTPUT;
-    cfg.pullup = MCP_PULLUP_DISABLE;
-    cfg.int_mode = MCP_INT_NONE;
-    cfg.int_polarity = MCP_INT_OPENDRAIN;
-    cfg.initial_level = 0x00;
-    cfg.flags = MCP_CFG_BATCH_WRITE;
-    (void)mcp23017_config_port(s_mcp_dev, 0, &cfg);
-
-    // Configure Port A bits 5 and 7 as inputs for rotary encoder with pullups, with interrupts on falling edge
-    cfg.port = MCP_PORT_A;
-    cfg.mask = 0xA0; // bits 5 and 7
-    cfg.pin_mode = MCP_PIN_INPUT;
-    cfg.pullup = MCP_PULLUP_ENABLE;
-    cfg.int_mode = MCP_INT_ANYEDGE; 
-    cfg.int_polarity = MCP_INT_OPENDRAIN;
-    cfg.initial_level = 0x00;
-    cfg.flags = MCP_CFG_BATCH_WRITE;
-    (void)mcp23017_config_port(s_mcp_dev, 0, &cfg);
-
-    // COnfigure Port A pin 6 as input for encoder direction with pullup without interrupts
-    cfg.port = MCP_PORT_A;
-    cfg.mask = 0x40; // bit 6
-    cfg.pin_mode = MCP_PIN_INPUT;
-    cfg.pullup = MCP_PULLUP_ENABLE;
-    cfg.int_mode = MCP_INT_NONE;
-    cfg.int_polarity = MCP_INT_OPENDRAIN;
-    cfg.initial_level = 0x00;
-    cfg.flags = MCP_CFG_BATCH_WRITE;
-    (void)mcp23017_config_port(s_mcp_dev, 0, &cfg);
-
-    // Enable mirrored INT output
-    (void)mcp23017_set_int_mirror(s_mcp_dev, 0, true);
-
-    ESP_LOGI(TAG, "io_mcp23017_task: setup complete");
-
-    // Terminate this one-shot task
-    vTaskDelete(NULL);
+    ESP_LOGI(TAG, "Port setup complete (%u expanders)", s_mcp_devices.count);
 }
 
+// Motor port state, owned by the io_motor_driver task (process_msg and the
+// flush run there, so nothing is locked). olat is what the expander holds,
+// pend_mask/pend_val what messages asked for since the last flush.
+typedef struct {
+    uint8_t olat;
+    uint8_t pend_mask;
+    uint8_t pend_val;
+    bool olat_known;
+} motor_port_t;
+
+static motor_port_t s_motor[MCP_EXPANDERS][2];
+
+static struct {
+    uint32_t msgs;
+    uint32_t merged;        // messages folded into an update already pending
+    uint32_t writes;
+    uint32_t suppressed;    // flushes whose image matched OLAT
+    uint32_t failed;
+} s_motor_stats;
+
 // Message format consumed by TARGET_MOTOR_DRIVER (pooled pointer messages):
-// data[0] = mask (bits to affect on the port)
-// data[1] = value (bits to set where mask==1)
+// 2 bytes: mask, value                     -> expander 0, Port A
+// 4 bytes: expander, port, mask, value     -> any expander/port
+// value is applied where mask==1. Later messages win bit by bit; the result
+// is written on the next flush tick.
 static void io_motor_driver_process_msg(const dispatcher_msg_t *msg)
 {
     if (!msg) return;
-    if (!s_mcp_dev) {
-        ESP_LOGW(TAG, "process_msg: MCP device not initialized");
-        return;
-    }
 
-    if (msg->message_len < 2) {
+    uint8_t expander = 0;
+    uint8_t port = MCP_PORT_A;
+    uint8_t mask, value;
+    if (msg->message_len >= 4) {
+        expander = (uint8_t)msg->data[0];
+        port = (uint8_t)msg->data[1];
+        mask = (uint8_t)msg->data[2];
+        value = (uint8_t)msg->data[3];
+    } else if (msg->message_len >= 2) {
+        mask = (uint8_t)msg->data[0];
+        value = (uint8_t)msg->data[1];
+    } else {
         ESP_LOGW(TAG, "process_msg: message too short (%u)", (unsigned)msg->message_len);
         return;
     }
+    if (expander >= MCP_EXPANDERS || port > MCP_PORT_B) {
+        ESP_LOGW(TAG, "process_msg: no expander %u port %u", expander, port);
+        return;
+    }
 
-    uint8_t mask = (uint8_t)msg->data[0];
-    uint8_t value = (uint8_t)msg->data[1];
+    motor_port_t *mp = &s_motor[expander][port];
+    s_motor_stats.msgs++;
+    if (mp->pend_mask) s_motor_stats.merged++;
+    mp->pend_val = (uint8_t)((mp->pend_val & ~mask) | (value & mask));
+    mp->pend_mask |= mask;
+}
 
-    // For this module we hard-code device index 0 and Port A for motor driver outputs
-    esp_err_t rc = mcp23017_port_masked_write(s_mcp_dev, 0, MCP_PORT_A, mask, value);
-    if (rc != ESP_OK) {
-        ESP_LOGW(TAG, "mcp masked write failed: 0x%X (mask=0x%02X val=0x%02X)", rc, mask, value);
-    } else {
-        ESP_LOGD(TAG, "mcp masked write ok (mask=0x%02X val=0x%02X)", mask, value);
+// Step frame: one full OLAT write per port whose pending image differs from
+// the cached OLAT. The cache is seeded by a single read the first time a port
+// is written (and again after a failed write); after that nothing is read back.
+static void io_motor_driver_flush(void)
+{
+    static TickType_t stats_last = 0;
+
+    if (s_mcp_dev) {
+        for (uint8_t e = 0; e < MCP_EXPANDERS; ++e) {
+            for (uint8_t port = MCP_PORT_A; port <= MCP_PORT_B; ++port) {
+                motor_port_t *mp = &s_motor[e][port];
+                if (!mp->pend_mask) continue;
+                if (s_mcp_idx[e] < 0) {
+                    ESP_LOGW(TAG, "motor flush: no expander %u, dropping mask 0x%02X", e, mp->pend_mask);
+                    mp->pend_mask = 0;
+                    continue;
+                }
+                uint8_t dev = (uint8_t)s_mcp_idx[e];
+
+                if (!mp->olat_known) {
+                    if (mcp23017_reg_read8(s_mcp_dev, dev, MCP_REG_OLATA + port, &mp->olat) != ESP_OK) {
+                        s_motor_stats.failed++;
+                        continue;   // keep pending, retry next tick
+                    }
+                    mp->olat_known = true;
+                }
+
+                uint8_t next = (uint8_t)((mp->olat & ~mp->pend_mask) | mp->pend_val);
+                mp->pend_mask = 0;
+                mp->pend_val = 0;
+                if (next == mp->olat) {
+                    s_motor_stats.suppressed++;
+                    continue;
+                }
+
+                esp_err_t rc = mcp23017_port_write(s_mcp_dev, dev, (mcp23017_port_t)port, next);
+                if (rc != ESP_OK) {
+                    // The device state is unknown now: re-read before the next write
+                    ESP_LOGW(TAG, "motor write failed: 0x%X (exp=%u port=%u olat=0x%02X)", rc, e, port, next);
+                    mp->olat_known = false;
+                    mp->pend_mask = 0xFF;
+                    mp->pend_val = next;
+                    s_motor_stats.failed++;
+                    continue;
+                }
+                mp->olat = next;
+                s_motor_stats.writes++;
+                ESP_LOGD(TAG, "motor write ok (exp=%u port=%u olat=0x%02X)", e, port, next);
+            }
+        }
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if (now - stats_last >= pdMS_TO_TICKS(MCP_STATS_PERIOD_MS)) {
+        if (s_motor_stats.msgs) {
+            ESP_LOGI(TAG, "motor driver: %u msgs, %u merged, %u writes, %u suppressed, %u failed",
+                     (unsigned)s_motor_stats.msgs, (unsigned)s_motor_stats.merged, (unsigned)s_motor_stats.writes,
+                     (unsigned)s_motor_stats.suppressed, (unsigned)s_motor_stats.failed);
+            memset(&s_motor_stats, 0, sizeof(s_motor_stats));
+        }
+        stats_last = now;
     }
 }
 
-// Initialize the module: auto-setup MCP devices, configure ports, register ISR worker, start dispatcher module
+// Initialize the module: auto-setup MCP devices, configure ports, then register the ISR worker and start
+// the dispatcher module. Everything runs in order on the caller's task; there is no background setup.
 void io_MCP23017_init(void)
 {
     ESP_LOGI(TAG, "io_MCP23017_init() starting auto-setup");
@@ -262,18 +586,27 @@ void io_MCP23017_init(void)
         ESP_LOGE(TAG, "Failed to auto-setup MCP23017: 0x%X", rc);
         return;
     }
+    mcp_index_devices();
     s_mcp_dev = s_mcp_devices.handle;
+    mcp_configure_ports();
 
-    // Create ISR worker task and register with MCP ISR helper (worker may run before device attached)
+    // Create the ISR worker and point every INT line of a present expander at
+    // it (shared lines register once)
     BaseType_t created = xTaskCreate(mcp_gpio_isr_worker, "mcp_gpio_worker", 4096, NULL, 6, &s_mcp_gpio_worker_task);
     if (created == pdPASS) {
-        mcp23017_isr_cfg_t isr_cfg = {
-            .int_gpio = MCP_INT_GPIOB,
-            .pull_mode = GPIO_PULLUP_ONLY,
-            .intr_type = GPIO_INTR_NEGEDGE,
-            .install_isr_service = MCP_ISR_SERVICE_YES,
-        };
-        (void)mcp23017_isr_register(&isr_cfg, s_mcp_gpio_worker_task);
+        for (uint8_t e = 0; e < MCP_EXPANDERS; ++e) {
+            if (s_mcp_idx[e] < 0 || s_mcp_int_gpio[e] == GPIO_NUM_NC) continue;
+            mcp23017_isr_cfg_t isr_cfg = {
+                .int_gpio = s_mcp_int_gpio[e],
+                .pull_mode = GPIO_PULLUP_ONLY,
+                .intr_type = GPIO_INTR_NEGEDGE,
+                .install_isr_service = MCP_ISR_SERVICE_YES,
+            };
+            (void)mcp23017_isr_register(&isr_cfg, s_mcp_gpio_worker_task);
+        }
+        // A line already held low by an interrupt latched during setup gives
+        // no falling edge: let the worker look at the lines once
+        xTaskNotifyGive(s_mcp_gpio_worker_task);
     } else {
         ESP_LOGW(TAG, "Failed to create ISR worker task; ISR disabled");
     }
@@ -284,10 +617,5 @@ void io_MCP23017_init(void)
         return;
     }
 
-    // Launch background setup task so init does not block other subsystems
-    if (xTaskCreate(io_mcp23017_task, "io_mcp23017_setup", 4096, NULL, 5, NULL) != pdPASS) {
-        ESP_LOGW(TAG, "Failed to create MCP23017 setup task");
-    }
-
-    ESP_LOGI(TAG, "io_MCP23017_init() started (setup running in background)");
+    ESP_LOGI(TAG, "io_MCP23017_init() done");
 }
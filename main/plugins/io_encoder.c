@@ -0,0 +1,538 @@
+#include "io_encoder.h"
+#include "lidar_deskew.h"
+#include "mod_line_position.h"
+#include "dispatcher_module.h"
+#include "dispatcher_pool.h"
+#include "dispatcher.h"
+#include "driver/pulse_cnt.h"
+#include "driver/gptimer.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <stdatomic.h>
+
+static const char *TAG = "io_encoder";
+
+#define ENC_PPR                 CONFIG_ENCODER_PPR
+#define ENC_CPR                 (4 * ENC_PPR)       // counts per motor revolution (both edges of A and B)
+#define ENC_GEAR_RATIO          CONFIG_ENCODER_GEAR_RATIO
+#define ENC_SAMPLE_MS           CONFIG_ENCODER_SAMPLE_MS
+#define ENC_WHEEL_DIAMETER_MM   CONFIG_ENCODER_WHEEL_DIAMETER_MM
+#define ENC_TRACK_MM            CONFIG_ENCODER_TRACK_MM
+
+/* Hardware counter range; the driver extends it to an int on each limit */
+#define ENC_PCNT_LIMIT          10000
+#define ENC_GLITCH_NS           1000
+
+/* A-edge period measurement: edges closer than this are contact bounce */
+#define ENC_EDGE_MIN_US         200
+
+#define ENC_TIMER_RESOLUTION_HZ 1000000     // 1 tick = 1 us
+
+/* Synthetic generator: a phase accumulator per wheel stepped at this rate,
+   so up to ENC_SYNTH_TICK_HZ / 2 transitions per second */
+#define ENC_SYNTH_TICK_HZ       20000
+#define ENC_SYNTH_MAX_RPM       ((ENC_SYNTH_TICK_HZ / 2) * 60 / ENC_CPR)
+
+/* Odometry (and bench log) consumers want ~10 Hz whatever the window */
+#define ENC_PUBLISH_MS          100
+#define ENC_PUBLISH_EVERY       ((ENC_PUBLISH_MS + ENC_SAMPLE_MS - 1) / ENC_SAMPLE_MS)
+
+#define ENC_STATS_PERIOD_MS     10000
+
+typedef struct {
+    gpio_num_t pin_a;
+    gpio_num_t pin_b;
+    int8_t sign;                        // +1, or -1 for a mirror-mounted motor
+    pcnt_unit_handle_t unit;
+
+    /* A-edge timing, written by enc_edge_isr under s_enc_lock */
+    int64_t last_edge_us;
+    int64_t prev_edge_us;
+    int8_t edge_dir;                    // +1 forward, -1 reverse (raw, before sign)
+
+    /* Owned by the sample task */
+    int32_t last_count;
+    bool edge_irq_on;
+
+    /* Synthetic generator, written by the command handler and read by the
+       generator alarm */
+    volatile int32_t synth_inc_q16;     // signed phase steps per tick, Q16
+    uint32_t synth_acc;
+    uint8_t synth_phase;
+} enc_wheel_t;
+
+static enc_wheel_t s_wheels[IO_ENCODER_COUNT] = {
+    [IO_ENCODER_LEFT]  = { .pin_a = CONFIG_ENCODER_LEFT_A_GPIO,  .pin_b = CONFIG_ENCODER_LEFT_B_GPIO,  .sign = 1 },
+#if CONFIG_ENCODER_RIGHT_INVERT
+    [IO_ENCODER_RIGHT] = { .pin_a = CONFIG_ENCODER_RIGHT_A_GPIO, .pin_b = CONFIG_ENCODER_RIGHT_B_GPIO, .sign = -1 },
+#else
+    [IO_ENCODER_RIGHT] = { .pin_a = CONFIG_ENCODER_RIGHT_A_GPIO, .pin_b = CONFIG_ENCODER_RIGHT_B_GPIO, .sign = 1 },
+#endif
+};
+
+/* Counts of both wheels latched by the sample alarm */
+typedef struct {
+    int count[IO_ENCODER_COUNT];
+    int64_t t_us;
+    uint32_t seq;
+} enc_snapshot_t;
+
+/* Sequence-locked copy of the newest samples: seq is odd while the sample
+   task writes, and a reader keeps the copy only if seq was even and did not
+   change around it */
+typedef struct {
+    atomic_uint seq;
+    io_encoder_msg_t sample[IO_ENCODER_COUNT];
+} enc_mailbox_t;
+
+static enc_mailbox_t s_mailbox;
+
+static portMUX_TYPE s_enc_lock = portMUX_INITIALIZER_UNLOCKED;
+static enc_snapshot_t s_snap;
+static gptimer_handle_t s_sample_timer = NULL;
+static gptimer_handle_t s_synth_timer = NULL;
+static bool s_synth_running = false;
+static TaskHandle_t s_enc_task = NULL;
+
+/* Quadrature phase for forward motion: (A,B) 10 -> 11 -> 01 -> 00 */
+static const uint8_t s_quad_a[4] = { 1, 1, 0, 0 };
+static const uint8_t s_quad_b[4] = { 0, 1, 1, 0 };
+
+IRAM_ATTR static bool enc_sample_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    (void)timer;
+    (void)edata;
+    (void)user_ctx;
+    int count[IO_ENCODER_COUNT];
+    for (int i = 0; i < IO_ENCODER_COUNT; ++i) {
+        count[i] = 0;
+        if (s_wheels[i].unit) pcnt_unit_get_count(s_wheels[i].unit, &count[i]);
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL_ISR(&s_enc_lock);
+    memcpy(s_snap.count, count, sizeof(s_snap.count));
+    s_snap.t_us = now_us;
+    s_snap.seq++;
+    portEXIT_CRITICAL_ISR(&s_enc_lock);
+
+    BaseType_t woken = pdFALSE;
+    if (s_enc_task) vTaskNotifyGiveFromISR(s_enc_task, &woken);
+    return woken == pdTRUE;
+}
+
+/* Enabled only at low speed. After an A edge, A != B means forward. */
+IRAM_ATTR static void enc_edge_isr(void *arg) {
+    enc_wheel_t *w = (enc_wheel_t *)arg;
+    int64_t now_us = esp_timer_get_time();
+    int a = gpio_get_level(w->pin_a);
+    int b = gpio_get_level(w->pin_b);
+
+    portENTER_CRITICAL_ISR(&s_enc_lock);
+    if (w->last_edge_us == 0 || now_us - w->last_edge_us >= ENC_EDGE_MIN_US) {
+        w->prev_edge_us = w->last_edge_us;
+        w->last_edge_us = now_us;
+        w->edge_dir = (a != b) ? 1 : -1;
+    }
+    portEXIT_CRITICAL_ISR(&s_enc_lock);
+}
+
+IRAM_ATTR static bool enc_synth_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    (void)timer;
+    (void)edata;
+    (void)user_ctx;
+    for (int i = 0; i < IO_ENCODER_COUNT; ++i) {
+        enc_wheel_t *w = &s_wheels[i];
+        int32_t inc = w->synth_inc_q16;
+        if (inc == 0) continue;
+        w->synth_acc += (uint32_t)(inc < 0 ? -inc : inc);
+        if (w->synth_acc < 65536u) continue;
+        w->synth_acc -= 65536u;
+        w->synth_phase = (uint8_t)((w->synth_phase + (inc < 0 ? 3 : 1)) & 3);
+        gpio_set_level(w->pin_a, s_quad_a[w->synth_phase]);
+        gpio_set_level(w->pin_b, s_quad_b[w->synth_phase]);
+    }
+    return false;
+}
+
+/* Counts in dt_us to motor RPM x100 */
+static int32_t enc_counts_to_rpm_x100(int32_t counts, int64_t dt_us) {
+    if (dt_us <= 0) return 0;
+    return (int32_t)((int64_t)counts * 60 * 100 * 1000000 / ((int64_t)ENC_CPR * dt_us));
+}
+
+/* One A-edge interval is half a pulse, 1 / (2 * PPR) of a revolution */
+static int32_t enc_period_to_rpm_x100(int64_t period_us) {
+    if (period_us <= 0) return 0;
+    return (int32_t)((int64_t)60 * 100 * 1000000 / ((int64_t)2 * ENC_PPR * period_us));
+}
+
+static void enc_edge_irq_set(enc_wheel_t *w, bool on) {
+    if (w->edge_irq_on == on) return;
+    if (on) {
+        portENTER_CRITICAL(&s_enc_lock);
+        w->last_edge_us = 0;
+        w->prev_edge_us = 0;
+        portEXIT_CRITICAL(&s_enc_lock);
+        gpio_intr_enable(w->pin_a);
+    } else {
+        gpio_intr_disable(w->pin_a);
+    }
+    w->edge_irq_on = on;
+}
+
+/* Velocity for one wheel over the window ending at t_us. Count rate at speed;
+   from the A-edge period when only a few counts arrived. The time since the
+   last edge bounds the period from below, so a wheel that stops decays to
+   zero instead of holding its last speed. */
+static void enc_wheel_sample(int id, int count, int64_t t_us, int64_t dt_us, io_encoder_msg_t *out) {
+    enc_wheel_t *w = &s_wheels[id];
+    int32_t delta = (int32_t)((uint32_t)count - (uint32_t)w->last_count);
+    w->last_count = count;
+    int32_t mag = delta < 0 ? -delta : delta;
+
+    uint8_t flags = w->synth_inc_q16 ? IO_ENCODER_FLAG_SYNTH : 0;
+    int32_t rpm_x100 = enc_counts_to_rpm_x100(delta, dt_us);
+
+    if (w->edge_irq_on && mag < IO_ENCODER_PERIOD_COUNTS) {
+        int64_t last, prev;
+        int8_t dir;
+        portENTER_CRITICAL(&s_enc_lock);
+        last = w->last_edge_us;
+        prev = w->prev_edge_us;
+        dir = w->edge_dir;
+        portEXIT_CRITICAL(&s_enc_lock);
+
+        if (last == 0 || t_us - last >= (int64_t)IO_ENCODER_STOP_MS * 1000) {
+            if (delta == 0) {
+                rpm_x100 = 0;
+                flags |= IO_ENCODER_FLAG_STOPPED;
+            }
+        } else {
+            int64_t period = prev ? last - prev : 0;
+            if (t_us - last > period) period = t_us - last;
+            rpm_x100 = dir * enc_period_to_rpm_x100(period);
+            flags |= IO_ENCODER_FLAG_PERIOD;
+        }
+    }
+
+    /* Period measurement below IO_ENCODER_PERIOD_COUNTS, off again at twice that */
+    if (mag < IO_ENCODER_PERIOD_COUNTS) enc_edge_irq_set(w, true);
+    else if (mag >= 2 * IO_ENCODER_PERIOD_COUNTS) enc_edge_irq_set(w, false);
+
+    rpm_x100 *= w->sign;
+
+    *out = (io_encoder_msg_t){
+        .id = (uint8_t)id,
+        .counts = delta * w->sign,
+        .motor_rpm_x100 = rpm_x100,
+        .wheel_rpm_x100 = rpm_x100 / ENC_GEAR_RATIO,
+        .total = count * w->sign,
+        .flags = flags,
+        .t_us = t_us,
+    };
+}
+
+static void enc_send(dispatch_target_t target, const void *data, size_t len) {
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = target;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_STREAMING,
+        .source = SOURCE_ENCODER,
+        .targets = targets,
+        .data = (const uint8_t *)data,
+        .data_len = len,
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; dropping message to target %d", target);
+    }
+}
+
+/* Wheel RPM x100 to surface speed: rpm * pi * D / 60 */
+static int32_t enc_wheel_mm_s(int32_t wheel_rpm_x100) {
+    return (int32_t)((int64_t)wheel_rpm_x100 * ENC_WHEEL_DIAMETER_MM * 31416 / (6000LL * 10000));
+}
+
+static int16_t sat16(int32_t v) {
+    if (v > INT16_MAX) return INT16_MAX;
+    if (v < INT16_MIN) return INT16_MIN;
+    return (int16_t)v;
+}
+
+static void enc_publish_odom(const io_encoder_msg_t *s, int64_t t_us) {
+    int32_t vl = enc_wheel_mm_s(s[IO_ENCODER_LEFT].wheel_rpm_x100);
+    int32_t vr = enc_wheel_mm_s(s[IO_ENCODER_RIGHT].wheel_rpm_x100);
+
+    lidar_deskew_odom_t odom = {
+        .cmd = LIDAR_DESKEW_CTRL_ODOM,
+        .flags = LIDAR_DESKEW_ODOM_HAS_V | LIDAR_DESKEW_ODOM_HAS_W,
+        .v_mm_s = sat16((vl + vr) / 2),
+        .w_mrad_s = sat16((vr - vl) * 1000 / ENC_TRACK_MM),
+        .t_us = t_us,
+    };
+    enc_send(TARGET_LIDAR_COORD, &odom, sizeof(odom));
+
+    line_position_speed_t speed = {
+        .cmd = LINE_POSITION_CMD_SPEED,
+        .v_mm_s = odom.v_mm_s,
+    };
+    enc_send(TARGET_LINE_POSITION, &speed, sizeof(speed));
+}
+
+static void enc_mailbox_put(const io_encoder_msg_t *s) {
+    unsigned seq = atomic_load_explicit(&s_mailbox.seq, memory_order_relaxed);
+    atomic_store_explicit(&s_mailbox.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(s_mailbox.sample, s, sizeof(s_mailbox.sample));
+    atomic_store_explicit(&s_mailbox.seq, seq + 2, memory_order_release);
+}
+
+bool io_encoder_latest(uint8_t id, io_encoder_msg_t *out, uint32_t *seq) {
+    if (id >= IO_ENCODER_COUNT || !out) return false;
+    unsigned before, after;
+    do {
+        before = atomic_load_explicit(&s_mailbox.seq, memory_order_acquire);
+        memcpy(out, &s_mailbox.sample[id], sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&s_mailbox.seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    if (seq) *seq = before / 2;
+    return before != 0;
+}
+
+static void enc_sample_task(void *arg) {
+    (void)arg;
+    uint32_t last_seq = 0;
+    int64_t last_t_us = 0;
+    uint32_t windows = 0;
+    uint32_t missed = 0;
+    uint32_t period_windows = 0;
+    TickType_t stats_last = xTaskGetTickCount();
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        enc_snapshot_t snap;
+        portENTER_CRITICAL(&s_enc_lock);
+        snap = s_snap;
+        portEXIT_CRITICAL(&s_enc_lock);
+
+        if (last_seq && snap.seq - last_seq > 1) missed += snap.seq - last_seq - 1;
+        int64_t dt_us = last_t_us ? snap.t_us - last_t_us : (int64_t)ENC_SAMPLE_MS * 1000;
+        last_seq = snap.seq;
+        last_t_us = snap.t_us;
+
+        io_encoder_msg_t s[IO_ENCODER_COUNT];
+        for (int i = 0; i < IO_ENCODER_COUNT; ++i) {
+            enc_wheel_sample(i, snap.count[i], snap.t_us, dt_us, &s[i]);
+            if (s[i].flags & IO_ENCODER_FLAG_PERIOD) period_windows++;
+        }
+        enc_mailbox_put(s);
+
+        if (++windows % ENC_PUBLISH_EVERY == 0) {
+            enc_publish_odom(s, snap.t_us);
+            if (s_synth_running) {
+                for (int i = 0; i < IO_ENCODER_COUNT; ++i) enc_send(TARGET_LOG, &s[i], sizeof(s[i]));
+            }
+        }
+
+        TickType_t now = xTaskGetTickCount();
+        if (now - stats_last >= pdMS_TO_TICKS(ENC_STATS_PERIOD_MS)) {
+            ESP_LOGI(TAG, "%u windows (%u missed, %u wheel-windows by period); motor rpm L %ld.%02ld R %ld.%02ld; total L %ld R %ld",
+                     (unsigned)windows, (unsigned)missed, (unsigned)period_windows,
+                     (long)(s[0].motor_rpm_x100 / 100), (long)((s[0].motor_rpm_x100 < 0 ? -s[0].motor_rpm_x100 : s[0].motor_rpm_x100) % 100),
+                     (long)(s[1].motor_rpm_x100 / 100), (long)((s[1].motor_rpm_x100 < 0 ? -s[1].motor_rpm_x100 : s[1].motor_rpm_x100) % 100),
+                     (long)s[0].total, (long)s[1].total);
+            windows = missed = period_windows = 0;
+            stats_last = now;
+        }
+    }
+}
+
+/* Start or change the generator on one wheel. The pins are switched to
+   input+output while it runs so PCNT and the edge interrupt see the driven
+   levels; with an encoder attached, disconnect it first. */
+static void enc_synth_set(int id, int16_t motor_rpm) {
+    enc_wheel_t *w = &s_wheels[id];
+    if (!s_synth_timer) return;
+    if (motor_rpm > ENC_SYNTH_MAX_RPM) motor_rpm = ENC_SYNTH_MAX_RPM;
+    if (motor_rpm < -ENC_SYNTH_MAX_RPM) motor_rpm = -ENC_SYNTH_MAX_RPM;
+
+    /* transitions per tick = rpm * CPR / 60 / tick rate, in Q16 */
+    int32_t inc = (int32_t)((int64_t)motor_rpm * w->sign * ENC_CPR * 65536 / (60LL * ENC_SYNTH_TICK_HZ));
+    if (inc && !w->synth_inc_q16) {
+        gpio_set_direction(w->pin_a, GPIO_MODE_INPUT_OUTPUT);
+        gpio_set_direction(w->pin_b, GPIO_MODE_INPUT_OUTPUT);
+    }
+    w->synth_inc_q16 = inc;
+    if (!inc) {
+        gpio_set_direction(w->pin_a, GPIO_MODE_INPUT);
+        gpio_set_direction(w->pin_b, GPIO_MODE_INPUT);
+    }
+
+    bool any = false;
+    for (int i = 0; i < IO_ENCODER_COUNT; ++i) any |= s_wheels[i].synth_inc_q16 != 0;
+    if (any && !s_synth_running) {
+        gptimer_start(s_synth_timer);
+    } else if (!any && s_synth_running) {
+        gptimer_stop(s_synth_timer);
+    }
+    s_synth_running = any;
+    ESP_LOGI(TAG, "Synthetic encoder %d: %d motor rpm", id, motor_rpm);
+}
+
+static void io_encoder_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg || msg->message_len < 1) return;
+    if (msg->data[0] == IO_ENCODER_CMD_SYNTH && msg->message_len >= sizeof(io_encoder_synth_t)) {
+        io_encoder_synth_t cmd;
+        memcpy(&cmd, msg->data, sizeof(cmd));
+        for (int i = 0; i < IO_ENCODER_COUNT; ++i) {
+            if (cmd.id == 0xFF || cmd.id == i) enc_synth_set(i, cmd.motor_rpm);
+        }
+    }
+}
+
+static dispatcher_module_t io_encoder_mod = {
+    .name = "io_encoder_task",
+    .target = TARGET_ENCODER,
+    .queue_len = 8,
+    .stack_size = 3072,
+    .task_prio = 5,
+    .process_msg = io_encoder_process_msg,
+    .step_frame = NULL,
+    .step_ms = 0,
+    .queue = NULL
+};
+
+/* A unit per wheel with a channel per phase. Channel A counts both edges of
+   A, up when B is low on a rising edge; channel B counts both edges of B, up
+   when A is high on a rising edge. Together that is every quadrature
+   transition, signed. */
+static esp_err_t enc_pcnt_init(enc_wheel_t *w) {
+    pcnt_unit_config_t unit_cfg = {
+        .low_limit = -ENC_PCNT_LIMIT,
+        .high_limit = ENC_PCNT_LIMIT,
+        .flags.accum_count = 1,
+    };
+    esp_err_t err = pcnt_new_unit(&unit_cfg, &w->unit);
+    if (err != ESP_OK) return err;
+
+    pcnt_glitch_filter_config_t filter_cfg = {
+        .max_glitch_ns = ENC_GLITCH_NS,
+    };
+    err = pcnt_unit_set_glitch_filter(w->unit, &filter_cfg);
+
+    pcnt_channel_handle_t ch_a = NULL, ch_b = NULL;
+    pcnt_chan_config_t a_cfg = { .edge_gpio_num = w->pin_a, .level_gpio_num = w->pin_b };
+    pcnt_chan_config_t b_cfg = { .edge_gpio_num = w->pin_b, .level_gpio_num = w->pin_a };
+    if (err == ESP_OK) err = pcnt_new_channel(w->unit, &a_cfg, &ch_a);
+    if (err == ESP_OK) err = pcnt_new_channel(w->unit, &b_cfg, &ch_b);
+    if (err == ESP_OK) err = pcnt_channel_set_edge_action(ch_a, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    if (err == ESP_OK) err = pcnt_channel_set_level_action(ch_a, PCNT_CHANNEL_LEVEL_ACTION_INVERSE, PCNT_CHANNEL_LEVEL_ACTION_KEEP);
+    if (err == ESP_OK) err = pcnt_channel_set_edge_action(ch_b, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    if (err == ESP_OK) err = pcnt_channel_set_level_action(ch_b, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    /* Watch points at the limits let the driver carry the count past them */
+    if (err == ESP_OK) err = pcnt_unit_add_watch_point(w->unit, -ENC_PCNT_LIMIT);
+    if (err == ESP_OK) err = pcnt_unit_add_watch_point(w->unit, ENC_PCNT_LIMIT);
+    if (err == ESP_OK) err = pcnt_unit_enable(w->unit);
+    if (err == ESP_OK) err = pcnt_unit_clear_count(w->unit);
+    if (err == ESP_OK) err = pcnt_unit_start(w->unit);
+    if (err != ESP_OK) {
+        pcnt_del_unit(w->unit);
+        w->unit = NULL;
+    }
+    return err;
+}
+
+/* A-edge interrupt for period measurement, installed disabled */
+static esp_err_t enc_edge_init(enc_wheel_t *w) {
+    gpio_config_t cfg = {
+        .pin_bit_mask = (1ULL << w->pin_a) | (1ULL << w->pin_b),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    esp_err_t err = gpio_config(&cfg);
+    if (err == ESP_OK) err = gpio_set_intr_type(w->pin_a, GPIO_INTR_ANYEDGE);
+    if (err == ESP_OK) err = gpio_isr_handler_add(w->pin_a, enc_edge_isr, w);
+    if (err == ESP_OK) err = gpio_intr_disable(w->pin_a);
+    return err;
+}
+
+static esp_err_t enc_timer_init(gptimer_handle_t *timer, uint64_t period_us, gptimer_alarm_cb_t cb) {
+    gptimer_config_t timer_cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = ENC_TIMER_RESOLUTION_HZ,
+    };
+    esp_err_t err = gptimer_new_timer(&timer_cfg, timer);
+    if (err != ESP_OK) return err;
+
+    gptimer_alarm_config_t alarm_cfg = {
+        .alarm_count = period_us,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = cb,
+    };
+    err = gptimer_set_alarm_action(*timer, &alarm_cfg);
+    if (err == ESP_OK) err = gptimer_register_event_callbacks(*timer, &cbs, NULL);
+    if (err == ESP_OK) err = gptimer_enable(*timer);
+    if (err != ESP_OK) {
+        gptimer_del_timer(*timer);
+        *timer = NULL;
+    }
+    return err;
+}
+
+void io_encoder_init(void) {
+    gpio_install_isr_service(0);    // ESP_ERR_INVALID_STATE if io_gpio already did
+
+    for (int i = 0; i < IO_ENCODER_COUNT; ++i) {
+        enc_wheel_t *w = &s_wheels[i];
+        esp_err_t err = enc_edge_init(w);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Encoder %d: edge interrupt setup failed (%d); count rate only", i, err);
+        }
+        err = enc_pcnt_init(w);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Encoder %d: PCNT setup failed (%d)", i, err);
+        }
+    }
+
+    if (xTaskCreate(enc_sample_task, "io_encoder_sample", 4096, NULL, 7, &s_enc_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create sample task");
+        return;
+    }
+    esp_err_t err = enc_timer_init(&s_sample_timer, (uint64_t)ENC_SAMPLE_MS * 1000, enc_sample_alarm_cb);
+    if (err == ESP_OK) err = gptimer_start(s_sample_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sample timer setup failed (%d)", err);
+        return;
+    }
+
+    err = enc_timer_init(&s_synth_timer, ENC_TIMER_RESOLUTION_HZ / ENC_SYNTH_TICK_HZ, enc_synth_alarm_cb);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Synthetic generator timer unavailable (%d)", err);
+    }
+
+    if (dispatcher_module_start(&io_encoder_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for io_encoder");
+        return;
+    }
+
+#if CONFIG_ENCODER_SYNTH_RPM != 0
+    for (int i = 0; i < IO_ENCODER_COUNT; ++i) enc_synth_set(i, CONFIG_ENCODER_SYNTH_RPM);
+#endif
+
+    ESP_LOGI(TAG, "Encoders: %d counts/rev, 1:%d gear, %d ms window", ENC_CPR, ENC_GEAR_RATIO, ENC_SAMPLE_MS);
+}
@@ -4,11 +4,17 @@
 #include "soc/gpio_reg.h"
 #include "driver/gpio.h"
 #include "driver/gpio_filter.h"
+#include "driver/gptimer.h"
+#include "driver/dedic_gpio.h"
+#include "hal/dedic_gpio_cpu_ll.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static const char *TAG = "io_gpio";
 
@@ -44,51 +50,163 @@ IRAM_ATTR static inline uint64_t read_all_gpio(void) {
     return ((uint64_t)all_upper_gpio << 32) | all_lower_gpio;
 }
 
-// Debounce packed line sensor state
+// Line sensor sampler
 // Tunable parameters — adjust these for tradeoff between latency and
 // robustness during testing.
-#define LINE_DEBOUNCE_SAMPLES      32
-#define LINE_DEBOUNCE_SAMPLE_US    50
-#define LINE_DEBOUNCE_STABLE_COUNT 2
-
-// NOTE: This function is placed in IRAM and safe to call from ISR context,
-// but it is blocking: it performs busy-wait delays. Worst-case duration is
-// approximately LINE_DEBOUNCE_SAMPLES * LINE_DEBOUNCE_SAMPLE_US (us).
-IRAM_ATTR static bool debounce_line_sensor(const gpio_num_t *pins, size_t pin_count, uint8_t *out_state) {
-    if (!out_state) return false;
-    uint32_t history = 0;
-
-    /* Compute mask for the lower N bytes we care about. For stable_count >= 4
-       use full 32-bit mask to avoid undefined shifts. */
-    const uint32_t stable_mask = (LINE_DEBOUNCE_STABLE_COUNT >= 4) ? 0xFFFFFFFFu : ((1u << (8 * LINE_DEBOUNCE_STABLE_COUNT)) - 1u);
-
-    uint32_t pattern_mult;
-    if (LINE_DEBOUNCE_STABLE_COUNT == 1) pattern_mult = 0x01u;
-    else if (LINE_DEBOUNCE_STABLE_COUNT == 2) pattern_mult = 0x0101u;
-    else if (LINE_DEBOUNCE_STABLE_COUNT == 3) pattern_mult = 0x010101u;
-    else pattern_mult = 0x01010101u;
-
-    for (int i = 0; i < LINE_DEBOUNCE_SAMPLES; ++i) {
-        esp_rom_delay_us(LINE_DEBOUNCE_SAMPLE_US);
-        uint8_t cur = pack_gpio_set(pins, pin_count, read_all_gpio());
-        history = (history << 8) | cur;
-
-        if (i < (LINE_DEBOUNCE_STABLE_COUNT - 1)) {
-            continue; // need more samples before checking
-        }
+#define LINE_SAMPLE_HZ             10000
+#define LINE_DEBOUNCE_STABLE_COUNT 2        // identical samples before a state is accepted
+
+#define LINE_SAMPLER_RESOLUTION_HZ 1000000  // 1 tick = 1 us
+#define LINE_SAMPLE_PERIOD_US      (LINE_SAMPLER_RESOLUTION_HZ / LINE_SAMPLE_HZ)
+#define LINE_ISR_STATS_PERIOD_MS   10000
+
+/* The line sensor is polled at a fixed LINE_SAMPLE_HZ from a gptimer alarm
+   instead of interrupting on edges, so sampling jitter is the timer's, not
+   that of the shared GPIO interrupt. All 8 channels are routed to the CPU's
+   dedicated GPIO inputs as one bundle (reversed, so channel 0 lands in the
+   MSB as pack_gpio_set orders them) and read with a single instruction.
+   Only accepted state changes are queued (edge-event compression); steady
+   samples cost one read and compare.
+
+   Dedicated GPIO inputs are per core: the bundle and the timer interrupt are
+   both set up from io_gpio_init, so the alarm runs on the core that owns the
+   bundle. */
+typedef struct {
+    const isr_ctx_t *ctx;
+    gptimer_handle_t timer;
+    dedic_gpio_bundle_handle_t bundle;  // NULL: fall back to GPIO_IN/IN1 reads
+    uint32_t in_offset;                 // bundle position in the dedicated inputs
+    uint8_t candidate;                  // last sampled state
+    int64_t candidate_us;               // time of the first sample showing it
+    uint8_t run;                        // consecutive samples equal to candidate
+    uint16_t published;                 // last queued state, 0x100 before the first
+    uint32_t last_cycles;               // cycle count at the previous alarm
+} line_sampler_t;
+
+static line_sampler_t line_sampler = { .published = 0x100 };
+
+/* Sampler health, updated from the alarm and read and cleared by the event
+   task: worst-case ISR time and period deviation, accepted changes, and
+   transitions rejected by the debounce. */
+static volatile uint32_t line_alarm_max_cycles = 0;
+static volatile uint32_t line_jitter_max_cycles = 0;
+static volatile uint32_t line_events = 0;
+static volatile uint32_t line_rejected = 0;
+
+IRAM_ATTR static inline uint8_t line_sampler_read(const line_sampler_t *ls) {
+    if (ls->bundle) return (uint8_t)(dedic_gpio_cpu_ll_read_in() >> ls->in_offset);
+    return pack_gpio_set(ls->ctx->pins, ls->ctx->pin_count, read_all_gpio());
+}
 
-        uint32_t pattern = ((uint32_t)cur) * pattern_mult;
-        if ((history & stable_mask) != pattern) {
-            continue; // not stable yet
-        }
+IRAM_ATTR static bool line_sampler_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    (void)timer;
+    (void)edata;
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    line_sampler_t *ls = (line_sampler_t *)user_ctx;
+    uint8_t cur = line_sampler_read(ls);
+
+    if (ls->last_cycles) {
+        const uint32_t period = esp_rom_get_cpu_ticks_per_us() * LINE_SAMPLE_PERIOD_US;
+        uint32_t dt = t0 - ls->last_cycles;
+        uint32_t dev = dt > period ? dt - period : period - dt;
+        if (dev > line_jitter_max_cycles) line_jitter_max_cycles = dev;
+    }
+    ls->last_cycles = t0;
+
+    if (cur != ls->candidate) {
+        if (ls->run < LINE_DEBOUNCE_STABLE_COUNT) line_rejected++;
+        ls->candidate = cur;
+        ls->candidate_us = esp_timer_get_time();
+        ls->run = 1;
+    } else if (ls->run < LINE_DEBOUNCE_STABLE_COUNT) {
+        ls->run++;
+    }
 
-        *out_state = cur;
-        return true;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    if (ls->run == LINE_DEBOUNCE_STABLE_COUNT && cur != ls->published) {
+        const isr_ctx_t *ctx = ls->ctx;
+        gpio_isr_msg_t msg = {
+            ctx->source_id,
+            {0}, // target_id to be filled below
+            cur,
+            ls->candidate_us
+        };
+        memcpy(msg.target_id, ctx->target_id, sizeof(msg.target_id));
+        if (xQueueSendFromISR(ctx->queue, &msg, &xHigherPriorityTaskWoken) == pdTRUE) {
+            ls->published = cur;    // retried on the next sample if the queue was full
+            line_events++;
+        }
     }
 
-    return false;
+    uint32_t busy = esp_cpu_get_cycle_count() - t0;
+    if (busy > line_alarm_max_cycles) line_alarm_max_cycles = busy;
+    return xHigherPriorityTaskWoken == pdTRUE;
 }
 
+// Route the pins to a dedicated GPIO input bundle, channel 0 in the MSB
+static esp_err_t line_sampler_bundle_init(line_sampler_t *ls) {
+    const isr_ctx_t *ctx = ls->ctx;
+    int gpio_array[8];
+    if (ctx->pin_count > 8) return ESP_ERR_INVALID_SIZE;
+    for (size_t i = 0; i < ctx->pin_count; ++i) {
+        gpio_array[i] = ctx->pins[ctx->pin_count - 1 - i];
+    }
+    dedic_gpio_bundle_config_t cfg = {
+        .gpio_array = gpio_array,
+        .array_size = ctx->pin_count,
+        .flags = {
+            .in_en = 1,
+        },
+    };
+    esp_err_t err = dedic_gpio_new_bundle(&cfg, &ls->bundle);
+    if (err != ESP_OK) {
+        ls->bundle = NULL;
+        return err;
+    }
+    err = dedic_gpio_get_in_offset(ls->bundle, &ls->in_offset);
+    if (err != ESP_OK) {
+        dedic_gpio_del_bundle(ls->bundle);
+        ls->bundle = NULL;
+    }
+    return err;
+}
+
+static esp_err_t line_sampler_init(const isr_ctx_t *ctx) {
+    line_sampler.ctx = ctx;
+    esp_err_t err = line_sampler_bundle_init(&line_sampler);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Line sensor: dedicated GPIO bundle unavailable (%d); sampling GPIO_IN registers", err);
+    }
+
+    gptimer_config_t timer_cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = LINE_SAMPLER_RESOLUTION_HZ,
+    };
+    err = gptimer_new_timer(&timer_cfg, &line_sampler.timer);
+    if (err != ESP_OK) return err;
+
+    gptimer_alarm_config_t alarm_cfg = {
+        .alarm_count = LINE_SAMPLE_PERIOD_US,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = line_sampler_alarm_cb,
+    };
+    err = gptimer_set_alarm_action(line_sampler.timer, &alarm_cfg);
+    if (err == ESP_OK) err = gptimer_register_event_callbacks(line_sampler.timer, &cbs, &line_sampler);
+    if (err == ESP_OK) err = gptimer_enable(line_sampler.timer);
+    if (err == ESP_OK) err = gptimer_start(line_sampler.timer);
+    if (err != ESP_OK) {
+        gptimer_del_timer(line_sampler.timer);
+        line_sampler.timer = NULL;
+        return err;
+    }
+    ESP_LOGI(TAG, "Line sensor sampler: %d Hz, %s", LINE_SAMPLE_HZ,
+             line_sampler.bundle ? "dedicated GPIO bundle" : "GPIO_IN registers");
+    return ESP_OK;
+}
 
 // Generic GPIO ISR registration function
 void register_gpio_isr(
@@ -139,7 +257,8 @@ void IRAM_ATTR button_gpio_isr(void *arg) {
     gpio_isr_msg_t msg = { 
         ctx->source_id,
         {0}, // target_id to be filled below 
-        button_state
+        button_state,
+        esp_timer_get_time()
     };
     dispatcher_fill_targets(msg.target_id);
     switch(button_state){
@@ -157,31 +276,6 @@ void IRAM_ATTR button_gpio_isr(void *arg) {
     if (xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
 }
 
-void IRAM_ATTR line_sensor_gpio_isr(void *arg) {
-    isr_ctx_t *ctx = (isr_ctx_t *)arg;
-    /* First-stage HW glitch filters (if present) reduce short spikes. As the
-       next stage, we perform the original multi-sample software debounce here
-       synchronously inside the ISR (this is blocking — see debounce func
-       comments). This is the incremental behavior you requested before
-       migrating to a task-based model. */
-    uint8_t packed = 0;
-    if (!debounce_line_sensor(ctx->pins, ctx->pin_count, &packed)) {
-        return; // unstable, drop
-    }
-
-    gpio_isr_msg_t msg = { 
-        ctx->source_id, 
-        {0}, // target_id to be filled below
-        packed 
-    };
-    dispatcher_fill_targets(msg.target_id);
-    memcpy(msg.target_id, ctx->target_id, sizeof(msg.target_id));
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    xQueueSendFromISR(ctx->queue, &msg, &xHigherPriorityTaskWoken);
-    if (xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
-}
-
-
 // Hardcoded setup for button on GPIO9
 void setup_button(void) {
     static gpio_num_t pins[1] = {0};
@@ -219,14 +313,18 @@ void setup_line_sensor(void) {
     ctx.queue = gpio_event_queue;
     dispatcher_fill_targets(ctx.target_id);
     ctx.target_id[0] = TARGET_LINE_SENSOR_WINDOW;
+    ctx.target_id[1] = TARGET_LINE_POSITION;
    
     gpio_config_t cfg = {
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_ANYEDGE
+        .intr_type = GPIO_INTR_DISABLE,     // polled by the sampler
     };
-    register_gpio_isr(pins, ctx.pin_count, line_sensor_gpio_isr, &ctx, &cfg);
+    for (size_t i = 0; i < ctx.pin_count; ++i) {
+        cfg.pin_bit_mask |= (1ULL << pins[i]);
+    }
+    gpio_config(&cfg);
 
     /* Create a pin glitch filter for each line sensor pin. If creation fails
        for a pin, log and leave that pin unfiltered for now. */
@@ -237,18 +335,45 @@ void setup_line_sensor(void) {
             line_sensor_glitch_filters[i] = NULL;
         }
     }
+
+    esp_err_t err = line_sampler_init(&ctx);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Line sensor: sampler timer init failed: %d", err);
+    }
 }
 
 bool io_gpio_get_state(gpio_num_t gpio_num) {
     return gpio_get_level(gpio_num);
 }
 
+// Log and clear the line sensor sampler health counters
+static void io_gpio_log_isr_stats(void) {
+    if (!line_sampler.timer) return;
+    uint32_t cpu_mhz = esp_rom_get_cpu_ticks_per_us();
+    uint32_t busy = line_alarm_max_cycles;
+    uint32_t jitter = line_jitter_max_cycles;
+    uint32_t events = line_events;
+    uint32_t rejected = line_rejected;
+    line_alarm_max_cycles = 0;
+    line_jitter_max_cycles = 0;
+    line_events = 0;
+    line_rejected = 0;
+    ESP_LOGI(TAG, "Line sensor sampler: ISR max %u us, period jitter max %u us, %u changes (%u rejected)",
+             (unsigned)(busy / cpu_mhz), (unsigned)(jitter / cpu_mhz), (unsigned)events, (unsigned)rejected);
+}
+
 void io_gpio_event_task(void *arg) {
     gpio_isr_msg_t msg;
     uint8_t last_line_state = 0;
     bool last_line_state_valid = false;
+    TickType_t next_stats = xTaskGetTickCount() + pdMS_TO_TICKS(LINE_ISR_STATS_PERIOD_MS);
     while (1) {
-        if (xQueueReceive(gpio_event_queue, &msg, portMAX_DELAY) == pdTRUE) {
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(now - next_stats) >= 0) {
+            io_gpio_log_isr_stats();
+            next_stats = now + pdMS_TO_TICKS(LINE_ISR_STATS_PERIOD_MS);
+        }
+        if (xQueueReceive(gpio_event_queue, &msg, next_stats - now) == pdTRUE) {
             if (msg.source_id == SOURCE_LINE_SENSOR) {
                 if (last_line_state_valid && msg.state == last_line_state) {
                     continue; // drop duplicate line sensor state
@@ -277,12 +402,17 @@ void io_gpio_event_task(void *arg) {
                 dispatcher_pool_type_t pool_type = (msg.source_id == SOURCE_MSC_BUTTON)
                     ? DISPATCHER_POOL_CONTROL
                     : DISPATCHER_POOL_STREAMING;
+                io_gpio_line_event_t line_evt = {
+                    .state = msg.state,
+                    .t_us = msg.t_us,
+                };
+                bool is_line = (msg.source_id == SOURCE_LINE_SENSOR);
                 dispatcher_pool_send_params_t params = {
                     .type = pool_type,
                     .source = msg.source_id,
                     .targets = ptr_targets,
-                    .data = &msg.state,
-                    .data_len = 1,
+                    .data = is_line ? (const uint8_t *)&line_evt : &msg.state,
+                    .data_len = is_line ? sizeof(line_evt) : 1,
                     .context = NULL
                 };
                 if (!dispatcher_pool_send_ptr_params(&params)) {
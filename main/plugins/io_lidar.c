@@ -10,9 +10,13 @@
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #define UART_EVENT_QUEUE_LEN 10
 
+// One UART byte on the wire (start + 8 data + stop), µs in Q8
+#define UART_BYTE_US_Q8 ((uint32_t)((10ull * 1000000ull * 256ull) / CONFIG_EXAMPLE_UART_BAUD_RATE))
+
 // Queues
 static QueueHandle_t uart_event_queue = NULL;
 static QueueHandle_t uart_tx_ptr_queue = NULL;
@@ -77,25 +81,38 @@ void io_lidar_event_task(void *arg)
         if (xQueueReceive(uart_event_queue, &event, portMAX_DELAY)) {
 
             if (event.type == UART_DATA) {
-                ESP_LOGI("io_lidar", "RX %u bytes", (unsigned)event.size);
+                ESP_LOGD("io_lidar", "RX %u bytes", (unsigned)event.size);
                 uint8_t tmp_buf[BUF_SIZE] = {0};
                 int len = uart_read_bytes(CONFIG_EXAMPLE_UART_PORT_NUM,
                                           tmp_buf,
                                           BUF_SIZE - 1,
                                           20 / portTICK_PERIOD_MS);
+                // The read returns what the driver buffered, so its last byte
+                // arrived no later than now
+                int64_t t_rx_us = esp_timer_get_time();
                 if (len > 0) {
                     dispatch_target_t targets[TARGET_MAX];
                     dispatcher_fill_targets(targets);
                     targets[0] = TARGET_LIDAR_COORD;   // UART → LIDAR_COORD bridge
-                    dispatcher_pool_send_params_t params = {
-                        .type = DISPATCHER_POOL_STREAMING,
-                        .source = SOURCE_LIDAR_IO,
-                        .targets = targets,
-                        .data = tmp_buf,
-                        .data_len = (size_t)len,
-                        .context = NULL
-                    };
-                    dispatcher_pool_send_ptr_params(&params);
+
+                    // Streaming payloads are small; split the read so scan data is not truncated
+                    size_t chunk = dispatcher_pool_payload_size(DISPATCHER_POOL_STREAMING);
+                    if (chunk == 0) chunk = (size_t)len;
+                    for (size_t off = 0; off < (size_t)len; off += chunk) {
+                        size_t n = ((size_t)len - off < chunk) ? ((size_t)len - off) : chunk;
+                        // Stamp each chunk with the arrival of its own last byte
+                        size_t behind = (size_t)len - off - n;
+                        int64_t t_chunk_us = t_rx_us - (int64_t)((behind * UART_BYTE_US_Q8) >> 8);
+                        dispatcher_pool_send_params_t params = {
+                            .type = DISPATCHER_POOL_STREAMING,
+                            .source = SOURCE_LIDAR_IO,
+                            .targets = targets,
+                            .data = &tmp_buf[off],
+                            .data_len = n,
+                            .context = io_lidar_stamp_pack(t_chunk_us)
+                        };
+                        dispatcher_pool_send_ptr_params(&params);
+                    }
                 }
             }
         }
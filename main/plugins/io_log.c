@@ -1,4 +1,6 @@
 #include "io_log.h"
+#include "io_MCP23017.h"
+#include "io_encoder.h"
 #include "dispatcher_module.h"
 #include "string.h"
 #include "esp_log.h"
@@ -16,6 +18,31 @@ static void io_log_process_msg(const dispatcher_msg_t *msg) {
             
             ESP_LOGI("io_log", "Log message from ultrasonic sensor: %s mm", decbuf);
             break;
+        case SOURCE_ENCODER: {
+            if (msg->message_len < sizeof(io_encoder_msg_t)) break;
+            io_encoder_msg_t enc;
+            memcpy(&enc, msg->data, sizeof(enc));
+            ESP_LOGI("io_log", "Wheel encoder %u: %ld counts, motor %ld.%02u rpm, total %ld%s%s", enc.id, (long)enc.counts,
+                     (long)(enc.motor_rpm_x100 / 100), (unsigned)((enc.motor_rpm_x100 < 0 ? -enc.motor_rpm_x100 : enc.motor_rpm_x100) % 100),
+                     (long)enc.total, (enc.flags & IO_ENCODER_FLAG_PERIOD) ? ", period" : "",
+                     (enc.flags & IO_ENCODER_FLAG_STOPPED) ? ", stopped" : "");
+            break;
+        }
+        case SOURCE_MCP23017: {
+            if (msg->message_len == 0) break;
+            if (msg->data[0] == IO_MCP_MSG_ENCODER && msg->message_len >= sizeof(io_mcp_encoder_msg_t)) {
+                io_mcp_encoder_msg_t enc;
+                memcpy(&enc, msg->data, sizeof(enc));
+                ESP_LOGI("io_log", "Encoder count %ld (%+d), %d steps/s, invalid %u%s", (long)enc.count, enc.delta,
+                         enc.velocity, (unsigned)enc.invalid, enc.pressed ? ", pressed" : "");
+            } else if (msg->data[0] == IO_MCP_MSG_PORT_EVENT && msg->message_len >= sizeof(io_mcp_port_event_t)) {
+                io_mcp_port_event_t ev;
+                memcpy(&ev, msg->data, sizeof(ev));
+                ESP_LOGI("io_log", "MCP23017 %u port %c INTF=0x%02X INTCAP=0x%02X level=0x%02X", ev.expander,
+                         ev.port ? 'B' : 'A', ev.intf, ev.intcap, ev.level);
+            }
+            break;
+        }
         case SOURCE_LINE_SENSOR_WINDOW:
         case SOURCE_LINE_SENSOR:
         case SOURCE_MSC_BUTTON: {
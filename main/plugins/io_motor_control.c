@@ -0,0 +1,440 @@
+#include "io_motor_control.h"
+#include "io_encoder.h"
+#include "dispatcher_module.h"
+#include "dispatcher_pool.h"
+#include "dispatcher.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "motor_control";
+
+#define MC_LOOP_HZ              CONFIG_MOTOR_CONTROL_LOOP_HZ
+/* The loop runs on whole ticks, so the real period can differ from
+   1 / MC_LOOP_HZ (10-1000 Hz vs. a 100 Hz tick). Everything timed per
+   iteration uses MC_PERIOD_US, not the configured rate. */
+#define MC_PERIOD_TICKS         (pdMS_TO_TICKS(1000 / MC_LOOP_HZ) ? pdMS_TO_TICKS(1000 / MC_LOOP_HZ) : 1)
+#define MC_PERIOD_US            ((int64_t)MC_PERIOD_TICKS * 1000000 / configTICK_RATE_HZ)
+#define MC_DUTY_BITS            CONFIG_MOTOR_PWM_RES_BITS
+#define MC_DUTY_MAX             ((1 << MC_DUTY_BITS) - 1)
+
+#define MC_LEDC_MODE            LEDC_LOW_SPEED_MODE
+#define MC_LEDC_TIMER           LEDC_TIMER_1        // LEDC_TIMER_0 belongs to the LIDAR motor
+#define MC_LEDC_CHANNEL_LEFT    LEDC_CHANNEL_1
+#define MC_LEDC_CHANNEL_RIGHT   LEDC_CHANNEL_2
+
+/* Speeds are wheel RPM x100 throughout, as io_encoder reports them */
+#define MC_RPM_X100_MAX         (CONFIG_MOTOR_MAX_WHEEL_RPM * 100)
+#define MC_ACCEL_MAX            (CONFIG_MOTOR_MAX_ACCEL * 100)      // per s
+#define MC_JERK_MAX             (CONFIG_MOTOR_MAX_JERK * 100)       // per s^2
+
+/* PID gains, Q16, duty counts per unit of error (I: per unit second,
+   D: per unit per second). D acts on the measurement, not the error, so a
+   setpoint step does not kick. */
+#define MC_KP_Q16               3000
+#define MC_KI_Q16               20000
+#define MC_KD_Q16               0
+
+/* Feedback older than this is ignored and the loop runs on feed-forward */
+#define MC_FEEDBACK_STALE_US    200000
+
+/* Direction bits are re-sent this often; io_MCP23017 drops unchanged writes */
+#define MC_DIR_REFRESH_MS       200
+
+#define MC_STATS_PERIOD_MS      10000
+
+/* MCP23017 expander 0, port A: bits 0-1 left IN1/IN2, bits 2-3 right (wired
+   mirrored, like the motor), bit 4 driver enable */
+#define MC_DIR_MASK             0x0F
+#define MC_DRIVER_ENABLE        0x10
+
+typedef enum {
+    MC_DIR_COAST = 0,
+    MC_DIR_FORWARD,
+    MC_DIR_REVERSE,
+} mc_dir_t;
+
+static const uint8_t s_dir_bits[MOTOR_CONTROL_COUNT][3] = {
+    [MOTOR_CONTROL_LEFT]  = { [MC_DIR_COAST] = 0x0, [MC_DIR_FORWARD] = 0x1, [MC_DIR_REVERSE] = 0x2 },
+    [MOTOR_CONTROL_RIGHT] = { [MC_DIR_COAST] = 0x0, [MC_DIR_FORWARD] = 0x8, [MC_DIR_REVERSE] = 0x4 },
+};
+
+static const ledc_channel_t s_ledc_channel[MOTOR_CONTROL_COUNT] = {
+    [MOTOR_CONTROL_LEFT] = MC_LEDC_CHANNEL_LEFT,
+    [MOTOR_CONTROL_RIGHT] = MC_LEDC_CHANNEL_RIGHT,
+};
+
+static const int s_pwm_gpio[MOTOR_CONTROL_COUNT] = {
+    [MOTOR_CONTROL_LEFT] = CONFIG_MOTOR_LEFT_PWM_GPIO,
+    [MOTOR_CONTROL_RIGHT] = CONFIG_MOTOR_RIGHT_PWM_GPIO,
+};
+
+/* Owned by the control task */
+typedef struct {
+    int32_t ref_q8;             // shaped reference, Q8
+    int32_t accel;              // current reference acceleration
+    int64_t integ_q16;          // integrator, duty Q16
+    int32_t meas;               // last measured speed
+    int32_t prev_meas;
+    uint32_t enc_seq;           // encoder mailbox sequence last used
+    int64_t enc_t_us;           // its latch time
+    int32_t d_term;             // duty, held between encoder samples
+    int32_t duty;               // signed duty applied
+    uint32_t pwm;               // |duty| written to LEDC
+    mc_dir_t dir;               // direction on the driver
+    mc_dir_t want_dir;
+    int64_t switch_since_us;    // duty forced to 0 since, 0 = no change pending
+} mc_motor_t;
+
+static mc_motor_t s_motors[MOTOR_CONTROL_COUNT];
+
+/* Command hand-over from the dispatcher module task */
+static portMUX_TYPE s_cmd_lock = portMUX_INITIALIZER_UNLOCKED;
+static int32_t s_cmd_rpm_x100[MOTOR_CONTROL_COUNT];
+static int64_t s_cmd_us = 0;
+static bool s_cmd_stop = false;
+
+static TaskHandle_t s_mc_task = NULL;
+
+static int32_t clamp32(int32_t v, int32_t lo, int32_t hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static uint32_t isqrt64(uint64_t v) {
+    uint64_t r = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+/* Surface speed to wheel RPM x100: v * 60 / (pi * D) */
+static int32_t mc_mm_s_to_rpm_x100(int32_t mm_s) {
+    return (int32_t)((int64_t)mm_s * 6000 * 10000 / ((int64_t)CONFIG_ENCODER_WHEEL_DIAMETER_MM * 31416));
+}
+
+/* S-curve: the reference acceleration moves toward the target by at most
+   jerk * dt per tick, and the target shrinks to sqrt(2 * jerk * |error|) near
+   the command so acceleration has run out by the time the reference gets
+   there. */
+static void mc_shape_reference(mc_motor_t *m, int32_t cmd) {
+    int32_t ref = m->ref_q8 >> 8;
+    int32_t err = cmd - ref;
+    int32_t mag = err < 0 ? -err : err;
+
+    int32_t a_lim = (int32_t)isqrt64(2ULL * MC_JERK_MAX * (uint64_t)mag);
+    if (a_lim > MC_ACCEL_MAX) a_lim = MC_ACCEL_MAX;
+    int32_t a_target = err < 0 ? -a_lim : a_lim;
+
+    int32_t jerk_step = (int32_t)((int64_t)MC_JERK_MAX * MC_PERIOD_US / 1000000);
+    if (jerk_step < 1) jerk_step = 1;
+    m->accel += clamp32(a_target - m->accel, -jerk_step, jerk_step);
+
+    m->ref_q8 += (int32_t)((int64_t)m->accel * MC_PERIOD_US * 256 / 1000000);
+    int32_t after = cmd - (m->ref_q8 >> 8);
+    if (err == 0 || (after < 0) != (err < 0) || after == 0) {
+        m->ref_q8 = cmd * 256;
+        m->accel = 0;
+    }
+}
+
+static void mc_reset_motor(mc_motor_t *m) {
+    m->ref_q8 = 0;
+    m->accel = 0;
+    m->integ_q16 = 0;
+    m->d_term = 0;
+    m->duty = 0;
+}
+
+/* New encoder sample: advance the integrator and the derivative with the
+   time between samples */
+static void mc_pid_sample(mc_motor_t *m, int32_t ref, int32_t meas, int64_t t_us, bool saturated_with_err) {
+    int64_t dt_us = m->enc_t_us ? t_us - m->enc_t_us : 0;
+    m->prev_meas = m->meas;
+    m->meas = meas;
+    m->enc_t_us = t_us;
+    if (dt_us <= 0 || dt_us > MC_FEEDBACK_STALE_US) {
+        m->d_term = 0;
+        return;
+    }
+
+    int32_t err = ref - meas;
+    if (!saturated_with_err) {
+        m->integ_q16 += (int64_t)MC_KI_Q16 * err * dt_us / 1000000;
+        int64_t lim = (int64_t)MC_DUTY_MAX << 16;
+        if (m->integ_q16 > lim) m->integ_q16 = lim;
+        if (m->integ_q16 < -lim) m->integ_q16 = -lim;
+    }
+    m->d_term = (int32_t)(-((int64_t)MC_KD_Q16 * (meas - m->prev_meas) * 1000000 / dt_us) >> 16);
+}
+
+static void mc_send_direction(void) {
+    uint8_t bits = MC_DRIVER_ENABLE;
+    for (int i = 0; i < MOTOR_CONTROL_COUNT; ++i) bits |= s_dir_bits[i][s_motors[i].dir];
+    uint8_t data[2] = { MC_DIR_MASK | MC_DRIVER_ENABLE, bits };
+
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_MOTOR_DRIVER;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_CONTROL,
+        .source = SOURCE_MOTOR_CONTROL,
+        .targets = targets,
+        .data = data,
+        .data_len = sizeof(data),
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; direction bits 0x%02X not sent", bits);
+    }
+}
+
+static void mc_set_pwm(int id, uint32_t pwm) {
+    mc_motor_t *m = &s_motors[id];
+    if (pwm == m->pwm) return;
+    ledc_set_duty(MC_LEDC_MODE, s_ledc_channel[id], pwm);
+    ledc_update_duty(MC_LEDC_MODE, s_ledc_channel[id]);
+    m->pwm = pwm;
+}
+
+/* Direction follows the reference with hysteresis: engage beyond the
+   deadband, fall back to coast inside half of it */
+static mc_dir_t mc_direction_for(const mc_motor_t *m, int32_t ref) {
+    const int32_t db = mc_mm_s_to_rpm_x100(CONFIG_MOTOR_DIRECTION_DEADBAND_MM_S);
+    if (ref > db) return MC_DIR_FORWARD;
+    if (ref < -db) return MC_DIR_REVERSE;
+    if (m->dir == MC_DIR_FORWARD && ref > db / 2) return MC_DIR_FORWARD;
+    if (m->dir == MC_DIR_REVERSE && ref < -db / 2) return MC_DIR_REVERSE;
+    return MC_DIR_COAST;
+}
+
+/* One control tick. Returns true if direction bits must go out. */
+static bool mc_step(int64_t now_us, const int32_t *cmd, bool stop) {
+    bool dir_changed = false;
+
+    for (int i = 0; i < MOTOR_CONTROL_COUNT; ++i) {
+        mc_motor_t *m = &s_motors[i];
+        if (stop) {
+            mc_reset_motor(m);
+            m->want_dir = MC_DIR_COAST;
+        } else {
+            mc_shape_reference(m, cmd[i]);
+        }
+        int32_t ref = m->ref_q8 >> 8;
+
+        io_encoder_msg_t enc;
+        uint32_t seq = 0;
+        bool have_enc = io_encoder_latest((uint8_t)i, &enc, &seq);
+        bool fresh = have_enc && now_us - enc.t_us < MC_FEEDBACK_STALE_US;
+
+        int32_t ff = (int32_t)((int64_t)ref * MC_DUTY_MAX / MC_RPM_X100_MAX);
+        int32_t p = 0;
+        if (fresh) {
+            int32_t err = ref - enc.wheel_rpm_x100;
+            p = (int32_t)(((int64_t)MC_KP_Q16 * err) >> 16);
+            if (seq != m->enc_seq) {
+                int32_t u_prev = m->duty;
+                bool sat = (u_prev >= MC_DUTY_MAX && err > 0) || (u_prev <= -MC_DUTY_MAX && err < 0);
+                mc_pid_sample(m, ref, enc.wheel_rpm_x100, enc.t_us, sat);
+                m->enc_seq = seq;
+            }
+        } else {
+            m->integ_q16 = 0;
+            m->d_term = 0;
+        }
+        int32_t u = ff + p + (int32_t)(m->integ_q16 >> 16) + m->d_term;
+
+        if (!stop) m->want_dir = mc_direction_for(m, ref);
+        if (m->want_dir == MC_DIR_COAST) {
+            m->integ_q16 = 0;
+            u = 0;
+        }
+
+        /* Interlock: duty 0 while the direction is about to change */
+        if (m->want_dir != m->dir) {
+            if (m->switch_since_us == 0) m->switch_since_us = now_us;
+            if (stop || m->want_dir == MC_DIR_COAST ||
+                now_us - m->switch_since_us >= (int64_t)MOTOR_CONTROL_DIR_SWITCH_MS * 1000) {
+                m->dir = m->want_dir;
+                m->switch_since_us = 0;
+                m->integ_q16 = 0;
+                dir_changed = true;
+            }
+            u = 0;
+        }
+
+        /* Only drive in the engaged direction; the opposite sign coasts */
+        int32_t mag = 0;
+        if (m->dir == MC_DIR_FORWARD && u > 0) mag = u;
+        if (m->dir == MC_DIR_REVERSE && u < 0) mag = -u;
+        if (mag > MC_DUTY_MAX) mag = MC_DUTY_MAX;
+        m->duty = clamp32(u, -MC_DUTY_MAX, MC_DUTY_MAX);
+        mc_set_pwm(i, (uint32_t)mag);
+    }
+    return dir_changed;
+}
+
+static void mc_task(void *arg) {
+    (void)arg;
+    const TickType_t period = MC_PERIOD_TICKS;
+    const int64_t period_us = MC_PERIOD_US;
+
+    uint32_t ticks = 0;
+    uint32_t overruns = 0;
+    int64_t busy_sum_us = 0;
+    int64_t busy_max_us = 0;
+    int64_t jitter_max_us = 0;
+    int64_t last_dir_us = 0;
+
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t expected_us = esp_timer_get_time();
+
+    for (;;) {
+        if (xTaskDelayUntil(&last_wake, period) == pdFALSE) {
+            overruns++;
+            expected_us = esp_timer_get_time();     // late: measure jitter from here
+        } else {
+            expected_us += period_us;
+        }
+        int64_t t0 = esp_timer_get_time();
+        int64_t jitter = t0 - expected_us;
+        if (jitter < 0) jitter = -jitter;
+        if (jitter > jitter_max_us) jitter_max_us = jitter;
+
+        int32_t cmd[MOTOR_CONTROL_COUNT];
+        bool stop;
+        int64_t cmd_us;
+        portENTER_CRITICAL(&s_cmd_lock);
+        memcpy(cmd, s_cmd_rpm_x100, sizeof(cmd));
+        stop = s_cmd_stop;
+        s_cmd_stop = false;
+        cmd_us = s_cmd_us;
+        portEXIT_CRITICAL(&s_cmd_lock);
+
+        /* Watchdog: no command within the timeout is a stop */
+        bool moving = false;
+        for (int i = 0; i < MOTOR_CONTROL_COUNT; ++i) moving |= cmd[i] != 0 || s_motors[i].ref_q8 != 0;
+        if (moving && t0 - cmd_us > (int64_t)CONFIG_MOTOR_CMD_TIMEOUT_MS * 1000) {
+            portENTER_CRITICAL(&s_cmd_lock);
+            memset(s_cmd_rpm_x100, 0, sizeof(s_cmd_rpm_x100));
+            portEXIT_CRITICAL(&s_cmd_lock);
+            ESP_LOGW(TAG, "No command for %d ms; stopping", CONFIG_MOTOR_CMD_TIMEOUT_MS);
+            stop = true;
+        }
+
+        if (mc_step(t0, cmd, stop) || t0 - last_dir_us >= (int64_t)MC_DIR_REFRESH_MS * 1000) {
+            mc_send_direction();
+            last_dir_us = t0;
+        }
+
+        int64_t busy = esp_timer_get_time() - t0;
+        busy_sum_us += busy;
+        if (busy > busy_max_us) busy_max_us = busy;
+
+        if (++ticks >= (uint32_t)((int64_t)MC_STATS_PERIOD_MS * 1000 / period_us)) {
+            const mc_motor_t *l = &s_motors[MOTOR_CONTROL_LEFT];
+            const mc_motor_t *r = &s_motors[MOTOR_CONTROL_RIGHT];
+            ESP_LOGI(TAG, "%u ticks: compute avg %lld max %lld us, jitter max %lld us, %u overruns; "
+                     "L ref %ld meas %ld duty %ld, R ref %ld meas %ld duty %ld",
+                     (unsigned)ticks, (long long)(busy_sum_us / ticks), (long long)busy_max_us,
+                     (long long)jitter_max_us, (unsigned)overruns,
+                     (long)(l->ref_q8 >> 8), (long)l->meas, (long)l->duty,
+                     (long)(r->ref_q8 >> 8), (long)r->meas, (long)r->duty);
+            ticks = overruns = 0;
+            busy_sum_us = busy_max_us = jitter_max_us = 0;
+        }
+    }
+}
+
+static void io_motor_control_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg || msg->message_len < 1) return;
+    switch (msg->data[0]) {
+        case MOTOR_CONTROL_CMD_SPEED: {
+            if (msg->message_len < sizeof(motor_control_speed_t)) break;
+            motor_control_speed_t sp;
+            memcpy(&sp, msg->data, sizeof(sp));
+            int32_t l = clamp32(mc_mm_s_to_rpm_x100(sp.left_mm_s), -MC_RPM_X100_MAX, MC_RPM_X100_MAX);
+            int32_t r = clamp32(mc_mm_s_to_rpm_x100(sp.right_mm_s), -MC_RPM_X100_MAX, MC_RPM_X100_MAX);
+            portENTER_CRITICAL(&s_cmd_lock);
+            s_cmd_rpm_x100[MOTOR_CONTROL_LEFT] = l;
+            s_cmd_rpm_x100[MOTOR_CONTROL_RIGHT] = r;
+            s_cmd_us = esp_timer_get_time();
+            portEXIT_CRITICAL(&s_cmd_lock);
+            break;
+        }
+        case MOTOR_CONTROL_CMD_STOP:
+            portENTER_CRITICAL(&s_cmd_lock);
+            memset(s_cmd_rpm_x100, 0, sizeof(s_cmd_rpm_x100));
+            s_cmd_stop = true;
+            portEXIT_CRITICAL(&s_cmd_lock);
+            break;
+        default:
+            break;
+    }
+}
+
+static dispatcher_module_t io_motor_control_mod = {
+    .name = "motor_control",
+    .target = TARGET_MOTOR_CONTROL,
+    .queue_len = 8,
+    .stack_size = 3072,
+    .task_prio = 6,
+    .process_msg = io_motor_control_process_msg,
+    .step_frame = NULL,
+    .step_ms = 0,
+    .queue = NULL
+};
+
+static esp_err_t mc_ledc_init(void) {
+    ledc_timer_config_t timer_cfg = {
+        .speed_mode = MC_LEDC_MODE,
+        .duty_resolution = (ledc_timer_bit_t)MC_DUTY_BITS,
+        .timer_num = MC_LEDC_TIMER,
+        .freq_hz = CONFIG_MOTOR_PWM_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK,
+    };
+    esp_err_t err = ledc_timer_config(&timer_cfg);
+    for (int i = 0; i < MOTOR_CONTROL_COUNT && err == ESP_OK; ++i) {
+        ledc_channel_config_t ch_cfg = {
+            .gpio_num = s_pwm_gpio[i],
+            .speed_mode = MC_LEDC_MODE,
+            .channel = s_ledc_channel[i],
+            .intr_type = LEDC_INTR_DISABLE,
+            .timer_sel = MC_LEDC_TIMER,
+            .duty = 0,
+            .hpoint = 0,
+        };
+        err = ledc_channel_config(&ch_cfg);
+    }
+    return err;
+}
+
+void io_motor_control_init(void) {
+    esp_err_t err = mc_ledc_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "LEDC setup failed (%d)", err);
+        return;
+    }
+    if (dispatcher_module_start(&io_motor_control_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for motor_control");
+        return;
+    }
+    if (xTaskCreatePinnedToCore(mc_task, "motor_ctl_loop", 4096, NULL, 12, &s_mc_task, MOTOR_CONTROL_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create control loop task");
+        return;
+    }
+    ESP_LOGI(TAG, "Motor control: %lld us loop (%d Hz requested) on core %d, PWM %d Hz / %d bits",
+             (long long)MC_PERIOD_US, MC_LOOP_HZ, MOTOR_CONTROL_CORE, CONFIG_MOTOR_PWM_FREQ_HZ, MC_DUTY_BITS);
+}
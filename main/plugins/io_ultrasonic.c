@@ -7,6 +7,7 @@
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "driver/gpio.h"
+#include "driver/gptimer.h"
 #include "esp_rom_sys.h"
 #include <string.h>
 
@@ -30,6 +31,38 @@ static const char *TAG = "io_ultrasonic";
 
 static esp_timer_handle_t tx_pulse_timer = NULL;
 
+/* Capture latency probe (CONFIG_ULTRASONIC_LATENCY_PROBE_GPIO >= 0): a gptimer
+ * alarm reads the timer count and then toggles a spare pin configured as
+ * input+output, so the pin's own input sees the edge at that count (internal
+ * loopback, nothing is wired to the pin). The pin's handler on the shared GPIO
+ * ISR service reads the same counter. Both stamps are taken in ISR context on
+ * one hardware clock, so the difference is the time from a real edge to a
+ * handler on the GPIO ISR service, which is the path the echo capture takes.
+ * No assumption about the sensor's own echo delay is needed. */
+#define ULTRASONIC_PROBE_RESOLUTION_HZ 10000000                 /* 0.1 us per tick */
+#define ULTRASONIC_PROBE_PERIOD_TICKS  (ULTRASONIC_PROBE_RESOLUTION_HZ / 1000 * 37) /* 37 ms, drifts against the 200 ms ping and other periodic ISRs */
+#define ULTRASONIC_PROBE_STATS_MS      10000
+
+#if CONFIG_ULTRASONIC_LATENCY_PROBE_GPIO >= 0
+typedef struct {
+    gptimer_handle_t timer;
+    uint64_t next_alarm;
+    volatile uint64_t edge_count;   /* timer count when the edge was made */
+    volatile uint8_t level;
+    volatile uint8_t pending;       /* edge made, handler not run yet */
+    /* Window statistics in timer ticks, read and cleared by step_frame */
+    uint32_t n;
+    uint32_t missed;
+    uint32_t min_ticks;
+    uint32_t max_ticks;
+    uint64_t sum_ticks;
+} ultrasonic_probe_t;
+
+static ultrasonic_probe_t probe = { .min_ticks = UINT32_MAX };
+static portMUX_TYPE probe_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t probe_next_log_us = 0;
+#endif
+
 /* ISR -> task message and queue for RX captures */
 #define ULTRASONIC_EVENT_QUEUE_LEN 32
 
@@ -81,6 +114,132 @@ IRAM_ATTR static void ultrasonic_rx_gpio_isr(void *arg)
     if (xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
 } 
 
+#if CONFIG_ULTRASONIC_LATENCY_PROBE_GPIO >= 0
+/* Probe alarm: stamp, then make the edge. The stamp is read before
+ * gpio_set_level, so the measured delay includes the write itself (tens of
+ * ns), never less than the real latency. */
+IRAM_ATTR static bool probe_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    ultrasonic_probe_t *p = (ultrasonic_probe_t *)user_ctx;
+    uint64_t now = 0;
+    gptimer_get_raw_count(timer, &now);
+
+    if (p->pending) {
+        /* Previous edge never reached its handler */
+        portENTER_CRITICAL_ISR(&probe_lock);
+        p->missed++;
+        portEXIT_CRITICAL_ISR(&probe_lock);
+    }
+    p->edge_count = now;
+    p->pending = 1;
+    p->level ^= 1;
+    gpio_set_level(CONFIG_ULTRASONIC_LATENCY_PROBE_GPIO, p->level);
+
+    p->next_alarm = edata->alarm_value + ULTRASONIC_PROBE_PERIOD_TICKS;
+    gptimer_alarm_config_t alarm_cfg = { .alarm_count = p->next_alarm };
+    gptimer_set_alarm_action(timer, &alarm_cfg);
+    return false;
+}
+
+/* Probe edge handler on the GPIO ISR service */
+IRAM_ATTR static void probe_gpio_isr(void *arg)
+{
+    ultrasonic_probe_t *p = (ultrasonic_probe_t *)arg;
+    uint64_t now = 0;
+    gptimer_get_raw_count(p->timer, &now);
+    if (!p->pending) return;
+    p->pending = 0;
+
+    uint64_t d = now - p->edge_count;
+    uint32_t ticks = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    portENTER_CRITICAL_ISR(&probe_lock);
+    p->n++;
+    p->sum_ticks += ticks;
+    if (ticks < p->min_ticks) p->min_ticks = ticks;
+    if (ticks > p->max_ticks) p->max_ticks = ticks;
+    portEXIT_CRITICAL_ISR(&probe_lock);
+}
+
+static void probe_init(void)
+{
+    const int pin = CONFIG_ULTRASONIC_LATENCY_PROBE_GPIO;
+    gpio_config_t cfg = {
+        .mode = GPIO_MODE_INPUT_OUTPUT,
+        .pin_bit_mask = (1ULL << pin),
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_ANYEDGE
+    };
+    gpio_config(&cfg);
+    gpio_set_level(pin, 0);
+
+    gptimer_config_t timer_cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = ULTRASONIC_PROBE_RESOLUTION_HZ,
+    };
+    esp_err_t err = gptimer_new_timer(&timer_cfg, &probe.timer);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Latency probe: gptimer_new_timer failed: %d", err);
+        probe.timer = NULL;
+        return;
+    }
+
+    /* Free-running counter, alarm moved forward by one period each time, so
+       the stamps of both ISRs come from one monotonic count. */
+    probe.next_alarm = ULTRASONIC_PROBE_PERIOD_TICKS;
+    gptimer_alarm_config_t alarm_cfg = { .alarm_count = probe.next_alarm };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = probe_alarm_cb,
+    };
+    err = gptimer_set_alarm_action(probe.timer, &alarm_cfg);
+    if (err == ESP_OK) err = gptimer_register_event_callbacks(probe.timer, &cbs, &probe);
+    if (err == ESP_OK) err = gpio_isr_handler_add(pin, probe_gpio_isr, &probe);
+    if (err == ESP_OK) err = gptimer_enable(probe.timer);
+    if (err == ESP_OK) err = gptimer_start(probe.timer);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Latency probe on GPIO %d not started: %d", pin, err);
+        gpio_isr_handler_remove(pin);
+        gptimer_del_timer(probe.timer);
+        probe.timer = NULL;
+        return;
+    }
+    probe_next_log_us = esp_timer_get_time() + ULTRASONIC_PROBE_STATS_MS * 1000LL;
+    ESP_LOGI(TAG, "Latency probe: loopback edge on GPIO %d every %d ms", pin,
+             ULTRASONIC_PROBE_PERIOD_TICKS / (ULTRASONIC_PROBE_RESOLUTION_HZ / 1000));
+}
+
+/* Log and clear the probe window. Ticks are 0.1 us. */
+static void probe_log(void)
+{
+    if (!probe.timer) return;
+    int64_t now = esp_timer_get_time();
+    if (now < probe_next_log_us) return;
+    probe_next_log_us = now + ULTRASONIC_PROBE_STATS_MS * 1000LL;
+
+    portENTER_CRITICAL(&probe_lock);
+    uint32_t n = probe.n, missed = probe.missed;
+    uint32_t min_t = probe.min_ticks, max_t = probe.max_ticks;
+    uint64_t sum = probe.sum_ticks;
+    probe.n = 0;
+    probe.missed = 0;
+    probe.min_ticks = UINT32_MAX;
+    probe.max_ticks = 0;
+    probe.sum_ticks = 0;
+    portEXIT_CRITICAL(&probe_lock);
+
+    if (n == 0) {
+        ESP_LOGW(TAG, "GPIO ISR latency: no loopback edge handled (%u missed)", (unsigned)missed);
+        return;
+    }
+    uint32_t avg_t = (uint32_t)(sum / n);
+    ESP_LOGI(TAG, "GPIO ISR latency: n %u, min %u.%u us, avg %u.%u us, max %u.%u us, missed %u",
+             (unsigned)n, (unsigned)(min_t / 10), (unsigned)(min_t % 10),
+             (unsigned)(avg_t / 10), (unsigned)(avg_t % 10),
+             (unsigned)(max_t / 10), (unsigned)(max_t % 10), (unsigned)missed);
+}
+#endif
+
 static dispatcher_module_t ultrasonic_mod = {
     .name = "io_ultrasonic",
     .target = TARGET_ULTRASONIC,
@@ -165,6 +324,10 @@ void io_ultrasonic_init(void)
         xTaskCreate(ultrasonic_event_task, "ultrasonic_event_task", 4096, NULL, 9, NULL);
     }
 
+#if CONFIG_ULTRASONIC_LATENCY_PROBE_GPIO >= 0
+    probe_init();
+#endif
+
     ESP_LOGI(TAG, "Using esp_timer for timestamps; pulse width = %u us", ULTRASONIC_MIN_PULSE_US);
 }
 
@@ -254,6 +417,7 @@ static void ultrasonic_event_task(void *arg)
         dispatch_target_t targets[TARGET_MAX];
         dispatcher_fill_targets(targets);
         targets[0] = TARGET_LOG;
+        targets[1] = TARGET_VFH;
 
         IO_ULTRASONIC_PUBLISH_MM(med, targets);
 
@@ -272,4 +436,7 @@ static void ultrasonic_step_frame(void)
     /* Start one-shot to clear TX after configured pulse width */
     esp_timer_start_once(tx_pulse_timer, ULTRASONIC_MIN_PULSE_US);
 
+#if CONFIG_ULTRASONIC_LATENCY_PROBE_GPIO >= 0
+    probe_log();
+#endif
 }
@@ -0,0 +1,312 @@
+#include "mod_line_position.h"
+#include "heading_cmd.h"
+#include "dispatcher_module.h"
+#include "dispatcher.h"
+#include "io_gpio.h"
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "line_position";
+
+/* Sensor output level over the line (1: the bit is set when a channel sees it) */
+#define LINE_POS_LINE_LEVEL        1
+
+/* A single run this wide or wider is a crossing line, not the track */
+#define LINE_POS_INTERSECTION_BITS 6
+
+/* EMA gain for a full-confidence sample, Q8 */
+#define LINE_POS_ALPHA_Q8          128
+
+/* After this long without the line the estimate is flagged stale */
+#define LINE_POS_LOST_HOLD_MS      250
+
+#define LINE_POS_ERR_MAX           32767
+
+/* Centroid to mm: an outermost channel is 3.5 pitches off centre */
+#define LINE_POS_HALF_SPAN_MM      (7 * LINE_POSITION_PITCH_MM / 2)
+/* Smallest centroid step the bar can resolve (half a pitch) */
+#define LINE_POS_STEP_MM           (LINE_POSITION_PITCH_MM / 2)
+
+/* Transitions further apart than this start a new rate estimate */
+#define LINE_POS_RATE_GAP_US       500000
+/* Curvature needs a known forward speed at least this high */
+#define LINE_POS_MIN_SPEED_MM_S    100
+#define LINE_POS_SPEED_STALE_US    500000
+
+#define LINE_POS_STATS_SAMPLES     1000
+
+typedef struct {
+    int16_t err_q15;        // centroid of the set channels
+    uint8_t confidence;
+    uint8_t flags;          // HEADING_CMD_LINE_FLAG_* implied by the pattern alone
+} line_pos_entry_t;
+
+static line_pos_entry_t line_pos_lut[256];
+
+/* Owned by the module task */
+static int32_t line_pos_err_q15 = 0;    // smoothed error
+static int16_t line_pos_raw_q15 = 0;
+static uint8_t line_pos_conf = 0;
+static uint8_t line_pos_flags = HEADING_CMD_LINE_FLAG_LOST | HEADING_CMD_LINE_FLAG_STALE;
+static uint8_t line_pos_pattern = 0;
+static bool line_pos_seen = false;      // line detected at least once
+static int64_t line_pos_last_seen_us = 0;
+static int64_t line_pos_last_pub_us = 0;
+static uint32_t line_pos_seq = 0;
+static int64_t line_pos_t_us = 0;       // sample time of the last transition
+
+/* Transition timing: the last usable centroid and when it was first seen */
+static bool rate_ref_valid = false;
+static int32_t rate_ref_mm = 0;
+static int64_t rate_ref_us = 0;
+static int32_t rate_mm_s = 0;           // smoothed lateral rate
+static int32_t accel_mm_s2 = 0;         // smoothed change of rate
+static int16_t speed_mm_s = 0;
+static int64_t speed_t_us = 0;
+
+static uint32_t stats_samples = 0;
+static uint32_t stats_lost = 0;
+static uint32_t stats_intersections = 0;
+
+/* Channel c sits at (3.5 - c) sensor pitches left of centre. In half pitches
+ * that is 7 - 2c, so the centroid is sum(7 - 2c) / n over the set channels,
+ * scaled so an outermost channel maps to ±LINE_POS_ERR_MAX. */
+static void line_pos_build_lut(void) {
+    for (int p = 0; p < 256; ++p) {
+        line_pos_entry_t *e = &line_pos_lut[p];
+        int n = 0;
+        int sum = 0;
+        int runs = 0;
+        int widest = 0;
+        int width = 0;
+        for (int c = 0; c < LINE_POSITION_CHANNELS; ++c) {
+            bool on = (p >> (LINE_POSITION_CHANNELS - 1 - c)) & 1;
+            if (on) {
+                n++;
+                sum += 7 - 2 * c;
+                if (width++ == 0) runs++;
+                if (width > widest) widest = width;
+            } else {
+                width = 0;
+            }
+        }
+
+        e->flags = 0;
+        if (n == 0) {
+            e->err_q15 = 0;
+            e->confidence = 0;
+            e->flags = HEADING_CMD_LINE_FLAG_LOST;
+            continue;
+        }
+        e->err_q15 = (int16_t)((sum * LINE_POS_ERR_MAX) / (7 * n));
+
+        if (runs > 1) {
+            e->flags |= HEADING_CMD_LINE_FLAG_FORK;
+            e->confidence = 96;
+        } else if (widest <= 2) {
+            e->confidence = 255;    // one or two adjacent channels: a clean track edge
+        } else if (widest == 3) {
+            e->confidence = 192;
+        } else {
+            e->confidence = 128;
+        }
+        if (widest >= LINE_POS_INTERSECTION_BITS) {
+            e->flags |= HEADING_CMD_LINE_FLAG_INTERSECTION;
+            e->confidence = 64;
+        }
+    }
+}
+
+static inline int16_t sat16(int64_t v) {
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+/* Lateral rate from the time between centroid steps, and its change */
+static void line_pos_rate_update(int16_t raw_q15, int64_t t_us) {
+    int32_t y_mm = ((int32_t)raw_q15 * LINE_POS_HALF_SPAN_MM) / LINE_POS_ERR_MAX;
+    int64_t dt = t_us - rate_ref_us;
+    if (rate_ref_valid && dt > 0 && dt < LINE_POS_RATE_GAP_US) {
+        int32_t rate = (int32_t)(((int64_t)(y_mm - rate_ref_mm) * 1000000) / dt);
+        int32_t prev = rate_mm_s;
+        rate_mm_s += (rate - rate_mm_s) / 2;
+        int32_t accel = (int32_t)(((int64_t)(rate_mm_s - prev) * 1000000) / dt);
+        accel_mm_s2 += (accel - accel_mm_s2) / 2;
+    } else {
+        rate_mm_s = 0;
+        accel_mm_s2 = 0;
+    }
+    rate_ref_valid = true;
+    rate_ref_mm = y_mm;
+    rate_ref_us = t_us;
+}
+
+/* With no transition for a while the line has moved less than one step:
+ * cap the rate accordingly so a steady line reads as steady */
+static void line_pos_rate_age(int64_t now_us) {
+    int64_t since = now_us - rate_ref_us;
+    if (!rate_ref_valid || since <= 0) return;
+    if (since >= LINE_POS_RATE_GAP_US) {
+        rate_ref_valid = false;
+        rate_mm_s = 0;
+        accel_mm_s2 = 0;
+        return;
+    }
+    int32_t bound = (int32_t)(((int64_t)LINE_POS_STEP_MM * 1000000) / since);
+    if (rate_mm_s > bound || rate_mm_s < -bound) {
+        rate_mm_s = rate_mm_s > 0 ? bound : -bound;
+        accel_mm_s2 = 0;
+    }
+}
+
+/* Relative curvature = lateral acceleration / v^2, in 1/km */
+static int16_t line_pos_curvature(int64_t now_us, bool *valid) {
+    int32_t v = speed_mm_s;
+    *valid = speed_t_us != 0 && now_us - speed_t_us < LINE_POS_SPEED_STALE_US &&
+             (v >= LINE_POS_MIN_SPEED_MM_S || v <= -LINE_POS_MIN_SPEED_MM_S);
+    if (!*valid) return 0;
+    return sat16(((int64_t)accel_mm_s2 * 1000000) / ((int64_t)v * v));
+}
+
+static void line_pos_publish(int64_t now_us) {
+    bool curv_valid = false;
+    int16_t curvature = line_pos_curvature(now_us, &curv_valid);
+    heading_cmd_line_t cmd = {
+        .kind = HEADING_CMD_KIND_LINE,
+        .flags = line_pos_flags | (curv_valid ? 0 : HEADING_CMD_LINE_FLAG_NO_CURVATURE),
+        .error_q15 = (int16_t)line_pos_err_q15,
+        .raw_q15 = line_pos_raw_q15,
+        .confidence = line_pos_conf,
+        .pattern = line_pos_pattern,
+        .seq = line_pos_seq++,
+        .rate_mm_s = sat16(rate_mm_s),
+        .curvature_mpm = curvature,
+        .t_us = (uint32_t)line_pos_t_us,
+    };
+
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_HEADING_CMD;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_STREAMING,
+        .source = SOURCE_LINE_POSITION,
+        .targets = targets,
+        .data = (const uint8_t *)&cmd,
+        .data_len = sizeof(cmd),
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; dropping line cmd");
+    }
+    line_pos_last_pub_us = now_us;
+}
+
+static void line_pos_update(uint8_t pattern, int64_t now_us) {
+    if (!LINE_POS_LINE_LEVEL) pattern = (uint8_t)~pattern;
+    const line_pos_entry_t *e = &line_pos_lut[pattern];
+
+    line_pos_pattern = pattern;
+    line_pos_t_us = now_us;
+    line_pos_flags = e->flags;
+    line_pos_conf = e->confidence;
+
+    if (e->flags & HEADING_CMD_LINE_FLAG_LOST) {
+        /* Hold the side the line was last seen on, at full deflection, so
+           the controller keeps turning back towards it */
+        line_pos_raw_q15 = 0;
+        rate_ref_valid = false;
+        rate_mm_s = 0;
+        accel_mm_s2 = 0;
+        if (line_pos_seen) {
+            line_pos_err_q15 = line_pos_err_q15 >= 0 ? LINE_POS_ERR_MAX : -LINE_POS_ERR_MAX;
+        }
+        if (!line_pos_seen || now_us - line_pos_last_seen_us > (int64_t)LINE_POS_LOST_HOLD_MS * 1000) {
+            line_pos_flags |= HEADING_CMD_LINE_FLAG_STALE;
+        }
+        stats_lost++;
+        return;
+    }
+
+    line_pos_seen = true;
+    line_pos_last_seen_us = now_us;
+    line_pos_raw_q15 = e->err_q15;
+    if (e->flags & HEADING_CMD_LINE_FLAG_INTERSECTION) {
+        stats_intersections++;
+        return;     // crossing line: the centroid says nothing about the track
+    }
+    if (e->flags & HEADING_CMD_LINE_FLAG_FORK) {
+        rate_ref_valid = false;     // centroid jumps between branches
+    } else {
+        line_pos_rate_update(e->err_q15, now_us);
+    }
+
+    int32_t alpha_q8 = (LINE_POS_ALPHA_Q8 * e->confidence) / 255;
+    line_pos_err_q15 += ((e->err_q15 - line_pos_err_q15) * alpha_q8) / 256;
+}
+
+static void line_pos_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg || msg->message_len < 1) return;
+    if (msg->source != SOURCE_LINE_SENSOR) {
+        if (msg->message_len >= sizeof(line_position_speed_t) && msg->data[0] == LINE_POSITION_CMD_SPEED) {
+            line_position_speed_t sp;
+            memcpy(&sp, msg->data, sizeof(sp));
+            speed_mm_s = sp.v_mm_s;
+            speed_t_us = esp_timer_get_time();
+        }
+        return;
+    }
+
+    /* Sampler events carry the time the state was first seen; other
+       producers (MCP23017 port B) only send the byte */
+    int64_t t_us;
+    if (msg->message_len >= sizeof(io_gpio_line_event_t)) {
+        io_gpio_line_event_t evt;
+        memcpy(&evt, msg->data, sizeof(evt));
+        t_us = evt.t_us;
+    } else {
+        t_us = esp_timer_get_time();
+    }
+    line_pos_update(msg->data[0], t_us);
+    line_pos_publish(t_us);
+
+    if (++stats_samples >= LINE_POS_STATS_SAMPLES) {
+        ESP_LOGI(TAG, "%u samples: %u lost, %u intersections; error %d (raw %d, conf %u), rate %d mm/s",
+                 (unsigned)stats_samples, (unsigned)stats_lost, (unsigned)stats_intersections,
+                 (int)line_pos_err_q15, (int)line_pos_raw_q15, (unsigned)line_pos_conf, (int)rate_mm_s);
+        stats_samples = 0;
+        stats_lost = 0;
+        stats_intersections = 0;
+    }
+}
+
+/* Repeat the estimate while the pattern is steady and age a lost line */
+static void line_pos_step_frame(void) {
+    int64_t now_us = esp_timer_get_time();
+    line_pos_rate_age(now_us);
+    if (now_us - line_pos_last_pub_us < (int64_t)LINE_POSITION_HEARTBEAT_MS * 1000) return;
+    if ((line_pos_flags & HEADING_CMD_LINE_FLAG_LOST) &&
+        now_us - line_pos_last_seen_us > (int64_t)LINE_POS_LOST_HOLD_MS * 1000) {
+        line_pos_flags |= HEADING_CMD_LINE_FLAG_STALE;
+    }
+    line_pos_publish(now_us);
+}
+
+static dispatcher_module_t line_position_mod = {
+    .name = "line_position_task",
+    .target = TARGET_LINE_POSITION,
+    .queue_len = 32,
+    .stack_size = 3072,
+    .task_prio = 8,
+    .process_msg = line_pos_process_msg,
+    .step_frame = line_pos_step_frame,
+    .step_ms = LINE_POSITION_HEARTBEAT_MS,
+    .queue = NULL
+};
+
+void mod_line_position_init(void) {
+    line_pos_build_lut();
+    if (dispatcher_module_start(&line_position_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for line_position");
+        return;
+    }
+}
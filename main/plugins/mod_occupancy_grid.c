@@ -0,0 +1,325 @@
+#include "mod_occupancy_grid.h"
+#include "dispatcher_module.h"
+#include "dispatcher.h"
+#include "lidar_scan.h"
+#include "lidar_cartesian.h"
+#include "rest_context.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "occupancy_grid";
+
+#define OCC_GRID_CELLS        (OCC_GRID_DIM * OCC_GRID_DIM)
+#define OCC_GRID_HALF         (OCC_GRID_DIM / 2)
+#define OCC_GRID_MASK         (OCC_GRID_DIM - 1)
+
+/* Log-odds increments (int8, saturating) */
+#define OCC_L_FREE            3
+#define OCC_L_OCC             12
+#define OCC_L_MAX             120
+
+/* Export classification thresholds */
+#define OCC_EXPORT_OCC_THRESH  20
+#define OCC_EXPORT_FREE_THRESH (-10)
+
+/* Pull every cell one step toward unknown every N integrated frames */
+#define OCC_DECAY_FRAMES      10
+
+#define OCC_STATS_FRAMES      50
+
+/* Grid storage: world cell (x, y) lives at ((y & MASK) << 8) | (x & MASK).
+ * Only the 256x256 window centred on win_cx/win_cy is meaningful. */
+static int8_t *grid = NULL;
+static int32_t win_cx = 0;
+static int32_t win_cy = 0;
+
+/* Robot pose in grid frame (x/y mm, heading CCW) */
+static float pose_x_mm = 0.0f;
+static float pose_y_mm = 0.0f;
+static int32_t pose_heading_mrad = 0;
+
+static uint32_t last_frame_seq = 0;
+static uint32_t frames_integrated = 0;
+static uint64_t stats_sum_us = 0;
+static uint32_t stats_max_us = 0;
+static uint32_t stats_count = 0;
+
+static inline int32_t floor_div(int32_t a, int32_t b) {
+    int32_t q = a / b;
+    return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+static inline size_t cell_idx(int32_t x, int32_t y) {
+    return ((size_t)(y & OCC_GRID_MASK) << 8) | (size_t)(x & OCC_GRID_MASK);
+}
+
+static inline bool in_window(int32_t x, int32_t y) {
+    return (uint32_t)(x - win_cx + OCC_GRID_HALF) < OCC_GRID_DIM &&
+           (uint32_t)(y - win_cy + OCC_GRID_HALF) < OCC_GRID_DIM;
+}
+
+static void grid_clear_column(int32_t x) {
+    size_t col = (size_t)(x & OCC_GRID_MASK);
+    for (size_t row = 0; row < OCC_GRID_DIM; ++row) {
+        grid[(row << 8) | col] = 0;
+    }
+}
+
+static void grid_clear_row(int32_t y) {
+    memset(&grid[(size_t)(y & OCC_GRID_MASK) << 8], 0, OCC_GRID_DIM);
+}
+
+/* Scroll the window so it is centred on the robot cell, clearing the strips
+ * that wrap around from the trailing edge to the leading edge. */
+static void grid_recentre(void) {
+    int32_t rcx = floor_div((int32_t)lroundf(pose_x_mm), OCC_GRID_CELL_MM);
+    int32_t rcy = floor_div((int32_t)lroundf(pose_y_mm), OCC_GRID_CELL_MM);
+
+    if (abs(rcx - win_cx) >= OCC_GRID_DIM || abs(rcy - win_cy) >= OCC_GRID_DIM) {
+        memset(grid, 0, OCC_GRID_CELLS);
+        win_cx = rcx;
+        win_cy = rcy;
+        return;
+    }
+    while (win_cx < rcx) { win_cx++; grid_clear_column(win_cx + OCC_GRID_HALF - 1); }
+    while (win_cx > rcx) { win_cx--; grid_clear_column(win_cx - OCC_GRID_HALF); }
+    while (win_cy < rcy) { win_cy++; grid_clear_row(win_cy + OCC_GRID_HALF - 1); }
+    while (win_cy > rcy) { win_cy--; grid_clear_row(win_cy - OCC_GRID_HALF); }
+}
+
+static inline void cell_add_free(size_t idx) {
+    int8_t v = grid[idx];
+    grid[idx] = (v > -OCC_L_MAX + OCC_L_FREE) ? (int8_t)(v - OCC_L_FREE) : (int8_t)-OCC_L_MAX;
+}
+
+static inline void cell_add_occ(size_t idx) {
+    int8_t v = grid[idx];
+    grid[idx] = (v < OCC_L_MAX - OCC_L_OCC) ? (int8_t)(v + OCC_L_OCC) : (int8_t)OCC_L_MAX;
+}
+
+/* Integer Bresenham from the robot cell to the hit cell. Cells along the ray
+ * are marked free; the endpoint is marked occupied if it is inside the window. */
+static void grid_trace_ray(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+    int32_t dx = abs(x1 - x0), sx = (x0 < x1) ? 1 : -1;
+    int32_t dy = -abs(y1 - y0), sy = (y0 < y1) ? 1 : -1;
+    int32_t err = dx + dy;
+    int32_t x = x0, y = y0;
+
+    while (x != x1 || y != y1) {
+        if (!in_window(x, y)) return;
+        cell_add_free(cell_idx(x, y));
+        int32_t e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x += sx; }
+        if (e2 <= dx) { err += dx; y += sy; }
+    }
+    if (in_window(x1, y1)) cell_add_occ(cell_idx(x1, y1));
+}
+
+/* Branchless decay of every cell one step toward 0, four cells per word.
+ * Per byte: delta = +1 if negative, -1 (0xFF) if positive, 0 if zero; the add
+ * masks bit 7 so carries never cross byte lanes. */
+static void grid_decay(void) {
+    uint32_t *w = (uint32_t *)grid;
+    for (size_t i = 0; i < OCC_GRID_CELLS / 4; ++i) {
+        uint32_t v = w[i];
+        uint32_t nz = (((v & 0x7F7F7F7Fu) + 0x7F7F7F7Fu) | v) & 0x80808080u;
+        uint32_t neg = v & 0x80808080u;
+        uint32_t pos = nz & ~neg;
+        uint32_t delta = (neg >> 7) | ((pos >> 7) * 0xFFu);
+        w[i] = ((v & 0x7F7F7F7Fu) + (delta & 0x7F7F7F7Fu)) ^ ((v ^ delta) & 0x80808080u);
+    }
+}
+
+static void grid_integrate(const lidar_scan_frame_t *frame) {
+    int64_t t0 = esp_timer_get_time();
+
+    grid_recentre();
+
+    int32_t px = (int32_t)lroundf(pose_x_mm);
+    int32_t py = (int32_t)lroundf(pose_y_mm);
+    int32_t rcx = floor_div(px, OCC_GRID_CELL_MM);
+    int32_t rcy = floor_div(py, OCC_GRID_CELL_MM);
+
+    /* The frame already carries robot-frame x/y; rotate by the heading
+     * (quantised to the 0.25° bin grid of the shared trig table). */
+    int32_t heading_bins = (int32_t)(((int64_t)pose_heading_mrad * LIDAR_SCAN_BINS + 3141) / 6283);
+    int32_t hc = lidar_trig_cos_bin(heading_bins);
+    int32_t hs = lidar_trig_sin_bin(heading_bins);
+
+    for (int32_t b = 0; b < LIDAR_SCAN_BINS; ++b) {
+        if (frame->dist_mm[b] == 0) continue;
+        int32_t x = frame->x_mm[b];
+        int32_t y = frame->y_mm[b];
+        int32_t ex = floor_div(px + ((x * hc - y * hs) >> LIDAR_TRIG_Q), OCC_GRID_CELL_MM);
+        int32_t ey = floor_div(py + ((x * hs + y * hc) >> LIDAR_TRIG_Q), OCC_GRID_CELL_MM);
+        grid_trace_ray(rcx, rcy, ex, ey);
+    }
+
+    last_frame_seq = frame->seq;
+    if (++frames_integrated % OCC_DECAY_FRAMES == 0) {
+        grid_decay();
+    }
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    stats_sum_us += dt;
+    if (dt > stats_max_us) stats_max_us = dt;
+    if (++stats_count >= OCC_STATS_FRAMES) {
+        ESP_LOGI(TAG, "integrate: avg %u us, max %u us over %u frames (seq %u)",
+                 (unsigned)(stats_sum_us / stats_count), (unsigned)stats_max_us,
+                 (unsigned)stats_count, (unsigned)last_frame_seq);
+        stats_sum_us = 0;
+        stats_max_us = 0;
+        stats_count = 0;
+    }
+}
+
+static void grid_apply_pose_delta(const occ_grid_pose_delta_t *pd) {
+    float th = (float)pose_heading_mrad * 0.001f;
+    float c = cosf(th), s = sinf(th);
+    pose_x_mm += c * (float)pd->dx_mm - s * (float)pd->dy_mm;
+    pose_y_mm += s * (float)pd->dx_mm + c * (float)pd->dy_mm;
+
+    pose_heading_mrad = (pose_heading_mrad + pd->dtheta_mrad) % 6283;
+    if (pose_heading_mrad < 0) pose_heading_mrad += 6283;
+}
+
+static inline uint8_t cell_class(int8_t v) {
+    if (v >= OCC_EXPORT_OCC_THRESH) return OCC_GRID_CLASS_OCCUPIED;
+    if (v <= OCC_EXPORT_FREE_THRESH) return OCC_GRID_CLASS_FREE;
+    return OCC_GRID_CLASS_UNKNOWN;
+}
+
+/* Downsampled block class: occupied wins over free wins over unknown */
+static uint8_t block_class(int32_t x0, int32_t y0, uint8_t ds) {
+    uint8_t cls = OCC_GRID_CLASS_UNKNOWN;
+    for (int32_t dy = 0; dy < ds; ++dy) {
+        for (int32_t dx = 0; dx < ds; ++dx) {
+            uint8_t c = cell_class(grid[cell_idx(x0 + dx, y0 + dy)]);
+            if (c == OCC_GRID_CLASS_OCCUPIED) return c;
+            if (c == OCC_GRID_CLASS_FREE) cls = c;
+        }
+    }
+    return cls;
+}
+
+/* Returns bytes written, or 0 if out_size is too small */
+static size_t grid_export_rle(uint8_t *out, size_t out_size, uint8_t ds) {
+    if (ds != 1 && ds != 2 && ds != 4 && ds != 8) ds = 1;
+    if (!out || out_size < sizeof(occ_grid_export_hdr_t)) return 0;
+
+    uint16_t dim = OCC_GRID_DIM / ds;
+    occ_grid_export_hdr_t hdr = {
+        .magic = { 'O', 'G' },
+        .version = 1,
+        .downsample = ds,
+        .width = dim,
+        .height = dim,
+        .cell_mm = (uint16_t)(OCC_GRID_CELL_MM * ds),
+        .frame_seq = last_frame_seq,
+        .heading_mrad = (int16_t)pose_heading_mrad,
+    };
+    memcpy(out, &hdr, sizeof(hdr));
+    size_t pos = sizeof(hdr);
+
+    int32_t x_min = win_cx - OCC_GRID_HALF;
+    int32_t y_max = win_cy + OCC_GRID_HALF - 1;
+    uint8_t run_cls = 0xFF;
+    uint8_t run_len = 0;
+
+    for (uint16_t r = 0; r < dim; ++r) {
+        int32_t y0 = y_max - (int32_t)(r + 1) * ds + 1;
+        for (uint16_t c = 0; c < dim; ++c) {
+            uint8_t cls = block_class(x_min + (int32_t)c * ds, y0, ds);
+            if (cls == run_cls && run_len < 255) {
+                run_len++;
+                continue;
+            }
+            if (run_len) {
+                if (pos + 2 > out_size) return 0;
+                out[pos++] = run_len;
+                out[pos++] = run_cls;
+            }
+            run_cls = cls;
+            run_len = 1;
+        }
+    }
+    if (run_len) {
+        if (pos + 2 > out_size) return 0;
+        out[pos++] = run_len;
+        out[pos++] = run_cls;
+    }
+    return pos;
+}
+
+static void occupancy_grid_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg || !grid) return;
+
+    switch (msg->source) {
+        case SOURCE_LIDAR_SCAN: {
+            const lidar_scan_frame_t *frame = lidar_scan_frame_from_msg(msg);
+            if (frame) grid_integrate(frame);
+            lidar_scan_frame_done(msg);
+            break;
+        }
+        case SOURCE_REST:
+            if (msg->context) {
+                rest_json_request_t *req = (rest_json_request_t *)msg->context;
+                uint8_t ds = (uint8_t)(intptr_t)req->user_data;
+                size_t len = grid_export_rle((uint8_t *)req->json_buf, req->buf_size, ds);
+                if (req->json_len) *req->json_len = len;
+                xSemaphoreGive(req->sem);
+            }
+            break;
+        default:
+            if (msg->message_len < 1) break;
+            switch (msg->data[0]) {
+                case OCC_GRID_CMD_POSE_DELTA:
+                    if (msg->message_len >= sizeof(occ_grid_pose_delta_t)) {
+                        occ_grid_pose_delta_t pd;
+                        memcpy(&pd, msg->data, sizeof(pd));
+                        grid_apply_pose_delta(&pd);
+                    }
+                    break;
+                case OCC_GRID_CMD_CLEAR:
+                    memset(grid, 0, OCC_GRID_CELLS);
+                    break;
+                default:
+                    break;
+            }
+            break;
+    }
+}
+
+static dispatcher_module_t occupancy_grid_mod = {
+    .name = "occupancy_grid_task",
+    .target = TARGET_OCCUPANCY_GRID,
+    .queue_len = 8,
+    .stack_size = 4096,
+    .task_prio = 5,
+    .process_msg = occupancy_grid_process_msg,
+    .step_frame = NULL,
+    .step_ms = 0,
+    .queue = NULL
+};
+
+void mod_occupancy_grid_init(void) {
+    grid = (int8_t *)heap_caps_calloc(1, OCC_GRID_CELLS, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grid) {
+        ESP_LOGW(TAG, "PSRAM grid alloc failed; trying internal heap");
+        grid = (int8_t *)heap_caps_calloc(1, OCC_GRID_CELLS, MALLOC_CAP_8BIT);
+    }
+    if (!grid) {
+        ESP_LOGE(TAG, "Grid allocation failed (%u bytes)", (unsigned)OCC_GRID_CELLS);
+        return;
+    }
+
+    if (dispatcher_module_start(&occupancy_grid_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for occupancy_grid");
+        return;
+    }
+    lidar_scan_subscribe(TARGET_OCCUPANCY_GRID);
+}
@@ -0,0 +1,390 @@
+#include "mod_scan_features.h"
+#include "dispatcher_module.h"
+#include "dispatcher.h"
+#include "dispatcher_pool.h"
+#include "lidar_scan.h"
+#include <math.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "scan_features";
+
+#define SF_MIN_RANGE_MM       100
+#define SF_MAX_RANGE_MM       8000
+
+/* Range-break segmentation: gap > max(BREAK_MIN, d * BREAK_K) or a bin hole */
+#define SF_BREAK_MIN_MM       100.0f
+#define SF_BREAK_K            0.05f
+#define SF_BREAK_MAX_BINS     8
+
+/* Split threshold: max(SPLIT_MIN, d * SPLIT_K) from the chord */
+#define SF_SPLIT_MIN_MM       20.0f
+#define SF_SPLIT_K            0.02f
+#define SF_MIN_POINTS         6
+
+/* Merge adjacent collinear segments */
+#define SF_MERGE_MAX_ANGLE    0.05f   // rad
+#define SF_MERGE_MAX_DIST_MM  30.0f
+
+/* Corners: adjacent lines with endpoints this close meeting at >= 45° */
+#define SF_CORNER_MAX_GAP_MM  150.0f
+#define SF_CORNER_MIN_ANGLE   0.785f
+
+/* Per-point range noise used for line covariance */
+#define SF_SIGMA_MM           15.0f
+
+#define SF_STATS_FRAMES       50
+
+typedef struct {
+    uint16_t i0, i1;        // inclusive point range
+    uint16_t cluster;
+    float cx, cy;           // centroid
+    float ux, uy;           // unit direction
+    float s_along;          // sum of squared along-line offsets
+} sf_seg_t;
+
+static float pt_x[LIDAR_SCAN_BINS];
+static float pt_y[LIDAR_SCAN_BINS];
+static float pt_d[LIDAR_SCAN_BINS];
+static uint16_t pt_bin[LIDAR_SCAN_BINS];      // scan order index, not raw bin
+static uint16_t pt_cluster[LIDAR_SCAN_BINS];
+
+static sf_seg_t segs[SCAN_FEATURES_MAX_LINES];
+static scan_feature_line_t lines[SCAN_FEATURES_MAX_LINES];
+static scan_feature_corner_t corners[SCAN_FEATURES_MAX_CORNERS];
+
+static uint64_t stats_sum_us = 0;
+static uint32_t stats_max_us = 0;
+static uint32_t stats_count = 0;
+static uint32_t stats_dropped_chunks = 0;
+
+static inline int16_t sat16(float v) {
+    if (v > 32767.0f) return 32767;
+    if (v < -32768.0f) return -32768;
+    return (int16_t)lroundf(v);
+}
+
+static inline uint16_t satu16(float v) {
+    if (v > 65535.0f) return 65535;
+    if (v < 0.0f) return 0;
+    return (uint16_t)lroundf(v);
+}
+
+/* Total least squares fit over points [i0, i1] */
+static void sf_fit(sf_seg_t *s) {
+    int n = s->i1 - s->i0 + 1;
+    float mx = 0.0f, my = 0.0f;
+    for (int i = s->i0; i <= s->i1; ++i) { mx += pt_x[i]; my += pt_y[i]; }
+    mx /= (float)n;
+    my /= (float)n;
+    float sxx = 0.0f, syy = 0.0f, sxy = 0.0f;
+    for (int i = s->i0; i <= s->i1; ++i) {
+        float dx = pt_x[i] - mx, dy = pt_y[i] - my;
+        sxx += dx * dx;
+        syy += dy * dy;
+        sxy += dx * dy;
+    }
+    /* Principal direction of the scatter matrix */
+    float phi = 0.5f * atan2f(2.0f * sxy, sxx - syy);
+    s->cx = mx;
+    s->cy = my;
+    s->ux = cosf(phi);
+    s->uy = sinf(phi);
+    s->s_along = sxx * s->ux * s->ux + 2.0f * sxy * s->ux * s->uy + syy * s->uy * s->uy;
+}
+
+static inline float sf_line_dist(const sf_seg_t *s, float x, float y) {
+    return fabsf(-(x - s->cx) * s->uy + (y - s->cy) * s->ux);
+}
+
+/* Split one cluster [i0, i1] with an explicit stack; segments come out in order.
+ * Sets *dropped if the segment table filled while a range that could still
+ * become a segment was pending. */
+static int sf_split_cluster(uint16_t i0, uint16_t i1, uint16_t cluster, int nseg, bool *dropped) {
+    uint16_t stack[2 * SCAN_FEATURES_MAX_LINES][2];
+    int sp = 0;
+    stack[sp][0] = i0;
+    stack[sp][1] = i1;
+    sp++;
+
+    while (sp > 0 && nseg < SCAN_FEATURES_MAX_LINES) {
+        sp--;
+        uint16_t a = stack[sp][0], b = stack[sp][1];
+        if (b - a + 1 < SF_MIN_POINTS) continue;
+
+        float ex = pt_x[b] - pt_x[a], ey = pt_y[b] - pt_y[a];
+        float len = sqrtf(ex * ex + ey * ey);
+        float best = 0.0f;
+        uint16_t best_i = a;
+        if (len > 1.0f) {
+            for (uint16_t i = a + 1; i < b; ++i) {
+                float d = fabsf((pt_x[i] - pt_x[a]) * ey - (pt_y[i] - pt_y[a]) * ex) / len;
+                float thresh = fmaxf(SF_SPLIT_MIN_MM, pt_d[i] * SF_SPLIT_K);
+                if (d - thresh > best) {
+                    best = d - thresh;
+                    best_i = i;
+                }
+            }
+        }
+
+        if (best > 0.0f && sp + 2 <= (int)(sizeof(stack) / sizeof(stack[0]))) {
+            /* Right half first so the left half is processed next */
+            stack[sp][0] = best_i; stack[sp][1] = b; sp++;
+            stack[sp][0] = a; stack[sp][1] = best_i; sp++;
+            continue;
+        }
+
+        sf_seg_t *s = &segs[nseg++];
+        s->i0 = a;
+        s->i1 = b;
+        s->cluster = cluster;
+        sf_fit(s);
+    }
+    for (int k = 0; k < sp; ++k) {
+        if (stack[k][1] - stack[k][0] + 1 >= SF_MIN_POINTS) *dropped = true;
+    }
+    return nseg;
+}
+
+static int sf_merge(int nseg) {
+    int out = 0;
+    for (int i = 0; i < nseg; ++i) {
+        if (out > 0) {
+            sf_seg_t *p = &segs[out - 1];
+            sf_seg_t *s = &segs[i];
+            float dot = fabsf(p->ux * s->ux + p->uy * s->uy);
+            if (p->cluster == s->cluster && dot > cosf(SF_MERGE_MAX_ANGLE) &&
+                sf_line_dist(p, pt_x[s->i0], pt_y[s->i0]) < SF_MERGE_MAX_DIST_MM &&
+                sf_line_dist(p, pt_x[s->i1], pt_y[s->i1]) < SF_MERGE_MAX_DIST_MM) {
+                p->i1 = s->i1;
+                sf_fit(p);
+                continue;
+            }
+        }
+        if (out != i) segs[out] = segs[i];
+        out++;
+    }
+    return out;
+}
+
+static void sf_make_line(const sf_seg_t *s, scan_feature_line_t *l) {
+    int n = s->i1 - s->i0 + 1;
+    float t0 = (pt_x[s->i0] - s->cx) * s->ux + (pt_y[s->i0] - s->cy) * s->uy;
+    float t1 = (pt_x[s->i1] - s->cx) * s->ux + (pt_y[s->i1] - s->cy) * s->uy;
+    l->x0_mm = sat16(s->cx + t0 * s->ux);
+    l->y0_mm = sat16(s->cy + t0 * s->uy);
+    l->x1_mm = sat16(s->cx + t1 * s->ux);
+    l->y1_mm = sat16(s->cy + t1 * s->uy);
+
+    /* rho = n . c with n = (-uy, ux); rotating about the centroid moves rho by
+     * (c . u) per radian, which couples the two variances. */
+    float sigma2 = SF_SIGMA_MM * SF_SIGMA_MM;
+    float var_alpha = (s->s_along > 1.0f) ? sigma2 / s->s_along : 1.0f;
+    float cu = s->cx * s->ux + s->cy * s->uy;
+    float var_rho = sigma2 / (float)n + cu * cu * var_alpha;
+    l->var_rho = satu16(var_rho);
+    l->var_alpha = satu16(var_alpha * 1e6f);
+    l->cov_rho_alpha = sat16(cu * var_alpha * 1e3f);
+    l->n_points = (n > 255) ? 255 : (uint8_t)n;
+}
+
+/* Sets *dropped if a corner was found with the corner table already full */
+static int sf_find_corners(int nseg, bool *dropped) {
+    int nc = 0;
+    for (int i = 0; i + 1 < nseg; ++i) {
+        const sf_seg_t *a = &segs[i];
+        const sf_seg_t *b = &segs[i + 1];
+        if (a->cluster != b->cluster) continue;
+        float gx = pt_x[b->i0] - pt_x[a->i1], gy = pt_y[b->i0] - pt_y[a->i1];
+        if (gx * gx + gy * gy > SF_CORNER_MAX_GAP_MM * SF_CORNER_MAX_GAP_MM) continue;
+
+        float dot = a->ux * b->ux + a->uy * b->uy;
+        float cross = a->ux * b->uy - a->uy * b->ux;
+        if (acosf(fminf(1.0f, fabsf(dot))) < SF_CORNER_MIN_ANGLE) continue;
+
+        /* Intersection of c_a + t u_a and c_b + s u_b */
+        float wx = b->cx - a->cx, wy = b->cy - a->cy;
+        float t = (wx * b->uy - wy * b->ux) / cross;
+        if (nc >= SCAN_FEATURES_MAX_CORNERS) {
+            *dropped = true;
+            break;
+        }
+        scan_feature_corner_t *c = &corners[nc++];
+        c->x_mm = sat16(a->cx + t * a->ux);
+        c->y_mm = sat16(a->cy + t * a->uy);
+        c->angle_mrad = (uint16_t)lroundf(acosf(fmaxf(-1.0f, fminf(1.0f, dot))) * 1000.0f);
+        c->line_a = (uint8_t)i;
+        c->line_b = (uint8_t)(i + 1);
+    }
+    return nc;
+}
+
+/* Lines first, then corners, cut into streaming-pool sized chunks. A client
+ * missing a chunk index for a frame_seq knows that frame's list is partial. */
+static void sf_chunk_plan(size_t room, int nl, int nc, int *fit_l, int *fit_c, int li, int ci) {
+    int l = (int)(room / sizeof(scan_feature_line_t));
+    if (l > nl - li) l = nl - li;
+    room -= (size_t)l * sizeof(scan_feature_line_t);
+    int c = (int)(room / sizeof(scan_feature_corner_t));
+    if (c > nc - ci) c = nc - ci;
+    *fit_l = l;
+    *fit_c = c;
+}
+
+static void sf_publish(const scan_features_hdr_t *hdr_in, int nl, int nc) {
+    uint8_t buf[sizeof(scan_features_hdr_t) +
+                SCAN_FEATURES_MAX_LINES * sizeof(scan_feature_line_t) +
+                SCAN_FEATURES_MAX_CORNERS * sizeof(scan_feature_corner_t)];
+    size_t cap = dispatcher_pool_payload_size(DISPATCHER_POOL_STREAMING);
+    if (cap > sizeof(buf)) cap = sizeof(buf);
+    if (cap < sizeof(scan_features_hdr_t) + sizeof(scan_feature_line_t)) {
+        ESP_LOGW(TAG, "Streaming payload (%u B) too small for a feature chunk", (unsigned)cap);
+        return;
+    }
+    size_t room = cap - sizeof(scan_features_hdr_t);
+
+    /* Count chunks first so every chunk carries n_chunks (an empty list
+     * still sends one header-only chunk) */
+    int n_chunks = 0, li = 0, ci = 0, fl, fc;
+    do {
+        sf_chunk_plan(room, nl, nc, &fl, &fc, li, ci);
+        li += fl;
+        ci += fc;
+        n_chunks++;
+    } while (li < nl || ci < nc);
+
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_SSE_LIDAR_FEATURES;
+
+    li = 0;
+    ci = 0;
+    for (int k = 0; k < n_chunks; ++k) {
+        sf_chunk_plan(room, nl, nc, &fl, &fc, li, ci);
+        scan_features_hdr_t hdr = *hdr_in;
+        hdr.n_lines = (uint8_t)fl;
+        hdr.n_corners = (uint8_t)fc;
+        hdr.chunk = (uint8_t)k;
+        hdr.n_chunks = (uint8_t)n_chunks;
+        hdr.first_line = (uint8_t)li;
+        hdr.first_corner = (uint8_t)ci;
+
+        size_t pos = 0;
+        memcpy(&buf[pos], &hdr, sizeof(hdr));
+        pos += sizeof(hdr);
+        memcpy(&buf[pos], &lines[li], (size_t)fl * sizeof(scan_feature_line_t));
+        pos += (size_t)fl * sizeof(scan_feature_line_t);
+        memcpy(&buf[pos], &corners[ci], (size_t)fc * sizeof(scan_feature_corner_t));
+        pos += (size_t)fc * sizeof(scan_feature_corner_t);
+        li += fl;
+        ci += fc;
+
+        dispatcher_pool_send_params_t params = {
+            .type = DISPATCHER_POOL_STREAMING,
+            .source = SOURCE_SCAN_FEATURES,
+            .targets = targets,
+            .data = buf,
+            .data_len = pos,
+            .context = NULL
+        };
+        if (!dispatcher_pool_send_ptr_params(&params)) stats_dropped_chunks++;
+    }
+}
+
+static void sf_extract(const lidar_scan_frame_t *frame) {
+    int64_t t0 = esp_timer_get_time();
+
+    /* Ordered points and range-break clusters (no sort: bins are angle-ordered).
+     * Start at an empty bin when there is one so a wall crossing 0° stays whole. */
+    int first = 0;
+    for (int b = 0; b < LIDAR_SCAN_BINS; ++b) {
+        uint16_t d = frame->dist_mm[b];
+        if (d < SF_MIN_RANGE_MM || d > SF_MAX_RANGE_MM) { first = b; break; }
+    }
+    int n = 0;
+    uint16_t cluster = 0;
+    for (int k = 0; k < LIDAR_SCAN_BINS; ++k) {
+        int b = first + k;
+        if (b >= LIDAR_SCAN_BINS) b -= LIDAR_SCAN_BINS;
+        uint16_t d = frame->dist_mm[b];
+        if (d < SF_MIN_RANGE_MM || d > SF_MAX_RANGE_MM) continue;
+        float x = (float)frame->x_mm[b], y = (float)frame->y_mm[b];
+        if (n > 0) {
+            float gx = x - pt_x[n - 1], gy = y - pt_y[n - 1];
+            float brk = fmaxf(SF_BREAK_MIN_MM, (float)d * SF_BREAK_K);
+            if (k - pt_bin[n - 1] > SF_BREAK_MAX_BINS || gx * gx + gy * gy > brk * brk) cluster++;
+        }
+        pt_x[n] = x;
+        pt_y[n] = y;
+        pt_d[n] = (float)d;
+        pt_bin[n] = (uint16_t)k;
+        pt_cluster[n] = cluster;
+        n++;
+    }
+
+    /* Every cluster is visited even with the segment table full, so a
+     * cluster that would have produced a segment marks the frame truncated.
+     * A table filled exactly is not truncation. */
+    int nseg = 0;
+    int start = 0;
+    bool capped = false;
+    for (int i = 1; i <= n; ++i) {
+        if (i == n || pt_cluster[i] != pt_cluster[start]) {
+            nseg = sf_split_cluster((uint16_t)start, (uint16_t)(i - 1), pt_cluster[start], nseg, &capped);
+            start = i;
+        }
+    }
+    nseg = sf_merge(nseg);
+    for (int i = 0; i < nseg; ++i) sf_make_line(&segs[i], &lines[i]);
+    int nc = sf_find_corners(nseg, &capped);
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    scan_features_hdr_t hdr = {
+        .frame_seq = frame->seq,
+        .lines_total = (uint8_t)nseg,
+        .corners_total = (uint8_t)nc,
+        .flags = capped ? SCAN_FEATURES_FLAG_TRUNCATED : 0,
+        .extract_us = (dt > 65535u) ? 65535u : (uint16_t)dt,
+    };
+    sf_publish(&hdr, nseg, nc);
+
+    stats_sum_us += dt;
+    if (dt > stats_max_us) stats_max_us = dt;
+    if (++stats_count >= SF_STATS_FRAMES) {
+        ESP_LOGI(TAG, "extract: avg %u us, max %u us over %u frames (last: %d lines, %d corners), %u chunks dropped",
+                 (unsigned)(stats_sum_us / stats_count), (unsigned)stats_max_us,
+                 (unsigned)stats_count, nseg, nc, (unsigned)stats_dropped_chunks);
+        stats_dropped_chunks = 0;
+        stats_sum_us = 0;
+        stats_max_us = 0;
+        stats_count = 0;
+    }
+}
+
+static void scan_features_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg || msg->source != SOURCE_LIDAR_SCAN) return;
+    const lidar_scan_frame_t *frame = lidar_scan_frame_from_msg(msg);
+    if (frame) sf_extract(frame);
+    lidar_scan_frame_done(msg);
+}
+
+static dispatcher_module_t scan_features_mod = {
+    .name = "scan_features_task",
+    .target = TARGET_SCAN_FEATURES,
+    .queue_len = 4,
+    .stack_size = 4096,
+    .task_prio = 4,
+    .process_msg = scan_features_process_msg,
+    .step_frame = NULL,
+    .step_ms = 0,
+    .queue = NULL
+};
+
+void mod_scan_features_init(void) {
+    if (dispatcher_module_start(&scan_features_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for scan_features");
+        return;
+    }
+    lidar_scan_subscribe(TARGET_SCAN_FEATURES);
+}
@@ -0,0 +1,349 @@
+#include "mod_scan_log.h"
+#include "dispatcher_module.h"
+#include "dispatcher.h"
+#include "dispatcher_pool.h"
+#include "lidar_scan.h"
+#include "lidar_scan_codec.h"
+#include "lidar_motor.h"
+#include "io_fatfs.h"
+#include "io_usb_msc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "scan_log";
+
+#define SL_WRITER_STACK       4096
+#define SL_WRITER_PRIO        (tskIDLE_PRIORITY + 1)
+#define SL_CLOSE_TIMEOUT_MS   5000
+#define SL_STATS_BLOCKS       32
+#define SL_MAX_FILES          10000
+
+typedef enum {
+    SL_OP_OPEN = 0,     // arg = file number
+    SL_OP_DATA,         // block, len
+    SL_OP_CLOSE,        // write index + footer, close
+} sl_op_t;
+
+typedef struct {
+    uint8_t  op;
+    uint8_t  block;
+    uint16_t len;
+    uint32_t arg;
+    scan_log_footer_t footer;   // SL_OP_CLOSE
+} sl_work_t;
+
+/* Staging ring, shared with the writer only through the two queues */
+static uint8_t *sl_ring = NULL;
+static QueueHandle_t sl_free_q = NULL;      // uint8_t block ids ready to fill
+static QueueHandle_t sl_work_q = NULL;      // sl_work_t for the writer
+static SemaphoreHandle_t sl_closed = NULL;  // writer finished SL_OP_CLOSE
+static volatile bool sl_write_error = false;
+
+/* Module task state */
+static bool sl_recording = false;
+static int sl_cur_block = -1;
+static size_t sl_cur_fill = 0;
+static uint32_t sl_file_bytes = 0;          // bytes staged for the open file
+static uint32_t sl_records = 0;
+static uint32_t sl_dropped = 0;
+static uint32_t sl_decimate = 0;
+static scan_log_index_t *sl_index = NULL;
+static uint32_t sl_index_count = 0;
+static uint8_t *sl_scratch = NULL;          // one encoded record
+
+static void *sl_alloc(size_t size, const char *what) {
+    void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) {
+        ESP_LOGW(TAG, "PSRAM alloc failed for %s; using internal RAM", what);
+        p = malloc(size);
+    }
+    return p;
+}
+
+// ---- Staging (module task) ----
+
+static size_t sl_space(void) {
+    size_t space = (size_t)uxQueueMessagesWaiting(sl_free_q) * SCAN_LOG_BLOCK_SIZE;
+    if (sl_cur_block >= 0) space += SCAN_LOG_BLOCK_SIZE - sl_cur_fill;
+    return space;
+}
+
+static void sl_submit_block(void) {
+    if (sl_cur_block < 0 || sl_cur_fill == 0) return;
+    sl_work_t w = { .op = SL_OP_DATA, .block = (uint8_t)sl_cur_block, .len = (uint16_t)sl_cur_fill };
+    xQueueSend(sl_work_q, &w, portMAX_DELAY);   // never full: one slot per block + control
+    sl_cur_block = -1;
+    sl_cur_fill = 0;
+}
+
+/* Copy into the ring; the caller has checked sl_space() */
+static void sl_stage(const void *src, size_t len) {
+    const uint8_t *p = (const uint8_t *)src;
+    while (len) {
+        if (sl_cur_block < 0) {
+            uint8_t id;
+            if (xQueueReceive(sl_free_q, &id, 0) != pdTRUE) return;
+            sl_cur_block = id;
+            sl_cur_fill = 0;
+        }
+        size_t n = SCAN_LOG_BLOCK_SIZE - sl_cur_fill;
+        if (n > len) n = len;
+        memcpy(sl_ring + (size_t)sl_cur_block * SCAN_LOG_BLOCK_SIZE + sl_cur_fill, p, n);
+        sl_cur_fill += n;
+        sl_file_bytes += n;
+        p += n;
+        len -= n;
+        if (sl_cur_fill == SCAN_LOG_BLOCK_SIZE) sl_submit_block();
+    }
+}
+
+static void sl_stop(const char *why) {
+    if (!sl_recording) return;
+    sl_recording = false;
+    sl_submit_block();
+
+    sl_work_t w = { .op = SL_OP_CLOSE };
+    w.footer.magic = SCAN_LOG_FOOTER_MAGIC;
+    w.footer.index_count = sl_index_count;
+    w.footer.index_offset = sl_file_bytes;
+    w.footer.record_count = sl_records;
+    xQueueSend(sl_work_q, &w, portMAX_DELAY);
+    ESP_LOGI(TAG, "Recording stopped (%s): %u records, %u bytes, %u dropped",
+             why, (unsigned)sl_records, (unsigned)sl_file_bytes, (unsigned)sl_dropped);
+}
+
+static void sl_start(void) {
+    sl_stop("restart");
+    /* The writer owns sl_index until the previous file is closed */
+    if (xSemaphoreTake(sl_closed, pdMS_TO_TICKS(SL_CLOSE_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGE(TAG, "Previous file still closing; not starting");
+        return;
+    }
+    xSemaphoreGive(sl_closed);
+    if (io_usb_msc_is_enabled()) {
+        ESP_LOGW(TAG, "FAT is exported over USB MSC; not recording");
+        return;
+    }
+    if (!io_fatfs_mkdir_recursive(SCAN_LOG_DIR)) {
+        ESP_LOGE(TAG, "Failed to create %s", SCAN_LOG_DIR);
+        return;
+    }
+    uint32_t file_no = 0;
+    char path[48];
+    for (; file_no < SL_MAX_FILES; ++file_no) {
+        snprintf(path, sizeof(path), SCAN_LOG_DIR "/scan_%04u.bin", (unsigned)file_no);
+        if (!io_fatfs_file_exists(path)) break;
+    }
+    if (file_no == SL_MAX_FILES) {
+        ESP_LOGE(TAG, "No free file name in %s", SCAN_LOG_DIR);
+        return;
+    }
+
+    sl_write_error = false;
+    xSemaphoreTake(sl_closed, 0);
+    sl_work_t w = { .op = SL_OP_OPEN, .arg = file_no };
+    xQueueSend(sl_work_q, &w, portMAX_DELAY);
+
+    sl_file_bytes = 0;
+    sl_records = 0;
+    sl_dropped = 0;
+    sl_decimate = 0;
+    sl_index_count = 0;
+    scan_log_file_hdr_t hdr = {
+        .magic = SCAN_LOG_MAGIC,
+        .version = SCAN_LOG_VERSION,
+        .hdr_size = sizeof(scan_log_file_hdr_t),
+        .bins = LIDAR_SCAN_BINS,
+        .q_shift = 0,
+        .start_ms = (uint32_t)(esp_timer_get_time() / 1000),
+    };
+    sl_stage(&hdr, sizeof(hdr));   // ring is empty after a close: always fits
+    sl_recording = true;
+    ESP_LOGI(TAG, "Recording to %s", path);
+}
+
+static void sl_record(const lidar_scan_frame_t *frame) {
+    if (sl_write_error) {
+        sl_stop("write error");
+        return;
+    }
+    if (++sl_decimate < CONFIG_LIDAR_SCAN_LOG_DECIMATE) return;
+    sl_decimate = 0;
+
+    scan_log_rec_hdr_t rec = {
+        .magic = SCAN_LOG_REC_MAGIC,
+        .seq = frame->seq,
+        .t_ms = (uint32_t)(frame->t_end_us / 1000),
+        .rpm_x10 = lidar_motor_rpm_x10(),
+    };
+    uint16_t count = 0;
+    size_t len = lidar_scan_codec_encode(frame->dist_mm, 0, sl_scratch, &count);
+    rec.len = (uint16_t)len;
+    rec.count = count;
+
+    size_t need = sizeof(rec) + len;
+    size_t tail = (size_t)(sl_index_count + 1) * sizeof(scan_log_index_t) + sizeof(scan_log_footer_t);
+    if (sl_file_bytes + need + tail > (size_t)CONFIG_LIDAR_SCAN_LOG_MAX_KB * 1024) {
+        sl_stop("size limit");
+        return;
+    }
+    if (sl_space() < need) {
+        sl_dropped++;   // writer behind: lose this frame, never block the scan path
+        return;
+    }
+    if (sl_records % SCAN_LOG_INDEX_EVERY == 0 && sl_index_count < SCAN_LOG_INDEX_MAX) {
+        sl_index[sl_index_count++] = (scan_log_index_t){ rec.seq, rec.t_ms, sl_file_bytes };
+    }
+    sl_stage(&rec, sizeof(rec));
+    sl_stage(sl_scratch, len);
+    sl_records++;
+}
+
+// ---- Writer (low priority) ----
+
+static void sl_writer_task(void *arg) {
+    FILE *f = NULL;
+    uint64_t write_us = 0;
+    uint32_t write_max_us = 0;
+    uint32_t blocks = 0;
+    sl_work_t w;
+    while (1) {
+        if (xQueueReceive(sl_work_q, &w, portMAX_DELAY) != pdTRUE) continue;
+        switch (w.op) {
+            case SL_OP_OPEN: {
+                char path[48];
+                snprintf(path, sizeof(path), SCAN_LOG_DIR "/scan_%04u.bin", (unsigned)w.arg);
+                f = fopen(path, "wb");
+                if (!f) {
+                    ESP_LOGE(TAG, "fopen failed for %s", path);
+                    sl_write_error = true;
+                    break;
+                }
+                /* Blocks are already sector-sized; skip newlib's copy */
+                setvbuf(f, NULL, _IONBF, 0);
+                break;
+            }
+            case SL_OP_DATA: {
+                if (f && !sl_write_error) {
+                    int64_t t0 = esp_timer_get_time();
+                    size_t n = fwrite(sl_ring + (size_t)w.block * SCAN_LOG_BLOCK_SIZE, 1, w.len, f);
+                    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+                    if (n != w.len) {
+                        ESP_LOGE(TAG, "fwrite failed (%u of %u bytes)", (unsigned)n, (unsigned)w.len);
+                        sl_write_error = true;
+                    }
+                    write_us += dt;
+                    if (dt > write_max_us) write_max_us = dt;
+                    if (++blocks >= SL_STATS_BLOCKS) {
+                        ESP_LOGI(TAG, "Block write avg %u us, max %u us (%u blocks)",
+                                 (unsigned)(write_us / blocks), (unsigned)write_max_us, (unsigned)blocks);
+                        write_us = 0;
+                        write_max_us = 0;
+                        blocks = 0;
+                    }
+                }
+                xQueueSend(sl_free_q, &w.block, portMAX_DELAY);
+                break;
+            }
+            case SL_OP_CLOSE: {
+                if (f) {
+                    if (!sl_write_error) {
+                        fwrite(sl_index, sizeof(scan_log_index_t), w.footer.index_count, f);
+                        fwrite(&w.footer, sizeof(w.footer), 1, f);
+                    }
+                    fclose(f);
+                    f = NULL;
+                }
+                xSemaphoreGive(sl_closed);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+// ---- Module ----
+
+static void scan_log_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg) return;
+    if (msg->source == SOURCE_LIDAR_SCAN) {
+        const lidar_scan_frame_t *frame = lidar_scan_frame_from_msg(msg);
+        if (sl_recording && frame) sl_record(frame);
+        lidar_scan_frame_done(msg);
+        return;
+    }
+    if (msg->message_len == 0) return;
+    switch (msg->data[0]) {
+        case SCAN_LOG_CMD_START: sl_start(); break;
+        case SCAN_LOG_CMD_STOP:  sl_stop("request"); break;
+        default:
+            ESP_LOGW(TAG, "Unknown command 0x%02X from source %d", (unsigned)msg->data[0], (int)msg->source);
+            break;
+    }
+}
+
+static dispatcher_module_t scan_log_mod = {
+    .name = "scan_log_task",
+    .target = TARGET_SCAN_LOG,
+    .queue_len = 4,
+    .stack_size = 4096,
+    .task_prio = 3,
+    .process_msg = scan_log_process_msg,
+    .step_frame = NULL,
+    .step_ms = 0,
+    .queue = NULL
+};
+
+void mod_scan_log_init(void) {
+    sl_ring = sl_alloc((size_t)SCAN_LOG_BLOCK_COUNT * SCAN_LOG_BLOCK_SIZE, "staging ring");
+    sl_index = sl_alloc(SCAN_LOG_INDEX_MAX * sizeof(scan_log_index_t), "index");
+    sl_scratch = sl_alloc(LIDAR_SCAN_CODEC_MAX_BYTES, "record scratch");
+    sl_free_q = xQueueCreate(SCAN_LOG_BLOCK_COUNT, sizeof(uint8_t));
+    sl_work_q = xQueueCreate(SCAN_LOG_BLOCK_COUNT + 2, sizeof(sl_work_t));
+    sl_closed = xSemaphoreCreateBinary();
+    if (!sl_ring || !sl_index || !sl_scratch || !sl_free_q || !sl_work_q || !sl_closed) {
+        ESP_LOGE(TAG, "Failed to allocate scan log resources");
+        return;
+    }
+    for (uint8_t i = 0; i < SCAN_LOG_BLOCK_COUNT; ++i) {
+        xQueueSend(sl_free_q, &i, 0);
+    }
+    xSemaphoreGive(sl_closed);
+
+    if (xTaskCreate(sl_writer_task, "scan_log_wr", SL_WRITER_STACK, NULL, SL_WRITER_PRIO, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start writer task");
+        return;
+    }
+    if (dispatcher_module_start(&scan_log_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for scan_log");
+        return;
+    }
+    lidar_scan_subscribe(TARGET_SCAN_LOG);
+#if CONFIG_LIDAR_SCAN_LOG
+    /* Start from the module task, which owns the recorder state */
+    uint8_t start = SCAN_LOG_CMD_START;
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_SCAN_LOG;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_CONTROL,
+        .source = SOURCE_SCAN_LOG,
+        .targets = targets,
+        .data = &start,
+        .data_len = 1,
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Failed to queue autostart");
+    }
+#endif
+}
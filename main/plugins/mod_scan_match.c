@@ -0,0 +1,429 @@
+#include "mod_scan_match.h"
+#include "mod_occupancy_grid.h"
+#include "heading_cmd.h"
+#include "dispatcher_module.h"
+#include "dispatcher.h"
+#include "lidar_scan.h"
+#include "esp_dsp.h"
+#include <math.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "scan_match";
+
+#define SM_MIN_RANGE_MM       150
+#define SM_MAX_RANGE_MM       6000
+
+/* Current scan is decimated to every Nth bin; the keyframe keeps all bins */
+#define SM_DECIMATE           2
+#define SM_MAX_POINTS         (LIDAR_SCAN_BINS / SM_DECIMATE)
+
+/* Polar correlative rotation search */
+#define SM_CORR_STRIDE        4     // compare every Nth bin
+#define SM_CORR_MAX_SHIFT     48    // ±12° in 0.25° bins
+#define SM_CORR_CLAMP_MM      500
+
+/* Gauss-Newton point-to-line refinement */
+#define SM_GN_MAX_ITERS       12
+#define SM_GATE_START_MM      300.0f
+#define SM_GATE_MIN_MM        60.0f
+#define SM_LINE_MAX_GAP_MM    200.0f
+#define SM_KEY_SEARCH_BINS    8     // 2°: how far to look for a valid keyframe bin
+#define SM_MIN_INLIERS        60
+#define SM_CONVERGED_MM       0.5f
+#define SM_CONVERGED_RAD      0.0005f
+
+/* Keyframe replacement */
+#define SM_KEY_MAX_TRANS_MM   250.0f
+#define SM_KEY_MAX_ROT_RAD    0.2f
+#define SM_KEY_MIN_OVERLAP    40    // percent of current points matched
+
+#define SM_ATAN_LUT_SIZE      256
+#define SM_STATS_MATCHES      20
+
+typedef struct {
+    float x;        // mm, keyframe frame
+    float y;
+    float theta;    // rad, CCW
+} sm_pose_t;
+
+typedef struct {
+    uint16_t inliers;
+    uint16_t points;
+    float rms_mm;
+    uint8_t iters;
+} sm_result_t;
+
+static float sm_atan_lut[SM_ATAN_LUT_SIZE + 1];
+
+/* Keyframe: per-bin Cartesian points and ranges (0 = invalid) */
+static float key_x[LIDAR_SCAN_BINS];
+static float key_y[LIDAR_SCAN_BINS];
+static uint16_t key_range[LIDAR_SCAN_BINS];
+static bool key_valid = false;
+
+/* The A1 samples about every 1°, so most 0.25° bins are empty. For each bin,
+ * the nearest valid keyframe bin at or before / at or after it, within
+ * SM_KEY_SEARCH_BINS (-1 if none), so lookups skip the gaps in O(1). */
+static int16_t key_before[LIDAR_SCAN_BINS];
+static int16_t key_after[LIDAR_SCAN_BINS];
+
+/* Current scan points and per-iteration Jacobian rows (SoA for dot products) */
+static float cur_x[SM_MAX_POINTS];
+static float cur_y[SM_MAX_POINTS];
+static float jac_x[SM_MAX_POINTS] __attribute__((aligned(16)));
+static float jac_y[SM_MAX_POINTS] __attribute__((aligned(16)));
+static float jac_t[SM_MAX_POINTS] __attribute__((aligned(16)));
+static float res_v[SM_MAX_POINTS] __attribute__((aligned(16)));
+
+static sm_pose_t pose_cur = {0};    // current frame in keyframe coordinates
+static sm_pose_t pose_prev = {0};   // previous frame in keyframe coordinates
+static int64_t last_match_us = 0;
+static uint32_t last_frame_seq = 0;
+
+static uint64_t stats_sum_us = 0;
+static uint32_t stats_max_us = 0;
+static uint32_t stats_iters = 0;
+static uint32_t stats_count = 0;
+
+static inline float wrap_pi(float a) {
+    while (a > (float)M_PI) a -= 2.0f * (float)M_PI;
+    while (a <= -(float)M_PI) a += 2.0f * (float)M_PI;
+    return a;
+}
+
+/* Fractional LIDAR bin (clockwise from forward) of a robot-frame point, using
+ * an atan LUT over [0, 1] with octant folding. */
+static float sm_point_bin(float x, float y) {
+    float ax = fabsf(x), ay = fabsf(y);
+    float a;
+    if (ax >= ay) {
+        float t = (ax > 0.0f) ? (ay / ax) * SM_ATAN_LUT_SIZE : 0.0f;
+        int i = (int)t;
+        a = sm_atan_lut[i] + (sm_atan_lut[i < SM_ATAN_LUT_SIZE ? i + 1 : i] - sm_atan_lut[i]) * (t - (float)i);
+    } else {
+        float t = (ax / ay) * SM_ATAN_LUT_SIZE;
+        int i = (int)t;
+        a = (float)M_PI_2 - (sm_atan_lut[i] + (sm_atan_lut[i < SM_ATAN_LUT_SIZE ? i + 1 : i] - sm_atan_lut[i]) * (t - (float)i));
+    }
+    if (x < 0.0f) a = (float)M_PI - a;
+    /* a is CCW angle magnitude; clockwise bin angle is -atan2(y, x) */
+    float cw = (y > 0.0f) ? (2.0f * (float)M_PI - a) : a;
+    float b = cw * ((float)LIDAR_SCAN_BINS / (2.0f * (float)M_PI));
+    return (b >= (float)LIDAR_SCAN_BINS) ? b - (float)LIDAR_SCAN_BINS : b;
+}
+
+static inline bool range_ok(uint16_t d) {
+    return d >= SM_MIN_RANGE_MM && d <= SM_MAX_RANGE_MM;
+}
+
+/* Scans come in as per-bin range plus the robot-frame x/y the assembler
+ * already computed for the same bins (lidar_cartesian.h). */
+static void sm_set_keyframe(const uint16_t *dist_mm, const int16_t *x_mm, const int16_t *y_mm) {
+    for (int b = 0; b < LIDAR_SCAN_BINS; ++b) {
+        uint16_t d = dist_mm[b];
+        if (!range_ok(d)) {
+            key_range[b] = 0;
+            continue;
+        }
+        key_range[b] = d;
+        key_x[b] = (float)x_mm[b];
+        key_y[b] = (float)y_mm[b];
+    }
+
+    /* Start each pass SM_KEY_SEARCH_BINS early so neighbours across 0° count */
+    int last = -LIDAR_SCAN_BINS;
+    for (int i = -SM_KEY_SEARCH_BINS; i < LIDAR_SCAN_BINS; ++i) {
+        int b = (i + LIDAR_SCAN_BINS) % LIDAR_SCAN_BINS;
+        if (key_range[b]) last = i;
+        if (i >= 0) key_before[b] = (int16_t)(i - last <= SM_KEY_SEARCH_BINS ? (last + LIDAR_SCAN_BINS) % LIDAR_SCAN_BINS : -1);
+    }
+    last = 2 * LIDAR_SCAN_BINS;
+    for (int i = LIDAR_SCAN_BINS - 1 + SM_KEY_SEARCH_BINS; i >= 0; --i) {
+        int b = i % LIDAR_SCAN_BINS;
+        if (key_range[b]) last = i;
+        if (i < LIDAR_SCAN_BINS) key_after[b] = (int16_t)(last - i <= SM_KEY_SEARCH_BINS ? last % LIDAR_SCAN_BINS : -1);
+    }
+    key_valid = true;
+}
+
+/* Nearest valid keyframe bin to b, or -1 */
+static int sm_key_nearest(int b) {
+    int lo = key_before[b], hi = key_after[b];
+    if (lo < 0 || hi < 0) return lo < 0 ? hi : lo;
+    int d_lo = b - lo, d_hi = hi - b;
+    if (d_lo < 0) d_lo += LIDAR_SCAN_BINS;
+    if (d_hi < 0) d_hi += LIDAR_SCAN_BINS;
+    return d_hi < d_lo ? hi : lo;
+}
+
+/* Rotation-only search on range profiles: a CCW rotation of theta maps the
+ * current bin b onto keyframe bin b - shift. Returns best shift in bins. */
+static int sm_correlate_rotation(const uint16_t *dist_mm, int centre_shift) {
+    int best_shift = centre_shift;
+    uint32_t best_cost = UINT32_MAX;
+    for (int shift = centre_shift - SM_CORR_MAX_SHIFT; shift <= centre_shift + SM_CORR_MAX_SHIFT; ++shift) {
+        uint32_t cost = 0;
+        uint32_t pairs = 0;
+        for (int b = 0; b < LIDAR_SCAN_BINS; b += SM_CORR_STRIDE) {
+            uint16_t dc = dist_mm[b];
+            if (!range_ok(dc)) continue;
+            int kb = b - shift;
+            kb %= LIDAR_SCAN_BINS;
+            if (kb < 0) kb += LIDAR_SCAN_BINS;
+            kb = sm_key_nearest(kb);
+            if (kb < 0) continue;
+            uint16_t dk = key_range[kb];
+            int diff = abs((int)dc - (int)dk);
+            cost += (uint32_t)(diff > SM_CORR_CLAMP_MM ? SM_CORR_CLAMP_MM : diff);
+            pairs++;
+        }
+        if (pairs < SM_MIN_INLIERS / SM_CORR_STRIDE) continue;
+        cost = (cost << 4) / pairs;
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_shift = shift;
+        }
+    }
+    return best_shift;
+}
+
+static bool solve3(const float H[6], const float g[3], float out[3]) {
+    /* H packed: h00 h01 h02 h11 h12 h22 */
+    float a = H[0], b = H[1], c = H[2], d = H[3], e = H[4], f = H[5];
+    float c00 = d * f - e * e;
+    float c01 = c * e - b * f;
+    float c02 = b * e - c * d;
+    float det = a * c00 + b * c01 + c * c02;
+    if (fabsf(det) < 1e-9f) return false;
+    float c11 = a * f - c * c;
+    float c12 = b * c - a * e;
+    float c22 = a * d - b * b;
+    float inv = 1.0f / det;
+    out[0] = -(c00 * g[0] + c01 * g[1] + c02 * g[2]) * inv;
+    out[1] = -(c01 * g[0] + c11 * g[1] + c12 * g[2]) * inv;
+    out[2] = -(c02 * g[0] + c12 * g[1] + c22 * g[2]) * inv;
+    return true;
+}
+
+/* Register dist_mm against the keyframe starting from *pose; refines *pose */
+static bool sm_match(const uint16_t *dist_mm, const int16_t *x_mm, const int16_t *y_mm,
+                     sm_pose_t *pose, sm_result_t *res) {
+    memset(res, 0, sizeof(*res));
+
+    int n = 0;
+    for (int b = 0; b < LIDAR_SCAN_BINS; b += SM_DECIMATE) {
+        uint16_t d = dist_mm[b];
+        if (!range_ok(d)) continue;
+        cur_x[n] = (float)x_mm[b];
+        cur_y[n] = (float)y_mm[b];
+        n++;
+    }
+    res->points = (uint16_t)n;
+    if (n < SM_MIN_INLIERS) return false;
+
+    const float bins_per_rad = (float)LIDAR_SCAN_BINS / (2.0f * (float)M_PI);
+    int shift = sm_correlate_rotation(dist_mm, (int)lroundf(pose->theta * bins_per_rad));
+    pose->theta = wrap_pi((float)shift / bins_per_rad);
+
+    float gate = SM_GATE_START_MM;
+    int m = 0;
+    float sq = 0.0f;
+    for (int it = 0; it < SM_GN_MAX_ITERS; ++it) {
+        float c = cosf(pose->theta), s = sinf(pose->theta);
+        m = 0;
+        for (int i = 0; i < n; ++i) {
+            float qx = c * cur_x[i] - s * cur_y[i] + pose->x;
+            float qy = s * cur_x[i] + c * cur_y[i] + pose->y;
+
+            /* Projective association: the valid keyframe bins either side
+               of the point's bearing form the line */
+            int kb = (int)sm_point_bin(qx, qy);
+            int k0 = key_before[kb];
+            int k1 = key_after[(kb + 1 == LIDAR_SCAN_BINS) ? 0 : kb + 1];
+            if (k0 < 0 || k1 < 0) continue;
+            float lx = key_x[k1] - key_x[k0];
+            float ly = key_y[k1] - key_y[k0];
+            float len2 = lx * lx + ly * ly;
+            if (len2 < 1.0f || len2 > SM_LINE_MAX_GAP_MM * SM_LINE_MAX_GAP_MM) continue;
+            float inv_len = 1.0f / sqrtf(len2);
+            float nx = -ly * inv_len, ny = lx * inv_len;
+
+            float r = nx * (qx - key_x[k0]) + ny * (qy - key_y[k0]);
+            if (fabsf(r) > gate) continue;
+
+            /* d(q)/d(theta) = (-(qy - ty), qx - tx) */
+            jac_x[m] = nx;
+            jac_y[m] = ny;
+            jac_t[m] = nx * -(qy - pose->y) + ny * (qx - pose->x);
+            res_v[m] = r;
+            m++;
+        }
+        if (m < SM_MIN_INLIERS) break;
+
+        float H[6], g[3];
+        dsps_dotprod_f32(jac_x, jac_x, &H[0], m);
+        dsps_dotprod_f32(jac_x, jac_y, &H[1], m);
+        dsps_dotprod_f32(jac_x, jac_t, &H[2], m);
+        dsps_dotprod_f32(jac_y, jac_y, &H[3], m);
+        dsps_dotprod_f32(jac_y, jac_t, &H[4], m);
+        dsps_dotprod_f32(jac_t, jac_t, &H[5], m);
+        dsps_dotprod_f32(jac_x, res_v, &g[0], m);
+        dsps_dotprod_f32(jac_y, res_v, &g[1], m);
+        dsps_dotprod_f32(jac_t, res_v, &g[2], m);
+        dsps_dotprod_f32(res_v, res_v, &sq, m);
+
+        float delta[3];
+        if (!solve3(H, g, delta)) break;
+        pose->x += delta[0];
+        pose->y += delta[1];
+        pose->theta = wrap_pi(pose->theta + delta[2]);
+        res->iters = (uint8_t)(it + 1);
+
+        gate *= 0.7f;
+        if (gate < SM_GATE_MIN_MM) gate = SM_GATE_MIN_MM;
+        if (fabsf(delta[0]) < SM_CONVERGED_MM && fabsf(delta[1]) < SM_CONVERGED_MM &&
+            fabsf(delta[2]) < SM_CONVERGED_RAD) {
+            break;
+        }
+    }
+
+    res->inliers = (uint16_t)m;
+    res->rms_mm = (m > 0) ? sqrtf(sq / (float)m) : 0.0f;
+    return m >= SM_MIN_INLIERS;
+}
+
+static void sm_publish(const heading_cmd_odom_t *odom) {
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_HEADING_CMD;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_STREAMING,
+        .source = SOURCE_SCAN_MATCH,
+        .targets = targets,
+        .data = (const uint8_t *)odom,
+        .data_len = sizeof(*odom),
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; dropping odometry");
+    }
+
+    if (odom->flags & HEADING_CMD_ODOM_FLAG_LOST) return;
+    occ_grid_pose_delta_t pd = {
+        .cmd = OCC_GRID_CMD_POSE_DELTA,
+        .dx_mm = odom->dx_mm,
+        .dy_mm = odom->dy_mm,
+        .dtheta_mrad = odom->dtheta_mrad,
+    };
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_OCCUPANCY_GRID;
+    params.data = (const uint8_t *)&pd;
+    params.data_len = sizeof(pd);
+    dispatcher_pool_send_ptr_params(&params);
+}
+
+static void sm_process_frame(const lidar_scan_frame_t *frame) {
+    int64_t t0 = esp_timer_get_time();
+    heading_cmd_odom_t odom = {
+        .kind = HEADING_CMD_KIND_ODOM,
+        .frame_seq = frame->seq,
+    };
+
+    if (!key_valid) {
+        sm_set_keyframe(frame->dist_mm, frame->x_mm, frame->y_mm);
+        pose_cur = (sm_pose_t){0};
+        pose_prev = pose_cur;
+        odom.flags = HEADING_CMD_ODOM_FLAG_KEYFRAME;
+        sm_publish(&odom);
+        return;
+    }
+
+    sm_result_t res;
+    sm_pose_t est = pose_cur;
+    bool ok = sm_match(frame->dist_mm, frame->x_mm, frame->y_mm, &est, &res);
+
+    if (!ok) {
+        /* Lost: restart from this frame rather than drifting on a bad match */
+        ESP_LOGW(TAG, "Match failed (%u/%u inliers); resetting keyframe", (unsigned)res.inliers, (unsigned)res.points);
+        sm_set_keyframe(frame->dist_mm, frame->x_mm, frame->y_mm);
+        pose_cur = (sm_pose_t){0};
+        pose_prev = pose_cur;
+        odom.flags = HEADING_CMD_ODOM_FLAG_LOST | HEADING_CMD_ODOM_FLAG_KEYFRAME;
+        sm_publish(&odom);
+        return;
+    }
+
+    /* Increment in the previous robot frame: R(-theta_prev) * (t_cur - t_prev) */
+    float c = cosf(pose_prev.theta), s = sinf(pose_prev.theta);
+    float tx = est.x - pose_prev.x, ty = est.y - pose_prev.y;
+    odom.dx_mm = (int16_t)lroundf(c * tx + s * ty);
+    odom.dy_mm = (int16_t)lroundf(-s * tx + c * ty);
+    odom.dtheta_mrad = (int16_t)lroundf(wrap_pi(est.theta - pose_prev.theta) * 1000.0f);
+    odom.inliers = res.inliers;
+    odom.rms_mm = (uint16_t)lroundf(res.rms_mm);
+
+    pose_cur = est;
+    pose_prev = est;
+
+    bool far = sqrtf(est.x * est.x + est.y * est.y) > SM_KEY_MAX_TRANS_MM || fabsf(est.theta) > SM_KEY_MAX_ROT_RAD;
+    bool thin = (uint32_t)res.inliers * 100u < (uint32_t)res.points * SM_KEY_MIN_OVERLAP;
+    if (far || thin) {
+        sm_set_keyframe(frame->dist_mm, frame->x_mm, frame->y_mm);
+        pose_cur = (sm_pose_t){0};
+        pose_prev = pose_cur;
+        odom.flags |= HEADING_CMD_ODOM_FLAG_KEYFRAME;
+    }
+    sm_publish(&odom);
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    stats_sum_us += dt;
+    stats_iters += res.iters;
+    if (dt > stats_max_us) stats_max_us = dt;
+    if (++stats_count >= SM_STATS_MATCHES) {
+        ESP_LOGI(TAG, "match: avg %u us, max %u us, avg %u iters over %u frames",
+                 (unsigned)(stats_sum_us / stats_count), (unsigned)stats_max_us,
+                 (unsigned)(stats_iters / stats_count), (unsigned)stats_count);
+        stats_sum_us = 0;
+        stats_max_us = 0;
+        stats_iters = 0;
+        stats_count = 0;
+    }
+}
+
+static void scan_match_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg || msg->source != SOURCE_LIDAR_SCAN) return;
+    const lidar_scan_frame_t *frame = lidar_scan_frame_from_msg(msg);
+    int64_t now = esp_timer_get_time();
+    if (frame && (last_match_us == 0 || (now - last_match_us) >= (int64_t)SCAN_MATCH_MIN_PERIOD_MS * 1000)) {
+        last_match_us = now;
+        last_frame_seq = frame->seq;
+        sm_process_frame(frame);
+    }
+    lidar_scan_frame_done(msg);
+}
+
+static dispatcher_module_t scan_match_mod = {
+    .name = "scan_match_task",
+    .target = TARGET_SCAN_MATCH,
+    .queue_len = 4,
+    .stack_size = 4096,
+    .task_prio = 4,
+    .process_msg = scan_match_process_msg,
+    .step_frame = NULL,
+    .step_ms = 0,
+    .queue = NULL
+};
+
+void mod_scan_match_init(void) {
+    for (int i = 0; i <= SM_ATAN_LUT_SIZE; ++i) {
+        sm_atan_lut[i] = atanf((float)i / (float)SM_ATAN_LUT_SIZE);
+    }
+
+    if (dispatcher_module_start(&scan_match_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for scan_match");
+        return;
+    }
+    lidar_scan_subscribe(TARGET_SCAN_MATCH);
+}
@@ -0,0 +1,336 @@
+#include "mod_vfh.h"
+#include "heading_cmd.h"
+#include "dispatcher_module.h"
+#include "dispatcher.h"
+#include "lidar_scan.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "vfh";
+
+#define VFH_BINS_PER_SECTOR   (LIDAR_SCAN_BINS / VFH_SECTORS)
+
+/* Obstacle magnitude: m = (D_MAX - d) >> MAG_SHIFT for d < D_MAX */
+#define VFH_D_MAX_MM          2000
+#define VFH_MAG_SHIFT         3
+
+/* Robot radius + safety margin used to widen obstacles (VFH+ enlargement) */
+#define VFH_R_ENLARGE_MM      150
+#define VFH_HW_LUT_STEP_MM    20
+#define VFH_HW_LUT_LEN        (VFH_D_MAX_MM / VFH_HW_LUT_STEP_MM)
+
+/* Binary histogram hysteresis thresholds */
+#define VFH_TAU_LOW           300
+#define VFH_TAU_HIGH          600
+
+/* Valleys wider than this are treated as wide (steer along the edge) */
+#define VFH_S_MAX             16
+
+/* Cost weights: target direction, current heading, previous choice */
+#define VFH_MU_TARGET         5
+#define VFH_MU_CURRENT        2
+#define VFH_MU_PREV           2
+
+/* Forward ultrasonic: beam half-width in sectors and weight relative to one LIDAR point */
+#define VFH_US_HALF_SECTORS   3
+#define VFH_US_WEIGHT         8
+#define VFH_US_MAX_MM         450
+#define VFH_US_STALE_US       500000
+
+#define VFH_LIDAR_STALE_US    500000
+
+/* A bin not refreshed for this many rotations is dropped from the
+ * histogram. The A1 samples about every 1°, so most 0.25° bins are not hit
+ * every rotation; without ageing a point seen once would stay forever. */
+#define VFH_BIN_MAX_AGE_ROT   2
+#define VFH_STATS_DECISIONS   100
+
+/* Histogram fed from the LIDAR coordinator task via the point sink.
+ * Each bin remembers what it added so a new point replaces it in O(width),
+ * and the rotation it was last seen in so stale bins can be swept out. */
+static volatile int32_t vfh_hist[VFH_SECTORS];
+static uint16_t vfh_bin_mag[LIDAR_SCAN_BINS];
+static uint8_t vfh_bin_hw[LIDAR_SCAN_BINS];
+static uint8_t vfh_bin_rot[LIDAR_SCAN_BINS];
+static uint8_t vfh_rot = 0;                 // rotation counter (wraps)
+static int32_t vfh_last_bin = -1;
+static uint32_t vfh_swept = 0;              // bins aged out since the last stats line
+static uint8_t vfh_hw_lut[VFH_HW_LUT_LEN];
+static volatile int64_t vfh_last_point_us = 0;
+
+/* Owned by the VFH task */
+static uint8_t vfh_blocked[VFH_SECTORS];
+static int16_t vfh_prev_sector = 0;
+static int16_t vfh_goal_sector = 0;
+static uint16_t vfh_us_mm = 0;
+static int64_t vfh_us_t_us = 0;
+static uint32_t vfh_seq = 0;
+
+static uint64_t stats_latency_sum_us = 0;
+static uint32_t stats_latency_max_us = 0;
+static uint32_t stats_compute_max_us = 0;
+static uint32_t stats_count = 0;
+
+static inline int16_t sector_wrap(int32_t s) {
+    s %= VFH_SECTORS;
+    return (int16_t)(s < 0 ? s + VFH_SECTORS : s);
+}
+
+static inline int16_t sector_dist(int16_t a, int16_t b) {
+    int16_t d = (int16_t)abs(a - b);
+    return (d > VFH_SECTORS / 2) ? (int16_t)(VFH_SECTORS - d) : d;
+}
+
+/* Sector centre angle is s * 5° clockwise; convert to CCW mrad in (-pi, pi] */
+static int16_t sector_to_mrad(int16_t s) {
+    int32_t cw_deg10 = (int32_t)s * (3600 / VFH_SECTORS);
+    if (cw_deg10 > 1800) cw_deg10 -= 3600;
+    return (int16_t)(-(cw_deg10 * 31416) / 18000);
+}
+
+static int16_t mrad_to_sector(int16_t mrad) {
+    int32_t cw_deg10 = -((int32_t)mrad * 18000) / 31416;
+    int32_t step = 3600 / VFH_SECTORS;
+    return sector_wrap((cw_deg10 + (cw_deg10 >= 0 ? step / 2 : -step / 2)) / step);
+}
+
+static void hist_apply(int16_t centre, uint8_t hw, int32_t mag) {
+    for (int32_t k = -(int32_t)hw; k <= (int32_t)hw; ++k) {
+        int16_t s = sector_wrap(centre + k);
+        vfh_hist[s] = vfh_hist[s] + mag;
+    }
+}
+
+/* Sector 0 is centred on forward: bins [-10, 10) map to sector 0 */
+static inline int16_t bin_sector(uint16_t bin) {
+    return sector_wrap((bin + VFH_BINS_PER_SECTOR / 2) / VFH_BINS_PER_SECTOR);
+}
+
+/* Rotation start: remove bins not refreshed within VFH_BIN_MAX_AGE_ROT */
+static void vfh_sweep(void) {
+    vfh_rot++;
+    for (uint16_t b = 0; b < LIDAR_SCAN_BINS; ++b) {
+        if (!vfh_bin_mag[b] || (uint8_t)(vfh_rot - vfh_bin_rot[b]) <= VFH_BIN_MAX_AGE_ROT) continue;
+        hist_apply(bin_sector(b), vfh_bin_hw[b], -(int32_t)vfh_bin_mag[b]);
+        vfh_bin_mag[b] = 0;
+        vfh_bin_hw[b] = 0;
+        vfh_swept++;
+    }
+}
+
+/* LIDAR point sink: replace this bin's previous contribution */
+static void vfh_point_sink(uint16_t bin, uint16_t dist_mm, uint8_t quality, int64_t t_us) {
+    /* Bin index falling back by more than half a turn: a new rotation */
+    if (vfh_last_bin >= 0 && (int32_t)bin + LIDAR_SCAN_BINS / 2 < vfh_last_bin) vfh_sweep();
+    vfh_last_bin = bin;
+
+    uint16_t mag = 0;
+    uint8_t hw = 0;
+    if (dist_mm != 0 && quality != 0 && dist_mm < VFH_D_MAX_MM) {
+        mag = (uint16_t)((VFH_D_MAX_MM - dist_mm) >> VFH_MAG_SHIFT);
+        hw = vfh_hw_lut[dist_mm / VFH_HW_LUT_STEP_MM];
+    }
+    vfh_last_point_us = t_us;
+    vfh_bin_rot[bin] = vfh_rot;
+    if (mag == vfh_bin_mag[bin] && hw == vfh_bin_hw[bin]) return;
+
+    int16_t centre = bin_sector(bin);
+    if (vfh_bin_mag[bin]) hist_apply(centre, vfh_bin_hw[bin], -(int32_t)vfh_bin_mag[bin]);
+    if (mag) hist_apply(centre, hw, mag);
+    vfh_bin_mag[bin] = mag;
+    vfh_bin_hw[bin] = hw;
+}
+
+static int32_t candidate_cost(int16_t c) {
+    return VFH_MU_TARGET * sector_dist(c, vfh_goal_sector) +
+           VFH_MU_CURRENT * sector_dist(c, 0) +
+           VFH_MU_PREV * sector_dist(c, vfh_prev_sector);
+}
+
+static void consider(int16_t c, int16_t *best, int32_t *best_cost) {
+    int32_t cost = candidate_cost(c);
+    if (cost < *best_cost) {
+        *best_cost = cost;
+        *best = c;
+    }
+}
+
+/* Build the binary histogram and pick a direction. Returns false if blocked. */
+static bool vfh_select(int64_t now_us, int16_t *out_sector, bool *out_narrow) {
+    int32_t h[VFH_SECTORS];
+    for (int s = 0; s < VFH_SECTORS; ++s) h[s] = vfh_hist[s];
+
+    if (vfh_us_mm != 0 && vfh_us_mm < VFH_US_MAX_MM && vfh_us_mm < VFH_D_MAX_MM &&
+        (now_us - vfh_us_t_us) < VFH_US_STALE_US) {
+        int32_t mag = ((VFH_D_MAX_MM - vfh_us_mm) >> VFH_MAG_SHIFT) * VFH_US_WEIGHT;
+        int32_t hw = VFH_US_HALF_SECTORS + vfh_hw_lut[vfh_us_mm / VFH_HW_LUT_STEP_MM];
+        if (hw > VFH_SECTORS / 2 - 1) hw = VFH_SECTORS / 2 - 1;
+        for (int32_t k = -hw; k <= hw; ++k) h[sector_wrap(k)] += mag;
+    }
+
+    int free_count = 0;
+    int16_t first_blocked = -1;
+    for (int s = 0; s < VFH_SECTORS; ++s) {
+        if (h[s] > VFH_TAU_HIGH) vfh_blocked[s] = 1;
+        else if (h[s] < VFH_TAU_LOW) vfh_blocked[s] = 0;
+        if (!vfh_blocked[s]) free_count++;
+        else if (first_blocked < 0) first_blocked = (int16_t)s;
+    }
+
+    if (free_count == 0) return false;
+    if (first_blocked < 0) {
+        *out_sector = vfh_goal_sector;
+        *out_narrow = false;
+        return true;
+    }
+
+    /* Walk valleys starting just after a blocked sector so none wraps the scan */
+    int16_t best = 0;
+    int32_t best_cost = INT32_MAX;
+    bool best_narrow = false;
+    int i = 0;
+    while (i < VFH_SECTORS) {
+        int16_t s = sector_wrap(first_blocked + 1 + i);
+        if (vfh_blocked[s]) { i++; continue; }
+        int16_t start = s;
+        int len = 0;
+        while (i < VFH_SECTORS && !vfh_blocked[sector_wrap(first_blocked + 1 + i)]) { len++; i++; }
+        int16_t end = sector_wrap(start + len - 1);
+
+        int32_t prev_cost = best_cost;
+        if (len > VFH_S_MAX) {
+            consider(sector_wrap(start + VFH_S_MAX / 2), &best, &best_cost);
+            consider(sector_wrap(end - VFH_S_MAX / 2), &best, &best_cost);
+            if (sector_wrap(vfh_goal_sector - start) < len) {
+                consider(vfh_goal_sector, &best, &best_cost);
+            }
+            if (best_cost < prev_cost) best_narrow = false;
+        } else {
+            consider(sector_wrap(start + len / 2), &best, &best_cost);
+            if (best_cost < prev_cost) best_narrow = true;
+        }
+    }
+
+    *out_sector = best;
+    *out_narrow = best_narrow;
+    return true;
+}
+
+static void vfh_build_cmd(int64_t now_us, heading_cmd_steer_t *cmd) {
+    int16_t sector = 0;
+    bool narrow = false;
+
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->kind = HEADING_CMD_KIND_STEER;
+    cmd->seq = vfh_seq++;
+
+    if (vfh_last_point_us == 0 || (now_us - vfh_last_point_us) > VFH_LIDAR_STALE_US) {
+        cmd->flags = HEADING_CMD_FLAG_STALE | HEADING_CMD_FLAG_BLOCKED;
+        return;
+    }
+    if (!vfh_select(now_us, &sector, &narrow)) {
+        cmd->flags = HEADING_CMD_FLAG_BLOCKED;
+        return;
+    }
+    vfh_prev_sector = sector;
+
+    /* Slow down for large turns (turn in place beyond 90°) and narrow valleys */
+    int32_t scale = 256 - (sector_dist(sector, 0) * 256) / (VFH_SECTORS / 4);
+    if (scale < 0) scale = 0;
+    if (narrow) scale /= 2;
+
+    cmd->heading_mrad = sector_to_mrad(sector);
+    cmd->speed_scale_q8 = (uint16_t)scale;
+}
+
+static void vfh_step_frame(void) {
+    int64_t t0 = esp_timer_get_time();
+    heading_cmd_steer_t cmd;
+    vfh_build_cmd(t0, &cmd);
+
+    dispatch_target_t targets[TARGET_MAX];
+    dispatcher_fill_targets(targets);
+    targets[0] = TARGET_HEADING_CMD;
+    dispatcher_pool_send_params_t params = {
+        .type = DISPATCHER_POOL_STREAMING,
+        .source = SOURCE_VFH,
+        .targets = targets,
+        .data = (const uint8_t *)&cmd,
+        .data_len = sizeof(cmd),
+        .context = NULL
+    };
+    if (!dispatcher_pool_send_ptr_params(&params)) {
+        ESP_LOGW(TAG, "Pool send failed; dropping heading cmd");
+    }
+
+    int64_t t1 = esp_timer_get_time();
+    if (cmd.flags & HEADING_CMD_FLAG_STALE) return;
+
+    uint32_t compute_us = (uint32_t)(t1 - t0);
+    uint32_t latency_us = (uint32_t)(t1 - vfh_last_point_us);
+    stats_latency_sum_us += latency_us;
+    if (latency_us > stats_latency_max_us) stats_latency_max_us = latency_us;
+    if (compute_us > stats_compute_max_us) stats_compute_max_us = compute_us;
+    if (++stats_count >= VFH_STATS_DECISIONS) {
+        ESP_LOGI(TAG, "point->cmd latency avg %u us, max %u us; decide max %u us (%u decisions), %u stale bins aged out",
+                 (unsigned)(stats_latency_sum_us / stats_count), (unsigned)stats_latency_max_us,
+                 (unsigned)stats_compute_max_us, (unsigned)stats_count, (unsigned)vfh_swept);
+        vfh_swept = 0;
+        stats_latency_sum_us = 0;
+        stats_latency_max_us = 0;
+        stats_compute_max_us = 0;
+        stats_count = 0;
+    }
+}
+
+static void vfh_process_msg(const dispatcher_msg_t *msg) {
+    if (!msg) return;
+
+    switch (msg->source) {
+        case SOURCE_ULTRASONIC:
+            if (msg->message_len >= sizeof(uint16_t)) {
+                memcpy(&vfh_us_mm, msg->data, sizeof(uint16_t));
+                vfh_us_t_us = esp_timer_get_time();
+            }
+            break;
+        default:
+            if (msg->message_len >= sizeof(vfh_goal_t) && msg->data[0] == VFH_CMD_SET_GOAL) {
+                vfh_goal_t goal;
+                memcpy(&goal, msg->data, sizeof(goal));
+                vfh_goal_sector = mrad_to_sector(goal.goal_mrad);
+            }
+            break;
+    }
+}
+
+static dispatcher_module_t vfh_mod = {
+    .name = "vfh_task",
+    .target = TARGET_VFH,
+    .queue_len = 8,
+    .stack_size = 3072,
+    .task_prio = 7,
+    .process_msg = vfh_process_msg,
+    .step_frame = vfh_step_frame,
+    .step_ms = VFH_STEP_MS,
+    .queue = NULL
+};
+
+void mod_vfh_init(void) {
+    /* Enlargement half-width per distance step: ceil(asin(r / d) / sector) */
+    const float sector_rad = 2.0f * (float)M_PI / (float)VFH_SECTORS;
+    for (int i = 0; i < VFH_HW_LUT_LEN; ++i) {
+        float d = (float)(i * VFH_HW_LUT_STEP_MM + VFH_HW_LUT_STEP_MM / 2);
+        float ratio = (float)VFH_R_ENLARGE_MM / d;
+        float gamma = (ratio >= 1.0f) ? ((float)M_PI / 2.0f) : asinf(ratio);
+        vfh_hw_lut[i] = (uint8_t)ceilf(gamma / sector_rad);
+    }
+
+    if (dispatcher_module_start(&vfh_mod) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to start dispatcher module for vfh");
+        return;
+    }
+    lidar_scan_add_point_sink(vfh_point_sink);
+}
@@ -0,0 +1,188 @@
+// LIDAR scan viewer: binary frames from the /api/lidar/stream WebSocket
+// (see wifi_lidar_stream.h for the layout), drawn as points on a canvas.
+(function(global){
+  const CANVAS_ID = 'lidar-canvas';
+  const HDR_LEN = 16;
+
+  // Decode one frame. Returns { seq, tMs, bins, count, bin: Uint16Array, dist: Uint16Array }
+  function decodeFrame(buf) {
+    const dv = new DataView(buf);
+    if (buf.byteLength < HDR_LEN || dv.getUint8(0) !== 0x4C || dv.getUint8(1) !== 0x53) return null;
+    if (dv.getUint8(2) !== 1) return null;
+    const q = dv.getUint8(3);
+    const count = dv.getUint16(14, true);
+    const frame = {
+      seq: dv.getUint32(4, true),
+      tMs: dv.getUint32(8, true),
+      bins: dv.getUint16(12, true),
+      count: count,
+      bin: new Uint16Array(count),
+      dist: new Uint16Array(count)
+    };
+    const bytes = new Uint8Array(buf);
+    let p = HDR_LEN;
+    function varint() {
+      let v = 0, shift = 0, b;
+      do {
+        if (p >= bytes.length) throw new Error('truncated frame');
+        b = bytes[p++];
+        v += (b & 0x7F) * Math.pow(2, shift);
+        shift += 7;
+      } while (b & 0x80);
+      return v;
+    }
+    let bin = -1, dq = 0;
+    for (let i = 0; i < count; ++i) {
+      bin += varint();
+      const z = varint();
+      dq += (z & 1) ? -((z + 1) / 2) : z / 2;
+      frame.bin[i] = bin;
+      frame.dist[i] = Math.min(dq * (1 << q), 0xFFFF);
+    }
+    return frame;
+  }
+
+  const LidarStream = (function(){
+    let ws = null;
+    let wanted = false;
+    let backoffMs = 1000;
+    let latest = null;
+    let drawPending = false;
+    let rangeMm = 4000;
+    let fps = 10;
+    let qShift = 2;
+    let trig = null;          // per-bin [cos, sin], bins clockwise from forward
+    let lastSeq = null;
+    let missed = 0;
+
+    function setStatus(text) {
+      const el = document.getElementById('lidar-status');
+      if (el) el.textContent = text;
+    }
+
+    function ensureTrig(bins) {
+      if (trig && trig.bins === bins) return;
+      const c = new Float32Array(bins), s = new Float32Array(bins);
+      for (let b = 0; b < bins; ++b) {
+        const a = b * 2 * Math.PI / bins;
+        c[b] = Math.cos(a);
+        s[b] = Math.sin(a);
+      }
+      trig = { bins: bins, cos: c, sin: s };
+    }
+
+    // Robot frame (x forward, y left) drawn with forward up
+    function draw() {
+      drawPending = false;
+      const canvas = document.getElementById(CANVAS_ID);
+      if (!canvas || !latest) return;
+      const ctx = canvas.getContext('2d');
+      const w = canvas.width, h = canvas.height;
+      const cx = w / 2, cy = h / 2;
+      const scale = (Math.min(w, h) / 2) / rangeMm;
+      ctx.fillStyle = '#111';
+      ctx.fillRect(0, 0, w, h);
+      ctx.strokeStyle = '#333';
+      for (let r = 1000; r <= rangeMm; r += 1000) {
+        ctx.beginPath();
+        ctx.arc(cx, cy, r * scale, 0, 2 * Math.PI);
+        ctx.stroke();
+      }
+      ensureTrig(latest.bins);
+      ctx.fillStyle = '#4fc3f7';
+      for (let i = 0; i < latest.count; ++i) {
+        const d = latest.dist[i];
+        if (d > rangeMm) continue;
+        const b = latest.bin[i];
+        const x = d * trig.cos[b];     // forward
+        const y = -d * trig.sin[b];    // left (bins run clockwise)
+        ctx.fillRect(cx - y * scale - 1, cy - x * scale - 1, 2, 2);
+      }
+      ctx.fillStyle = '#f44';
+      ctx.fillRect(cx - 2, cy - 2, 4, 4);
+      setStatus('#' + latest.seq + '  ' + latest.count + ' pts' + (missed ? '  (' + missed + ' skipped)' : ''));
+    }
+
+    function onMessage(ev) {
+      if (!(ev.data instanceof ArrayBuffer)) return;
+      let frame;
+      try { frame = decodeFrame(ev.data); } catch (e) { console.warn('lidar frame', e); return; }
+      if (!frame) return;
+      if (lastSeq !== null && frame.seq > lastSeq + 1) missed += frame.seq - lastSeq - 1;
+      lastSeq = frame.seq;
+      latest = frame;
+      // Render at most once per animation frame; older frames are simply replaced
+      if (!drawPending) {
+        drawPending = true;
+        global.requestAnimationFrame(draw);
+      }
+    }
+
+    function url() {
+      const proto = global.location.protocol === 'https:' ? 'wss:' : 'ws:';
+      return proto + '//' + global.location.host + '/api/lidar/stream?fps=' + fps + '&q=' + qShift;
+    }
+
+    function connect() {
+      wanted = true;
+      if (ws) return;
+      ws = new WebSocket(url());
+      ws.binaryType = 'arraybuffer';
+      ws.onopen = function(){ backoffMs = 1000; lastSeq = null; missed = 0; setStatus('connected'); };
+      ws.onmessage = onMessage;
+      ws.onclose = function(){
+        ws = null;
+        setStatus(wanted ? 'reconnecting...' : 'disconnected');
+        if (wanted) {
+          setTimeout(function(){ if (wanted) connect(); }, backoffMs);
+          backoffMs = Math.min(backoffMs * 2, 30000);
+        }
+      };
+      ws.onerror = function(){ if (ws) ws.close(); };
+    }
+
+    function disconnect() {
+      wanted = false;
+      if (ws) ws.close();
+    }
+
+    // Push new rate/quantization to the server without reconnecting
+    function configure(opts) {
+      if (opts.fps) fps = opts.fps;
+      if (opts.q !== undefined) qShift = opts.q;
+      if (ws && ws.readyState === WebSocket.OPEN) ws.send('fps=' + fps + '&q=' + qShift);
+    }
+
+    function setRange(mm) {
+      rangeMm = mm;
+      if (latest && !drawPending) { drawPending = true; global.requestAnimationFrame(draw); }
+    }
+
+    return {
+      connect: connect,
+      disconnect: disconnect,
+      configure: configure,
+      setRange: setRange,
+      isConnected: function(){ return !!ws; }
+    };
+  })();
+
+  function init() {
+    const btn = document.getElementById('lidar-connect-btn');
+    if (btn) {
+      btn.addEventListener('click', function(){
+        if (LidarStream.isConnected()) { LidarStream.disconnect(); btn.textContent = 'Connect'; }
+        else { LidarStream.connect(); btn.textContent = 'Disconnect'; }
+      });
+    }
+    const range = document.getElementById('lidar-range');
+    if (range) range.addEventListener('change', function(){ LidarStream.setRange(parseInt(range.value, 10)); });
+    const rate = document.getElementById('lidar-fps');
+    if (rate) rate.addEventListener('change', function(){ LidarStream.configure({ fps: parseInt(rate.value, 10) }); });
+  }
+
+  global.LidarStream = LidarStream;
+  global.LidarStreamDecode = decodeFrame;
+  if (document.readyState === 'loading') document.addEventListener('DOMContentLoaded', init);
+  else init();
+})(window);
@@ -5,10 +5,13 @@
 #include "io_rgb.h"
 #include "rest_context.h"
 #include "wifi_sse.h"
+#include "wifi_lidar_stream.h"
+#include "lidar_scan_filter.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "cJSON.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -222,60 +225,58 @@ static esp_err_t upload_post_handler(httpd_req_t *req) {
         return serve_file(req, filepath, NULL);
     }
 
-// --- Unified dispatcher helper for REST handlers ---
-static esp_err_t dispatch_from_rest(const httpd_req_t *req, void *user_ctx, const void *data, size_t len) {
-    if (!user_ctx || !data || len == 0) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    dispatch_target_t target = (dispatch_target_t)(intptr_t)user_ctx;
-
-    if (dispatcher_has_ptr_queue(target)) {
-        pool_msg_t *pmsg = dispatcher_pool_try_alloc(DISPATCHER_POOL_CONTROL);
-        if (!pmsg) {
-            if (len == sizeof(rest_json_request_t)) {
-                rest_json_request_t *req_ctx = (rest_json_request_t *)data;
-                if (req_ctx->sem) xSemaphoreGive(req_ctx->sem);
-            }
-            return ESP_ERR_NO_MEM;
-        }
+// --- Dispatcher helpers for REST handlers ---
+// Commands copy their payload into the message; requests (GET and anything
+// else that waits for an answer) pass a rest_json_request_t as the message
+// context, optionally with a payload. On any failure the request's semaphore
+// is given so the waiting handler does not block until its timeout.
+static esp_err_t rest_request_abort(rest_json_request_t *ctx, esp_err_t err) {
+    if (ctx && ctx->sem) xSemaphoreGive(ctx->sem);
+    return err;
+}
 
-        dispatcher_msg_ptr_t *msg = dispatcher_pool_get_msg(pmsg);
-        if (!msg || !msg->data) {
-            dispatcher_pool_msg_unref(pmsg);
-            return ESP_FAIL;
-        }
+static esp_err_t rest_dispatch(dispatch_target_t target, const void *data, size_t len, rest_json_request_t *ctx) {
+    if (!dispatcher_has_ptr_queue(target)) {
+        ESP_LOGW(TAG, "rest_dispatch: target %d has no pointer queue; dropping", (int)target);
+        return rest_request_abort(ctx, ESP_FAIL);
+    }
+    pool_msg_t *pmsg = dispatcher_pool_try_alloc(DISPATCHER_POOL_CONTROL);
+    if (!pmsg) {
+        return rest_request_abort(ctx, ESP_ERR_NO_MEM);
+    }
+    dispatcher_msg_ptr_t *msg = dispatcher_pool_get_msg(pmsg);
+    if (!msg || !msg->data) {
+        dispatcher_pool_msg_unref(pmsg);
+        return rest_request_abort(ctx, ESP_FAIL);
+    }
 
-        msg->source = SOURCE_REST;
-        dispatcher_fill_targets(msg->targets);
-        msg->targets[0] = target;
-
-        if (len == sizeof(rest_json_request_t)) {
-            msg->context = (void *)data;
-            msg->message_len = 0;
-            ESP_LOGI(TAG, "dispatch_from_rest: REST GET (ptr), context=%p", msg->context);
-        } else {
-            size_t max_len = dispatcher_pool_payload_size(DISPATCHER_POOL_CONTROL);
-            size_t copy_len = len > max_len ? max_len : len;
-            memcpy(msg->data, data, copy_len);
-            msg->message_len = copy_len;
-            msg->context = NULL;
-            ESP_LOGI(TAG, "dispatch_from_rest: REST COMMAND (ptr), copying %d bytes", (int)copy_len);
-        }
+    msg->source = SOURCE_REST;
+    dispatcher_fill_targets(msg->targets);
+    msg->targets[0] = target;
+    size_t max_len = dispatcher_pool_payload_size(DISPATCHER_POOL_CONTROL);
+    size_t copy_len = len > max_len ? max_len : len;
+    if (copy_len) memcpy(msg->data, data, copy_len);
+    msg->message_len = copy_len;
+    msg->context = ctx;
+    ESP_LOGI(TAG, "rest_dispatch: REST %s (ptr), %d bytes, context=%p",
+             ctx ? "REQUEST" : "COMMAND", (int)copy_len, (void *)ctx);
+
+    int sent = dispatcher_broadcast_ptr(pmsg, msg->targets);
+    return sent > 0 ? ESP_OK : rest_request_abort(ctx, ESP_FAIL);
+}
 
-        int sent = dispatcher_broadcast_ptr(pmsg, msg->targets);
-        if (sent == 0 && len == sizeof(rest_json_request_t)) {
-            rest_json_request_t *req_ctx = (rest_json_request_t *)data;
-            if (req_ctx->sem) xSemaphoreGive(req_ctx->sem);
-        }
-        return sent > 0 ? ESP_OK : ESP_FAIL;
+static esp_err_t dispatch_from_rest(const httpd_req_t *req, void *user_ctx, const void *data, size_t len) {
+    if (!user_ctx || !data || len == 0) {
+        return ESP_ERR_INVALID_ARG;
     }
+    return rest_dispatch((dispatch_target_t)(intptr_t)user_ctx, data, len, NULL);
+}
 
-    ESP_LOGW(TAG, "dispatch_from_rest: target %d has no pointer queue; dropping", (int)target);
-    if (len == sizeof(rest_json_request_t)) {
-        rest_json_request_t *req_ctx = (rest_json_request_t *)data;
-        if (req_ctx->sem) xSemaphoreGive(req_ctx->sem);
+static esp_err_t dispatch_rest_request(void *user_ctx, rest_json_request_t *ctx, const void *data, size_t len) {
+    if (!user_ctx || !ctx || (len && !data)) {
+        return ESP_ERR_INVALID_ARG;
     }
-    return ESP_FAIL;
+    return rest_dispatch((dispatch_target_t)(intptr_t)user_ctx, data, len, ctx);
 }
 
 static char *rest_json_buf = NULL;
@@ -307,7 +308,7 @@ static esp_err_t json_get_handler(httpd_req_t *req) {
 
 
     // ESP_LOGI(TAG, "Dispatching REST GET for RGB JSON (target=%p, sem=%p)", target, rest_ctx.sem);
-    esp_err_t err = dispatch_from_rest(req, target, &rest_ctx, sizeof(rest_ctx));
+    esp_err_t err = dispatch_rest_request(target, &rest_ctx, NULL, 0);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Dispatch failed for RGB JSON");
         send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Dispatch failed");
@@ -330,6 +331,71 @@ static esp_err_t json_get_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/* Binary GET: same request/semaphore handshake as json_get_handler, but the
+ * module fills a larger buffer with raw bytes. Optional "ds" query parameter
+ * is passed to the module through user_data. */
+static uint8_t *rest_bin_buf = NULL;
+static size_t rest_bin_buf_len = 2 * 256 * 256 + 64;
+
+static esp_err_t binary_get_handler(httpd_req_t *req) {
+    if (!rest_bin_buf) {
+        rest_bin_buf = (uint8_t *)heap_caps_malloc(rest_bin_buf_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!rest_bin_buf) {
+            ESP_LOGE(TAG, "Failed to allocate rest_bin_buf");
+            send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server buffer not available");
+            return ESP_FAIL;
+        }
+    }
+
+    intptr_t arg = 0;
+    char query[32];
+    char val[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "ds", val, sizeof(val)) == ESP_OK) {
+        arg = (intptr_t)atoi(val);
+    }
+
+    size_t bin_len = 0;
+    rest_json_request_t rest_ctx = {
+        .json_buf = (char *)rest_bin_buf,
+        .buf_size = rest_bin_buf_len,
+        .json_len = &bin_len,
+        .sem = xSemaphoreCreateBinary(),
+        .user_data = (void *)arg
+    };
+
+    void *target = req->user_ctx;
+    if (!target) {
+        send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No target for binary GET");
+        vSemaphoreDelete(rest_ctx.sem);
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = dispatch_rest_request(target, &rest_ctx, NULL, 0);
+    if (err != ESP_OK) {
+        send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Dispatch failed");
+        vSemaphoreDelete(rest_ctx.sem);
+        return ESP_FAIL;
+    }
+
+    if (xSemaphoreTake(rest_ctx.sem, pdMS_TO_TICKS(20000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Timeout waiting for binary response");
+        send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Timeout waiting for data");
+        vSemaphoreDelete(rest_ctx.sem);
+        return ESP_FAIL;
+    }
+    vSemaphoreDelete(rest_ctx.sem);
+
+    if (bin_len == 0) {
+        send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No data");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_send(req, (const char *)rest_bin_buf, bin_len);
+    return ESP_OK;
+}
+
 static esp_err_t rgb_handler(httpd_req_t *req) {
     switch(req->method) {
         case HTTP_GET:
@@ -410,6 +476,76 @@ static esp_err_t rgb_reload_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/* POST /api/lidar/filter: JSON object with any of the lidar_scan_filter_cfg_t
+ * keys. The LIDAR coordinator applies it and answers with the configuration
+ * it ended up with (values clamped to their ranges); only that is saved for
+ * the next boot and returned. GET on the same URI returns the active
+ * configuration. */
+static esp_err_t lidar_filter_handler(httpd_req_t *req) {
+    if (!rest_json_buf) {
+        send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server buffer not available");
+        return ESP_FAIL;
+    }
+    uint8_t data[256];
+    size_t cap = dispatcher_pool_payload_size(DISPATCHER_POOL_CONTROL);
+    if (cap > sizeof(data)) cap = sizeof(data);
+    if (req->content_len == 0 || req->content_len > cap - 2) {
+        send_http_error(req, HTTPD_400_BAD_REQUEST, "Filter JSON missing or too large");
+        return ESP_FAIL;
+    }
+    int ret = httpd_req_recv(req, (char *)data + 1, req->content_len);
+    if (ret <= 0) {
+        send_http_error(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        return ESP_FAIL;
+    }
+    data[1 + ret] = '\0';
+
+    cJSON *json = cJSON_Parse((const char *)data + 1);
+    if (!cJSON_IsObject(json)) {
+        cJSON_Delete(json);
+        send_http_error(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+    cJSON_Delete(json);
+
+    data[0] = LIDAR_FILTER_CTRL_JSON;
+    size_t json_len = 0;
+    rest_json_request_t rest_ctx = {
+        .json_buf = rest_json_buf,
+        .buf_size = rest_json_buf_len,
+        .json_len = &json_len,
+        .sem = xSemaphoreCreateBinary(),
+        .user_data = NULL
+    };
+    esp_err_t err = dispatch_rest_request((void*)(intptr_t)TARGET_LIDAR_COORD, &rest_ctx, data, 1 + (size_t)ret);
+    if (err != ESP_OK) {
+        send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Dispatch failed");
+        vSemaphoreDelete(rest_ctx.sem);
+        return ESP_FAIL;
+    }
+    if (xSemaphoreTake(rest_ctx.sem, pdMS_TO_TICKS(20000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Timeout waiting for LIDAR filter result");
+        send_http_error(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Timeout waiting for filter result");
+        vSemaphoreDelete(rest_ctx.sem);
+        return ESP_FAIL;
+    }
+    vSemaphoreDelete(rest_ctx.sem);
+    if (json_len == 0) {
+        send_http_error(req, HTTPD_400_BAD_REQUEST, "Filter configuration rejected");
+        return ESP_FAIL;
+    }
+
+    FILE *f = fopen(LIDAR_FILTER_JSON_PATH, "wb");
+    if (!f || fwrite(rest_json_buf, 1, json_len, f) != json_len) {
+        ESP_LOGW(TAG, "Failed to save %s", LIDAR_FILTER_JSON_PATH);
+    }
+    if (f) fclose(f);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, rest_json_buf, json_len);
+    return ESP_OK;
+}
+
 static esp_err_t images_list_handler(httpd_req_t *req) {
     char file_list[32][64]; // Up to 32 files, 63 chars each
     int count = io_fatfs_list_files("/data/images", file_list, 32);
@@ -507,8 +643,8 @@ void wifi_http_server_start(void)
 
     // Ensure the httpd instance has enough slots for all routes we plan to register
     size_t route_count = sizeof(http_server_routes) / sizeof(http_server_routes[0]);
-    /* +2 for SSE handlers, +1 for catch-all route registered after SSE */
-    config.max_uri_handlers = (int)route_count + 3;
+    /* +2 for SSE handlers, +1 for the LIDAR stream, +1 for catch-all route registered last */
+    config.max_uri_handlers = (int)route_count + 4;
     // ESP_LOGI(TAG, "Setting max_uri_handlers = %d", config.max_uri_handlers);
 
     // ESP_LOGI(TAG, "Starting HTTP server on port %d", config.server_port);
@@ -519,6 +655,10 @@ void wifi_http_server_start(void)
         if (rc != ESP_OK) {
             ESP_LOGW(TAG, "SSE broker failed to start (rc=%d); continuing without SSE", rc);
         }
+        rc = wifi_lidar_stream_init(server);
+        if (rc != ESP_OK) {
+            ESP_LOGW(TAG, "LIDAR stream unavailable (rc=%d)", rc);
+        }
         /* Register catch-all static file handler last to avoid masking specific routes */
         httpd_uri_t catch_all = {
             .uri = "/*",
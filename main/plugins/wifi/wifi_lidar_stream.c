@@ -0,0 +1,309 @@
+#include "wifi_lidar_stream.h"
+#include "dispatcher.h"
+#include "dispatcher_module.h"
+#include "lidar_scan.h"
+#include "lidar_scan_codec.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "wifi_lidar_stream";
+
+#if CONFIG_HTTPD_WS_SUPPORT
+
+#define LS_FRAME_MAX        (sizeof(lidar_stream_hdr_t) + LIDAR_SCAN_CODEC_MAX_BYTES)
+/* Busy clients pin at most one buffer each, so one per client always suffices */
+#define LS_BUF_COUNT        LIDAR_STREAM_MAX_CLIENTS
+#define LS_CTRL_MAX         32
+#define LS_STATS_FRAMES     100
+
+typedef struct {
+    int      fd;                // 0 = free slot
+    bool     busy;              // a frame is queued on the socket
+    uint8_t  q_shift;
+    uint32_t interval_us;
+    int64_t  last_sent_us;
+    uint32_t sent;
+    uint32_t dropped;
+} ls_client_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t   len;
+    uint32_t seq;
+    uint8_t  q_shift;
+    uint8_t  refs;              // clients this buffer is in flight to
+} ls_buf_t;
+
+static httpd_handle_t ls_server = NULL;
+static SemaphoreHandle_t ls_mutex = NULL;
+static ls_client_t ls_clients[LIDAR_STREAM_MAX_CLIENTS];
+static ls_buf_t ls_bufs[LS_BUF_COUNT];
+
+static uint32_t stats_frames = 0;
+static uint32_t stats_sent = 0;
+static uint32_t stats_dropped = 0;
+static uint64_t stats_bytes = 0;
+static uint64_t stats_encode_us = 0;
+static uint32_t stats_encodes = 0;
+
+static void wifi_lidar_stream_process_msg(const dispatcher_msg_t *msg);
+static dispatcher_module_t wifi_lidar_stream_mod = {
+    .name = "wifi_lidar_stream",
+    .target = TARGET_LIDAR_STREAM,
+    .queue_len = 2,
+    .stack_size = 3072,
+    .task_prio = tskIDLE_PRIORITY + 2,
+    .process_msg = wifi_lidar_stream_process_msg,
+    .step_frame = NULL,
+    .step_ms = 0,
+    .queue = NULL
+};
+
+/* Header plus lidar_scan_codec body. Returns bytes written. */
+static size_t ls_encode(const lidar_scan_frame_t *frame, uint8_t q_shift, uint8_t *out) {
+    lidar_stream_hdr_t hdr = {
+        .magic = { LIDAR_STREAM_MAGIC0, LIDAR_STREAM_MAGIC1 },
+        .version = LIDAR_STREAM_VERSION,
+        .q_shift = q_shift,
+        .seq = frame->seq,
+        .t_ms = (uint32_t)(frame->t_end_us / 1000),
+        .bins = LIDAR_SCAN_BINS,
+        .count = 0
+    };
+    uint16_t count = 0;
+    size_t n = lidar_scan_codec_encode(frame->dist_mm, q_shift, out + sizeof(hdr), &count);
+    hdr.count = count;
+    memcpy(out, &hdr, sizeof(hdr));
+    return sizeof(hdr) + n;
+}
+
+/* Encoded copy of this frame at this quantization, encoding it on first use.
+ * Called with ls_mutex held. */
+static ls_buf_t *ls_get_buf(const lidar_scan_frame_t *frame, uint8_t q_shift) {
+    ls_buf_t *free_buf = NULL;
+    for (int i = 0; i < LS_BUF_COUNT; ++i) {
+        ls_buf_t *b = &ls_bufs[i];
+        if (!b->data) continue;
+        if (b->len && b->seq == frame->seq && b->q_shift == q_shift) return b;
+        if (b->refs == 0 && !free_buf) free_buf = b;
+    }
+    if (!free_buf) return NULL;
+
+    int64_t t0 = esp_timer_get_time();
+    free_buf->len = ls_encode(frame, q_shift, free_buf->data);
+    free_buf->seq = frame->seq;
+    free_buf->q_shift = q_shift;
+    stats_encode_us += (uint64_t)(esp_timer_get_time() - t0);
+    stats_encodes++;
+    return free_buf;
+}
+
+static ls_client_t *ls_find_client(int fd) {
+    for (int i = 0; i < LIDAR_STREAM_MAX_CLIENTS; ++i) {
+        if (ls_clients[i].fd == fd) return &ls_clients[i];
+    }
+    return NULL;
+}
+
+static void ls_drop_client(ls_client_t *c, const char *why) {
+    ESP_LOGI(TAG, "Client fd=%d %s (sent %u, dropped %u)", c->fd, why,
+             (unsigned)c->sent, (unsigned)c->dropped);
+    memset(c, 0, sizeof(*c));
+}
+
+/* Parse "fps=N&q=N" (handshake query or text message) into client settings */
+static void ls_apply_params(ls_client_t *c, const char *query) {
+    char val[8];
+    if (httpd_query_key_value(query, "fps", val, sizeof(val)) == ESP_OK) {
+        int fps = atoi(val);
+        if (fps < 1) fps = 1;
+        if (fps > LIDAR_STREAM_MAX_FPS) fps = LIDAR_STREAM_MAX_FPS;
+        c->interval_us = 1000000u / (uint32_t)fps;
+    }
+    if (httpd_query_key_value(query, "q", val, sizeof(val)) == ESP_OK) {
+        int q = atoi(val);
+        if (q < 0) q = 0;
+        if (q > LIDAR_STREAM_MAX_Q_SHIFT) q = LIDAR_STREAM_MAX_Q_SHIFT;
+        c->q_shift = (uint8_t)q;
+    }
+}
+
+/* httpd task: the queued frame went out (or failed) */
+static void ls_send_done(esp_err_t err, int fd, void *arg) {
+    ls_buf_t *b = (ls_buf_t *)arg;
+    xSemaphoreTake(ls_mutex, portMAX_DELAY);
+    if (b->refs) b->refs--;
+    ls_client_t *c = ls_find_client(fd);
+    if (c) {
+        c->busy = false;
+        if (err != ESP_OK) ls_drop_client(c, "send failed");
+    }
+    xSemaphoreGive(ls_mutex);
+}
+
+static void ls_log_stats(void) {
+    if (++stats_frames < LS_STATS_FRAMES) return;
+    int clients = 0;
+    for (int i = 0; i < LIDAR_STREAM_MAX_CLIENTS; ++i) {
+        if (ls_clients[i].fd) clients++;
+    }
+    ESP_LOGI(TAG, "%d clients, %u sent / %u dropped over %u frames, avg %u B, encode avg %u us",
+             clients, (unsigned)stats_sent, (unsigned)stats_dropped, (unsigned)stats_frames,
+             stats_sent ? (unsigned)(stats_bytes / stats_sent) : 0,
+             stats_encodes ? (unsigned)(stats_encode_us / stats_encodes) : 0);
+    stats_frames = stats_sent = stats_dropped = stats_encodes = 0;
+    stats_bytes = stats_encode_us = 0;
+}
+
+static void ls_send_frame(const lidar_scan_frame_t *frame) {
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(ls_mutex, portMAX_DELAY);
+    for (int i = 0; i < LIDAR_STREAM_MAX_CLIENTS; ++i) {
+        ls_client_t *c = &ls_clients[i];
+        if (!c->fd) continue;
+        if (httpd_ws_get_fd_info(ls_server, c->fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            ls_drop_client(c, "disconnected");
+            continue;
+        }
+        /* 3/4 of the interval so scan-period jitter does not halve the rate */
+        if (now - c->last_sent_us < (int64_t)(c->interval_us * 3 / 4)) continue;
+        if (c->busy) {
+            c->dropped++;
+            stats_dropped++;
+            continue;
+        }
+        ls_buf_t *b = ls_get_buf(frame, c->q_shift);
+        if (!b) {
+            c->dropped++;
+            stats_dropped++;
+            continue;
+        }
+        httpd_ws_frame_t ws = {
+            .final = true,
+            .fragmented = false,
+            .type = HTTPD_WS_TYPE_BINARY,
+            .payload = b->data,
+            .len = b->len
+        };
+        b->refs++;
+        c->busy = true;
+        if (httpd_ws_send_data_async(ls_server, c->fd, &ws, ls_send_done, b) != ESP_OK) {
+            b->refs--;
+            ls_drop_client(c, "queue failed");
+            continue;
+        }
+        c->last_sent_us = now;
+        c->sent++;
+        stats_sent++;
+        stats_bytes += b->len;
+    }
+    xSemaphoreGive(ls_mutex);
+    ls_log_stats();
+}
+
+static void wifi_lidar_stream_process_msg(const dispatcher_msg_t *msg) {
+    const lidar_scan_frame_t *frame = lidar_scan_frame_from_msg(msg);
+    if (frame) ls_send_frame(frame);
+    lidar_scan_frame_done(msg);
+}
+
+static esp_err_t wifi_lidar_stream_handler(httpd_req_t *req) {
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET) {
+        /* Handshake: claim a slot and take the initial settings from the query */
+        char query[LS_CTRL_MAX] = {0};
+        bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+        xSemaphoreTake(ls_mutex, portMAX_DELAY);
+        ls_client_t *c = ls_find_client(0);
+        unsigned fps = 0, q = 0;
+        if (c) {
+            c->fd = fd;
+            c->interval_us = 1000000u / LIDAR_STREAM_DEFAULT_FPS;
+            if (have_query) ls_apply_params(c, query);
+            fps = 1000000u / c->interval_us;
+            q = c->q_shift;
+        }
+        xSemaphoreGive(ls_mutex);
+        if (!c) {
+            ESP_LOGW(TAG, "Client limit reached; rejecting fd=%d", fd);
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Client fd=%d connected (%u fps, q=%u)", fd, fps, q);
+        return ESP_OK;
+    }
+
+    /* Text message from the client: new settings, same key=value form */
+    httpd_ws_frame_t pkt = { .type = HTTPD_WS_TYPE_TEXT };
+    esp_err_t err = httpd_ws_recv_frame(req, &pkt, 0);
+    if (err != ESP_OK) return err;
+    if (pkt.len == 0 || pkt.len >= LS_CTRL_MAX) return ESP_OK;
+    char text[LS_CTRL_MAX] = {0};
+    pkt.payload = (uint8_t *)text;
+    err = httpd_ws_recv_frame(req, &pkt, sizeof(text) - 1);
+    if (err != ESP_OK || pkt.type != HTTPD_WS_TYPE_TEXT) return err;
+    xSemaphoreTake(ls_mutex, portMAX_DELAY);
+    ls_client_t *c = ls_find_client(fd);
+    if (c) ls_apply_params(c, text);
+    xSemaphoreGive(ls_mutex);
+    return ESP_OK;
+}
+
+esp_err_t wifi_lidar_stream_init(httpd_handle_t server) {
+    if (!server) return ESP_ERR_INVALID_ARG;
+    if (ls_server) return ESP_OK;
+
+    if (!ls_mutex) {
+        ls_mutex = xSemaphoreCreateMutex();
+        if (!ls_mutex) return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < LS_BUF_COUNT; ++i) {
+        if (ls_bufs[i].data) continue;
+        ls_bufs[i].data = heap_caps_malloc(LS_FRAME_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!ls_bufs[i].data) {
+            ESP_LOGW(TAG, "PSRAM alloc failed for stream buffer %d; using internal RAM", i);
+            ls_bufs[i].data = malloc(LS_FRAME_MAX);
+        }
+        if (!ls_bufs[i].data) {
+            ESP_LOGE(TAG, "Failed to allocate stream buffer %d", i);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    httpd_uri_t uri = {
+        .uri = LIDAR_STREAM_URI,
+        .method = HTTP_GET,
+        .handler = wifi_lidar_stream_handler,
+        .user_ctx = NULL,
+        .is_websocket = true
+    };
+    esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s", LIDAR_STREAM_URI);
+        return err;
+    }
+    ls_server = server;
+
+    if (dispatcher_module_start(&wifi_lidar_stream_mod) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to start dispatcher module for wifi_lidar_stream");
+        return ESP_FAIL;
+    }
+    lidar_scan_subscribe(TARGET_LIDAR_STREAM);
+    ESP_LOGI(TAG, "LIDAR stream on %s", LIDAR_STREAM_URI);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t wifi_lidar_stream_init(httpd_handle_t server) {
+    (void)server;
+    ESP_LOGW(TAG, "CONFIG_HTTPD_WS_SUPPORT is off; %s disabled", LIDAR_STREAM_URI);
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
@@ -0,0 +1,52 @@
+#ifndef WIFI_LIDAR_STREAM_H
+#define WIFI_LIDAR_STREAM_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary LIDAR frame stream on /api/lidar/stream (WebSocket).
+ *
+ * Every completed 360° frame is delta-encoded once per quantization step and
+ * pushed to each client as one binary WS message. Clients choose their rate
+ * and quantization in the handshake query (?fps=10&q=2) or later with a text
+ * message in the same form. A client whose previous frame is still in flight
+ * skips frames instead of queueing them.
+ *
+ * Message layout (little endian):
+ *   lidar_stream_hdr_t
+ *   count points in lidar_scan_codec form (see lidar_scan_codec.h)
+ */
+#define LIDAR_STREAM_URI            "/api/lidar/stream"
+#define LIDAR_STREAM_MAGIC0         'L'
+#define LIDAR_STREAM_MAGIC1         'S'
+#define LIDAR_STREAM_VERSION        1
+
+#define LIDAR_STREAM_MAX_CLIENTS    4
+#define LIDAR_STREAM_DEFAULT_FPS    10
+#define LIDAR_STREAM_MAX_FPS        20
+#define LIDAR_STREAM_MAX_Q_SHIFT    5       // 32 mm quantum
+
+typedef struct __attribute__((packed)) {
+    uint8_t  magic[2];
+    uint8_t  version;
+    uint8_t  q_shift;
+    uint32_t seq;           // lidar_scan_frame_t.seq
+    uint32_t t_ms;          // frame end, ms since boot
+    uint16_t bins;          // LIDAR_SCAN_BINS
+    uint16_t count;         // encoded points
+} lidar_stream_hdr_t;
+
+/* Register the WS handler on the shared server and start the frame module */
+esp_err_t wifi_lidar_stream_init(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WIFI_LIDAR_STREAM_H
@@ -88,6 +88,7 @@ static const char *target_to_event_name(dispatch_target_t t) {
     switch (t) {
         case TARGET_SSE_CONSOLE: return "console";
         case TARGET_SSE_LINE_SENSOR: return "line_sensor";
+        case TARGET_SSE_LIDAR_FEATURES: return "lidar_features";
         case TARGET_SSE: return "sse";
         default: return NULL;
     }
@@ -173,6 +174,18 @@ static void wifi_sse_dispatch_common(dispatch_source_t source,
                 sse_free(b64buf);
                 break;
             }
+            case SOURCE_SCAN_FEATURES: {
+                /* One chunk: packed scan_features_hdr_t + lines + corners; decode client-side */
+                size_t b64_size = ((data_len + 2) / 3) * 4 + 1;
+                char *b64buf = (char *)sse_alloc_psram(b64_size);
+                if (b64buf && base64_encode(data, data_len, b64buf, b64_size)) {
+                    cJSON_AddStringToObject(root, "data_b64", b64buf);
+                }
+                cJSON_AddStringToObject(root, "schema", "lidar_features.v2");
+                cJSON_AddNumberToObject(root, "byte_count", (int)data_len);
+                sse_free(b64buf);
+                break;
+            }
             default: {
                 /* Add message bytes as a base64-safe string or plain text; for simplicity, treat as string */
                 cJSON_AddStringToObject(root, "data", (const char*)data);
@@ -208,6 +221,7 @@ static bool name_to_target(const char *name, dispatch_target_t *out) {
     if (!name || !out) return false;
     if (strcasecmp(name, "console") == 0) { *out = TARGET_SSE_CONSOLE; return true; }
     if (strcasecmp(name, "line_sensor") == 0) { *out = TARGET_SSE_LINE_SENSOR; return true; }
+    if (strcasecmp(name, "lidar_features") == 0) { *out = TARGET_SSE_LIDAR_FEATURES; return true; }
     if (strcasecmp(name, "sse") == 0) { *out = TARGET_SSE; return true; }
     return false;
 }
@@ -479,6 +493,7 @@ esp_err_t wifi_sse_init(httpd_handle_t server) {
         /* Register the same queue for additional SSE-related targets */
         dispatcher_register_ptr_queue(TARGET_SSE_CONSOLE, wifi_sse_mod.queue);
         dispatcher_register_ptr_queue(TARGET_SSE_LINE_SENSOR, wifi_sse_mod.queue);
+        dispatcher_register_ptr_queue(TARGET_SSE_LIDAR_FEATURES, wifi_sse_mod.queue);
     }
 
     ESP_LOGI(TAG, "SSE handlers registered on shared HTTP server");
@@ -491,6 +506,7 @@ esp_err_t wifi_sse_deinit(void) {
         /* Unregister additional targets and delete the queue */
         dispatcher_register_ptr_queue(TARGET_SSE_CONSOLE, NULL);
         dispatcher_register_ptr_queue(TARGET_SSE_LINE_SENSOR, NULL);
+        dispatcher_register_ptr_queue(TARGET_SSE_LIDAR_FEATURES, NULL);
         vQueueDelete(wifi_sse_mod.queue);
         wifi_sse_mod.queue = NULL;
     }
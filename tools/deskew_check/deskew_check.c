@@ -0,0 +1,188 @@
+// deskew_check.c
+// Host check of the LIDAR motion de-skew (main/plugins/RPLIDAR/lidar_deskew.c).
+// Builds the module unchanged against the stand-ins in host/ and feeds it a
+// synthetic frame taken while the robot drives an arc:
+//
+//   - the robot moves at a constant forward speed and yaw rate; its true pose
+//     at any time is the exact arc, not the module's integration,
+//   - odometry samples arrive every ODOM_PERIOD_US, as io_encoder sends them,
+//   - each bin is sampled at its own time across the revolution, from a world
+//     point RANGE_MIN_MM..RANGE_MAX_MM away in the bin's direction,
+//   - x_mm/y_mm are filled as lidar_cartesian does (x forward, y left, bin
+//     angle clockwise).
+//
+// The reference for every bin is its world point seen from the true pose at
+// t_end_us. The check prints the max and RMS error of the raw Cartesian view
+// and of the de-skewed one. It fails if the de-skewed max is above the step
+// bound: a point is moved with the pose at the middle of its step, so it can
+// be off by the motion over half a step (LIDAR_DESKEW_STEPS per frame), plus
+// ROUNDING_MM for the integer x/y and Q14 rotation. Where the raw error is
+// large it must also shrink at least MIN_GAIN times.
+//
+// Build and run from the repository root: see README.md.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lidar_deskew.h"
+
+#define FRAME_SPAN_US       150000      // one revolution, ~6.7 Hz
+#define ODOM_PERIOD_US      100000      // io_encoder publishes about every 100 ms
+#define T_START_US          1000000     // frame start, from the case's time origin
+#define CASE_SPACING_US     10000000    // each case starts this much later
+#define RANGE_MIN_MM        2000
+#define RANGE_MAX_MM        3000
+
+#define ROUNDING_MM         2.0
+#define MIN_GAIN            10.0
+#define MIN_RAW_FOR_GAIN_MM 100.0
+
+typedef struct {
+    double v_mm_s;
+    double w_rad_s;
+    const char *name;
+} deskew_case_t;
+
+static const deskew_case_t cases[] = {
+    { 500.0, 1.0, "0.5 m/s, 1 rad/s turn" },
+    { 500.0, 0.0, "0.5 m/s straight" },
+    {   0.0, 1.0, "1 rad/s spin in place" },
+    { 300.0, -2.0, "0.3 m/s, -2 rad/s turn" },
+};
+
+static int64_t host_now_us = 0;
+
+int64_t esp_timer_get_time(void)
+{
+    return host_now_us;
+}
+
+static lidar_scan_frame_t frame;
+
+typedef struct {
+    double x;
+    double y;
+    double th;
+} pose_t;
+
+// Exact pose at time t for constant v, w, starting at the origin at t = 0
+static pose_t true_pose(const deskew_case_t *c, int64_t t_us)
+{
+    double t = (double)t_us * 1e-6;
+    double th = c->w_rad_s * t;
+    pose_t p = { .th = th };
+    if (fabs(c->w_rad_s) < 1e-9) {
+        p.x = c->v_mm_s * t;
+        p.y = 0.0;
+    } else {
+        double r = c->v_mm_s / c->w_rad_s;
+        p.x = r * sin(th);
+        p.y = r * (1.0 - cos(th));
+    }
+    return p;
+}
+
+static void to_world(pose_t p, double lx, double ly, double *wx, double *wy)
+{
+    *wx = p.x + cos(p.th) * lx - sin(p.th) * ly;
+    *wy = p.y + sin(p.th) * lx + cos(p.th) * ly;
+}
+
+static void to_local(pose_t p, double wx, double wy, double *lx, double *ly)
+{
+    double dx = wx - p.x;
+    double dy = wy - p.y;
+    *lx = cos(p.th) * dx + sin(p.th) * dy;
+    *ly = -sin(p.th) * dx + cos(p.th) * dy;
+}
+
+static int run_case(const deskew_case_t *c, int64_t base_us)
+{
+    // The module keeps its history across cases; each case starts later on
+    // the clock, so its frame only sees its own samples. Only poses relative
+    // to t_end matter, so the pose the history carries over is irrelevant.
+    int64_t t_end = T_START_US + FRAME_SPAN_US;
+    for (int64_t t = 0; t <= t_end; t += ODOM_PERIOD_US) {
+        lidar_deskew_odom_t odom = {
+            .cmd = LIDAR_DESKEW_CTRL_ODOM,
+            .flags = LIDAR_DESKEW_ODOM_HAS_V | LIDAR_DESKEW_ODOM_HAS_W,
+            .v_mm_s = (int16_t)lrint(c->v_mm_s),
+            .w_mrad_s = (int16_t)lrint(c->w_rad_s * 1000.0),
+            .t_us = base_us + t,
+        };
+        host_now_us = base_us + t;
+        lidar_deskew_on_odom(&odom);
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.t_start_us = base_us + T_START_US;
+    frame.t_end_us = base_us + t_end;
+
+    static double ref_x[LIDAR_SCAN_BINS];
+    static double ref_y[LIDAR_SCAN_BINS];
+    pose_t end = true_pose(c, t_end);
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        int64_t rel = (int64_t)FRAME_SPAN_US * i / (LIDAR_SCAN_BINS - 1);
+        frame.t_rel[i] = (uint16_t)(rel >> LIDAR_SCAN_T_REL_SHIFT);
+        int64_t t = lidar_scan_bin_time_us(&frame, (uint16_t)i) - base_us;
+
+        double a = 2.0 * M_PI * i / LIDAR_SCAN_BINS;        // clockwise
+        double d = RANGE_MIN_MM + (i * 37) % (RANGE_MAX_MM - RANGE_MIN_MM);
+        double lx = d * cos(a);
+        double ly = -d * sin(a);
+        frame.dist_mm[i] = (uint16_t)lrint(d);
+        frame.x_mm[i] = (int16_t)lrint(lx);
+        frame.y_mm[i] = (int16_t)lrint(ly);
+
+        double wx, wy;
+        to_world(true_pose(c, t), lx, ly, &wx, &wy);
+        to_local(end, wx, wy, &ref_x[i], &ref_y[i]);
+    }
+
+    double raw_max = 0.0, raw_sq = 0.0;
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        double e = hypot(frame.x_mm[i] - ref_x[i], frame.y_mm[i] - ref_y[i]);
+        if (e > raw_max) raw_max = e;
+        raw_sq += e * e;
+    }
+
+    host_now_us = base_us + t_end;
+    lidar_deskew_apply(&frame);
+    if (!(frame.flags & LIDAR_SCAN_FLAG_DESKEWED)) {
+        printf("%-24s FAIL: frame not de-skewed\n", c->name);
+        return 1;
+    }
+
+    double fix_max = 0.0, fix_sq = 0.0;
+    for (int i = 0; i < LIDAR_SCAN_BINS; ++i) {
+        double e = hypot(frame.x_mm[i] - ref_x[i], frame.y_mm[i] - ref_y[i]);
+        if (e > fix_max) fix_max = e;
+        fix_sq += e * e;
+    }
+
+    double half_step_s = (double)FRAME_SPAN_US * 1e-6 / (2 * LIDAR_DESKEW_STEPS);
+    double bound = fabs(c->w_rad_s) * half_step_s * RANGE_MAX_MM + fabs(c->v_mm_s) * half_step_s + ROUNDING_MM;
+    // The gain is only demanded where the raw error is worth correcting
+    bool ok = fix_max <= bound && (raw_max < MIN_RAW_FOR_GAIN_MM || raw_max >= MIN_GAIN * fix_max);
+    printf("%-24s raw max %6.1f mm rms %6.1f mm | de-skewed max %5.1f mm rms %4.1f mm (bound %4.1f mm)  %s\n",
+           c->name, raw_max, sqrt(raw_sq / LIDAR_SCAN_BINS), fix_max, sqrt(fix_sq / LIDAR_SCAN_BINS),
+           bound, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    if (!lidar_deskew_init()) {
+        printf("lidar_deskew_init failed\n");
+        return 1;
+    }
+    printf("Frame %d ms, odometry every %d ms, ranges %d-%d mm, %d bins\n",
+           FRAME_SPAN_US / 1000, ODOM_PERIOD_US / 1000, RANGE_MIN_MM, RANGE_MAX_MM, LIDAR_SCAN_BINS);
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        failed += run_case(&cases[i], (int64_t)i * CASE_SPACING_US);
+    }
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+// Host stand-in for ESP-IDF logging
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+#include <stdio.h>
+#define ESP_LOGI(tag, fmt, ...) printf("I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) printf("W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+#endif // HOST_ESP_LOG_H
@@ -0,0 +1,6 @@
+// Host stand-in: the check drives the clock (deskew_check.c)
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+#include <stdint.h>
+int64_t esp_timer_get_time(void);
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,15 @@
+// Host stand-in for the FreeRTOS types the de-skew check pulls in
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef void *QueueHandle_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define portMAX_DELAY   ((TickType_t)0xffffffffUL)
+
+#endif // HOST_FREERTOS_H
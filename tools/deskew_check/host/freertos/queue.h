@@ -0,0 +1,5 @@
+// Host stand-in: dispatcher.h only needs the QueueHandle_t type
+#ifndef HOST_FREERTOS_QUEUE_H
+#define HOST_FREERTOS_QUEUE_H
+#include "freertos/FreeRTOS.h"
+#endif // HOST_FREERTOS_QUEUE_H
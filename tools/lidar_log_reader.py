@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""Reader for LIDAR scan recordings made by mod_scan_log (/data/lidar/scan_NNNN.bin).
+
+File layout and record encoding are described in main/include/mod_scan_log.h
+and main/plugins/RPLIDAR/lidar_scan_codec.h.
+
+Examples:
+    lidar_log_reader.py scan_0003.bin                  # summary
+    lidar_log_reader.py scan_0003.bin --frame 1200     # points of one frame (seeks via the index)
+    lidar_log_reader.py scan_0003.bin --csv out.csv    # every point: seq,t_ms,rpm,bin,angle_deg,dist_mm
+"""
+import argparse
+import csv
+import math
+import struct
+import sys
+
+FILE_MAGIC = 0x4E43534C     # "LSCN"
+REC_MAGIC = 0x5346          # "FS"
+FOOTER_MAGIC = 0x5844494C   # "LIDX"
+
+FILE_HDR = struct.Struct("<IHHHBBI16s")
+REC_HDR = struct.Struct("<HHIIHH")
+INDEX = struct.Struct("<III")
+FOOTER = struct.Struct("<IIII")
+
+
+class Frame:
+    __slots__ = ("seq", "t_ms", "rpm", "bins", "dist")
+
+    def points(self, bins_total):
+        """(bin, angle_deg, dist_mm) for every valid bin; angles clockwise from forward."""
+        return [(b, b * 360.0 / bins_total, d) for b, d in zip(self.bins, self.dist)]
+
+
+def _varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(buf):
+            raise ValueError("truncated varint")
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def decode_points(payload, count, q_shift):
+    bins = []
+    dist = []
+    pos = 0
+    b = -1
+    q = 0
+    for _ in range(count):
+        skip, pos = _varint(payload, pos)
+        z, pos = _varint(payload, pos)
+        b += skip
+        q += (z >> 1) ^ -(z & 1)
+        bins.append(b)
+        dist.append(q << q_shift)
+    return bins, dist
+
+
+class ScanLog:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if len(self.data) < FILE_HDR.size:
+            raise ValueError("file too short")
+        (magic, self.version, hdr_size, self.bins_total, self.q_shift, _,
+         self.start_ms, _) = FILE_HDR.unpack_from(self.data, 0)
+        if magic != FILE_MAGIC:
+            raise ValueError("not a scan log (bad magic)")
+        self.first_record = hdr_size
+        self.index = []
+        self.record_count = None
+        self.records_end = len(self.data)
+        self.complete = False
+        if len(self.data) >= hdr_size + FOOTER.size:
+            fmagic, icount, ioff, rcount = FOOTER.unpack_from(self.data, len(self.data) - FOOTER.size)
+            if fmagic == FOOTER_MAGIC and ioff + icount * INDEX.size + FOOTER.size == len(self.data):
+                self.index = [INDEX.unpack_from(self.data, ioff + i * INDEX.size) for i in range(icount)]
+                self.record_count = rcount
+                self.records_end = ioff
+                self.complete = True
+
+    def _read_record(self, pos):
+        if pos + REC_HDR.size > self.records_end:
+            return None, pos
+        magic, length, seq, t_ms, rpm_x10, count = REC_HDR.unpack_from(self.data, pos)
+        end = pos + REC_HDR.size + length
+        if magic != REC_MAGIC or end > self.records_end:
+            return None, pos
+        frame = Frame()
+        frame.seq = seq
+        frame.t_ms = t_ms
+        frame.rpm = rpm_x10 / 10.0
+        frame.bins, frame.dist = decode_points(self.data[pos + REC_HDR.size:end], count, self.q_shift)
+        return frame, end
+
+    def frames(self, start=None):
+        """Iterate frames from the start (or from a file offset)."""
+        pos = self.first_record if start is None else start
+        while True:
+            frame, pos = self._read_record(pos)
+            if frame is None:
+                return
+            yield frame
+
+    def find(self, seq):
+        """Frame with this sequence number: jump to the nearest index entry, then walk."""
+        start = None
+        for s, _, off in self.index:
+            if s > seq:
+                break
+            start = off
+        for frame in self.frames(start):
+            if frame.seq == seq:
+                return frame
+            if frame.seq > seq:
+                return None
+        return None
+
+
+def summary(log):
+    n = 0
+    first = last = None
+    rpm_sum = 0.0
+    points = 0
+    for frame in log.frames():
+        if first is None:
+            first = frame
+        last = frame
+        n += 1
+        rpm_sum += frame.rpm
+        points += len(frame.bins)
+    print("version %d, %d bins, q_shift %d, started at %.3f s" %
+          (log.version, log.bins_total, log.q_shift, log.start_ms / 1000.0))
+    if log.complete:
+        print("footer: %d records, %d index entries" % (log.record_count, len(log.index)))
+    else:
+        print("no footer (recording was cut short); records recovered by walking the file")
+    if n == 0:
+        print("no frames")
+        return
+    span = (last.t_ms - first.t_ms) / 1000.0
+    gaps = last.seq - first.seq + 1 - n
+    print("%d frames, seq %d..%d (%d not recorded), %.1f s" % (n, first.seq, last.seq, gaps, span))
+    print("avg %.0f points/frame, avg %.1f RPM, %.1f bytes/point" %
+          (points / n, rpm_sum / n, (log.records_end - log.first_record) / max(points, 1)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("file")
+    ap.add_argument("--frame", type=int, help="print the points of the frame with this seq")
+    ap.add_argument("--csv", help="write every point to this CSV file")
+    args = ap.parse_args()
+
+    log = ScanLog(args.file)
+    if args.frame is not None:
+        frame = log.find(args.frame)
+        if frame is None:
+            print("frame %d not found" % args.frame, file=sys.stderr)
+            return 1
+        print("seq %d  t %.3f s  %.1f RPM  %d points" % (frame.seq, frame.t_ms / 1000.0, frame.rpm, len(frame.bins)))
+        for b, angle, d in frame.points(log.bins_total):
+            a = math.radians(angle)
+            print("%4d %7.2f %6d  x %7.0f y %7.0f" % (b, angle, d, d * math.cos(a), -d * math.sin(a)))
+        return 0
+    if args.csv:
+        with open(args.csv, "w", newline="") as out:
+            w = csv.writer(out)
+            w.writerow(["seq", "t_ms", "rpm", "bin", "angle_deg", "dist_mm"])
+            for frame in log.frames():
+                for b, angle, d in frame.points(log.bins_total):
+                    w.writerow([frame.seq, frame.t_ms, frame.rpm, b, "%.2f" % angle, d])
+        return 0
+    summary(log)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
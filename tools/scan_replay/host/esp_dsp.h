@@ -0,0 +1,32 @@
+// Host stand-in for the esp-dsp calls the replayed modules make. Same
+// arithmetic as the library's ANSI versions (dsps_*_ansi.c), so results
+// match the target up to float rounding order.
+#ifndef HOST_ESP_DSP_H
+#define HOST_ESP_DSP_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+static inline esp_err_t dsps_dotprod_f32(const float *src1, const float *src2, float *dest, int len)
+{
+    float acc = 0;
+    for (int i = 0; i < len; i++) {
+        acc += src1[i] * src2[i];
+    }
+    *dest = acc;
+    return ESP_OK;
+}
+
+static inline esp_err_t dsps_mul_s16(const int16_t *input1, const int16_t *input2, int16_t *output,
+                                     int len, int step1, int step2, int step_out, int shift)
+{
+    for (int i = 0; i < len; i++) {
+        int ttt = (int)input1[i * step1] * (int)input2[i * step2];
+        output[i * step_out] = ttt >> shift;
+    }
+    return ESP_OK;
+}
+
+#endif // HOST_ESP_DSP_H
@@ -0,0 +1,12 @@
+// Host stand-in for ESP-IDF logging. Info lines are dropped: the modules'
+// periodic stats time themselves with esp_timer, which is the replay clock
+// here, so their figures would be meaningless. The replayers print host
+// timings instead.
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+#include <stdio.h>
+#define ESP_LOGI(tag, fmt, ...) do { } while (0)
+#define ESP_LOGW(tag, fmt, ...) printf("W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+#endif // HOST_ESP_LOG_H
@@ -0,0 +1,7 @@
+// Host stand-in: the replay drives the clock from the recorded frame times
+// (scan_replay.c)
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+#include <stdint.h>
+int64_t esp_timer_get_time(void);
+#endif // HOST_ESP_TIMER_H
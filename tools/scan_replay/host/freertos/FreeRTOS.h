@@ -0,0 +1,22 @@
+// Host stand-in for the FreeRTOS types the replayed modules pull in
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// The IDF's FreeRTOS.h pulls these in through its port headers, and the
+// modules rely on that
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *QueueHandle_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define portMAX_DELAY   ((TickType_t)0xffffffffUL)
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,7 @@
+// Host stand-in: the replay calls process_msg directly, so queues are never
+// created; dispatcher_module.h still names xQueueCreate in an inline helper
+#ifndef HOST_FREERTOS_QUEUE_H
+#define HOST_FREERTOS_QUEUE_H
+#include "freertos/FreeRTOS.h"
+static inline QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size) { (void)len; (void)item_size; return 0; }
+#endif // HOST_FREERTOS_QUEUE_H
@@ -0,0 +1,5 @@
+// Host stand-in: dispatcher_module.h includes this for the task types only
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+#include "freertos/FreeRTOS.h"
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,153 @@
+// scan_match_replay.c
+// Replays a LIDAR recording (mod_scan_log, /data/lidar/scan_NNNN.bin)
+// through the scan-match odometry (main/plugins/mod_scan_match.c), built
+// unchanged against the stand-ins in host/ and scan_replay.c:
+//
+//   - frames are delivered in file order; the replay clock is set to each
+//     frame's recorded end time, so the module's SCAN_MATCH_MIN_PERIOD_MS
+//     gate skips the same frames it would on the robot,
+//   - every odometry increment the module publishes is collected and chained
+//     into a pose from the first keyframe,
+//   - each module call is timed on the host clock.
+//
+// The recordings carry no ground truth. What the replay shows is how often
+// the matcher loses track or replaces its keyframe on real data, the inlier
+// count and residual it reaches, and the chained pose: for a recording that
+// returns to its start, the final pose is the accumulated drift.
+//
+// Build and run from the repository root: see README.md.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan_replay.h"
+#include "mod_scan_match.h"
+#include "heading_cmd.h"
+
+typedef struct {
+    uint32_t odoms;
+    uint32_t keyframes;
+    uint32_t lost;
+    uint64_t inliers_sum;
+    uint64_t rms_sum;
+    uint32_t matched;
+    double x_mm;
+    double y_mm;
+    double th_rad;
+    double path_mm;
+} replay_totals_t;
+
+static replay_totals_t totals;
+static FILE *csv = NULL;
+static bool have_odom = false;
+static heading_cmd_odom_t last_odom;
+
+static void on_send(const dispatcher_pool_send_params_t *params)
+{
+    if (params->targets[0] != TARGET_HEADING_CMD || params->data_len < sizeof(heading_cmd_odom_t)) return;
+    memcpy(&last_odom, params->data, sizeof(last_odom));
+    if (last_odom.kind != HEADING_CMD_KIND_ODOM) return;
+    have_odom = true;
+}
+
+static void account(const heading_cmd_odom_t *o, int64_t t_us, int64_t host_us)
+{
+    totals.odoms++;
+    if (o->flags & HEADING_CMD_ODOM_FLAG_KEYFRAME) totals.keyframes++;
+    if (o->flags & HEADING_CMD_ODOM_FLAG_LOST) {
+        totals.lost++;
+    } else if (o->inliers) {
+        // The first keyframe carries no increment and no inliers
+        double c = cos(totals.th_rad), s = sin(totals.th_rad);
+        totals.x_mm += c * o->dx_mm - s * o->dy_mm;
+        totals.y_mm += s * o->dx_mm + c * o->dy_mm;
+        totals.th_rad += o->dtheta_mrad * 1e-3;
+        totals.path_mm += hypot(o->dx_mm, o->dy_mm);
+        totals.inliers_sum += o->inliers;
+        totals.rms_sum += o->rms_mm;
+        totals.matched++;
+    }
+    if (csv) {
+        fprintf(csv, "%u,%lld,%u,%d,%d,%d,%u,%u,%lld,%.1f,%.1f,%.4f\n",
+                (unsigned)o->frame_seq, (long long)(t_us / 1000), (unsigned)o->flags,
+                o->dx_mm, o->dy_mm, o->dtheta_mrad, (unsigned)o->inliers, (unsigned)o->rms_mm,
+                (long long)host_us, totals.x_mm, totals.y_mm, totals.th_rad);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *csv_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path) {
+        printf("usage: %s scan_NNNN.bin [--csv out.csv]\n", argv[0]);
+        return 2;
+    }
+    if (!scan_replay_open(path)) return 1;
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            printf("%s: cannot create\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "seq,t_ms,flags,dx_mm,dy_mm,dtheta_mrad,inliers,rms_mm,host_us,x_mm,y_mm,theta_rad\n");
+    }
+
+    scan_replay_on_send = on_send;
+    mod_scan_match_init();
+    if (!scan_replay_module) {
+        printf("scan_match did not start its module\n");
+        return 1;
+    }
+
+    static lidar_scan_frame_t frame;
+    uint32_t frames = 0;
+    int64_t host_sum = 0, host_max = 0;
+    while (scan_replay_next(&frame)) {
+        frames++;
+        scan_replay_now_us = frame.t_end_us;
+        have_odom = false;
+        int64_t t0 = scan_replay_host_us();
+        scan_replay_deliver(&frame);
+        int64_t dt = scan_replay_host_us() - t0;
+        if (!have_odom) continue;       // skipped by the rate gate
+        account(&last_odom, frame.t_end_us, dt);
+        // Keyframe-only frames (first, lost) do no matching; time only matches
+        if (last_odom.inliers) {
+            host_sum += dt;
+            if (dt > host_max) host_max = dt;
+        }
+    }
+    if (csv) fclose(csv);
+
+    scan_replay_stats_t st;
+    scan_replay_get_stats(&st);
+    printf("%s: %u frames (%s%s), %u processed\n", path, (unsigned)frames,
+           st.complete ? "complete" : "no index, walked",
+           st.bad_records ? ", stopped at a damaged record" : "", (unsigned)totals.odoms);
+    if (totals.odoms == 0) {
+        printf("no frames reached the matcher\n");
+        return 1;
+    }
+    printf("matches %u, lost %u, keyframes %u\n", (unsigned)totals.matched, (unsigned)totals.lost,
+           (unsigned)totals.keyframes);
+    if (totals.matched) {
+        printf("inliers avg %.0f, residual avg %.1f mm, host time avg %lld us max %lld us\n",
+               (double)totals.inliers_sum / totals.matched, (double)totals.rms_sum / totals.matched,
+               (long long)(host_sum / totals.matched), (long long)host_max);
+    }
+    printf("chained pose: x %.0f mm, y %.0f mm, theta %.1f deg after %.0f mm of path\n",
+           totals.x_mm, totals.y_mm, totals.th_rad * 180.0 / M_PI, totals.path_mm);
+    return 0;
+}
@@ -0,0 +1,229 @@
+// scan_replay.c
+// Recording reader and module stand-ins shared by the scan replayers (see
+// scan_replay.h). The record decoder follows lidar_scan_codec.h and matches
+// tools/lidar_log_reader.py.
+
+#include "scan_replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lidar_cartesian.h"
+#include "mod_scan_log.h"
+
+#define REPLAY_FRAME_HANDLE 1u
+
+static uint8_t *log_data = NULL;
+static size_t log_size = 0;
+static size_t log_pos = 0;
+static size_t records_end = 0;
+static uint8_t q_shift = 0;
+static scan_replay_stats_t stats;
+
+static const lidar_scan_frame_t *cur_frame = NULL;
+
+int64_t scan_replay_now_us = 0;
+dispatcher_module_t *scan_replay_module = NULL;
+lidar_scan_point_sink_t scan_replay_point_sink = NULL;
+scan_replay_send_hook_t scan_replay_on_send = NULL;
+
+bool scan_replay_open(const char *path)
+{
+    scan_replay_close();
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    log_data = size > 0 ? malloc((size_t)size) : NULL;
+    if (!log_data || fread(log_data, 1, (size_t)size, f) != (size_t)size) {
+        printf("%s: read failed\n", path);
+        fclose(f);
+        scan_replay_close();
+        return false;
+    }
+    fclose(f);
+    log_size = (size_t)size;
+
+    scan_log_file_hdr_t hdr;
+    if (log_size < sizeof(hdr)) {
+        printf("%s: file too short\n", path);
+        scan_replay_close();
+        return false;
+    }
+    memcpy(&hdr, log_data, sizeof(hdr));
+    if (hdr.magic != SCAN_LOG_MAGIC || hdr.bins != LIDAR_SCAN_BINS || hdr.hdr_size < sizeof(hdr)) {
+        printf("%s: not a scan log with %d bins\n", path, LIDAR_SCAN_BINS);
+        scan_replay_close();
+        return false;
+    }
+    q_shift = hdr.q_shift;
+    log_pos = hdr.hdr_size;
+    records_end = log_size;
+
+    // A complete file ends with the index and footer; a file cut short by
+    // power loss has neither and is walked to its last whole record
+    scan_log_footer_t footer;
+    if (log_size >= hdr.hdr_size + sizeof(footer)) {
+        memcpy(&footer, log_data + log_size - sizeof(footer), sizeof(footer));
+        if (footer.magic == SCAN_LOG_FOOTER_MAGIC &&
+            (uint64_t)footer.index_offset + (uint64_t)footer.index_count * sizeof(scan_log_index_t) + sizeof(footer) == log_size) {
+            records_end = footer.index_offset;
+            stats.complete = true;
+        }
+    }
+    return true;
+}
+
+void scan_replay_close(void)
+{
+    free(log_data);
+    log_data = NULL;
+    log_size = 0;
+    log_pos = 0;
+    records_end = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void scan_replay_get_stats(scan_replay_stats_t *out)
+{
+    *out = stats;
+}
+
+static bool read_varint(const uint8_t *buf, size_t len, size_t *pos, uint32_t *out)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= len) return false;
+        uint8_t b = buf[(*pos)++];
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool decode_points(const uint8_t *buf, size_t len, uint16_t count, uint16_t *dist_mm)
+{
+    size_t pos = 0;
+    int32_t bin = -1;
+    int32_t q = 0;
+    for (uint16_t i = 0; i < count; ++i) {
+        uint32_t skip, z;
+        if (!read_varint(buf, len, &pos, &skip) || !read_varint(buf, len, &pos, &z)) return false;
+        bin += (int32_t)skip;
+        q += (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+        if (bin < 0 || bin >= LIDAR_SCAN_BINS || q <= 0) return false;
+        dist_mm[bin] = (uint16_t)(q << q_shift);
+    }
+    return true;
+}
+
+bool scan_replay_next(lidar_scan_frame_t *frame)
+{
+    if (!log_data) return false;
+    scan_log_rec_hdr_t rec;
+    if (log_pos + sizeof(rec) > records_end) return false;
+    memcpy(&rec, log_data + log_pos, sizeof(rec));
+    size_t payload = log_pos + sizeof(rec);
+    if (rec.magic != SCAN_LOG_REC_MAGIC || payload + rec.len > records_end) {
+        stats.bad_records++;
+        log_pos = records_end;
+        return false;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    if (!decode_points(log_data + payload, rec.len, rec.count, frame->dist_mm)) {
+        stats.bad_records++;
+        log_pos = records_end;
+        return false;
+    }
+    log_pos = payload + rec.len;
+    stats.frames++;
+
+    int64_t rot_us = rec.rpm_x10 ? 600000000LL / rec.rpm_x10 : SCAN_REPLAY_DEFAULT_ROT_US;
+    frame->seq = rec.seq;
+    frame->t_end_us = (int64_t)rec.t_ms * 1000;
+    frame->t_start_us = frame->t_end_us - rot_us;
+    frame->sample_count = rec.count;
+    frame->valid_count = rec.count;
+    for (int b = 0; b < LIDAR_SCAN_BINS; ++b) {
+        int64_t rel = rot_us * b / (LIDAR_SCAN_BINS - 1);
+        frame->t_rel[b] = (uint16_t)(rel >> LIDAR_SCAN_T_REL_SHIFT);
+    }
+    lidar_cartesian_convert(frame->dist_mm, frame->x_mm, frame->y_mm);
+    return true;
+}
+
+void scan_replay_deliver(const lidar_scan_frame_t *frame)
+{
+    if (!scan_replay_module || !scan_replay_module->process_msg) return;
+    static dispatcher_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    lidar_scan_msg_t hdr = {
+        .seq = frame->seq,
+        .sample_count = frame->sample_count,
+        .valid_count = frame->valid_count,
+        .handle = REPLAY_FRAME_HANDLE,
+    };
+    msg.source = SOURCE_LIDAR_SCAN;
+    msg.message_len = sizeof(hdr);
+    memcpy(msg.data, &hdr, sizeof(hdr));
+    cur_frame = frame;
+    scan_replay_module->process_msg(&msg);
+    cur_frame = NULL;
+}
+
+int64_t scan_replay_host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ---- Stand-ins for what the replayed module links against ----
+
+int64_t esp_timer_get_time(void)
+{
+    return scan_replay_now_us;
+}
+
+BaseType_t dispatcher_module_start(dispatcher_module_t *module)
+{
+    scan_replay_module = module;
+    return pdTRUE;
+}
+
+bool lidar_scan_subscribe(dispatch_target_t target)
+{
+    (void)target;
+    return true;
+}
+
+bool lidar_scan_add_point_sink(lidar_scan_point_sink_t sink)
+{
+    scan_replay_point_sink = sink;
+    return true;
+}
+
+lidar_scan_frame_t *lidar_frame_pool_get(lidar_frame_handle_t handle)
+{
+    return handle == REPLAY_FRAME_HANDLE ? (lidar_scan_frame_t *)cur_frame : NULL;
+}
+
+void lidar_frame_pool_release(lidar_frame_handle_t handle)
+{
+    (void)handle;
+}
+
+pool_msg_t *dispatcher_pool_send_ptr_params(const dispatcher_pool_send_params_t *params)
+{
+    static int token;
+    if (scan_replay_on_send) scan_replay_on_send(params);
+    return (pool_msg_t *)&token;
+}
@@ -0,0 +1,56 @@
+// scan_replay.h
+// Shared host side of the scan replayers (scan_match_replay.c, ...). Reads a
+// mod_scan_log recording (/data/lidar/scan_NNNN.bin, layout in
+// main/include/mod_scan_log.h) back into lidar_scan_frame_t, and stands in
+// for the dispatcher, frame pool, point-sink registry and clock that the
+// replayed module talks to, so the module builds unchanged.
+
+#ifndef SCAN_REPLAY_H
+#define SCAN_REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "dispatcher_module.h"
+#include "lidar_scan.h"
+
+// Rotation time assumed when a record has no motor speed (rpm_x10 == 0)
+#define SCAN_REPLAY_DEFAULT_ROT_US  150000
+
+typedef struct {
+    uint32_t frames;            // records decoded
+    uint32_t bad_records;       // records cut short or with a bad magic (end of a truncated file)
+    bool     complete;          // footer and index present
+} scan_replay_stats_t;
+
+// Open a recording. Prints the reason and returns false if it is not one.
+bool scan_replay_open(const char *path);
+
+// Next recorded frame, or false at the end. dist_mm, x_mm/y_mm (raw
+// Cartesian, lidar_cartesian_convert; recordings carry no pose, so no
+// de-skew), valid_count, seq and the times are filled. t_end_us is the
+// recorded frame end; t_start_us and t_rel[] spread the bins over one
+// rotation at the recorded motor speed.
+bool scan_replay_next(lidar_scan_frame_t *frame);
+
+void scan_replay_get_stats(scan_replay_stats_t *out);
+void scan_replay_close(void);
+
+// Replay clock returned by esp_timer_get_time()
+extern int64_t scan_replay_now_us;
+
+// Set when the module calls dispatcher_module_start / lidar_scan_add_point_sink
+extern dispatcher_module_t *scan_replay_module;
+extern lidar_scan_point_sink_t scan_replay_point_sink;
+
+// Called for every dispatcher_pool_send_ptr_params() the module makes
+typedef void (*scan_replay_send_hook_t)(const dispatcher_pool_send_params_t *params);
+extern scan_replay_send_hook_t scan_replay_on_send;
+
+// Announce a frame to the module as lidar_scan would (SOURCE_LIDAR_SCAN
+// message holding a frame handle) and run its process_msg
+void scan_replay_deliver(const lidar_scan_frame_t *frame);
+
+// Host monotonic clock for timing the module's own work
+int64_t scan_replay_host_us(void);
+
+#endif // SCAN_REPLAY_H
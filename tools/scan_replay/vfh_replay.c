@@ -0,0 +1,199 @@
+// vfh_replay.c
+// Replays a LIDAR recording (mod_scan_log, /data/lidar/scan_NNNN.bin)
+// through the VFH+ obstacle avoidance (main/plugins/mod_vfh.c), built
+// unchanged against the stand-ins in host/ and scan_replay.c:
+//
+//   - every recorded point goes to the module's point sink in bin order at
+//     its sample time, as the LIDAR coordinator would call it,
+//   - the module's step runs every VFH_STEP_MS of replay time, interleaved
+//     with the points, as its task would,
+//   - every steering command it publishes is collected,
+//   - the point sink and the step are timed on the host clock.
+//
+// The recording has no ultrasonic readings, so only the LIDAR feeds the
+// histogram. The output shows how often the module reports blocked or
+// stale, where it steers, and how much the heading jumps between
+// consecutive decisions.
+//
+// Build and run from the repository root: see README.md.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan_replay.h"
+#include "mod_vfh.h"
+#include "heading_cmd.h"
+
+#define POINT_QUALITY       40      // not recorded; recorded bins passed the quality gate
+#define HEADING_BUCKET_DEG  30
+
+typedef struct {
+    uint32_t decisions;
+    uint32_t blocked;
+    uint32_t stale;
+    uint32_t steered;
+    uint64_t scale_sum;
+    uint64_t jump_sum_mrad;
+    uint32_t jumps;
+    uint32_t jump_max_mrad;
+    uint32_t buckets[360 / HEADING_BUCKET_DEG];
+} replay_totals_t;
+
+static replay_totals_t totals;
+static FILE *csv = NULL;
+static bool have_prev = false;
+static int16_t prev_heading = 0;
+
+static void on_send(const dispatcher_pool_send_params_t *params)
+{
+    if (params->targets[0] != TARGET_HEADING_CMD || params->data_len < sizeof(heading_cmd_steer_t)) return;
+    heading_cmd_steer_t cmd;
+    memcpy(&cmd, params->data, sizeof(cmd));
+    if (cmd.kind != HEADING_CMD_KIND_STEER) return;
+
+    totals.decisions++;
+    if (cmd.flags & HEADING_CMD_FLAG_STALE) {
+        totals.stale++;
+        have_prev = false;
+    } else if (cmd.flags & HEADING_CMD_FLAG_BLOCKED) {
+        totals.blocked++;
+        have_prev = false;
+    } else {
+        totals.steered++;
+        totals.scale_sum += cmd.speed_scale_q8;
+        // Headings are CCW from forward in (-pi, pi]; offset by 180° so the
+        // buckets run from -180° up
+        int deg = (int)lrint(cmd.heading_mrad * 0.18 / M_PI) + 180;
+        int bucket = (deg % 360) / HEADING_BUCKET_DEG;
+        totals.buckets[bucket]++;
+        if (have_prev) {
+            uint32_t jump = (uint32_t)abs(cmd.heading_mrad - prev_heading);
+            if (jump > 3142) jump = 6283 - jump;    // across ±180°
+            totals.jump_sum_mrad += jump;
+            totals.jumps++;
+            if (jump > totals.jump_max_mrad) totals.jump_max_mrad = jump;
+        }
+        prev_heading = cmd.heading_mrad;
+        have_prev = true;
+    }
+    if (csv) {
+        fprintf(csv, "%lld,%u,%u,%d,%u\n", (long long)(scan_replay_now_us / 1000), (unsigned)cmd.seq,
+                (unsigned)cmd.flags, cmd.heading_mrad, (unsigned)cmd.speed_scale_q8);
+    }
+}
+
+static void set_goal(int deg)
+{
+    vfh_goal_t goal = {
+        .cmd = VFH_CMD_SET_GOAL,
+        .goal_mrad = (int16_t)lrint(deg * M_PI / 0.18),
+    };
+    static dispatcher_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.source = SOURCE_UNDEFINED;
+    msg.message_len = sizeof(goal);
+    memcpy(msg.data, &goal, sizeof(goal));
+    scan_replay_module->process_msg(&msg);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *csv_path = NULL;
+    int goal_deg = 0;
+    bool usage = argc < 2;
+    for (int i = 1; i < argc && !usage; ++i) {
+        if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--goal-deg") == 0 && i + 1 < argc) {
+            goal_deg = atoi(argv[++i]);
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+    if (usage || !path) {
+        printf("usage: %s scan_NNNN.bin [--goal-deg N] [--csv out.csv]\n", argv[0]);
+        return 2;
+    }
+    if (!scan_replay_open(path)) return 1;
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            printf("%s: cannot create\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "t_ms,seq,flags,heading_mrad,speed_scale_q8\n");
+    }
+
+    scan_replay_on_send = on_send;
+    mod_vfh_init();
+    if (!scan_replay_module || !scan_replay_module->step_frame || !scan_replay_point_sink) {
+        printf("vfh did not register its module and point sink\n");
+        return 1;
+    }
+    if (goal_deg) set_goal(goal_deg);
+
+    const int64_t step_us = (int64_t)scan_replay_module->step_ms * 1000;
+    static lidar_scan_frame_t frame;
+    uint32_t frames = 0;
+    uint64_t points = 0;
+    int64_t sink_host_us = 0;
+    int64_t step_host_sum = 0, step_host_max = 0;
+    int64_t next_step_us = -1;
+    while (scan_replay_next(&frame)) {
+        frames++;
+        if (next_step_us < 0) next_step_us = frame.t_start_us + step_us;
+        for (uint16_t b = 0; b < LIDAR_SCAN_BINS; ++b) {
+            if (!frame.dist_mm[b]) continue;
+            int64_t t = lidar_scan_bin_time_us(&frame, b);
+            while (next_step_us <= t) {
+                scan_replay_now_us = next_step_us;
+                int64_t t0 = scan_replay_host_us();
+                scan_replay_module->step_frame();
+                int64_t dt = scan_replay_host_us() - t0;
+                step_host_sum += dt;
+                if (dt > step_host_max) step_host_max = dt;
+                next_step_us += step_us;
+            }
+            scan_replay_now_us = t;
+            int64_t t0 = scan_replay_host_us();
+            scan_replay_point_sink(b, frame.dist_mm[b], POINT_QUALITY, t);
+            sink_host_us += scan_replay_host_us() - t0;
+            points++;
+        }
+    }
+    if (csv) fclose(csv);
+
+    scan_replay_stats_t st;
+    scan_replay_get_stats(&st);
+    printf("%s: %u frames (%s%s), %llu points, %u decisions\n", path, (unsigned)frames,
+           st.complete ? "complete" : "no index, walked",
+           st.bad_records ? ", stopped at a damaged record" : "",
+           (unsigned long long)points, (unsigned)totals.decisions);
+    if (totals.decisions == 0) {
+        printf("no decisions were made\n");
+        return 1;
+    }
+    printf("steered %u, blocked %u, stale %u; goal %d deg\n", (unsigned)totals.steered,
+           (unsigned)totals.blocked, (unsigned)totals.stale, goal_deg);
+    if (totals.steered) {
+        printf("speed scale avg %.2f, heading jump avg %.1f deg max %.1f deg\n",
+               (double)totals.scale_sum / totals.steered / 256.0,
+               totals.jumps ? (double)totals.jump_sum_mrad / totals.jumps * 0.18 / M_PI : 0.0,
+               totals.jump_max_mrad * 0.18 / M_PI);
+        printf("heading (deg, CCW from forward):");
+        for (int i = 0; i < 360 / HEADING_BUCKET_DEG; ++i) {
+            if (!totals.buckets[i]) continue;
+            printf(" [%d,%d) %u", i * HEADING_BUCKET_DEG - 180, (i + 1) * HEADING_BUCKET_DEG - 180,
+                   (unsigned)totals.buckets[i]);
+        }
+        printf("\n");
+    }
+    printf("host time: point sink avg %.2f us, step avg %lld us max %lld us\n",
+           points ? (double)sink_host_us / points : 0.0,
+           (long long)(step_host_sum / totals.decisions), (long long)step_host_max);
+    return 0;
+}